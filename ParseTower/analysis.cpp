@@ -0,0 +1,273 @@
+#include "analysis.h"
+#include <sstream>
+#include <iomanip>
+#include <algorithm>
+
+BalanceReport BalanceAnalyzer::analyze(const std::vector<IRInstruction>& instructions) {
+    return analyze(GameModel::fromIR(instructions));
+}
+
+BalanceReport BalanceAnalyzer::analyze(const GameModel& model) {
+    BalanceReport report;
+    report.pathLength = model.path.length();
+
+    // Path length inside each placement's range, shared by all enemy types
+    std::vector<double> covered;
+    double totalDps = 0.0;
+    for (const auto& p : model.placements) {
+        const auto& tower = model.towers[p.tower];
+        covered.push_back(model.path.coveredLength(p.x, p.y, tower.range));
+        totalDps += tower.dps;
+    }
+
+    for (const auto& e : model.enemies) {
+        std::vector<double> row;
+        double damage = 0.0;
+        for (size_t p = 0; p < model.placements.size(); p++) {
+            double seconds = covered[p] / e.speed;
+            row.push_back(seconds);
+            damage += seconds * model.towers[model.placements[p].tower].dps;
+        }
+        report.dwell.push_back(row);
+        report.damagePerEnemy.push_back(damage);
+    }
+
+    for (const auto& w : model.waves) {
+        WaveBalance wave;
+        wave.name = w.name;
+
+        double exposureSum = 0.0;
+        double firstSpawn = 0.0;
+        double lastExit = 0.0;
+        bool any = false;
+
+        for (const auto& s : w.spawns) {
+            const auto& enemy = model.enemies[s.enemy];
+
+            // Merge groups of the same type into one row
+            EnemyBalance* row = nullptr;
+            for (auto& existing : wave.enemies) {
+                if (existing.enemy == enemy.name) row = &existing;
+            }
+            if (!row) {
+                wave.enemies.push_back(EnemyBalance());
+                row = &wave.enemies.back();
+                row->enemy = enemy.name;
+                row->damagePerEnemy = report.damagePerEnemy[s.enemy];
+            }
+
+            row->count += s.count;
+            row->hpIncoming += static_cast<long long>(s.count) * enemy.hp;
+            row->margin += s.count * (report.damagePerEnemy[s.enemy] - enemy.hp);
+            wave.hpIncoming += static_cast<long long>(s.count) * enemy.hp;
+            exposureSum += s.count * report.damagePerEnemy[s.enemy];
+
+            double spawnEnd = s.start + static_cast<double>(s.count - 1) * s.interval;
+            double exit = spawnEnd + report.pathLength / enemy.speed;
+            if (!any || s.start < firstSpawn) firstSpawn = s.start;
+            lastExit = any ? std::max(lastExit, exit) : exit;
+            any = true;
+        }
+
+        wave.throughputCap = any ? totalDps * (lastExit - firstSpawn) : 0.0;
+        wave.deliverable = std::min(exposureSum, wave.throughputCap);
+        wave.margin = wave.deliverable - wave.hpIncoming;
+        report.waves.push_back(wave);
+    }
+
+    return report;
+}
+
+std::string BalanceAnalyzer::format(const BalanceReport& report) const {
+    std::ostringstream out;
+    out << std::fixed << std::setprecision(1);
+    out << "=== Balance Analysis ===\n";
+    out << "  Path length: " << report.pathLength << " tiles\n";
+
+    for (const auto& w : report.waves) {
+        double ratio = w.hpIncoming > 0 ? w.deliverable / w.hpIncoming : 0.0;
+        out << "  " << w.name << ": incoming " << w.hpIncoming << " hp, deliverable "
+            << w.deliverable << " (" << std::setprecision(2) << ratio << "x), margin "
+            << std::showpos << std::setprecision(1) << w.margin << std::noshowpos;
+        if (w.margin < 0) out << "  ** LIKELY BROKEN **";
+        out << "\n";
+
+        for (const auto& e : w.enemies) {
+            out << "    " << e.enemy << " x" << e.count << ": " << e.damagePerEnemy
+                << " dmg/enemy, margin " << std::showpos << e.margin << std::noshowpos;
+            if (e.margin < 0) out << "  (likely survives the full path)";
+            out << "\n";
+        }
+    }
+
+    return out.str();
+}
+
+CombatMatrix CombatAnalyzer::build(const GameModel& model) {
+    CombatMatrix matrix;
+
+    for (const auto& e : model.enemies) matrix.enemies.push_back(e.name);
+
+    for (const auto& t : model.towers) {
+        matrix.towers.push_back(t.name);
+        std::vector<int> shots;
+        std::vector<double> seconds;
+        for (const auto& e : model.enemies) {
+            // hp + damage - 1 overflows near INT_MAX; this never exceeds hp
+            int n = e.hp / t.damage + (e.hp % t.damage != 0);
+            shots.push_back(n);
+            seconds.push_back((n - 1) / t.fireRate);
+        }
+        matrix.shotsToKill.push_back(shots);
+        matrix.timeToKill.push_back(seconds);
+    }
+
+    for (const auto& p : model.placements) {
+        double covered = model.path.coveredLength(p.x, p.y, model.towers[p.tower].range);
+        std::vector<double> row;
+        for (const auto& e : model.enemies) row.push_back(covered / e.speed);
+        matrix.dwellTime.push_back(row);
+    }
+
+    return matrix;
+}
+
+std::vector<EconomyReport::Point> EconomyAnalyzer::curve(const GameModel& model, const GameModel::Wave& wave,
+                                                         long long total) {
+    std::vector<EconomyReport::Point> points;
+    for (const auto& s : wave.spawns) {
+        long long reward = model.enemies[s.enemy].reward;
+        for (int k = 0; k < s.count; k++) {
+            points.push_back({s.start + static_cast<long long>(k) * s.interval, reward});
+        }
+    }
+    std::sort(points.begin(), points.end(), [](const EconomyReport::Point& a, const EconomyReport::Point& b) {
+        return a.tick < b.tick;
+    });
+
+    size_t merged = 0;
+    for (size_t i = 0; i < points.size(); i++) {
+        total += points[i].gold;
+        if (merged > 0 && points[merged - 1].tick == points[i].tick) {
+            points[merged - 1].gold = total;
+        } else {
+            points[merged++] = {points[i].tick, total};
+        }
+    }
+    points.resize(merged);
+    return points;
+}
+
+bool EconomyAnalyzer::affordAt(const std::vector<EconomyReport::Point>& points, long long budget, long long cost,
+                               size_t& point) {
+    while (point < points.size() && budget + points[point].gold < cost) point++;
+    return point < points.size();
+}
+
+EconomyReport EconomyAnalyzer::build(const GameModel& model, int startingGold) {
+    EconomyReport report;
+    report.startingGold = startingGold;
+
+    long long total = 0;
+    for (const auto& w : model.waves) {
+        report.tickGold.push_back(curve(model, w, total));
+        if (!report.tickGold.back().empty()) total = report.tickGold.back().back().gold;
+        report.waveGold.push_back(total);
+    }
+
+    long long cost = 0;
+    size_t wave = 0;
+    size_t point = 0;
+    for (const auto& p : model.placements) {
+        EconomyReport::Affordability entry;
+        entry.towerType = model.towers[p.tower].name;
+        cost += model.towers[p.tower].cost;
+        entry.cumulativeCost = cost;
+
+        if (cost <= startingGold) {
+            entry.affordable = true;
+        } else {
+            // Costs only grow, so the cursor never moves backwards
+            while (wave < report.tickGold.size() && !affordAt(report.tickGold[wave], startingGold, cost, point)) {
+                wave++;
+                point = 0;
+            }
+            if (wave < report.tickGold.size()) {
+                entry.affordable = true;
+                entry.wave = static_cast<int>(wave);
+                entry.tick = report.tickGold[wave][point].tick;
+            }
+        }
+        report.placements.push_back(entry);
+    }
+
+    return report;
+}
+
+std::string EconomyAnalyzer::validate(const EconomyReport& report) const {
+    std::ostringstream out;
+    for (size_t i = 0; i < report.placements.size(); i++) {
+        const auto& p = report.placements[i];
+        if (p.affordable) continue;
+        out << "  Warning: placement #" << (i + 1) << " (" << p.towerType
+            << ") is never affordable: needs " << p.cumulativeCost << " gold, match pays "
+            << report.startingGold + (report.waveGold.empty() ? 0 : report.waveGold.back()) << "\n";
+    }
+    return out.str();
+}
+
+CapacityHints CapacityAnalyzer::build(const GameModel& model) {
+    CapacityHints hints;
+    for (const auto& e : model.enemies) hints.enemies.push_back(e.name);
+    hints.pool.assign(model.enemies.size(), 0);
+
+    // Spawns sort before exits at the same time, so an enemy leaving as
+    // another arrives still counts as overlapping
+    struct Event {
+        double time;
+        int exit;
+        int enemy;
+        bool operator<(const Event& other) const {
+            return time != other.time ? time < other.time : exit < other.exit;
+        }
+    };
+
+    const double pathLength = model.path.length();
+    std::vector<Event> events;
+    for (const auto& w : model.waves) {
+        events.clear();
+        for (const auto& s : w.spawns) {
+            double speed = model.enemies[s.enemy].speed;
+            for (int k = 0; k < s.count; k++) {
+                double time = s.start + static_cast<double>(k) * s.interval;
+                events.push_back({time, 0, s.enemy});
+                if (speed > 0) events.push_back({time + pathLength / speed, 1, s.enemy});
+            }
+        }
+        std::sort(events.begin(), events.end());
+
+        CapacityHints::Wave wave;
+        wave.name = w.name;
+        wave.perType.assign(model.enemies.size(), 0);
+        std::vector<int> alive(model.enemies.size(), 0);
+        int total = 0;
+        for (const auto& e : events) {
+            if (e.exit) {
+                alive[e.enemy]--;
+                total--;
+                continue;
+            }
+            wave.perType[e.enemy] = std::max(wave.perType[e.enemy], ++alive[e.enemy]);
+            if (++total > wave.peak) {
+                wave.peak = total;
+                wave.peakTime = e.time;
+            }
+        }
+
+        for (size_t t = 0; t < hints.pool.size(); t++) hints.pool[t] = std::max(hints.pool[t], wave.perType[t]);
+        hints.peak = std::max(hints.peak, wave.peak);
+        hints.waves.push_back(wave);
+    }
+
+    return hints;
+}
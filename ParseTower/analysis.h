@@ -0,0 +1,136 @@
+#ifndef ANALYSIS_H
+#define ANALYSIS_H
+
+#include "ir.h"
+#include "model.h"
+#include <vector>
+#include <string>
+
+// Closed-form balance numbers for one enemy type inside one wave
+struct EnemyBalance {
+    std::string enemy;
+    int count = 0;
+    long long hpIncoming = 0;
+    double damagePerEnemy = 0.0; // Damage one enemy takes walking the whole path
+    double margin = 0.0;         // count * (damagePerEnemy - hp)
+};
+
+struct WaveBalance {
+    std::string name;
+    long long hpIncoming = 0;
+    double deliverable = 0.0;    // min(per-enemy exposure sum, tower throughput)
+    double throughputCap = 0.0;  // Total DPS x seconds the wave is on the path
+    double margin = 0.0;         // deliverable - hpIncoming
+    std::vector<EnemyBalance> enemies;
+};
+
+struct BalanceReport {
+    double pathLength = 0.0;
+    // dwell[e][p]: seconds enemy type e spends inside placement p's range
+    std::vector<std::vector<double>> dwell;
+    std::vector<double> damagePerEnemy;
+    std::vector<WaveBalance> waves;
+};
+
+// Cheap "is this wave obviously broken" check that runs on every compile.
+//
+// Every number is closed form: dwell time is the path length covered by a
+// placement's range divided by enemy speed, and a wave's deliverable damage
+// is estimated as the smaller of what each enemy soaks up on its walk
+// (ignoring target contention) and the towers' combined DPS over the wave's
+// time on the path. Damage is continuous DPS x seconds, not whole shots, so
+// a tower firing on entry can deal up to one shot more per pass than this
+// counts: a negative margin flags a wave that is probably too hard, not one
+// proven unclearable. The simulator gives the exact answer.
+class BalanceAnalyzer {
+public:
+    BalanceReport analyze(const std::vector<IRInstruction>& instructions);
+    BalanceReport analyze(const GameModel& model);
+
+    std::string format(const BalanceReport& report) const;
+};
+
+// Dense lookup tables so clients read kill and dwell numbers instead of
+// recomputing them. Rows follow tower (or placement) definition order and
+// columns follow enemy definition order.
+struct CombatMatrix {
+    std::vector<std::string> towers;
+    std::vector<std::string> enemies;
+    std::vector<std::vector<int>> shotsToKill;     // ceil(hp / damage)
+    std::vector<std::vector<double>> timeToKill;   // (shots - 1) / fire_rate, first shot at t=0
+    std::vector<std::vector<double>> dwellTime;    // Per placement: seconds inside range
+};
+
+class CombatAnalyzer {
+public:
+    CombatMatrix build(const GameModel& model);
+};
+
+// Gold curve as prefix sums, assuming every spawned enemy is killed for its
+// reward at its spawn tick. Starting gold is not included. The curve is
+// sparse: one point per distinct spawn tick, so a server looks up budget +
+// the gold of the last point at or before its tick.
+struct EconomyReport {
+    struct Point {
+        long long tick;
+        long long gold;   // Cumulative over the match up to and including `tick`
+    };
+
+    int startingGold = 0;
+    std::vector<long long> waveGold;             // Cumulative at the end of each wave
+    std::vector<std::vector<Point>> tickGold;    // Per wave, in tick order
+
+    // First point where placements 0..i are all paid for, in order
+    struct Affordability {
+        std::string towerType;
+        long long cumulativeCost = 0;
+        int wave = -1;    // -1 with tick 0: affordable from the start
+        long long tick = 0;
+        bool affordable = false;
+    };
+    std::vector<Affordability> placements;
+};
+
+class EconomyAnalyzer {
+public:
+    EconomyReport build(const GameModel& model, int startingGold);
+
+    // Spawn ticks of one wave with the gold they pay, merged and summed
+    // from `total`, in 64-bit so far-off spawns cannot overflow
+    static std::vector<EconomyReport::Point> curve(const GameModel& model, const GameModel::Wave& wave,
+                                                   long long total);
+
+    // Advance a (wave, point) cursor to the first point where `budget`
+    // covers `cost`; false when the wave runs out first
+    static bool affordAt(const std::vector<EconomyReport::Point>& points, long long budget, long long cost,
+                         size_t& point);
+
+    // Warnings for placements the gold curve never pays for
+    std::string validate(const EconomyReport& report) const;
+};
+
+// Worst-case enemies alive at once, assuming nothing is killed: an enemy is
+// alive from its spawn until it walks off the end of the path. Servers size
+// their pools from these so they never grow mid-match. Per-type columns
+// follow enemy definition order.
+struct CapacityHints {
+    struct Wave {
+        std::string name;
+        int peak = 0;
+        double peakTime = 0.0;      // First time the wave's peak is reached
+        std::vector<int> perType;   // Each type's own peak within the wave
+    };
+
+    std::vector<std::string> enemies;
+    std::vector<int> pool;          // Per type: largest peak over all waves
+    int peak = 0;                   // Largest wave peak
+    std::vector<Wave> waves;
+};
+
+class CapacityAnalyzer {
+public:
+    // Sweep line over spawn and exit events, wave by wave
+    CapacityHints build(const GameModel& model);
+};
+
+#endif // ANALYSIS_H
@@ -6,9 +6,25 @@
 #include <memory>
 
 struct ASTNode {
+    // Byte range of the declaration in its source, set by the parser
+    size_t sourceBegin = 0;
+    size_t sourceEnd = 0;
+
+    // Named constants folded into the declaration, as "NAME=value;" - its
+    // meaning depends on them beyond its own text
+    std::string constants;
+
     virtual ~ASTNode() {}
 };
 
+// `const NAME = expression;`, folded by the parser
+struct ConstDecl : ASTNode {
+    std::string name;
+    bool isFloat = false;
+    int intValue = 0;
+    double floatValue = 0.0;
+};
+
 struct MapDecl : ASTNode {
     std::string name;
     int width, height;
@@ -33,11 +49,28 @@ struct SpawnStmt {
     int count;
     int start;
     int interval;
+
+    // Inside repeat blocks the values above are those of the first
+    // iteration; each enclosing block (outermost first) adds its step
+    // times its counter
+    int block = -1; // Innermost enclosing RepeatBlock, -1 at wave level
+    std::vector<int> countSteps, startSteps, intervalSteps;
+};
+
+// `repeat(variable, times) { ... }`: the body is the spawn range
+// [firstSpawn, endSpawn), nested blocks included
+struct RepeatBlock {
+    std::string variable;
+    int times;
+    int parent;         // Enclosing block, -1 at wave level
+    size_t firstSpawn;
+    size_t endSpawn;
 };
 
 struct WaveDecl : ASTNode {
     std::string name;
     std::vector<SpawnStmt> spawns;
+    std::vector<RepeatBlock> repeats; // In source order of their opening
 };
 
 struct PlaceStmt : ASTNode {
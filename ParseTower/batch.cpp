@@ -0,0 +1,158 @@
+#include "batch.h"
+#include "threadpool.h"
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <stdexcept>
+#include <unordered_map>
+#include <glob.h>
+
+namespace fs = std::filesystem;
+
+namespace {
+
+// Manifest and glob inputs can come from anywhere, so each is placed by
+// its path below the deepest directory they all share. Basenames alone
+// would send a/level.td and b/level.td to the same output.
+void relativeToCommonRoot(std::vector<BatchItem>& items) {
+    std::vector<fs::path> paths;
+    fs::path root;
+    for (const auto& item : items) {
+        paths.push_back(fs::absolute(item.input).lexically_normal());
+        fs::path parent = paths.back().parent_path();
+        if (paths.size() == 1) {
+            root = parent;
+            continue;
+        }
+        fs::path shared;
+        auto a = root.begin();
+        auto b = parent.begin();
+        for (; a != root.end() && b != parent.end() && *a == *b; ++a, ++b) shared /= *a;
+        root = shared;
+    }
+    for (size_t i = 0; i < items.size(); i++) {
+        items[i].relative = paths[i].lexically_relative(root).string();
+    }
+}
+
+}
+
+BatchCompiler::BatchCompiler(const CompileOptions& opts, size_t threads)
+    : options(opts), threadCount(threads == 0 ? 1 : threads) {}
+
+std::vector<BatchItem> BatchCompiler::collectInputs(const std::string& spec) {
+    std::vector<BatchItem> items;
+
+    auto add = [&items](const std::string& path, const std::string& relative) {
+        BatchItem item;
+        item.input = path;
+        item.relative = relative;
+        items.push_back(item);
+    };
+
+    if (!spec.empty() && spec[0] == '@') {
+        std::ifstream manifest(spec.substr(1));
+        if (!manifest.is_open()) {
+            throw std::runtime_error("could not open manifest " + spec.substr(1));
+        }
+        std::string line;
+        while (std::getline(manifest, line)) {
+            if (!line.empty() && line.back() == '\r') line.pop_back();
+            if (line.empty() || line[0] == '#') continue;
+            add(line, "");
+        }
+        relativeToCommonRoot(items);
+    } else if (fs::is_directory(spec)) {
+        std::vector<fs::path> found;
+        for (const auto& entry : fs::recursive_directory_iterator(spec)) {
+            if (entry.is_regular_file() && entry.path().extension() == ".td") {
+                found.push_back(entry.path());
+            }
+        }
+        std::sort(found.begin(), found.end());
+        for (const auto& p : found) {
+            add(p.string(), fs::relative(p, spec).string());
+        }
+    } else {
+        glob_t matches;
+        if (glob(spec.c_str(), 0, nullptr, &matches) == 0) {
+            for (size_t i = 0; i < matches.gl_pathc; i++) {
+                std::string path = matches.gl_pathv[i];
+                add(path, "");
+            }
+        }
+        globfree(&matches);
+        relativeToCommonRoot(items);
+    }
+
+    if (items.empty()) {
+        throw std::runtime_error("no input files match " + spec);
+    }
+    return items;
+}
+
+std::string BatchCompiler::outputPathFor(const BatchItem& item, const std::string& outputDir, bool readable) {
+    fs::path out = outputDir.empty() ? fs::path(item.input) : fs::path(outputDir) / item.relative;
+    out.replace_extension(readable ? ".txt" : ".json");
+    return out.string();
+}
+
+void BatchCompiler::run(std::vector<BatchItem>& items, const std::string& outputDir) {
+    // Two inputs writing one file would race; refuse before compiling any
+    std::unordered_map<std::string, const BatchItem*> writers;
+    for (auto& item : items) {
+        item.output = outputPathFor(item, outputDir, options.readable);
+        auto claimed = writers.emplace(fs::absolute(item.output).lexically_normal().string(), &item);
+        if (!claimed.second) {
+            throw std::runtime_error(claimed.first->second->input + " and " + item.input + " both write " +
+                                     item.output);
+        }
+    }
+
+    ThreadPool pool(threadCount);
+    std::atomic<size_t> next(0);
+
+    pool.parallelFor(pool.size(), [&](size_t, size_t, size_t) {
+        Compiler compiler(options);
+
+        for (size_t i = next++; i < items.size(); i = next++) {
+            BatchItem& item = items[i];
+            auto start = std::chrono::steady_clock::now();
+            try {
+                fs::path parent = fs::path(item.output).parent_path();
+                if (!parent.empty()) fs::create_directories(parent);
+                compiler.compileFile(item.input, item.output);
+                item.ok = true;
+            } catch (const std::exception& e) {
+                item.ok = false;
+                item.error = e.what();
+            }
+            item.millis = std::chrono::duration<double, std::milli>(
+                std::chrono::steady_clock::now() - start).count();
+        }
+    });
+}
+
+std::string BatchCompiler::summary(const std::vector<BatchItem>& items, double totalMillis) const {
+    std::ostringstream out;
+    size_t failed = 0;
+    out << std::fixed << std::setprecision(2);
+
+    for (const auto& item : items) {
+        if (item.ok) {
+            out << "  OK    " << item.input << " -> " << item.output
+                << " (" << item.millis << " ms)\n";
+        } else {
+            failed++;
+            out << "  FAIL  " << item.input << ": " << item.error << "\n";
+        }
+    }
+
+    out << "Batch: " << items.size() - failed << " succeeded, " << failed << " failed, "
+        << threadCount << " thread(s), " << totalMillis << " ms total\n";
+    return out.str();
+}
@@ -0,0 +1,43 @@
+#ifndef BATCH_H
+#define BATCH_H
+
+#include "driver.h"
+#include <string>
+#include <vector>
+
+struct BatchItem {
+    std::string input;
+    std::string relative;   // Path used to place the output under -out-dir
+    std::string output;
+    bool ok = false;
+    std::string error;
+    double millis = 0.0;
+};
+
+// Compiles many .td files in one process on a thread pool. Each worker
+// owns a Compiler and pulls the next file from a shared counter, so one
+// slow file does not stall a whole static partition.
+class BatchCompiler {
+public:
+    BatchCompiler(const CompileOptions& options, size_t threads);
+
+    // Expand a directory (recursive *.td), a glob pattern or an @manifest
+    // file (one path per line, # comments) into batch items. Outputs keep
+    // each input's path below the directory spec, or below the deepest
+    // directory all manifest or glob inputs share.
+    static std::vector<BatchItem> collectInputs(const std::string& spec);
+
+    // Output next to the input, or under outputDir when it is set
+    static std::string outputPathFor(const BatchItem& item, const std::string& outputDir, bool readable);
+
+    // Throws before compiling anything when two items share an output
+    void run(std::vector<BatchItem>& items, const std::string& outputDir);
+
+    std::string summary(const std::vector<BatchItem>& items, double totalMillis) const;
+
+private:
+    CompileOptions options;
+    size_t threadCount;
+};
+
+#endif // BATCH_H
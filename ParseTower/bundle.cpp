@@ -0,0 +1,409 @@
+#include "bundle.h"
+#include "json.h"
+#include <stdexcept>
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <chrono>
+#include <iomanip>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+namespace fs = std::filesystem;
+
+namespace {
+
+const char MAGIC[4] = {'P', 'T', 'B', 'N'};
+const uint32_t FORMAT_VERSION = 1;
+
+enum ChunkKind : uint8_t { CHUNK_SECTION = 0, CHUNK_WAVE = 1 };
+enum Codec : uint8_t { CODEC_RAW = 0, CODEC_LZ = 1 };
+
+struct Header {
+    char magic[4];
+    uint32_t format;
+    uint32_t chunkCount;
+    uint32_t indexSize;
+    uint64_t indexChecksum;
+};
+
+const size_t MIN_MATCH = 4;
+const size_t MAX_OFFSET = 65535;
+const int HASH_BITS = 14;
+
+uint64_t fnv1a(const char* data, size_t size) {
+    uint64_t hash = 14695981039346656037ULL;
+    for (size_t i = 0; i < size; i++) {
+        hash ^= static_cast<unsigned char>(data[i]);
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+template <typename T>
+void put(std::string& out, T value) {
+    out.append(reinterpret_cast<const char*>(&value), sizeof(T));
+}
+
+// Bounds-checked cursor over the mapped index
+struct Reader {
+    const char* data;
+    size_t size;
+    size_t pos = 0;
+
+    template <typename T>
+    bool get(T& value) {
+        if (size - pos < sizeof(T)) return false;
+        std::memcpy(&value, data + pos, sizeof(T));
+        pos += sizeof(T);
+        return true;
+    }
+};
+
+// Nibble overflow: 15 in the token, then 255-continued bytes
+void putLength(std::string& out, size_t length) {
+    while (length >= 255) {
+        out += static_cast<char>(255);
+        length -= 255;
+    }
+    out += static_cast<char>(length);
+}
+
+// A match length of 0 marks the closing literals-only sequence
+void putSequence(std::string& out, const char* literals, size_t literalLength, size_t offset, size_t matchLength) {
+    size_t extra = matchLength > 0 ? matchLength - MIN_MATCH : 0;
+    out += static_cast<char>((std::min<size_t>(literalLength, 15) << 4) | std::min<size_t>(extra, 15));
+    if (literalLength >= 15) putLength(out, literalLength - 15);
+    out.append(literals, literalLength);
+    if (matchLength == 0) return;
+
+    out += static_cast<char>(offset & 0xff);
+    out += static_cast<char>(offset >> 8);
+    if (extra >= 15) putLength(out, extra - 15);
+}
+
+uint32_t read32(const char* p) {
+    uint32_t value;
+    std::memcpy(&value, p, sizeof(value));
+    return value;
+}
+
+}
+
+std::string LZ::compress(const char* data, size_t size) {
+    std::string out;
+    out.reserve(size / 2 + 16);
+
+    // Last position each 4-byte prefix was seen at, plus one
+    std::vector<uint32_t> table(size_t(1) << HASH_BITS, 0);
+    size_t anchor = 0;
+    size_t i = 0;
+
+    while (i + MIN_MATCH <= size) {
+        uint32_t sequence = read32(data + i);
+        uint32_t slot = (sequence * 2654435761u) >> (32 - HASH_BITS);
+        size_t candidate = table[slot];
+        table[slot] = static_cast<uint32_t>(i + 1);
+
+        if (candidate == 0 || i - (candidate - 1) > MAX_OFFSET || read32(data + candidate - 1) != sequence) {
+            i++;
+            continue;
+        }
+
+        size_t from = candidate - 1;
+        size_t length = MIN_MATCH;
+        while (i + length < size && data[from + length] == data[i + length]) length++;
+
+        putSequence(out, data + anchor, i - anchor, i - from, length);
+        i += length;
+        anchor = i;
+    }
+
+    putSequence(out, data + anchor, size - anchor, 0, 0);
+    return out;
+}
+
+std::string LZ::decompress(const char* data, size_t size, size_t rawSize) {
+    auto corrupt = [] { throw std::runtime_error("corrupt LZ block"); };
+
+    std::string out;
+    out.reserve(rawSize);
+    size_t pos = 0;
+
+    auto length = [&](size_t n) {
+        if (n < 15) return n;
+        while (true) {
+            if (pos >= size) corrupt();
+            unsigned char b = static_cast<unsigned char>(data[pos++]);
+            n += b;
+            if (b != 255) return n;
+        }
+    };
+
+    while (true) {
+        if (pos >= size) corrupt();
+        unsigned char token = static_cast<unsigned char>(data[pos++]);
+
+        size_t literals = length(token >> 4);
+        if (size - pos < literals || rawSize - out.size() < literals) corrupt();
+        out.append(data + pos, literals);
+        pos += literals;
+
+        if (pos == size) {
+            if (out.size() != rawSize) corrupt();
+            break;
+        }
+
+        if (size - pos < 2) corrupt();
+        size_t offset = static_cast<unsigned char>(data[pos]) |
+                        (static_cast<size_t>(static_cast<unsigned char>(data[pos + 1])) << 8);
+        pos += 2;
+        size_t match = length(token & 15) + MIN_MATCH;
+        if (offset == 0 || offset > out.size() || rawSize - out.size() < match) corrupt();
+
+        // Byte by byte: a match may overlap the bytes it produces
+        size_t from = out.size() - offset;
+        for (size_t k = 0; k < match; k++) out += out[from + k];
+    }
+
+    return out;
+}
+
+std::string BundleWriter::write(const std::vector<IRInstruction>& instructions, CodeGenerator& codeGen) {
+    struct Piece {
+        uint8_t kind;
+        uint16_t section;
+        std::string name;
+        std::string text;
+    };
+
+    std::vector<Piece> pieces;
+    for (int s = 0; s < SECTION_COUNT; s++) {
+        if (s == SECTION_WAVES) continue;
+        std::string text = codeGen.generateSection(instructions, static_cast<JSONSection>(s));
+        if (!text.empty()) pieces.push_back({CHUNK_SECTION, static_cast<uint16_t>(s), "", std::move(text)});
+    }
+
+    std::vector<std::string> waves = codeGen.generateItems(instructions, SECTION_WAVES);
+    size_t w = 0;
+    for (const auto& instr : instructions) {
+        if (instr.opcode != IROpcode::DEFINE_WAVE) continue;
+        pieces.push_back({CHUNK_WAVE, SECTION_WAVES, instr.operands[0], std::move(waves[w++])});
+    }
+
+    std::string index;
+    std::string payload;
+    for (const auto& piece : pieces) {
+        if (piece.text.size() > UINT32_MAX) throw std::runtime_error("bundle chunk over 4 GB");
+
+        std::string packed = compress ? LZ::compress(piece.text.data(), piece.text.size()) : "";
+        uint8_t codec = compress && packed.size() < piece.text.size() ? CODEC_LZ : CODEC_RAW;
+        const std::string& stored = codec == CODEC_LZ ? packed : piece.text;
+
+        put<uint8_t>(index, piece.kind);
+        put<uint8_t>(index, codec);
+        put<uint16_t>(index, piece.section);
+        put<uint32_t>(index, static_cast<uint32_t>(piece.name.size()));
+        index += piece.name;
+        put<uint64_t>(index, payload.size());
+        put<uint32_t>(index, static_cast<uint32_t>(stored.size()));
+        put<uint32_t>(index, static_cast<uint32_t>(piece.text.size()));
+        put<uint64_t>(index, fnv1a(stored.data(), stored.size()));
+        payload += stored;
+    }
+
+    Header header;
+    std::memcpy(header.magic, MAGIC, 4);
+    header.format = FORMAT_VERSION;
+    header.chunkCount = static_cast<uint32_t>(pieces.size());
+    header.indexSize = static_cast<uint32_t>(index.size());
+    header.indexChecksum = fnv1a(index.data(), index.size());
+
+    std::string out(reinterpret_cast<const char*>(&header), sizeof(header));
+    out.reserve(out.size() + index.size() + payload.size());
+    out += index;
+    out += payload;
+    return out;
+}
+
+BundleReader::BundleReader(const std::string& path) : sections(SECTION_COUNT, -1) {
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) throw std::runtime_error("could not open " + path);
+
+    struct stat st;
+    if (fstat(fd, &st) == 0 && st.st_size >= static_cast<off_t>(sizeof(Header))) {
+        size = static_cast<size_t>(st.st_size);
+        void* mapped = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (mapped != MAP_FAILED) data = static_cast<const char*>(mapped);
+    }
+    close(fd);
+    if (!data) throw std::runtime_error(path + " is not a config bundle");
+
+    try {
+        Header header;
+        std::memcpy(&header, data, sizeof(header));
+        if (std::memcmp(header.magic, MAGIC, 4) != 0 || header.format != FORMAT_VERSION) {
+            throw std::runtime_error(path + " is not a config bundle");
+        }
+        if (header.indexSize > size - sizeof(header) ||
+            fnv1a(data + sizeof(header), header.indexSize) != header.indexChecksum) {
+            throw std::runtime_error("corrupt bundle index in " + path);
+        }
+
+        dataStart = sizeof(header) + header.indexSize;
+        Reader in{data + sizeof(header), header.indexSize};
+        chunks.resize(header.chunkCount);
+        for (size_t c = 0; c < chunks.size(); c++) {
+            Chunk& chunk = chunks[c];
+            uint32_t nameLength;
+            bool ok = in.get(chunk.kind) && in.get(chunk.codec) && in.get(chunk.section) && in.get(nameLength) &&
+                      in.size - in.pos >= nameLength;
+            if (ok) {
+                chunk.name.assign(in.data + in.pos, nameLength);
+                in.pos += nameLength;
+                ok = in.get(chunk.offset) && in.get(chunk.storedSize) && in.get(chunk.rawSize) && in.get(chunk.checksum);
+            }
+            ok = ok && chunk.kind <= CHUNK_WAVE && chunk.codec <= CODEC_LZ && chunk.section < SECTION_COUNT &&
+                 chunk.offset <= size - dataStart && chunk.storedSize <= size - dataStart - chunk.offset;
+            if (!ok) throw std::runtime_error("corrupt bundle index in " + path);
+
+            if (chunk.kind == CHUNK_WAVE) waves.push_back(c);
+            else sections[chunk.section] = static_cast<long>(c);
+        }
+        if (in.pos != in.size) throw std::runtime_error("corrupt bundle index in " + path);
+    } catch (...) {
+        munmap(const_cast<char*>(data), size);
+        throw;
+    }
+}
+
+BundleReader::~BundleReader() {
+    munmap(const_cast<char*>(data), size);
+}
+
+const std::string& BundleReader::decode(Chunk& chunk) {
+    if (chunk.decoded) return chunk.text;
+
+    const char* stored = data + dataStart + chunk.offset;
+    if (fnv1a(stored, chunk.storedSize) != chunk.checksum) {
+        throw std::runtime_error("corrupt bundle chunk" + (chunk.name.empty() ? "" : " " + chunk.name));
+    }
+    if (chunk.codec == CODEC_LZ) {
+        chunk.text = LZ::decompress(stored, chunk.storedSize, chunk.rawSize);
+    } else {
+        chunk.text.assign(stored, chunk.storedSize);
+    }
+
+    chunk.decoded = true;
+    decodedChunks++;
+    decodedBytes += chunk.rawSize;
+    return chunk.text;
+}
+
+const std::string& BundleReader::section(JSONSection section) {
+    static const std::string empty;
+
+    if (section == SECTION_WAVES) {
+        // Same framing as CodeGenerator's waves section
+        if (!wavesAssembled && !waves.empty()) {
+            wavesSection = "    \"waves\": [\n";
+            for (size_t i = 0; i < waves.size(); i++) {
+                if (i > 0) wavesSection += ",\n";
+                wavesSection += wave(i);
+            }
+            wavesSection += "    ]";
+        }
+        wavesAssembled = true;
+        return wavesSection;
+    }
+
+    if (section < 0 || section >= SECTION_COUNT || sections[section] < 0) return empty;
+    return decode(chunks[sections[section]]);
+}
+
+const std::string& BundleReader::waveName(size_t index) const {
+    if (index >= waves.size()) throw std::runtime_error("wave index out of range");
+    return chunks[waves[index]].name;
+}
+
+const std::string& BundleReader::wave(size_t index) {
+    if (index >= waves.size()) throw std::runtime_error("wave index out of range");
+    return decode(chunks[waves[index]]);
+}
+
+std::string BundleReader::toJSON() {
+    std::vector<std::string> parts;
+    for (int s = 0; s < SECTION_COUNT; s++) parts.push_back(section(static_cast<JSONSection>(s)));
+    CodeGenerator codeGen;
+    return codeGen.assembleJSON(parts);
+}
+
+bool BundleReader::verify(const std::vector<IRInstruction>& instructions, CodeGenerator& codeGen, std::ostream& log) {
+    std::string json = codeGen.generateJSON(instructions);
+    BundleWriter writer;
+    std::string bundle = writer.write(instructions, codeGen);
+
+    std::string path = (fs::temp_directory_path() / ("parsetower-verify-" + std::to_string(getpid()) + ".ptb")).string();
+    {
+        std::ofstream file(path, std::ios::binary);
+        if (!file.is_open()) throw std::runtime_error("could not write " + path);
+        file << bundle;
+    }
+    struct Cleanup {
+        std::string path;
+        ~Cleanup() {
+            std::error_code ec;
+            fs::remove(path, ec);
+        }
+    } cleanup{path};
+
+    // Level start: map, roster, placements and the first wave
+    auto start = std::chrono::steady_clock::now();
+    BundleReader reader(path);
+    for (JSONSection s : {SECTION_MAP, SECTION_ENEMIES, SECTION_TOWERS, SECTION_PLACEMENTS}) {
+        const std::string& text = reader.section(s);
+        if (!text.empty()) JsonValue::parse("{" + text + "}");
+    }
+    if (reader.waveCount() > 0) JsonValue::parse(reader.wave(0));
+    auto loaded = std::chrono::steady_clock::now();
+    uint64_t loadBytes = reader.bytesDecoded();
+
+    // Today's level start parses the whole output
+    JsonValue::parse(json);
+    auto parsed = std::chrono::steady_clock::now();
+
+    for (int s = 0; s < SECTION_COUNT; s++) {
+        JSONSection section = static_cast<JSONSection>(s);
+        if (reader.section(section) != codeGen.generateSection(instructions, section)) {
+            log << "  MISMATCH in section " << s << "\n";
+            return false;
+        }
+    }
+    std::vector<std::string> waves = codeGen.generateItems(instructions, SECTION_WAVES);
+    if (waves.size() != reader.waveCount()) {
+        log << "  MISMATCH in wave count\n";
+        return false;
+    }
+    for (size_t i = 0; i < waves.size(); i++) {
+        if (reader.wave(i) != waves[i]) {
+            log << "  MISMATCH in wave " << reader.waveName(i) << "\n";
+            return false;
+        }
+    }
+    if (reader.toJSON() != json) {
+        log << "  MISMATCH in reassembled JSON\n";
+        return false;
+    }
+
+    auto millis = [](std::chrono::steady_clock::duration d) {
+        return std::chrono::duration<double, std::milli>(d).count();
+    };
+    log << "  Bundle matched (" << json.size() << " JSON bytes -> " << bundle.size() << " bundle bytes, "
+        << reader.waveCount() << " wave chunks).\n";
+    log << "  Level start decoded " << loadBytes << " bytes in " << std::fixed << std::setprecision(2)
+        << millis(loaded - start) << " ms; parsing the full JSON took " << millis(parsed - loaded) << " ms.\n";
+    return true;
+}
@@ -0,0 +1,98 @@
+#ifndef BUNDLE_H
+#define BUNDLE_H
+
+#include "ir.h"
+#include "codegen.h"
+#include <string>
+#include <vector>
+#include <ostream>
+#include <cstdint>
+
+// Byte-oriented LZ77 codec for bundle chunks. A block is a run of
+// sequences: a token (literal length in the high nibble, match length - 4
+// in the low), 255-continued length bytes, the literals, then a 16-bit
+// back-reference offset. The last sequence carries literals only.
+namespace LZ {
+    std::string compress(const char* data, size_t size);
+
+    // Throws std::runtime_error unless the block decodes to exactly rawSize bytes
+    std::string decompress(const char* data, size_t size, size_t rawSize);
+}
+
+// Sectioned config bundle (.ptb). An index header is followed by one chunk
+// per non-empty JSON section and one chunk per wave; each chunk is stored
+// raw or LZ-compressed, whichever is smaller. A section chunk holds the
+// `"name": value` member generateJSON writes for it (wrap it in braces to
+// parse it alone) and a wave chunk holds one wave object. The waves
+// section itself is not stored; readers rebuild it from the wave chunks.
+class BundleWriter {
+public:
+    explicit BundleWriter(bool compress = true) : compress(compress) {}
+
+    std::string write(const std::vector<IRInstruction>& instructions, CodeGenerator& codeGen);
+
+private:
+    bool compress;
+};
+
+// Maps a bundle read-only and checks its index on open. Chunks are
+// checksummed and decoded the first time they are asked for and kept until
+// the reader is destroyed, so starting a level costs the index plus the
+// chunks it touches. Errors are thrown as std::runtime_error. Not safe to
+// share between threads.
+class BundleReader {
+public:
+    explicit BundleReader(const std::string& path);
+    ~BundleReader();
+
+    BundleReader(const BundleReader&) = delete;
+    BundleReader& operator=(const BundleReader&) = delete;
+
+    // "" when the config has no such section; SECTION_WAVES is assembled
+    // from every wave chunk
+    const std::string& section(JSONSection section);
+
+    size_t waveCount() const { return waves.size(); }
+    const std::string& waveName(size_t index) const;
+    const std::string& wave(size_t index);
+
+    // Decode everything and rebuild generateJSON's output byte for byte
+    std::string toJSON();
+
+    size_t chunksDecoded() const { return decodedChunks; }
+    uint64_t bytesDecoded() const { return decodedBytes; }
+
+    // Round-trip `instructions` through a bundle file and compare level
+    // load against parsing the whole JSON output
+    static bool verify(const std::vector<IRInstruction>& instructions, CodeGenerator& codeGen,
+                       std::ostream& log);
+
+private:
+    struct Chunk {
+        uint8_t kind = 0;
+        uint8_t codec = 0;
+        uint16_t section = 0;
+        std::string name;
+        uint64_t offset = 0;
+        uint32_t storedSize = 0;
+        uint32_t rawSize = 0;
+        uint64_t checksum = 0;
+        bool decoded = false;
+        std::string text;
+    };
+
+    const char* data = nullptr;
+    size_t size = 0;
+    size_t dataStart = 0;
+    std::vector<Chunk> chunks;
+    std::vector<size_t> waves;               // Chunk indices in wave order
+    std::vector<long> sections;              // Chunk index per JSONSection, -1 when absent
+    std::string wavesSection;
+    bool wavesAssembled = false;
+    size_t decodedChunks = 0;
+    uint64_t decodedBytes = 0;
+
+    const std::string& decode(Chunk& chunk);
+};
+
+#endif // BUNDLE_H
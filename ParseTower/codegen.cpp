@@ -1,20 +1,34 @@
 #include "codegen.h"
+#include "analysis.h"
+#include "threadpool.h"
 #include <sstream>
 #include <iomanip>
+#include <chrono>
+
+CodeGenerator::CodeGenerator() = default;
+CodeGenerator::~CodeGenerator() = default;
+
+void CodeGenerator::setThreads(size_t threads) {
+    if (threads > 1) pool.reset(new ThreadPool(threads));
+    else pool.reset();
+}
 
 std::string CodeGenerator::escapeJSON(const std::string& str) {
-    std::ostringstream escaped;
+    // Called for every name emitted: one reserved string is a single
+    // allocation, where an ostringstream per call pays stream setup too
+    std::string escaped;
+    escaped.reserve(str.size());
     for (char c : str) {
         switch (c) {
-            case '"': escaped << "\\\""; break;
-            case '\\': escaped << "\\\\"; break;
-            case '\n': escaped << "\\n"; break;
-            case '\r': escaped << "\\r"; break;
-            case '\t': escaped << "\\t"; break;
-            default: escaped << c; break;
+            case '"': escaped += "\\\""; break;
+            case '\\': escaped += "\\\\"; break;
+            case '\n': escaped += "\\n"; break;
+            case '\r': escaped += "\\r"; break;
+            case '\t': escaped += "\\t"; break;
+            default: escaped += c; break;
         }
     }
-    return escaped.str();
+    return escaped;
 }
 
 std::string CodeGenerator::generateMapJSON(const IRInstruction& instr) {
@@ -33,20 +47,11 @@ std::string CodeGenerator::generateMapJSON(const IRInstruction& instr) {
         std::string pathStr = std::get<std::string>(instr.metadata.at("path"));
         json << "      \"path\": [\n";
         
-        std::istringstream pathStream(pathStr);
-        std::string coord;
         bool first = true;
-        
-        while (std::getline(pathStream, coord, ';')) {
+        for (const auto& point : PathGeometry::parse(pathStr)) {
             if (!first) json << ",\n";
             first = false;
-            
-            size_t commaPos = coord.find(',');
-            if (commaPos != std::string::npos) {
-                int x = std::stoi(coord.substr(0, commaPos));
-                int y = std::stoi(coord.substr(commaPos + 1));
-                json << "        {\"x\": " << x << ", \"y\": " << y << "}";
-            }
+            json << "        {\"x\": " << point.first << ", \"y\": " << point.second << "}";
         }
         
         json << "\n      ]\n";
@@ -109,6 +114,14 @@ std::string CodeGenerator::generateWaveJSON(const std::vector<IRInstruction>& in
     std::ostringstream json;
 
     const IRInstruction& waveInstr = instructions[index];
+
+    // A folded wave has no spawns of its own and points at its canonical wave
+    if (waveInstr.metadata.count("alias")) {
+        json << "      {\"name\": \"" << escapeJSON(waveInstr.operands[0]) << "\", \"alias\": \""
+             << escapeJSON(std::get<std::string>(waveInstr.metadata.at("alias"))) << "\"}";
+        return json.str();
+    }
+
     json << "      {\n";
     json << "        \"name\": \"" << escapeJSON(waveInstr.operands[0]) << "\",\n";
     json << "        \"spawns\": [\n";
@@ -116,12 +129,30 @@ std::string CodeGenerator::generateWaveJSON(const std::vector<IRInstruction>& in
     bool firstSpawn = true;
     size_t i = index + 1;
 
-    // Collect all SPAWN_ENEMY instructions for this wave
+    auto writeSpawn = [&](const IRInstruction& spawnInstr, int count, int start, int interval) {
+        if (!firstSpawn) json << ",\n";
+        firstSpawn = false;
+
+        json << "          {\n";
+        json << "            \"enemyType\": \"" << escapeJSON(spawnInstr.operands[1]) << "\",\n";
+        json << "            \"count\": " << count << ",\n";
+        json << "            \"start\": " << start << ",\n";
+        json << "            \"interval\": " << interval << "\n";
+        json << "          }";
+    };
+
+    // Collect all SPAWN_ENEMY instructions for this wave; repeat blocks are
+    // expanded here, as they are written
     while (i < instructions.size() && 
-            instructions[i].opcode == IROpcode::SPAWN_ENEMY &&
+            (instructions[i].opcode == IROpcode::SPAWN_ENEMY ||
+             instructions[i].opcode == IROpcode::REPEAT_BEGIN) &&
             instructions[i].operands[0] == waveInstr.operands[0]
         ) {
         const IRInstruction& spawnInstr = instructions[i];
+        if (spawnInstr.opcode == IROpcode::REPEAT_BEGIN) {
+            i = IRGenerator::expandRepeat(instructions, i, writeSpawn) + 1;
+            continue;
+        }
 
         if (!firstSpawn) json << ",\n";
         firstSpawn = false;
@@ -164,103 +195,343 @@ std::string CodeGenerator::generatePlacementJSON(const IRInstruction& instr) {
     return json.str();
 }
 
-std::string CodeGenerator::generateJSON(const std::vector<IRInstruction>& instructions) {
+std::string CodeGenerator::generateCombatMatrixJSON(const std::vector<IRInstruction>& instructions) {
+    CombatAnalyzer analyzer;
+    CombatMatrix matrix = analyzer.build(GameModel::fromIR(instructions));
+
     std::ostringstream json;
+    json << std::fixed << std::setprecision(2);
+
+    auto names = [&](const std::vector<std::string>& list) {
+        json << "[";
+        for (size_t i = 0; i < list.size(); i++) {
+            if (i > 0) json << ", ";
+            json << "\"" << escapeJSON(list[i]) << "\"";
+        }
+        json << "]";
+    };
+
+    // One row per line keeps the section compact but diffable
+    auto rows = [&](const auto& table) {
+        json << "[";
+        for (size_t r = 0; r < table.size(); r++) {
+            json << (r > 0 ? ",\n        [" : "\n        [");
+            for (size_t c = 0; c < table[r].size(); c++) {
+                if (c > 0) json << ", ";
+                json << table[r][c];
+            }
+            json << "]";
+        }
+        json << (table.empty() ? "]" : "\n      ]");
+    };
+
+    json << "    \"combatMatrix\": {\n";
+    json << "      \"towers\": ";
+    names(matrix.towers);
+    json << ",\n      \"enemies\": ";
+    names(matrix.enemies);
+    json << ",\n      \"shotsToKill\": ";
+    rows(matrix.shotsToKill);
+    json << ",\n      \"timeToKill\": ";
+    rows(matrix.timeToKill);
+    json << ",\n      \"dwellTime\": ";
+    rows(matrix.dwellTime);
+    json << "\n    }";
+    return json.str();
+}
+
+std::string CodeGenerator::generateEconomyJSON(const std::vector<IRInstruction>& instructions) {
+    EconomyReport built;
+    if (!economyReport) built = EconomyAnalyzer().build(GameModel::fromIR(instructions), startingGold);
+    const EconomyReport& economy = economyReport ? *economyReport : built;
+
+    std::ostringstream json;
+    json << "    \"economy\": {\n";
+    json << "      \"startingGold\": " << economy.startingGold << ",\n";
+
+    json << "      \"waveGold\": [";
+    for (size_t i = 0; i < economy.waveGold.size(); i++) {
+        if (i > 0) json << ", ";
+        json << economy.waveGold[i];
+    }
+    json << "],\n";
+
+    json << "      \"tickGold\": [";
+    for (size_t w = 0; w < economy.tickGold.size(); w++) {
+        json << (w > 0 ? ",\n        [" : "\n        [");
+        for (size_t t = 0; t < economy.tickGold[w].size(); t++) {
+            if (t > 0) json << ", ";
+            json << "[" << economy.tickGold[w][t].tick << ", " << economy.tickGold[w][t].gold << "]";
+        }
+        json << "]";
+    }
+    json << (economy.tickGold.empty() ? "]" : "\n      ]") << ",\n";
+
+    json << "      \"placementAffordable\": [";
+    for (size_t i = 0; i < economy.placements.size(); i++) {
+        const auto& p = economy.placements[i];
+        json << (i > 0 ? ",\n        " : "\n        ");
+        json << "{\"towerType\": \"" << escapeJSON(p.towerType) << "\", "
+             << "\"cumulativeCost\": " << p.cumulativeCost << ", ";
+        if (p.affordable) {
+            json << "\"wave\": " << p.wave << ", \"tick\": " << p.tick << "}";
+        } else {
+            json << "\"wave\": null, \"tick\": null}";
+        }
+    }
+    json << (economy.placements.empty() ? "]" : "\n      ]") << "\n";
+
+    json << "    }";
+    return json.str();
+}
+
+std::string CodeGenerator::generateCapacityHintsJSON(const std::vector<IRInstruction>& instructions) {
+    CapacityAnalyzer analyzer;
+    CapacityHints hints = analyzer.build(GameModel::fromIR(instructions));
+
+    std::ostringstream json;
+    json << std::fixed << std::setprecision(2);
+
+    auto counts = [&](const std::vector<int>& list) {
+        json << "[";
+        for (size_t i = 0; i < list.size(); i++) {
+            if (i > 0) json << ", ";
+            json << list[i];
+        }
+        json << "]";
+    };
+
+    json << "    \"capacityHints\": {\n";
+    json << "      \"enemies\": [";
+    for (size_t i = 0; i < hints.enemies.size(); i++) {
+        if (i > 0) json << ", ";
+        json << "\"" << escapeJSON(hints.enemies[i]) << "\"";
+    }
+    json << "],\n";
+    json << "      \"peakAlive\": " << hints.peak << ",\n";
+    json << "      \"pool\": ";
+    counts(hints.pool);
+    json << ",\n";
+
+    json << "      \"waves\": [";
+    for (size_t w = 0; w < hints.waves.size(); w++) {
+        const auto& wave = hints.waves[w];
+        json << (w > 0 ? ",\n        " : "\n        ");
+        json << "{\"name\": \"" << escapeJSON(wave.name) << "\", \"peakAlive\": " << wave.peak
+             << ", \"peakTime\": " << wave.peakTime << ", \"perType\": ";
+        counts(wave.perType);
+        json << "}";
+    }
+    json << (hints.waves.empty() ? "]" : "\n      ]") << "\n";
+
+    json << "    }";
+    return json.str();
+}
+
+std::string CodeGenerator::generateAliasesJSON(const std::vector<IRInstruction>& instructions) {
+    std::string groups[3];  // enemies, towers, waves
+    for (const auto& instr : instructions) {
+        std::string alias;
+        int group = 0;
+        if (instr.opcode == IROpcode::DEFINE_ALIAS) {
+            alias = instr.operands[1];
+            group = std::get<std::string>(instr.metadata.at("kind")) == "enemy" ? 0 : 1;
+        } else if (instr.opcode == IROpcode::DEFINE_WAVE && instr.metadata.count("alias")) {
+            alias = std::get<std::string>(instr.metadata.at("alias"));
+            group = 2;
+        } else {
+            continue;
+        }
+        if (!groups[group].empty()) groups[group] += ", ";
+        groups[group] += "\"" + escapeJSON(instr.operands[0]) + "\": \"" + escapeJSON(alias) + "\"";
+    }
+
+    static const char* const names[3] = {"enemies", "towers", "waves"};
+    std::ostringstream json;
+    for (int g = 0; g < 3; g++) {
+        if (groups[g].empty()) continue;
+        json << (json.tellp() > 0 ? ",\n" : "    \"aliases\": {\n");
+        json << "      \"" << names[g] << "\": {" << groups[g] << "}";
+    }
+    if (json.tellp() > 0) json << "\n    }";
+    return json.str();
+}
+
+void CodeGenerator::renderItems(size_t count, const std::function<void(size_t, std::string&)>& item,
+                                std::vector<std::string>& chunks) {
+    if (!pool || count < parallelMinimum) {
+        std::string buffer;
+        for (size_t i = 0; i < count; i++) item(i, buffer);
+        chunks.push_back(std::move(buffer));
+        return;
+    }
+
+    std::vector<std::string> buffers(pool->size());
+    pool->parallelFor(count, [&](size_t begin, size_t end, size_t chunk) {
+        for (size_t i = begin; i < end; i++) item(i, buffers[chunk]);
+    });
+    for (auto& buffer : buffers) {
+        if (!buffer.empty()) chunks.push_back(std::move(buffer));
+    }
+}
+
+void CodeGenerator::renderSection(const std::vector<IRInstruction>& instructions, JSONSection section,
+                                  std::vector<std::string>& chunks) {
+    std::ostringstream json;
+    std::vector<size_t> indices;
     
-    json << "{\n";
-    json << "  \"gameConfig\": {\n";
-    
-    bool hasMap = false;
-    std::vector<size_t> enemyIndices;
-    std::vector<size_t> towerIndices;
-    std::vector<size_t> waveIndices;
-    std::vector<size_t> placementIndices;
+    IROpcode wanted = IROpcode::NOP;
+    switch (section) {
+        case SECTION_MAP: wanted = IROpcode::DEFINE_MAP; break;
+        case SECTION_ENEMIES: wanted = IROpcode::DEFINE_ENEMY; break;
+        case SECTION_TOWERS: wanted = IROpcode::DEFINE_TOWER; break;
+        case SECTION_WAVES: wanted = IROpcode::DEFINE_WAVE; break;
+        case SECTION_PLACEMENTS: wanted = IROpcode::PLACE_TOWER; break;
+        default: break;
+    }
     
     // Categorize instructions
+    bool hasEnemies = false, hasTowers = false, hasWaves = false, hasPlacements = false;
     for (size_t i = 0; i < instructions.size(); i++) {
-        switch (instructions[i].opcode) {
-            case IROpcode::DEFINE_MAP:
-                if (!hasMap) {
-                    json << generateMapJSON(instructions[i]);
-                    hasMap = true;
-                }
-                break;
-            case IROpcode::DEFINE_ENEMY:
-                enemyIndices.push_back(i);
-                break;
-            case IROpcode::DEFINE_TOWER:
-                towerIndices.push_back(i);
-                break;
-            case IROpcode::DEFINE_WAVE:
-                waveIndices.push_back(i);
-                break;
-            case IROpcode::PLACE_TOWER:
-                placementIndices.push_back(i);
-                break;
-            default:
-                break;
-        }
+        IROpcode op = instructions[i].opcode;
+        if (op == wanted) indices.push_back(i);
+        hasEnemies = hasEnemies || op == IROpcode::DEFINE_ENEMY;
+        hasTowers = hasTowers || op == IROpcode::DEFINE_TOWER;
+        hasWaves = hasWaves || op == IROpcode::DEFINE_WAVE;
+        hasPlacements = hasPlacements || op == IROpcode::PLACE_TOWER;
     }
     
-    // Generate enemies array
-    if (!enemyIndices.empty()) {
-        if (hasMap) json << ",\n";
-        json << "    \"enemies\": [\n";
-        
-        for (size_t i = 0; i < enemyIndices.size(); i++) {
-            json << generateEnemyJSON(instructions[enemyIndices[i]]);
-            if (i + 1 < enemyIndices.size()) json << ",";
-            json << "\n";
-        }
-        
-        json << "    ]";
+    switch (section) {
+        case SECTION_MAP:
+            // Only the first map is emitted
+            if (!indices.empty()) json << generateMapJSON(instructions[indices[0]]);
+            break;
+            
+        case SECTION_ENEMIES:
+            if (indices.empty()) break;
+            chunks.push_back("    \"enemies\": [\n");
+            renderItems(indices.size(), [&](size_t i, std::string& out) {
+                out += generateEnemyJSON(instructions[indices[i]]);
+                out += i + 1 < indices.size() ? ",\n" : "\n";
+            }, chunks);
+            json << "    ]";
+            break;
+            
+        case SECTION_TOWERS:
+            if (indices.empty()) break;
+            chunks.push_back("    \"towers\": [\n");
+            renderItems(indices.size(), [&](size_t i, std::string& out) {
+                out += generateTowerJSON(instructions[indices[i]]);
+                out += i + 1 < indices.size() ? ",\n" : "\n";
+            }, chunks);
+            json << "    ]";
+            break;
+            
+        case SECTION_WAVES:
+            // Each wave's spawns follow its DEFINE_WAVE, so waves split
+            // cleanly at their definitions
+            if (indices.empty()) break;
+            chunks.push_back("    \"waves\": [\n");
+            renderItems(indices.size(), [&](size_t i, std::string& out) {
+                if (i > 0) out += ",\n";
+                size_t index = indices[i];
+                out += generateWaveJSON(instructions, index);
+            }, chunks);
+            json << "    ]";
+            break;
+            
+        case SECTION_PLACEMENTS:
+            if (indices.empty()) break;
+            chunks.push_back("    \"initialPlacements\": [\n");
+            renderItems(indices.size(), [&](size_t i, std::string& out) {
+                out += generatePlacementJSON(instructions[indices[i]]);
+                out += i + 1 < indices.size() ? ",\n" : "\n";
+            }, chunks);
+            json << "    ]";
+            break;
+            
+        case SECTION_COMBAT_MATRIX:
+            // Tower x enemy lookup tables
+            if (hasEnemies && hasTowers) json << generateCombatMatrixJSON(instructions);
+            break;
+            
+        case SECTION_ECONOMY:
+            // Gold prefix sums and placement affordability
+            if (hasWaves || hasPlacements) json << generateEconomyJSON(instructions);
+            break;
+            
+        case SECTION_CAPACITY_HINTS:
+            // Worst-case concurrent enemies for pool sizing
+            if (hasWaves && hasEnemies) json << generateCapacityHintsJSON(instructions);
+            break;
+            
+        case SECTION_ALIASES:
+            // Names folded into structurally identical definitions
+            json << generateAliasesJSON(instructions);
+            break;
+            
+        default:
+            break;
     }
     
-    // Generate towers array
-    if (!towerIndices.empty()) {
-        if (hasMap || !enemyIndices.empty()) json << ",\n";
-        json << "    \"towers\": [\n";
-        
-        for (size_t i = 0; i < towerIndices.size(); i++) {
-            json << generateTowerJSON(instructions[towerIndices[i]]);
-            if (i + 1 < towerIndices.size()) json << ",";
-            json << "\n";
-        }
-        
-        json << "    ]";
+    if (json.tellp() > 0) chunks.push_back(json.str());
+}
+
+std::string CodeGenerator::generateSection(const std::vector<IRInstruction>& instructions, JSONSection section) {
+    std::vector<std::string> chunks;
+    renderSection(instructions, section, chunks);
+    
+    std::string json;
+    for (const auto& chunk : chunks) json += chunk;
+    return json;
+}
+
+std::vector<std::string> CodeGenerator::generateItems(const std::vector<IRInstruction>& instructions,
+                                                      JSONSection section) {
+    IROpcode wanted = IROpcode::NOP;
+    switch (section) {
+        case SECTION_ENEMIES: wanted = IROpcode::DEFINE_ENEMY; break;
+        case SECTION_TOWERS: wanted = IROpcode::DEFINE_TOWER; break;
+        case SECTION_WAVES: wanted = IROpcode::DEFINE_WAVE; break;
+        case SECTION_PLACEMENTS: wanted = IROpcode::PLACE_TOWER; break;
+        default: return {};
     }
     
-    // Generate waves array
-    if (!waveIndices.empty()) {
-        if (hasMap || !enemyIndices.empty() || !towerIndices.empty()) json << ",\n";
-        json << "    \"waves\": [\n";
-        
-        bool firstWave = true;
-        for (size_t i = 0; i < instructions.size(); i++) {
-            if (instructions[i].opcode == IROpcode::DEFINE_WAVE) {
-                if (!firstWave) json << ",\n";
-                firstWave = false;
-                json << generateWaveJSON(instructions, i);
+    std::vector<size_t> indices;
+    for (size_t i = 0; i < instructions.size(); i++) {
+        if (instructions[i].opcode == wanted) indices.push_back(i);
+    }
+    
+    std::vector<std::string> items(indices.size());
+    auto render = [&](size_t begin, size_t end, size_t) {
+        for (size_t i = begin; i < end; i++) {
+            size_t index = indices[i];
+            const IRInstruction& instr = instructions[index];
+            switch (section) {
+                case SECTION_ENEMIES: items[i] = generateEnemyJSON(instr); break;
+                case SECTION_TOWERS: items[i] = generateTowerJSON(instr); break;
+                case SECTION_WAVES: items[i] = generateWaveJSON(instructions, index); break;
+                default: items[i] = generatePlacementJSON(instr); break;
             }
         }
+    };
+    if (pool && indices.size() >= parallelMinimum) pool->parallelFor(indices.size(), render);
+    else render(0, indices.size(), 0);
+    return items;
+}
 
-        json << "    ]";
-    }
+std::string CodeGenerator::assembleJSON(const std::vector<std::string>& sections) {
+    std::ostringstream json;
     
-    // Generate placements array
-    if (!placementIndices.empty()) {
-        if (hasMap || !enemyIndices.empty() || !towerIndices.empty() || !waveIndices.empty()) {
-            json << ",\n";
-        }
-        json << "    \"initialPlacements\": [\n";
-        
-        for (size_t i = 0; i < placementIndices.size(); i++) {
-            json << generatePlacementJSON(instructions[placementIndices[i]]);
-            if (i + 1 < placementIndices.size()) json << ",";
-            json << "\n";
-        }
-        
-        json << "    ]";
+    json << "{\n";
+    json << "  \"gameConfig\": {\n";
+    
+    bool first = true;
+    for (const auto& section : sections) {
+        if (section.empty()) continue;
+        if (!first) json << ",\n";
+        first = false;
+        json << section;
     }
     
     json << "\n  }\n";
@@ -269,6 +540,68 @@ std::string CodeGenerator::generateJSON(const std::vector<IRInstruction>& instru
     return json.str();
 }
 
+std::vector<std::string> CodeGenerator::generateJSONChunks(const std::vector<IRInstruction>& instructions) {
+    // Same framing as assembleJSON, without joining the sections
+    std::vector<std::string> chunks;
+    chunks.push_back("{\n  \"gameConfig\": {\n");
+    
+    bool first = true;
+    std::vector<std::string> section;
+    for (int s = 0; s < SECTION_COUNT; s++) {
+        section.clear();
+        renderSection(instructions, static_cast<JSONSection>(s), section);
+        if (section.empty()) continue;
+        if (!first) chunks.push_back(",\n");
+        first = false;
+        for (auto& chunk : section) chunks.push_back(std::move(chunk));
+    }
+    
+    chunks.push_back("\n  }\n}\n");
+    return chunks;
+}
+
+std::string CodeGenerator::generateJSON(const std::vector<IRInstruction>& instructions) {
+    std::vector<std::string> chunks = generateJSONChunks(instructions);
+    
+    size_t size = 0;
+    for (const auto& chunk : chunks) size += chunk.size();
+    std::string json;
+    json.reserve(size);
+    for (const auto& chunk : chunks) json += chunk;
+    return json;
+}
+
+bool CodeGenerator::verifyParallel(const std::vector<IRInstruction>& instructions, std::ostream& log) {
+    CodeGenerator sequential;
+    sequential.setStartingGold(startingGold);
+    
+    auto start = std::chrono::steady_clock::now();
+    std::string expected = sequential.generateJSON(instructions);
+    auto middle = std::chrono::steady_clock::now();
+    std::string actual = generateJSON(instructions);
+    auto end = std::chrono::steady_clock::now();
+    
+    // Again with every list split, so small inputs exercise the joins too
+    size_t minimum = parallelMinimum;
+    parallelMinimum = 1;
+    std::string split = generateJSON(instructions);
+    parallelMinimum = minimum;
+    
+    if (actual != expected || split != expected) {
+        log << "  MISMATCH between sequential and parallel output\n";
+        return false;
+    }
+    
+    auto millis = [](std::chrono::steady_clock::duration d) {
+        return std::chrono::duration<double, std::milli>(d).count();
+    };
+    log << "  Parallel output matched (" << expected.size() << " bytes, "
+        << (pool ? pool->size() : 1) << " thread(s)); "
+        << std::fixed << std::setprecision(1) << millis(middle - start) << " ms sequential, "
+        << millis(end - middle) << " ms parallel.\n";
+    return true;
+}
+
 std::string CodeGenerator::generateReadable(const std::vector<IRInstruction>& instructions) {
     IRGenerator irGen;
     std::vector<std::string> lines = irGen.toString(instructions);
@@ -4,23 +4,92 @@
 #include "ir.h"
 #include <string>
 #include <vector>
+#include <memory>
+#include <functional>
+#include <ostream>
+
+class ThreadPool;
+struct EconomyReport;
+
+// Top-level members of "gameConfig", in output order
+enum JSONSection {
+    SECTION_MAP,
+    SECTION_ENEMIES,
+    SECTION_TOWERS,
+    SECTION_WAVES,
+    SECTION_PLACEMENTS,
+    SECTION_COMBAT_MATRIX,
+    SECTION_ECONOMY,
+    SECTION_CAPACITY_HINTS,
+    SECTION_ALIASES,
+    SECTION_COUNT
+};
 
 class CodeGenerator {
 public:
+    CodeGenerator();
+    ~CodeGenerator();
+
     // Generate final code from optimized IR
     std::string generateJSON(const std::vector<IRInstruction>& instructions);
     
+    // generateJSON as ordered buffers; joined, they are the same bytes.
+    // Writers hand them to writev instead of concatenating first.
+    std::vector<std::string> generateJSONChunks(const std::vector<IRInstruction>& instructions);
+    
+    // Render one section on its own ("" when the program has none), and
+    // join rendered sections exactly as generateJSON does. Incremental
+    // builds use these to re-render only the sections that changed.
+    std::string generateSection(const std::vector<IRInstruction>& instructions, JSONSection section);
+    std::string assembleJSON(const std::vector<std::string>& sections);
+    
+    // Each enemy, tower, wave or placement object of a list section on
+    // its own, in order and without separators
+    std::vector<std::string> generateItems(const std::vector<IRInstruction>& instructions, JSONSection section);
+    
+    // Starting gold used for the economy section's affordability table
+    void setStartingGold(int gold) { startingGold = gold; }
+    
+    // Economy section from a report the caller already built for the IR it
+    // renders next (not owned); null builds one per render
+    void setEconomy(const EconomyReport* report) { economyReport = report; }
+    
+    // Workers for the enemy, tower, wave and placement lists (1: none).
+    // Long lists are split into contiguous index ranges, each rendered into
+    // its own buffer, so the bytes do not depend on the thread count.
+    void setThreads(size_t threads);
+    
+    // Render with the configured workers, splitting every list, and check
+    // the result against a single-threaded render
+    bool verifyParallel(const std::vector<IRInstruction>& instructions, std::ostream& log);
+    
     // Alternative output formats
     std::string generateReadable(const std::vector<IRInstruction>& instructions);
     
+    // Escape a name for use inside a JSON string literal
+    static std::string escapeJSON(const std::string& str);
+    
 private:
+    int startingGold = 0;
+    const EconomyReport* economyReport = nullptr;
+    std::unique_ptr<ThreadPool> pool;
+    size_t parallelMinimum = 256;   // Shorter lists are rendered inline
+    
+    void renderSection(const std::vector<IRInstruction>& instructions, JSONSection section,
+                       std::vector<std::string>& chunks);
+    void renderItems(size_t count, const std::function<void(size_t, std::string&)>& item,
+                     std::vector<std::string>& chunks);
+    
     // Helper functions for JSON generation
-    std::string escapeJSON(const std::string& str);
     std::string generateMapJSON(const IRInstruction& instr);
     std::string generateEnemyJSON(const IRInstruction& instr);
     std::string generateTowerJSON(const IRInstruction& instr);
     std::string generateWaveJSON(const std::vector<IRInstruction>& instructions, size_t& index);
     std::string generatePlacementJSON(const IRInstruction& instr);
+    std::string generateCombatMatrixJSON(const std::vector<IRInstruction>& instructions);
+    std::string generateEconomyJSON(const std::vector<IRInstruction>& instructions);
+    std::string generateCapacityHintsJSON(const std::vector<IRInstruction>& instructions);
+    std::string generateAliasesJSON(const std::vector<IRInstruction>& instructions);
 };
 
 #endif // CODEGEN_H
@@ -0,0 +1,542 @@
+#include "delta.h"
+#include "importer.h"
+#include <unordered_map>
+#include <algorithm>
+#include <stdexcept>
+#include <cstring>
+
+namespace {
+
+const char MAGIC[4] = {'P', 'T', 'D', 'L'};
+const uint8_t FORMAT_VERSION = 1;
+
+enum DeltaOp : uint8_t {
+    OP_COPY = 1,     // Run of unchanged base entities: start, count
+    OP_UPDATE = 2,   // Base entity with field edits and a spliced body
+    OP_INSERT = 3    // Entity not in the base
+};
+
+enum ValueTag : uint8_t { VALUE_INT = 0, VALUE_DOUBLE = 1, VALUE_STRING = 2 };
+
+using Range = std::pair<size_t, size_t>;   // [begin, end) in the instruction list
+
+// A wave's spawn groups and repeat markers belong to the wave before them;
+// every other instruction is an entity of its own
+std::vector<Range> splitEntities(const std::vector<IRInstruction>& instructions) {
+    std::vector<Range> entities;
+    for (size_t i = 0; i < instructions.size(); i++) {
+        IROpcode op = instructions[i].opcode;
+        bool body = op == IROpcode::SPAWN_ENEMY || op == IROpcode::REPEAT_BEGIN || op == IROpcode::REPEAT_END;
+        if (body && !entities.empty()) entities.back().second = i + 1;
+        else entities.push_back({i, i + 1});
+    }
+    return entities;
+}
+
+// Definitions are known by kind and name, anything else by its position
+// among instructions of the same opcode
+std::vector<std::string> entityKeys(const std::vector<IRInstruction>& instructions, const std::vector<Range>& entities) {
+    std::vector<std::string> keys;
+    std::unordered_map<int, size_t> ordinals;
+    for (const auto& range : entities) {
+        const IRInstruction& head = instructions[range.first];
+        std::string key(1, static_cast<char>('A' + static_cast<int>(head.opcode)));
+        switch (head.opcode) {
+            case IROpcode::DEFINE_MAP:
+            case IROpcode::DEFINE_ENEMY:
+            case IROpcode::DEFINE_TOWER:
+            case IROpcode::DEFINE_WAVE:
+            case IROpcode::DEFINE_ALIAS:
+                if (!head.operands.empty()) {
+                    key += ':' + head.operands[0];
+                    break;
+                }
+                // fall through
+            default:
+                key += '#' + std::to_string(ordinals[static_cast<int>(head.opcode)]++);
+                break;
+        }
+        keys.push_back(key);
+    }
+    return keys;
+}
+
+bool sameInstruction(const IRInstruction& a, const IRInstruction& b) {
+    return a.opcode == b.opcode && a.operands == b.operands && a.metadata == b.metadata;
+}
+
+bool sameRange(const std::vector<IRInstruction>& a, Range ra, const std::vector<IRInstruction>& b, Range rb) {
+    if (ra.second - ra.first != rb.second - rb.first) return false;
+    for (size_t i = 0; i < ra.second - ra.first; i++) {
+        if (!sameInstruction(a[ra.first + i], b[rb.first + i])) return false;
+    }
+    return true;
+}
+
+void putVarint(std::string& out, uint64_t value) {
+    while (value >= 0x80) {
+        out += static_cast<char>((value & 0x7f) | 0x80);
+        value >>= 7;
+    }
+    out += static_cast<char>(value);
+}
+
+void putSigned(std::string& out, int64_t value) {
+    putVarint(out, (static_cast<uint64_t>(value) << 1) ^ static_cast<uint64_t>(value >> 63));
+}
+
+void putString(std::string& out, const std::string& text) {
+    putVarint(out, text.size());
+    out += text;
+}
+
+void putValue(std::string& out, const std::variant<int, double, std::string>& value) {
+    if (auto i = std::get_if<int>(&value)) {
+        out += static_cast<char>(VALUE_INT);
+        putSigned(out, *i);
+    } else if (auto d = std::get_if<double>(&value)) {
+        out += static_cast<char>(VALUE_DOUBLE);
+        char bytes[sizeof(double)];
+        std::memcpy(bytes, d, sizeof(double));
+        out.append(bytes, sizeof(double));
+    } else {
+        out += static_cast<char>(VALUE_STRING);
+        putString(out, std::get<std::string>(value));
+    }
+}
+
+void putInstruction(std::string& out, const IRInstruction& instr) {
+    out += static_cast<char>(instr.opcode);
+    putVarint(out, instr.operands.size());
+    for (const auto& operand : instr.operands) putString(out, operand);
+    putVarint(out, instr.metadata.size());
+    for (const auto& field : instr.metadata) {
+        putString(out, field.first);
+        putValue(out, field.second);
+    }
+}
+
+uint64_t checksum(const std::vector<IRInstruction>& instructions) {
+    uint64_t hash = 1469598103934665603ULL;
+    std::string bytes;
+    for (const auto& instr : instructions) {
+        bytes.clear();
+        putInstruction(bytes, instr);
+        for (char c : bytes) {
+            hash ^= static_cast<unsigned char>(c);
+            hash *= 1099511628211ULL;
+        }
+    }
+    return hash;
+}
+
+class PatchReader {
+public:
+    PatchReader(const std::string& patch) : p(patch.data()), end(patch.data() + patch.size()) {}
+
+    bool done() const { return p == end; }
+
+    uint8_t byte() {
+        need(1);
+        return static_cast<uint8_t>(*p++);
+    }
+
+    uint64_t varint() {
+        uint64_t value = 0;
+        for (int shift = 0; shift < 64; shift += 7) {
+            uint8_t b = byte();
+            value |= static_cast<uint64_t>(b & 0x7f) << shift;
+            if (!(b & 0x80)) return value;
+        }
+        fail();
+    }
+
+    int64_t signedInt() {
+        uint64_t value = varint();
+        return static_cast<int64_t>(value >> 1) ^ -static_cast<int64_t>(value & 1);
+    }
+
+    // A count of things at least `minimumSize` bytes each
+    size_t count(size_t minimumSize) {
+        uint64_t n = varint();
+        if (n > static_cast<uint64_t>(end - p) / minimumSize) fail();
+        return static_cast<size_t>(n);
+    }
+
+    std::string string() {
+        size_t size = count(1);
+        std::string text(p, size);
+        p += size;
+        return text;
+    }
+
+    uint64_t fixed64() {
+        need(sizeof(uint64_t));
+        uint64_t value;
+        std::memcpy(&value, p, sizeof(value));
+        p += sizeof(value);
+        return value;
+    }
+
+    std::variant<int, double, std::string> value() {
+        switch (byte()) {
+            case VALUE_INT: return static_cast<int>(signedInt());
+            case VALUE_DOUBLE: {
+                need(sizeof(double));
+                double d;
+                std::memcpy(&d, p, sizeof(double));
+                p += sizeof(double);
+                return d;
+            }
+            case VALUE_STRING: return string();
+            default: fail();
+        }
+    }
+
+    IRInstruction instruction() {
+        uint8_t opcode = byte();
+        if (opcode > static_cast<uint8_t>(IROpcode::NOP)) fail();
+        IRInstruction instr(static_cast<IROpcode>(opcode));
+        instr.operands.resize(count(1));
+        for (auto& operand : instr.operands) operand = string();
+        for (size_t n = count(2); n > 0; n--) {
+            std::string key = string();
+            instr.metadata[key] = value();
+        }
+        return instr;
+    }
+
+    std::vector<IRInstruction> instructions() {
+        std::vector<IRInstruction> list(count(3));
+        for (auto& instr : list) instr = instruction();
+        return list;
+    }
+
+    [[noreturn]] void fail() const { throw std::runtime_error("corrupt delta patch"); }
+
+private:
+    const char* p;
+    const char* end;
+
+    void need(size_t n) const {
+        if (static_cast<size_t>(end - p) < n) fail();
+    }
+};
+
+}
+
+std::string DeltaWriter::write(const std::vector<IRInstruction>& base, const std::vector<IRInstruction>& target,
+                               int startingGold) {
+    stats = Stats();
+    std::vector<Range> oldEntities = splitEntities(base);
+    std::vector<Range> newEntities = splitEntities(target);
+    std::vector<std::string> oldKeys = entityKeys(base, oldEntities);
+    std::vector<std::string> newKeys = entityKeys(target, newEntities);
+
+    std::unordered_map<std::string, size_t> oldIndex;
+    for (size_t i = 0; i < oldKeys.size(); i++) oldIndex.emplace(oldKeys[i], i);
+    std::vector<bool> used(oldEntities.size(), false);
+
+    std::string ops;
+    size_t opCount = 0;
+    size_t runStart = 0, runLength = 0;
+    auto flushRun = [&] {
+        if (runLength == 0) return;
+        ops += static_cast<char>(OP_COPY);
+        putVarint(ops, runStart);
+        putVarint(ops, runLength);
+        opCount++;
+        runLength = 0;
+    };
+
+    for (size_t i = 0; i < newEntities.size(); i++) {
+        Range now = newEntities[i];
+        auto match = oldIndex.find(newKeys[i]);
+        if (match == oldIndex.end() || used[match->second]) {
+            flushRun();
+            ops += static_cast<char>(OP_INSERT);
+            putVarint(ops, now.second - now.first);
+            for (size_t k = now.first; k < now.second; k++) putInstruction(ops, target[k]);
+            opCount++;
+            stats.added++;
+            continue;
+        }
+
+        size_t j = match->second;
+        used[j] = true;
+        Range was = oldEntities[j];
+        if (sameRange(base, was, target, now)) {
+            if (runLength > 0 && runStart + runLength == j) {
+                runLength++;
+            } else {
+                flushRun();
+                runStart = j;
+                runLength = 1;
+            }
+            stats.unchanged++;
+            continue;
+        }
+
+        flushRun();
+        ops += static_cast<char>(OP_UPDATE);
+        putVarint(ops, j);
+        stats.changed++;
+        opCount++;
+
+        // Head: operands when they differ, then set and removed fields
+        const IRInstruction& before = base[was.first];
+        const IRInstruction& after = target[now.first];
+        if (before.operands == after.operands) {
+            ops += '\0';
+        } else {
+            ops += '\1';
+            putVarint(ops, after.operands.size());
+            for (const auto& operand : after.operands) putString(ops, operand);
+        }
+
+        std::vector<const std::pair<const std::string, std::variant<int, double, std::string>>*> set;
+        for (const auto& field : after.metadata) {
+            auto old = before.metadata.find(field.first);
+            if (old == before.metadata.end() || old->second != field.second) set.push_back(&field);
+        }
+        putVarint(ops, set.size());
+        for (const auto* field : set) {
+            putString(ops, field->first);
+            putValue(ops, field->second);
+        }
+
+        std::vector<const std::string*> removedFields;
+        for (const auto& field : before.metadata) {
+            if (!after.metadata.count(field.first)) removedFields.push_back(&field.first);
+        }
+        putVarint(ops, removedFields.size());
+        for (const auto* name : removedFields) putString(ops, *name);
+
+        // Body: keep the common ends and replace the spawn groups between
+        size_t oldBody = was.second - was.first - 1;
+        size_t newBody = now.second - now.first - 1;
+        size_t prefix = 0;
+        while (prefix < oldBody && prefix < newBody &&
+               sameInstruction(base[was.first + 1 + prefix], target[now.first + 1 + prefix])) {
+            prefix++;
+        }
+        size_t suffix = 0;
+        while (suffix < oldBody - prefix && suffix < newBody - prefix &&
+               sameInstruction(base[was.second - 1 - suffix], target[now.second - 1 - suffix])) {
+            suffix++;
+        }
+        putVarint(ops, prefix);
+        putVarint(ops, suffix);
+        putVarint(ops, newBody - prefix - suffix);
+        for (size_t k = now.first + 1 + prefix; k < now.second - suffix; k++) putInstruction(ops, target[k]);
+    }
+    flushRun();
+
+    for (bool u : used) {
+        if (!u) stats.removed++;
+    }
+
+    std::string patch(MAGIC, sizeof(MAGIC));
+    patch += static_cast<char>(FORMAT_VERSION);
+    putSigned(patch, startingGold);
+    uint64_t sums[2] = {checksum(base), checksum(target)};
+    patch.append(reinterpret_cast<const char*>(sums), sizeof(sums));
+    putVarint(patch, opCount);
+    return patch + ops;
+}
+
+std::vector<IRInstruction> DeltaApplier::apply(const std::vector<IRInstruction>& base, const std::string& patch) {
+    if (patch.size() < sizeof(MAGIC) + 1 || patch.compare(0, sizeof(MAGIC), MAGIC, sizeof(MAGIC)) != 0) {
+        throw std::runtime_error("not a delta patch");
+    }
+    PatchReader in(patch);
+    for (size_t i = 0; i < sizeof(MAGIC); i++) in.byte();
+    if (in.byte() != FORMAT_VERSION) throw std::runtime_error("unsupported delta patch version");
+    int64_t startingGold = in.signedInt();
+    uint64_t baseSum = in.fixed64();
+    uint64_t resultSum = in.fixed64();
+    if (baseSum != checksum(base)) throw std::runtime_error("delta patch was written against a different config");
+
+    std::vector<Range> entities = splitEntities(base);
+    std::vector<IRInstruction> result;
+    for (size_t n = in.count(1); n > 0; n--) {
+        uint8_t op = in.byte();
+        if (op == OP_COPY) {
+            uint64_t start = in.varint();
+            uint64_t length = in.varint();
+            if (start > entities.size() || length > entities.size() - start || length == 0) in.fail();
+            size_t first = entities[start].first;
+            size_t last = entities[start + length - 1].second;
+            result.insert(result.end(), base.begin() + first, base.begin() + last);
+        } else if (op == OP_UPDATE) {
+            uint64_t index = in.varint();
+            if (index >= entities.size()) in.fail();
+            Range was = entities[index];
+
+            IRInstruction head = base[was.first];
+            if (in.byte() != 0) {
+                head.operands.resize(in.count(1));
+                for (auto& operand : head.operands) operand = in.string();
+            }
+            for (size_t k = in.count(2); k > 0; k--) {
+                std::string key = in.string();
+                head.metadata[key] = in.value();
+            }
+            for (size_t k = in.count(1); k > 0; k--) head.metadata.erase(in.string());
+            result.push_back(head);
+
+            size_t oldBody = was.second - was.first - 1;
+            uint64_t prefix = in.varint();
+            uint64_t suffix = in.varint();
+            if (prefix > oldBody || suffix > oldBody - prefix) in.fail();
+            result.insert(result.end(), base.begin() + was.first + 1, base.begin() + was.first + 1 + prefix);
+            std::vector<IRInstruction> middle = in.instructions();
+            result.insert(result.end(), middle.begin(), middle.end());
+            result.insert(result.end(), base.begin() + was.second - suffix, base.begin() + was.second);
+        } else if (op == OP_INSERT) {
+            std::vector<IRInstruction> entity = in.instructions();
+            result.insert(result.end(), entity.begin(), entity.end());
+        } else {
+            in.fail();
+        }
+    }
+    if (!in.done() || checksum(result) != resultSum) in.fail();
+
+    gold = static_cast<int>(startingGold);
+    return result;
+}
+
+namespace {
+
+// Nudge the first numeric field of an instruction
+bool bumpField(IRInstruction& instr) {
+    for (auto& field : instr.metadata) {
+        if (auto i = std::get_if<int>(&field.second)) {
+            (*i)++;
+            return true;
+        }
+        if (auto d = std::get_if<double>(&field.second)) {
+            *d += 0.5;
+            return true;
+        }
+    }
+    return false;
+}
+
+}
+
+std::vector<IRInstruction> DeltaWriter::asJSON(const std::vector<IRInstruction>& target, CodeGenerator& codeGen) {
+    JSONImporter importer;
+    return importer.import(codeGen.generateJSON(target));
+}
+
+bool DeltaWriter::verify(const std::vector<IRInstruction>& instructions, CodeGenerator& codeGen, std::ostream& log) {
+    // Edits of up to 32 entities spread over the program
+    std::vector<std::pair<std::string, std::vector<IRInstruction>>> edits;
+    edits.push_back({"no change", instructions});
+    edits.push_back({"everything removed", {}});
+
+    std::vector<Range> entities = splitEntities(instructions);
+    size_t step = std::max<size_t>(1, entities.size() / 32);
+    for (size_t e = 0; e < entities.size(); e += step) {
+        Range range = entities[e];
+        std::string label = "entity " + std::to_string(e + 1);
+        auto begin = instructions.begin() + range.first;
+        auto end = instructions.begin() + range.second;
+
+        std::vector<IRInstruction> edited = instructions;
+        if (bumpField(edited[range.first])) edits.push_back({label + ": field changed", edited});
+
+        edited.assign(instructions.begin(), begin);
+        edited.insert(edited.end(), end, instructions.end());
+        edits.push_back({label + ": removed", edited});
+
+        edited.assign(instructions.begin(), end);
+        edited.insert(edited.end(), begin, end);
+        if (!edited[range.second].operands.empty()) edited[range.second].operands[0] += "_copy";
+        edited.insert(edited.end(), end, instructions.end());
+        edits.push_back({label + ": added", edited});
+
+        // Spawn groups: change the middle one, then drop it
+        std::vector<size_t> spawns;
+        for (size_t k = range.first + 1; k < range.second; k++) {
+            if (instructions[k].opcode == IROpcode::SPAWN_ENEMY) spawns.push_back(k);
+        }
+        if (spawns.empty()) continue;
+        size_t spawn = spawns[spawns.size() / 2];
+        edited = instructions;
+        if (bumpField(edited[spawn])) edits.push_back({label + ": spawn group changed", edited});
+        edited = instructions;
+        edited.erase(edited.begin() + spawn);
+        edits.push_back({label + ": spawn group removed", edited});
+    }
+
+    const int gold = 100;
+    std::string fullJSON = codeGen.generateJSON(instructions);
+    uint64_t patchBytes = 0, jsonBytes = 0;
+    size_t patches = 0;
+    for (const auto& edit : edits) {
+        // Both directions: the edit as the new config, and rolling it back
+        const std::vector<IRInstruction>* pairs[2][2] = {{&instructions, &edit.second}, {&edit.second, &instructions}};
+        for (const auto& pair : pairs) {
+            const std::vector<IRInstruction>& base = *pair[0];
+            const std::vector<IRInstruction>& target = *pair[1];
+
+            DeltaWriter writer;
+            std::string patch = writer.write(base, target, gold);
+            DeltaApplier applier;
+            std::vector<IRInstruction> result = applier.apply(base, patch);
+
+            bool same = result.size() == target.size() && applier.startingGold() == gold &&
+                        sameRange(result, {0, result.size()}, target, {0, target.size()});
+            std::string expected = &target == &instructions ? fullJSON : codeGen.generateJSON(target);
+            if (!same || codeGen.generateJSON(result) != expected) {
+                log << "  MISMATCH applying '" << edit.first << "'" << (&base == &instructions ? "" : " in reverse") << "\n";
+                return false;
+            }
+
+            if (&base != &target && checksum(base) != checksum(target)) {
+                bool refused = false;
+                try {
+                    applier.apply(target, patch);
+                } catch (const std::runtime_error&) {
+                    refused = true;
+                }
+                if (!refused) {
+                    log << "  Patch for '" << edit.first << "' applied to the wrong base\n";
+                    return false;
+                }
+            }
+
+            patchBytes += patch.size();
+            jsonBytes += expected.size();
+            patches++;
+        }
+    }
+
+    // A server's previous output.json against an unchanged compile, and
+    // against the first edit
+    JSONImporter importer;
+    std::vector<IRInstruction> loaded = importer.import(fullJSON);
+    for (size_t e = 0; e < edits.size() && e < 3; e += 2) {
+        const std::vector<IRInstruction>& target = edits[e].second;
+        DeltaWriter writer;
+        std::string patch = writer.write(loaded, asJSON(target, codeGen), gold);
+        DeltaApplier applier;
+        std::string result = codeGen.generateJSON(applier.apply(loaded, patch));
+        const Stats& stats = writer.lastStats();
+        if (result != codeGen.generateJSON(target) ||
+            (e == 0 && stats.changed + stats.added + stats.removed > 0)) {
+            log << "  MISMATCH applying '" << edits[e].first << "' to the JSON output (" << patch.size()
+                << " byte patch)\n";
+            return false;
+        }
+        patchBytes += patch.size();
+        jsonBytes += result.size();
+        patches++;
+    }
+
+    log << "  Delta patches matched full output in " << patches << " cases; average patch "
+        << patchBytes / patches << " bytes against " << jsonBytes / patches << " bytes of JSON.\n";
+    return true;
+}
@@ -0,0 +1,66 @@
+#ifndef DELTA_H
+#define DELTA_H
+
+#include "ir.h"
+#include "codegen.h"
+#include <string>
+#include <vector>
+#include <ostream>
+#include <cstdint>
+
+// Binary patch between two optimized IR programs, for hot-reloading a live
+// server without shipping the whole config. Programs are compared as lists
+// of entities: a definition, alias or placement instruction, or a wave with
+// its spawn groups. Definitions match by kind and name, placements by
+// position. The patch rebuilds the new list in order from runs of
+// unchanged entities, field-level updates of matched ones (a wave's spawn
+// groups as one spliced range) and added entities; entities it never
+// mentions are removed. Checksums of both programs make a patch refuse
+// any base but its own.
+//
+// Format: "PTDL", version byte, starting gold, base and result checksums,
+// then the ops. Integers are LEB128 varints (zigzag when signed).
+class DeltaWriter {
+public:
+    struct Stats {
+        size_t unchanged = 0;
+        size_t changed = 0;
+        size_t added = 0;
+        size_t removed = 0;
+    };
+
+    // The starting gold is carried so the applier's economy section matches
+    std::string write(const std::vector<IRInstruction>& base, const std::vector<IRInstruction>& target,
+                      int startingGold);
+
+    const Stats& lastStats() const { return stats; }
+
+    // `target` the way a server holding its JSON output loads it: repeats
+    // expanded, aliases last, derived metadata dropped. A .json base is
+    // imported as is, so diff it against this rather than compiled IR,
+    // which would differ in every wave.
+    static std::vector<IRInstruction> asJSON(const std::vector<IRInstruction>& target, CodeGenerator& codeGen);
+
+    // Patch `instructions` against generated edits of itself and check the
+    // applier rebuilds each edit's IR and JSON output byte for byte; also
+    // that the unchanged config patches to nothing against its own JSON
+    static bool verify(const std::vector<IRInstruction>& instructions, CodeGenerator& codeGen, std::ostream& log);
+
+private:
+    Stats stats;
+};
+
+// Applies a DeltaWriter patch. Throws std::runtime_error when the patch is
+// malformed or was written against a different base.
+class DeltaApplier {
+public:
+    std::vector<IRInstruction> apply(const std::vector<IRInstruction>& base, const std::string& patch);
+
+    // Starting gold of the last applied patch
+    int startingGold() const { return gold; }
+
+private:
+    int gold = 0;
+};
+
+#endif // DELTA_H
@@ -0,0 +1,66 @@
+#include "driver.h"
+#include "semantic.h"
+#include "ircache.h"
+#include <fstream>
+#include <stdexcept>
+
+Compiler::Compiler(const CompileOptions& opts)
+    : options(opts), lexer(""), parser(lexer) {
+    optimizer.setVerbose(false);
+    optimizer.setSmoothing(options.smoothTicks);
+    codeGen.setStartingGold(options.startingGold);
+}
+
+std::string Compiler::compile(const std::string& text) {
+    program.reset();
+
+    IRCache::Key key;
+    if (options.cache) {
+        key = IRCache::keyFor(text, options);
+        if (options.cache->load(key, optimizedIR)) return render();
+    }
+
+    lexer.reset(text);
+    parser.reset();
+    std::shared_ptr<Program> ast = parser.parseProgram();
+
+    SemanticAnalyzer analyzer;
+    analyzer.analyze(ast);
+
+    optimizedIR = irGen.generate(ast);
+    program = ast;
+    if (options.optimize) {
+        optimizedIR = optimizer.optimize(optimizedIR);
+    }
+    if (options.cache) options.cache->store(key, optimizedIR);
+
+    return render();
+}
+
+std::string Compiler::render() {
+    return options.readable ? codeGen.generateReadable(optimizedIR)
+                            : codeGen.generateJSON(optimizedIR);
+}
+
+void Compiler::readInto(const std::string& path, std::string& buffer) {
+    std::ifstream file(path, std::ios::binary);
+    if (!file.is_open()) {
+        throw std::runtime_error("could not open " + path);
+    }
+    file.seekg(0, std::ios::end);
+    std::streamoff size = file.tellg();
+    file.seekg(0, std::ios::beg);
+    buffer.resize(size > 0 ? static_cast<size_t>(size) : 0);
+    if (size > 0) file.read(&buffer[0], size);
+}
+
+void Compiler::compileFile(const std::string& inputPath, const std::string& outputPath) {
+    readInto(inputPath, source);
+    std::string output = compile(source);
+
+    std::ofstream file(outputPath, std::ios::binary);
+    if (!file.is_open()) {
+        throw std::runtime_error("could not write " + outputPath);
+    }
+    file << output;
+}
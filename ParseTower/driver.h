@@ -0,0 +1,60 @@
+#ifndef DRIVER_H
+#define DRIVER_H
+
+#include "lexer.h"
+#include "parser.h"
+#include "ir.h"
+#include "optimizer.h"
+#include "codegen.h"
+#include <string>
+#include <vector>
+
+// Part of every IR cache key; bump when IR or optimizer output changes
+#define PARSETOWER_VERSION "1.2.0"
+
+class IRCache;
+
+struct CompileOptions {
+    bool optimize = true;
+    bool readable = false;
+    int startingGold = 0;
+    int smoothTicks = 0;        // Spawn load smoothing tolerance; 0 disables
+    IRCache* cache = nullptr;   // Optional; shared, not owned
+};
+
+// Quiet, reusable front-to-back pipeline for tools that compile many
+// inputs. The lexer, parser, IR and output buffers are owned by the
+// instance and reused between calls, so one Compiler per thread avoids
+// per-file setup. Errors are thrown as std::runtime_error; every compile
+// resets the pipeline, so an instance stays usable after a failure.
+class Compiler {
+public:
+    explicit Compiler(const CompileOptions& options);
+
+    // Source text to JSON (or readable) output
+    std::string compile(const std::string& source);
+
+    // Read, compile and write one file
+    void compileFile(const std::string& inputPath, const std::string& outputPath);
+
+    // AST and optimized IR of the last successful compile. The AST is
+    // null when the IR came from the cache.
+    std::shared_ptr<Program> lastProgram() const { return program; }
+    const std::vector<IRInstruction>& lastIR() const { return optimizedIR; }
+
+private:
+    CompileOptions options;
+    std::string source;
+    Lexer lexer;
+    Parser parser;
+    IRGenerator irGen;
+    Optimizer optimizer;
+    CodeGenerator codeGen;
+    std::shared_ptr<Program> program;
+    std::vector<IRInstruction> optimizedIR;
+
+    std::string render();
+    void readInto(const std::string& path, std::string& buffer);
+};
+
+#endif // DRIVER_H
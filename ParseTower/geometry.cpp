@@ -0,0 +1,84 @@
+#include "geometry.h"
+#include <cmath>
+#include <charconv>
+#include <algorithm>
+
+PathGeometry::PathGeometry(const std::vector<std::pair<int,int>>& pts) : points(pts) {
+    double total = 0.0;
+    for (size_t i = 0; i < points.size(); i++) {
+        if (i > 0) {
+            double dx = points[i].first - points[i - 1].first;
+            double dy = points[i].second - points[i - 1].second;
+            total += std::sqrt(dx * dx + dy * dy);
+        }
+        cumulative.push_back(total);
+    }
+}
+
+std::vector<std::pair<int,int>> PathGeometry::parse(const std::string& pathMetadata) {
+    std::vector<std::pair<int,int>> result;
+    const char* p = pathMetadata.data();
+    const char* end = p + pathMetadata.size();
+
+    // "x,y;x,y;..." - entries that do not hold two integers are skipped
+    while (p < end) {
+        const char* next = std::find(p, end, ';');
+        int x, y;
+        auto first = std::from_chars(p, next, x);
+        if (first.ec == std::errc() && first.ptr < next && *first.ptr == ',') {
+            auto second = std::from_chars(first.ptr + 1, next, y);
+            if (second.ec == std::errc()) result.push_back({x, y});
+        }
+        p = next + (next < end ? 1 : 0);
+    }
+    return result;
+}
+
+void PathGeometry::positionAt(double distance, size_t& segment, double& x, double& y) const {
+    if (points.empty()) {
+        x = y = 0.0;
+        return;
+    }
+    if (points.size() == 1 || distance <= 0.0) {
+        x = points[0].first;
+        y = points[0].second;
+        return;
+    }
+
+    // Advance the hint until distance falls inside [cumulative[s], cumulative[s + 1]]
+    while (segment + 2 < points.size() && cumulative[segment + 1] < distance)
+        segment++;
+
+    double segLen = cumulative[segment + 1] - cumulative[segment];
+    double t = segLen > 0.0 ? (distance - cumulative[segment]) / segLen : 0.0;
+    t = std::min(1.0, std::max(0.0, t));
+
+    x = points[segment].first + t * (points[segment + 1].first - points[segment].first);
+    y = points[segment].second + t * (points[segment + 1].second - points[segment].second);
+}
+
+double PathGeometry::coveredLength(double cx, double cy, double radius) const {
+    double covered = 0.0;
+
+    for (size_t i = 0; i + 1 < points.size(); i++) {
+        double px = points[i].first - cx;
+        double py = points[i].second - cy;
+        double dx = points[i + 1].first - points[i].first;
+        double dy = points[i + 1].second - points[i].second;
+
+        // Solve |P + t*D|^2 = r^2 for t in [0, 1]
+        double a = dx * dx + dy * dy;
+        if (a == 0.0) continue;
+        double b = 2.0 * (px * dx + py * dy);
+        double c = px * px + py * py - radius * radius;
+        double disc = b * b - 4.0 * a * c;
+        if (disc <= 0.0) continue;
+
+        double root = std::sqrt(disc);
+        double t1 = std::max(0.0, (-b - root) / (2.0 * a));
+        double t2 = std::min(1.0, (-b + root) / (2.0 * a));
+        if (t2 > t1) covered += (t2 - t1) * std::sqrt(a);
+    }
+
+    return covered;
+}
@@ -0,0 +1,34 @@
+#ifndef GEOMETRY_H
+#define GEOMETRY_H
+
+#include <vector>
+#include <string>
+#include <utility>
+
+// Polyline view of a map path, measured in tiles
+class PathGeometry {
+public:
+    PathGeometry() {}
+    explicit PathGeometry(const std::vector<std::pair<int,int>>& points);
+
+    // Parse the "x,y;x,y;..." form stored in DEFINE_MAP metadata
+    static std::vector<std::pair<int,int>> parse(const std::string& pathMetadata);
+
+    // Total walking distance from the first to the last waypoint
+    double length() const { return cumulative.empty() ? 0.0 : cumulative.back(); }
+
+    // Position after walking `distance` tiles. `segment` is a hint that only
+    // moves forward, so walking enemies cost O(1) amortized per lookup.
+    void positionAt(double distance, size_t& segment, double& x, double& y) const;
+
+    // Length of the path that lies inside the disc (cx, cy, radius)
+    double coveredLength(double cx, double cy, double radius) const;
+
+    const std::vector<std::pair<int,int>>& waypoints() const { return points; }
+
+private:
+    std::vector<std::pair<int,int>> points;
+    std::vector<double> cumulative; // cumulative[i] = distance to points[i]
+};
+
+#endif // GEOMETRY_H
@@ -0,0 +1,527 @@
+#include "importer.h"
+#include "driver.h"
+#include "geometry.h"
+#include <charconv>
+#include <chrono>
+#include <cstring>
+#include <algorithm>
+#include <stdexcept>
+#include <unordered_set>
+
+std::vector<IRInstruction> JSONImporter::import(const std::string& json) {
+    begin = p = json.data();
+    end = begin + json.size();
+    gold = 0;
+    out.clear();
+    origins.clear();
+
+    expect('{');
+    std::string name;
+    bool found = false;
+    while (key(name)) {
+        if (name == "gameConfig") {
+            gameConfig();
+            found = true;
+        } else {
+            skipValue();
+        }
+        consume(',');
+    }
+    if (!found) fail("missing \"gameConfig\"");
+    check();
+
+    std::vector<IRInstruction> result;
+    result.swap(out);
+    return result;
+}
+
+void JSONImporter::fail(const std::string& what) const {
+    failAt(p, what);
+}
+
+void JSONImporter::failAt(const char* at, const std::string& what) const {
+    size_t line = 1 + std::count(begin, std::min(at, end), '\n');
+    throw std::runtime_error("JSON import: " + what + " at line " + std::to_string(line));
+}
+
+void JSONImporter::emit(const IRInstruction& instr, const char* at) {
+    out.push_back(instr);
+    origins.push_back(at);
+}
+
+void JSONImporter::require(const IRInstruction& instr, std::initializer_list<const char*> fields, const char* at,
+                           const std::string& what) const {
+    if (instr.operands.empty()) failAt(at, what + " without \"name\"");
+    for (const char* field : fields) {
+        if (!instr.metadata.count(field)) {
+            failAt(at, what + " " + instr.operands.back() + " without \"" + field + "\"");
+        }
+    }
+}
+
+// The SemanticAnalyzer rules, over IR. Aliases come last in the document
+// but may be referenced earlier, so names are collected first.
+void JSONImporter::check() const {
+    std::unordered_set<std::string> enemies, towers, waves;
+    for (size_t i = 0; i < out.size(); i++) {
+        const IRInstruction& instr = out[i];
+        std::unordered_set<std::string>* names = nullptr;
+        const char* kind = "";
+        if (instr.opcode == IROpcode::DEFINE_ENEMY) names = &enemies, kind = "enemy";
+        else if (instr.opcode == IROpcode::DEFINE_TOWER) names = &towers, kind = "tower";
+        else if (instr.opcode == IROpcode::DEFINE_WAVE) names = &waves, kind = "wave";
+        else if (instr.opcode == IROpcode::DEFINE_ALIAS) {
+            bool enemy = std::get<std::string>(instr.metadata.at("kind")) == "enemy";
+            names = enemy ? &enemies : &towers;
+            kind = enemy ? "enemy" : "tower";
+        }
+        if (names && !names->insert(instr.operands[0]).second) {
+            failAt(origins[i], std::string("duplicate ") + kind + ": " + instr.operands[0]);
+        }
+    }
+
+    auto integer = [](const IRInstruction& instr, const char* field) {
+        return std::get<int>(instr.metadata.at(field));
+    };
+    auto number = [](const IRInstruction& instr, const char* field) {
+        return std::get<double>(instr.metadata.at(field));
+    };
+
+    const IRInstruction* map = nullptr;
+    for (size_t i = 0; i < out.size(); i++) {
+        const IRInstruction& instr = out[i];
+        const char* at = origins[i];
+        switch (instr.opcode) {
+            case IROpcode::DEFINE_MAP: {
+                map = &instr;
+                int width = integer(instr, "width");
+                int height = integer(instr, "height");
+                if (width <= 0 || height <= 0) failAt(at, "invalid map size");
+                for (const auto& point : PathGeometry::parse(std::get<std::string>(instr.metadata.at("path")))) {
+                    if (point.first < 0 || point.first >= width || point.second < 0 || point.second >= height) {
+                        failAt(at, "path coordinate out of map bounds");
+                    }
+                }
+                break;
+            }
+            case IROpcode::DEFINE_ENEMY:
+                if (integer(instr, "hp") <= 0) failAt(at, "enemy HP invalid");
+                if (!(number(instr, "speed") > 0)) failAt(at, "enemy speed invalid");
+                if (integer(instr, "reward") < 0) failAt(at, "enemy reward invalid");
+                break;
+            case IROpcode::DEFINE_TOWER:
+                if (integer(instr, "range") <= 0 || integer(instr, "damage") <= 0 || integer(instr, "cost") < 0) {
+                    failAt(at, "invalid tower stats");
+                }
+                if (!(number(instr, "fire_rate") > 0)) failAt(at, "invalid fire rate");
+                break;
+            case IROpcode::DEFINE_WAVE:
+                if (instr.metadata.count("alias")) {
+                    const std::string& target = std::get<std::string>(instr.metadata.at("alias"));
+                    if (!waves.count(target)) failAt(at, "wave aliases undefined wave: " + target);
+                }
+                break;
+            case IROpcode::SPAWN_ENEMY:
+                if (!enemies.count(instr.operands[1])) failAt(at, "wave uses undefined enemy: " + instr.operands[1]);
+                if (integer(instr, "count") <= 0 || integer(instr, "start") < 0 || integer(instr, "interval") <= 0) {
+                    failAt(at, "invalid spawn parameters");
+                }
+                break;
+            case IROpcode::PLACE_TOWER:
+                if (!towers.count(instr.operands[0])) failAt(at, "placing undefined tower type: " + instr.operands[0]);
+                if (!map) failAt(at, "placement without a map");
+                if (integer(instr, "x") < 0 || integer(instr, "x") >= integer(*map, "width") ||
+                    integer(instr, "y") < 0 || integer(instr, "y") >= integer(*map, "height")) {
+                    failAt(at, "tower placement out of map bounds");
+                }
+                break;
+            case IROpcode::DEFINE_ALIAS: {
+                bool enemy = std::get<std::string>(instr.metadata.at("kind")) == "enemy";
+                if (!(enemy ? enemies : towers).count(instr.operands[1])) {
+                    failAt(at, "alias of undefined " + std::string(enemy ? "enemy" : "tower") + ": " + instr.operands[1]);
+                }
+                break;
+            }
+            default:
+                break;
+        }
+    }
+}
+
+void JSONImporter::skipSpace() {
+    while (p < end && (*p == ' ' || *p == '\n' || *p == '\r' || *p == '\t')) p++;
+}
+
+void JSONImporter::expect(char c) {
+    skipSpace();
+    if (p >= end || *p != c) fail(std::string("expected '") + c + "'");
+    p++;
+}
+
+bool JSONImporter::consume(char c) {
+    skipSpace();
+    if (p < end && *p == c) {
+        p++;
+        return true;
+    }
+    return false;
+}
+
+// Runs without escapes are copied with one memchr per quote
+std::string JSONImporter::string() {
+    expect('"');
+    std::string s;
+    while (true) {
+        const char* quote = static_cast<const char*>(std::memchr(p, '"', end - p));
+        if (!quote) fail("unterminated string");
+        const char* escape = static_cast<const char*>(std::memchr(p, '\\', quote - p));
+        if (!escape) {
+            s.append(p, quote);
+            p = quote + 1;
+            return s;
+        }
+
+        s.append(p, escape);
+        p = escape + 1;
+        if (p >= end) fail("unterminated string");
+        switch (*p++) {
+            case '"': s += '"'; break;
+            case '\\': s += '\\'; break;
+            case '/': s += '/'; break;
+            case 'n': s += '\n'; break;
+            case 'r': s += '\r'; break;
+            case 't': s += '\t'; break;
+            case 'b': s += '\b'; break;
+            case 'f': s += '\f'; break;
+            default: fail("unsupported escape");
+        }
+    }
+}
+
+bool JSONImporter::key(std::string& name) {
+    if (consume('}')) return false;
+    name = string();
+    expect(':');
+    return true;
+}
+
+int JSONImporter::integer() {
+    skipSpace();
+    int value = 0;
+    auto result = std::from_chars(p, end, value);
+    if (result.ec != std::errc()) fail("expected integer");
+    p = result.ptr;
+    return value;
+}
+
+double JSONImporter::number() {
+    skipSpace();
+    double value = 0.0;
+    auto result = std::from_chars(p, end, value);
+    if (result.ec != std::errc()) fail("expected number");
+    p = result.ptr;
+    return value;
+}
+
+void JSONImporter::skipString() {
+    p++;
+    while (true) {
+        const char* quote = static_cast<const char*>(std::memchr(p, '"', end - p));
+        if (!quote) fail("unterminated string");
+        // A quote preceded by an odd run of backslashes is escaped
+        const char* back = quote;
+        while (back > p && back[-1] == '\\') back--;
+        p = quote + 1;
+        if ((quote - back) % 2 == 0) return;
+    }
+}
+
+// Skip any value by bracket depth; only strings need a closer look
+void JSONImporter::skipValue() {
+    skipSpace();
+    if (p >= end) fail("expected value");
+    if (*p == '"') {
+        skipString();
+        return;
+    }
+    if (*p != '{' && *p != '[') {
+        while (p < end && *p != ',' && *p != '}' && *p != ']') p++;
+        return;
+    }
+
+    int depth = 0;
+    while (p < end) {
+        char c = *p;
+        if (c == '"') {
+            skipString();
+            continue;
+        }
+        p++;
+        if (c == '{' || c == '[') depth++;
+        else if ((c == '}' || c == ']') && --depth == 0) return;
+    }
+    fail("unterminated value");
+}
+
+void JSONImporter::gameConfig() {
+    expect('{');
+    std::string name;
+    while (key(name)) {
+        if (name == "map") {
+            map();
+        } else if (name == "enemies" || name == "towers" || name == "waves" || name == "initialPlacements") {
+            expect('[');
+            while (!consume(']')) {
+                if (name == "enemies") enemy();
+                else if (name == "towers") tower();
+                else if (name == "waves") wave();
+                else placement();
+                consume(',');
+            }
+        } else if (name == "economy") {
+            economy();
+        } else if (name == "aliases") {
+            aliases();
+        } else {
+            skipValue();
+        }
+        consume(',');
+    }
+}
+
+void JSONImporter::map() {
+    IRInstruction instr(IROpcode::DEFINE_MAP);
+    std::string name;
+    skipSpace();
+    const char* at = p;
+    expect('{');
+    while (key(name)) {
+        if (name == "name") {
+            instr.operands = {string()};
+        } else if (name == "width" || name == "height") {
+            instr.metadata[name] = integer();
+        } else if (name == "path") {
+            std::string path;
+            expect('[');
+            while (!consume(']')) {
+                int x = 0;
+                int y = 0;
+                int seen = 0;
+                std::string field;
+                expect('{');
+                while (key(field)) {
+                    if (field == "x") x = integer(), seen |= 1;
+                    else if (field == "y") y = integer(), seen |= 2;
+                    else skipValue();
+                    consume(',');
+                }
+                if (seen != 3) fail("path point without \"x\" and \"y\"");
+                if (!path.empty()) path += ';';
+                path += std::to_string(x) + "," + std::to_string(y);
+                consume(',');
+            }
+            instr.metadata["path"] = path;
+        } else {
+            skipValue();
+        }
+        consume(',');
+    }
+    require(instr, {"width", "height", "path"}, at, "map");
+    emit(instr, at);
+}
+
+void JSONImporter::enemy() {
+    IRInstruction instr(IROpcode::DEFINE_ENEMY);
+    std::string name;
+    skipSpace();
+    const char* at = p;
+    expect('{');
+    while (key(name)) {
+        if (name == "name") instr.operands = {string()};
+        else if (name == "hp" || name == "reward") instr.metadata[name] = integer();
+        else if (name == "speed") instr.metadata[name] = number();
+        else skipValue();
+        consume(',');
+    }
+    require(instr, {"hp", "speed", "reward"}, at, "enemy");
+    emit(instr, at);
+}
+
+void JSONImporter::tower() {
+    IRInstruction instr(IROpcode::DEFINE_TOWER);
+    std::string name;
+    skipSpace();
+    const char* at = p;
+    expect('{');
+    while (key(name)) {
+        if (name == "name") instr.operands = {string()};
+        else if (name == "range" || name == "damage" || name == "cost") instr.metadata[name] = integer();
+        else if (name == "fireRate") instr.metadata["fire_rate"] = number();
+        else if (name == "dps") instr.metadata["dps"] = number();
+        else skipValue();
+        consume(',');
+    }
+    require(instr, {"range", "damage", "fire_rate", "cost"}, at, "tower");
+    emit(instr, at);
+}
+
+void JSONImporter::wave() {
+    IRInstruction instr(IROpcode::DEFINE_WAVE);
+    std::vector<IRInstruction> spawns;
+    std::vector<const char*> spawnOrigins;
+    bool listed = false;
+    std::string name;
+    skipSpace();
+    const char* at = p;
+    expect('{');
+    while (key(name)) {
+        if (name == "name") {
+            instr.operands = {string()};
+        } else if (name == "alias") {
+            instr.metadata["alias"] = string();
+        } else if (name == "spawns") {
+            listed = true;
+            expect('[');
+            while (!consume(']')) {
+                IRInstruction spawn(IROpcode::SPAWN_ENEMY);
+                std::string field;
+                skipSpace();
+                spawnOrigins.push_back(p);
+                expect('{');
+                while (key(field)) {
+                    if (field == "enemyType") spawn.operands = {string()};
+                    else if (field == "count" || field == "start" || field == "interval") spawn.metadata[field] = integer();
+                    else skipValue();
+                    consume(',');
+                }
+                require(spawn, {"count", "start", "interval"}, spawnOrigins.back(), "spawn");
+                spawns.push_back(spawn);
+                consume(',');
+            }
+        } else {
+            skipValue();
+        }
+        consume(',');
+    }
+
+    // Spawns name their wave, which may come after the spawn list
+    require(instr, {}, at, "wave");
+    if (!listed && !instr.metadata.count("alias")) failAt(at, "wave " + instr.operands[0] + " without \"spawns\"");
+    emit(instr, at);
+    for (size_t i = 0; i < spawns.size(); i++) {
+        spawns[i].operands.insert(spawns[i].operands.begin(), instr.operands[0]);
+        emit(spawns[i], spawnOrigins[i]);
+    }
+}
+
+void JSONImporter::placement() {
+    IRInstruction instr(IROpcode::PLACE_TOWER);
+    std::string name;
+    skipSpace();
+    const char* at = p;
+    expect('{');
+    while (key(name)) {
+        if (name == "towerType") instr.operands = {string()};
+        else if (name == "x" || name == "y") instr.metadata[name] = integer();
+        else skipValue();
+        consume(',');
+    }
+    if (instr.operands.empty()) failAt(at, "placement without \"towerType\"");
+    require(instr, {"x", "y"}, at, "placement of");
+    emit(instr, at);
+}
+
+void JSONImporter::aliases() {
+    std::string group;
+    expect('{');
+    while (key(group)) {
+        // Folded waves already carry their alias in the waves section
+        if (group != "enemies" && group != "towers") {
+            skipValue();
+            consume(',');
+            continue;
+        }
+        std::string name;
+        expect('{');
+        skipSpace();
+        const char* at = p;
+        while (key(name)) {
+            IRInstruction instr(IROpcode::DEFINE_ALIAS);
+            instr.operands = {name, string()};
+            instr.metadata["kind"] = std::string(group == "enemies" ? "enemy" : "tower");
+            emit(instr, at);
+            skipSpace();
+            at = p;
+            consume(',');
+        }
+        consume(',');
+    }
+}
+
+void JSONImporter::economy() {
+    std::string name;
+    expect('{');
+    while (key(name)) {
+        if (name == "startingGold") gold = integer();
+        else skipValue();
+        consume(',');
+    }
+}
+
+bool JSONImporter::verify(const std::string& source, const CompileOptions& options, std::ostream& log) {
+    CompileOptions jsonOptions = options;
+    jsonOptions.readable = false;
+    Compiler compiler(jsonOptions);
+    std::string json = compiler.compile(source);
+
+    JSONImporter importer;
+    std::vector<IRInstruction> ir = importer.import(json);
+    CodeGenerator codeGen;
+    codeGen.setStartingGold(importer.startingGold());
+    if (codeGen.generateJSON(ir) != json) {
+        log << "  MISMATCH: re-generated JSON differs from the original\n";
+        return false;
+    }
+
+    // Broken edits of the output must be rejected, not crash later phases
+    const std::pair<const char*, const char*> edits[] = {
+        {"damage", nullptr}, {"interval", "-100000000"}, {"enemyType", "\"Nobody\""},
+        {"count", "0"}, {"x", "100000"}, {"hp", "\"tough\""},
+    };
+    size_t rejected = 0;
+    for (const auto& e : edits) {
+        std::string field = std::string("\"") + e.first + "\": ";
+        size_t at = json.find(field);
+        if (at == std::string::npos) continue;
+        size_t to = json.find_first_of(",\n}", at + field.size());
+        std::string broken = json;
+        if (e.second) broken.replace(at + field.size(), to - at - field.size(), e.second);
+        else broken.erase(at, to + 1 - at);
+        try {
+            importer.import(broken);
+            log << "  MISMATCH: import accepted a config with a broken \"" << e.first << "\"\n";
+            return false;
+        } catch (const std::runtime_error& error) {
+            if (std::string(error.what()).find(" at line ") == std::string::npos) {
+                log << "  MISMATCH: no line number in \"" << error.what() << "\"\n";
+                return false;
+            }
+            rejected++;
+        }
+    }
+
+    // Import alone, repeated long enough to time
+    size_t rounds = 0;
+    auto start = std::chrono::steady_clock::now();
+    double seconds = 0.0;
+    do {
+        importer.import(json);
+        rounds++;
+        seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    } while (seconds < 0.2);
+
+    log << "  Round trip matched (" << ir.size() << " instructions, " << json.size() << " bytes, "
+        << rejected << " broken edits rejected); import runs at "
+        << static_cast<long long>(json.size() * rounds / seconds / (1024 * 1024)) << " MB/s.\n";
+    return true;
+}
@@ -0,0 +1,72 @@
+#ifndef IMPORTER_H
+#define IMPORTER_H
+
+#include "ir.h"
+#include <string>
+#include <vector>
+#include <ostream>
+#include <initializer_list>
+
+struct CompileOptions;
+
+// Front end for JSON in the "gameConfig" shape CodeGenerator::generateJSON
+// writes. The parser knows the schema, so it walks the document once and
+// emits IR directly: no DOM, no per-token allocation beyond the names and
+// metadata it keeps. Derived sections (combatMatrix, economy tables) and
+// unknown keys are skipped with memchr-driven scanning. Every schema field
+// must be present, and the result gets the same checks SemanticAnalyzer
+// applies to source: defined references, positive stats and spawn
+// parameters, placements and path inside the map. Throws
+// std::runtime_error with a line number on malformed or invalid input.
+//
+// Imported values are what the JSON holds, so fractional stats are the
+// two-decimal values generateJSON printed, and a serialized "dps" is kept
+// as folded metadata (re-optimizing recomputes it).
+class JSONImporter {
+public:
+    std::vector<IRInstruction> import(const std::string& json);
+
+    // economy.startingGold of the last import (0 when absent)
+    int startingGold() const { return gold; }
+
+    // Compile `source`, import the JSON and check generateJSON reproduces
+    // it byte for byte, and that broken edits of it are rejected; also
+    // reports import throughput
+    static bool verify(const std::string& source, const CompileOptions& options, std::ostream& log);
+
+private:
+    const char* begin = nullptr;
+    const char* p = nullptr;
+    const char* end = nullptr;
+    int gold = 0;
+    std::vector<IRInstruction> out;
+    std::vector<const char*> origins;   // Where each instruction of `out` starts
+
+    [[noreturn]] void fail(const std::string& what) const;
+    [[noreturn]] void failAt(const char* at, const std::string& what) const;
+    void emit(const IRInstruction& instr, const char* at);
+    void require(const IRInstruction& instr, std::initializer_list<const char*> fields, const char* at,
+                 const std::string& what) const;
+    void check() const;
+    void skipSpace();
+    void expect(char c);
+    bool consume(char c);
+
+    std::string string();
+    bool key(std::string& name);      // false at the closing brace
+    int integer();
+    double number();
+    void skipString();
+    void skipValue();
+
+    void gameConfig();
+    void map();
+    void enemy();
+    void tower();
+    void wave();
+    void placement();
+    void economy();
+    void aliases();
+};
+
+#endif // IMPORTER_H
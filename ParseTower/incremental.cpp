@@ -0,0 +1,246 @@
+#include "incremental.h"
+#include "semantic.h"
+#include <set>
+#include <cctype>
+#include <stdexcept>
+#include <charconv>
+
+IncrementalCompiler::IncrementalCompiler(const CompileOptions& opts)
+    : options(opts), lexer(""), parser(lexer),
+      sections(SECTION_COUNT), sectionKeys(SECTION_COUNT) {
+    optimizer.setVerbose(false);
+    optimizer.setSmoothing(options.smoothTicks);
+    codeGen.setStartingGold(options.startingGold);
+}
+
+std::string IncrementalCompiler::compile(const std::string& source) {
+    stats = Stats();
+
+    lexer.reset(source);
+    parser.reset();
+    std::shared_ptr<Program> ast = parser.parseProgram();
+    const auto& decls = ast->declarations;
+    stats.declarations = decls.size();
+
+    // Dependency keys, computed in declaration order like the analyzer runs
+    std::vector<std::string> texts;
+    std::vector<std::string> keys;
+    std::vector<bool> validate;
+    std::set<std::string> enemiesSoFar;
+    std::set<std::string> towersSoFar;
+    std::string currentMapText;
+
+    for (const auto& decl : decls) {
+        // Folded constants are part of what the text means
+        std::string text = source.substr(decl->sourceBegin, decl->sourceEnd - decl->sourceBegin);
+        text += '\0';
+        text += decl->constants;
+        std::string key = text;
+        key += '\0';
+
+        if (dynamic_cast<MapDecl*>(decl.get())) {
+            currentMapText = text;
+        } else if (auto e = dynamic_cast<EnemyDecl*>(decl.get())) {
+            enemiesSoFar.insert(e->name);
+        } else if (auto t = dynamic_cast<TowerDecl*>(decl.get())) {
+            towersSoFar.insert(t->name);
+        } else if (auto w = dynamic_cast<WaveDecl*>(decl.get())) {
+            for (const auto& s : w->spawns) key += enemiesSoFar.count(s.enemyType) ? '1' : '0';
+        } else if (auto p = dynamic_cast<PlaceStmt*>(decl.get())) {
+            key += towersSoFar.count(p->towerType) ? '1' : '0';
+            key += currentMapText;
+        }
+
+        bool dirty = !validated.count(key);
+        if (dirty) stats.validated++;
+        validate.push_back(dirty);
+        texts.push_back(text);
+        keys.push_back(key);
+    }
+
+    SemanticAnalyzer analyzer;
+    analyzer.analyze(ast, validate);
+
+    validated.clear();
+    validated.insert(keys.begin(), keys.end());
+
+    // Reuse or regenerate each declaration's IR
+    for (auto& entry : fragments) entry.second.used = false;
+
+    std::vector<Fragment*> ordered;
+    for (size_t i = 0; i < decls.size(); i++) {
+        Fragment& fragment = fragments[texts[i]];
+        if (fragment.version == 0) {
+            std::vector<IRInstruction> ir = irGen.generateDeclaration(decls[i].get());
+            fragment.ir = options.optimize ? optimizer.optimizeLocal(ir) : ir;
+            fragment.version = nextVersion++;
+            stats.regenerated++;
+
+            const ASTNode* node = decls[i].get();
+            if (dynamic_cast<const MapDecl*>(node)) fragment.kind = KIND_MAP;
+            else if (dynamic_cast<const EnemyDecl*>(node)) fragment.kind = KIND_ENEMY;
+            else if (dynamic_cast<const TowerDecl*>(node)) fragment.kind = KIND_TOWER;
+            else if (dynamic_cast<const WaveDecl*>(node)) fragment.kind = KIND_WAVE;
+            else if (dynamic_cast<const ConstDecl*>(node)) fragment.kind = KIND_CONST;
+            else fragment.kind = KIND_PLACE;
+
+            for (const auto& instr : fragment.ir) {
+                if (instr.opcode == IROpcode::SPAWN_ENEMY) fragment.refs.push_back(instr.operands[1]);
+                if (instr.opcode == IROpcode::PLACE_TOWER) fragment.refs.push_back(instr.operands[0]);
+            }
+        }
+        fragment.used = true;
+        ordered.push_back(&fragment);
+    }
+
+    for (auto it = fragments.begin(); it != fragments.end(); ) {
+        if (it->second.used) ++it;
+        else it = fragments.erase(it);
+    }
+
+    // Whole-program passes over the cached fragments
+    std::vector<IRInstruction> ir;
+    std::string kindKeys[KIND_COUNT];
+    std::set<std::string> enemyRefs;
+    std::set<std::string> towerRefs;
+
+    for (const Fragment* fragment : ordered) {
+        ir.insert(ir.end(), fragment->ir.begin(), fragment->ir.end());
+        kindKeys[fragment->kind] += std::to_string(fragment->version) + ",";
+        auto& refs = fragment->kind == KIND_WAVE ? enemyRefs : towerRefs;
+        refs.insert(fragment->refs.begin(), fragment->refs.end());
+    }
+
+    optimizedIR = options.optimize ? optimizer.optimizeGlobal(ir) : ir;
+    program = ast;
+
+    if (options.readable) {
+        stats.sections = SECTION_COUNT;
+        return codeGen.generateReadable(optimizedIR);
+    }
+
+    // DCE liveness decides which definitions the sections contain
+    if (options.optimize) {
+        kindKeys[KIND_ENEMY] += "|";
+        for (const auto& name : enemyRefs) kindKeys[KIND_ENEMY] += name + ",";
+        kindKeys[KIND_TOWER] += "|";
+        for (const auto& name : towerRefs) kindKeys[KIND_TOWER] += name + ",";
+    }
+
+    const std::string& map = kindKeys[KIND_MAP];
+    const std::string& enemies = kindKeys[KIND_ENEMY];
+    const std::string& towers = kindKeys[KIND_TOWER];
+    std::string waves = kindKeys[KIND_WAVE];
+    std::string places = kindKeys[KIND_PLACE];
+
+    // Structural deduplication rewrites spawns and placements through aliases
+    if (options.optimize) {
+        waves += "#" + enemies;
+        places += "#" + towers;
+    }
+
+    std::string sectionInputs[SECTION_COUNT];
+    sectionInputs[SECTION_MAP] = map;
+    sectionInputs[SECTION_ENEMIES] = enemies;
+    sectionInputs[SECTION_TOWERS] = towers;
+    sectionInputs[SECTION_WAVES] = waves;
+    sectionInputs[SECTION_PLACEMENTS] = places;
+    sectionInputs[SECTION_COMBAT_MATRIX] = map + "#" + enemies + "#" + towers + "#" + places;
+    sectionInputs[SECTION_ECONOMY] = enemies + "#" + towers + "#" + waves + "#" + places;
+    sectionInputs[SECTION_CAPACITY_HINTS] = map + "#" + enemies + "#" + waves;
+    sectionInputs[SECTION_ALIASES] = enemies + "#" + towers + "#" + waves;
+
+    for (int s = 0; s < SECTION_COUNT; s++) {
+        // Version 0 is never issued, so the first compile renders everything
+        std::string key = "v" + sectionInputs[s];
+        if (key == sectionKeys[s]) continue;
+        sections[s] = codeGen.generateSection(optimizedIR, static_cast<JSONSection>(s));
+        sectionKeys[s] = key;
+        stats.sections++;
+    }
+
+    return codeGen.assembleJSON(sections);
+}
+
+namespace {
+
+// Add one to the first (or last) integer literal in `text`
+std::string bumpNumber(const std::string& text, bool last) {
+    size_t end = std::string::npos;
+    size_t begin = std::string::npos;
+
+    for (size_t i = 0; i < text.size(); i++) {
+        if (!std::isdigit(static_cast<unsigned char>(text[i]))) continue;
+        size_t j = i;
+        while (j < text.size() && std::isdigit(static_cast<unsigned char>(text[j]))) j++;
+        bool partOfName = i > 0 && (std::isalpha(static_cast<unsigned char>(text[i - 1])) || text[i - 1] == '_');
+        bool partOfFloat = (j < text.size() && text[j] == '.') || (i > 0 && text[i - 1] == '.');
+        if (!partOfName && !partOfFloat) {
+            begin = i;
+            end = j;
+            if (!last) break;
+        }
+        i = j;
+    }
+
+    if (begin == std::string::npos) return text;
+    long long value = 0;
+    std::from_chars(text.data() + begin, text.data() + end, value);
+    std::string number = std::to_string(value + 1);
+    return text.substr(0, begin) + number + text.substr(end);
+}
+
+std::string compileOrError(const std::string& source, const CompileOptions& options) {
+    Compiler clean(options);
+    try {
+        return clean.compile(source);
+    } catch (const std::exception& e) {
+        return std::string("error: ") + e.what();
+    }
+}
+
+}
+
+bool IncrementalCompiler::verify(const std::string& source, const CompileOptions& options, std::ostream& log) {
+    // Spans of the original declarations drive the edit script
+    Lexer lexer(source);
+    Parser parser(lexer);
+    std::shared_ptr<Program> original = parser.parseProgram();
+
+    std::vector<std::pair<std::string, std::string>> steps;
+    steps.push_back({"initial", source});
+    for (size_t i = 0; i < original->declarations.size(); i++) {
+        const auto& decl = original->declarations[i];
+        std::string before = source.substr(0, decl->sourceBegin);
+        std::string text = source.substr(decl->sourceBegin, decl->sourceEnd - decl->sourceBegin);
+        std::string after = source.substr(decl->sourceEnd);
+        std::string label = "declaration " + std::to_string(i + 1);
+
+        steps.push_back({label + ": bump first number", before + bumpNumber(text, false) + after});
+        steps.push_back({label + ": bump last number", before + bumpNumber(text, true) + after});
+        steps.push_back({label + ": delete", before + after});
+        steps.push_back({label + ": restore", source});
+    }
+
+    IncrementalCompiler incremental(options);
+    size_t reused = 0;
+    for (const auto& step : steps) {
+        std::string expected = compileOrError(step.second, options);
+        std::string actual;
+        try {
+            actual = incremental.compile(step.second);
+            reused += incremental.lastStats().declarations - incremental.lastStats().regenerated;
+        } catch (const std::exception& e) {
+            actual = std::string("error: ") + e.what();
+        }
+
+        if (actual != expected) {
+            log << "  MISMATCH at step '" << step.first << "'\n";
+            return false;
+        }
+    }
+
+    log << "  Incremental output matched clean compiles in " << steps.size()
+        << " edit steps (" << reused << " declarations reused).\n";
+    return true;
+}
@@ -1,72 +1,207 @@
 #include "ir.h"
 #include <sstream>
+#include <cstdlib>
+#include <cctype>
+
+namespace {
+
+const char* const SPAWN_FIELDS[3] = {"count", "start", "interval"};
+
+// A repeat block resolved to plain arrays: a nested block (spawn == nullptr)
+// or a spawn with its per-counter steps, outermost counter first
+struct RepeatOp {
+    const IRInstruction* spawn = nullptr;
+    int times = 0;
+    size_t end = 0;     // Nested block: one past its last body op
+    int base[3] = {0, 0, 0};
+    std::vector<int> steps[3];
+};
+
+}
 
 std::vector<IRInstruction> IRGenerator::generate(std::shared_ptr<Program> program) {
     code.clear(); // Clear previous IR
 
     for (const auto& decl : program->declarations) {
+        emitDeclaration(decl.get());
+    }
 
-        if (auto m = dynamic_cast<MapDecl*>(decl.get())) {
-            IRInstruction instr(IROpcode::DEFINE_MAP);
-            instr.operands.push_back(m->name);
-            instr.metadata["width"] = m->width;
-            instr.metadata["height"] = m->height;
-            
-            // Store path as metadata
-            std::stringstream pathStr;
-            for (size_t i = 0; i < m->path.size(); i++) {
-                pathStr << m->path[i].first << "," << m->path[i].second;
-                if (i + 1 < m->path.size()) pathStr << ";";
-            }
-            instr.metadata["path"] = pathStr.str();
-            emit(instr);
-        }
+    return code;
+}
 
-        else if (auto e = dynamic_cast<EnemyDecl*>(decl.get())) {
-            IRInstruction instr(IROpcode::DEFINE_ENEMY);
-            instr.operands.push_back(e->name);
-            instr.metadata["hp"] = e->hp;
-            instr.metadata["speed"] = e->speed;
-            instr.metadata["reward"] = e->reward;
-            emit(instr);
-        }
+std::vector<IRInstruction> IRGenerator::generateDeclaration(const ASTNode* decl) {
+    code.clear();
+    emitDeclaration(decl);
+    return code;
+}
 
-        else if (auto t = dynamic_cast<TowerDecl*>(decl.get())) {
-            IRInstruction instr(IROpcode::DEFINE_TOWER);
-            instr.operands.push_back(t->name);
-            instr.metadata["range"] = t->range;
-            instr.metadata["damage"] = t->damage;
-            instr.metadata["fire_rate"] = t->fire_rate;
-            instr.metadata["cost"] = t->cost;
-            emit(instr);
+void IRGenerator::emitDeclaration(const ASTNode* decl) {
+    if (auto m = dynamic_cast<const MapDecl*>(decl)) {
+        IRInstruction instr(IROpcode::DEFINE_MAP);
+        instr.operands.push_back(m->name);
+        instr.metadata["width"] = m->width;
+        instr.metadata["height"] = m->height;
+        
+        // Store path as metadata
+        std::stringstream pathStr;
+        for (size_t i = 0; i < m->path.size(); i++) {
+            pathStr << m->path[i].first << "," << m->path[i].second;
+            if (i + 1 < m->path.size()) pathStr << ";";
         }
+        instr.metadata["path"] = pathStr.str();
+        emit(instr);
+    }
+
+    else if (auto e = dynamic_cast<const EnemyDecl*>(decl)) {
+        IRInstruction instr(IROpcode::DEFINE_ENEMY);
+        instr.operands.push_back(e->name);
+        instr.metadata["hp"] = e->hp;
+        instr.metadata["speed"] = e->speed;
+        instr.metadata["reward"] = e->reward;
+        emit(instr);
+    }
+
+    else if (auto t = dynamic_cast<const TowerDecl*>(decl)) {
+        IRInstruction instr(IROpcode::DEFINE_TOWER);
+        instr.operands.push_back(t->name);
+        instr.metadata["range"] = t->range;
+        instr.metadata["damage"] = t->damage;
+        instr.metadata["fire_rate"] = t->fire_rate;
+        instr.metadata["cost"] = t->cost;
+        emit(instr);
+    }
+
+    else if (auto w = dynamic_cast<const WaveDecl*>(decl)) {
+        IRInstruction instr(IROpcode::DEFINE_WAVE);
+        instr.operands.push_back(w->name);
+        emit(instr);
+        
+        size_t spawn = 0;
+        size_t repeat = 0;
+        std::vector<std::string> variables;
+        emitSpawns(w, -1, spawn, repeat, variables);
+    }
+
+    else if (auto p = dynamic_cast<const PlaceStmt*>(decl)) {
+        IRInstruction instr(IROpcode::PLACE_TOWER);
+        instr.operands.push_back(p->towerType);
+        instr.metadata["x"] = p->x;
+        instr.metadata["y"] = p->y;
+        emit(instr);
+    }
+}
+
+// Emits the body of `block` (the wave itself for -1). Blocks are stored in
+// opening order, so the next unopened one is always wave->repeats[repeat].
+void IRGenerator::emitSpawns(const WaveDecl* wave, int block, size_t& spawn, size_t& repeat,
+                             std::vector<std::string>& variables) {
+    size_t end = block < 0 ? wave->spawns.size() : wave->repeats[block].endSpawn;
+
+    while (true) {
+        if (repeat < wave->repeats.size() && wave->repeats[repeat].parent == block &&
+            wave->repeats[repeat].firstSpawn == spawn) {
+            const RepeatBlock& r = wave->repeats[repeat];
+            IRInstruction begin(IROpcode::REPEAT_BEGIN);
+            begin.operands.push_back(wave->name);
+            begin.operands.push_back(r.variable);
+            begin.metadata["times"] = r.times;
+            emit(begin);
 
-        else if (auto w = dynamic_cast<WaveDecl*>(decl.get())) {
-            IRInstruction instr(IROpcode::DEFINE_WAVE);
-            instr.operands.push_back(w->name);
-            emit(instr);
-            
-            for (const auto& s : w->spawns) {
-                IRInstruction spawnInstr(IROpcode::SPAWN_ENEMY);
-                spawnInstr.operands.push_back(w->name);
-                spawnInstr.operands.push_back(s.enemyType);
-                spawnInstr.metadata["count"] = s.count;
-                spawnInstr.metadata["start"] = s.start;
-                spawnInstr.metadata["interval"] = s.interval;
-                emit(spawnInstr);
+            int child = static_cast<int>(repeat++);
+            variables.push_back(r.variable);
+            emitSpawns(wave, child, spawn, repeat, variables);
+            variables.pop_back();
+
+            IRInstruction close(IROpcode::REPEAT_END);
+            close.operands.push_back(wave->name);
+            emit(close);
+        } else if (spawn < end) {
+            const SpawnStmt& s = wave->spawns[spawn++];
+            IRInstruction spawnInstr(IROpcode::SPAWN_ENEMY);
+            spawnInstr.operands.push_back(wave->name);
+            spawnInstr.operands.push_back(s.enemyType);
+            spawnInstr.metadata["count"] = s.count;
+            spawnInstr.metadata["start"] = s.start;
+            spawnInstr.metadata["interval"] = s.interval;
+
+            const std::vector<int>* steps[3] = {&s.countSteps, &s.startSteps, &s.intervalSteps};
+            for (int f = 0; f < 3; f++) {
+                for (size_t k = 0; k < steps[f]->size(); k++) {
+                    if ((*steps[f])[k] != 0) {
+                        spawnInstr.metadata[std::string(SPAWN_FIELDS[f]) + "_step_" + variables[k]] = (*steps[f])[k];
+                    }
+                }
             }
+            emit(spawnInstr);
+        } else {
+            break;
         }
+    }
+}
 
-        else if (auto p = dynamic_cast<PlaceStmt*>(decl.get())) {
-            IRInstruction instr(IROpcode::PLACE_TOWER);
-            instr.operands.push_back(p->towerType);
-            instr.metadata["x"] = p->x;
-            instr.metadata["y"] = p->y;
-            emit(instr);
+size_t IRGenerator::expandRepeat(const std::vector<IRInstruction>& instructions, size_t index,
+                                 const SpawnVisitor& visit) {
+    // Resolve the block once so the walk below does no metadata lookups
+    std::vector<RepeatOp> ops;
+    std::vector<std::string> variables;
+    std::vector<size_t> open;
+    size_t i = index;
+    for (; i < instructions.size(); i++) {
+        const IRInstruction& instr = instructions[i];
+        if (instr.opcode == IROpcode::REPEAT_BEGIN) {
+            RepeatOp op;
+            op.times = std::get<int>(instr.metadata.at("times"));
+            open.push_back(ops.size());
+            ops.push_back(op);
+            variables.push_back(instr.operands[1]);
+        } else if (instr.opcode == IROpcode::REPEAT_END) {
+            ops[open.back()].end = ops.size();
+            open.pop_back();
+            variables.pop_back();
+            if (open.empty()) break;
+        } else if (instr.opcode == IROpcode::SPAWN_ENEMY) {
+            RepeatOp op;
+            op.spawn = &instr;
+            for (int f = 0; f < 3; f++) {
+                op.base[f] = std::get<int>(instr.metadata.at(SPAWN_FIELDS[f]));
+                op.steps[f].assign(variables.size(), 0);
+                for (size_t k = 0; k < variables.size(); k++) {
+                    auto step = instr.metadata.find(std::string(SPAWN_FIELDS[f]) + "_step_" + variables[k]);
+                    if (step != instr.metadata.end()) op.steps[f][k] = std::get<int>(step->second);
+                }
+            }
+            ops.push_back(op);
         }
     }
+    if (ops.empty()) return i;
 
-    return code;
+    std::vector<int> counters;
+    std::function<void(size_t)> run = [&](size_t b) {
+        const RepeatOp& block = ops[b];
+        size_t depth = counters.size();
+        counters.push_back(0);
+        for (int n = 0; n < block.times; n++) {
+            counters[depth] = n;
+            for (size_t j = b + 1; j < block.end; ) {
+                const RepeatOp& op = ops[j];
+                if (!op.spawn) {
+                    run(j);
+                    j = op.end;
+                    continue;
+                }
+                int value[3];
+                for (int f = 0; f < 3; f++) {
+                    value[f] = op.base[f];
+                    for (size_t k = 0; k < op.steps[f].size(); k++) value[f] += op.steps[f][k] * counters[k];
+                }
+                visit(*op.spawn, value[0], value[1], value[2]);
+                j++;
+            }
+        }
+        counters.pop_back();
+    };
+    run(0);
+    return i;
 }
 
 std::vector<std::string> IRGenerator::toString(const std::vector<IRInstruction>& instructions) {
@@ -110,16 +245,36 @@ std::vector<std::string> IRGenerator::toString(const std::vector<IRInstruction>&
                 
             case IROpcode::DEFINE_WAVE:
                 ss << "DEFINE_WAVE " << instr.operands[0];
+                if (instr.metadata.count("alias"))
+                    ss << " ALIAS=" << std::get<std::string>(instr.metadata.at("alias"));
                 break;
                 
             case IROpcode::SPAWN_ENEMY:
                 ss << "  SPAWN_ENEMY " << instr.operands[1] << " IN_WAVE=" << instr.operands[0];
-                if (instr.metadata.count("count"))
-                    ss << " COUNT=" << std::get<int>(instr.metadata.at("count"));
-                if (instr.metadata.count("start"))
-                    ss << " START=" << std::get<int>(instr.metadata.at("start"));
-                if (instr.metadata.count("interval"))
-                    ss << " INTERVAL=" << std::get<int>(instr.metadata.at("interval"));
+                for (const char* field : SPAWN_FIELDS) {
+                    if (!instr.metadata.count(field)) continue;
+                    std::string name = field;
+                    for (auto& c : name) c = static_cast<char>(toupper(c));
+                    ss << " " << name << "=" << std::get<int>(instr.metadata.at(field));
+
+                    // Progressions inside repeat blocks, e.g. COUNT=5+2*i
+                    std::string prefix = std::string(field) + "_step_";
+                    for (auto it = instr.metadata.lower_bound(prefix);
+                         it != instr.metadata.end() && it->first.compare(0, prefix.size(), prefix) == 0; ++it) {
+                        int step = std::get<int>(it->second);
+                        ss << (step < 0 ? "-" : "+") << std::abs(step) << "*" << it->first.substr(prefix.size());
+                    }
+                }
+                break;
+
+            case IROpcode::REPEAT_BEGIN:
+                ss << "  REPEAT " << instr.operands[1] << " IN_WAVE=" << instr.operands[0];
+                if (instr.metadata.count("times"))
+                    ss << " TIMES=" << std::get<int>(instr.metadata.at("times"));
+                break;
+
+            case IROpcode::REPEAT_END:
+                ss << "  END_REPEAT IN_WAVE=" << instr.operands[0];
                 break;
                 
             case IROpcode::PLACE_TOWER:
@@ -129,6 +284,12 @@ std::vector<std::string> IRGenerator::toString(const std::vector<IRInstruction>&
                 if (instr.metadata.count("y"))
                     ss << " Y=" << std::get<int>(instr.metadata.at("y"));
                 break;
+
+            case IROpcode::DEFINE_ALIAS:
+                ss << "DEFINE_ALIAS " << instr.operands[0] << " = " << instr.operands[1];
+                if (instr.metadata.count("kind"))
+                    ss << " KIND=" << std::get<std::string>(instr.metadata.at("kind"));
+                break;
                 
             case IROpcode::NOP:
                 ss << "NOP";
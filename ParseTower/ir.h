@@ -7,6 +7,7 @@
 #include <memory>
 #include <variant>
 #include <map>
+#include <functional>
 
 // IR Instruction types
 enum class IROpcode {
@@ -15,7 +16,10 @@ enum class IROpcode {
     DEFINE_TOWER,
     DEFINE_WAVE,
     SPAWN_ENEMY,
+    REPEAT_BEGIN,   // [wave, variable], times; SPAWN_ENEMY inside carry <field>_step_<variable>
+    REPEAT_END,     // [wave]
     PLACE_TOWER,
+    DEFINE_ALIAS,   // [alias, canonical], kind "enemy" or "tower"; folded duplicate definition
     SET_VALUE,
     LOAD_CONST,
     NOP  // No operation (for dead code elimination)
@@ -31,19 +35,34 @@ struct IRInstruction {
     IRInstruction(IROpcode op) : opcode(op) {}
 };
 
+// Receives one concrete spawn of an expanded repeat block
+using SpawnVisitor = std::function<void(const IRInstruction& spawn, int count, int start, int interval)>;
+
 class IRGenerator {
 public:
     // Generate intermediate code from AST
     std::vector<IRInstruction> generate(std::shared_ptr<Program> program);
     
+    // Generate the instructions of a single top-level declaration
+    std::vector<IRInstruction> generateDeclaration(const ASTNode* decl);
+    
     // Convert IR instructions to readable format
     std::vector<std::string> toString(const std::vector<IRInstruction>& instructions);
 
+    // Expand the repeat block opening at `index` in body order, without
+    // materialising it. Returns the index of the matching REPEAT_END.
+    static size_t expandRepeat(const std::vector<IRInstruction>& instructions, size_t index,
+                               const SpawnVisitor& visit);
+
 private:
     std::vector<IRInstruction> code;
     
     // Add an instruction to the IR
     void emit(const IRInstruction& instr) { code.push_back(instr); }
+    
+    void emitDeclaration(const ASTNode* decl);
+    void emitSpawns(const WaveDecl* wave, int block, size_t& spawn, size_t& repeat,
+                    std::vector<std::string>& variables);
 };
 
 #endif // IR_H
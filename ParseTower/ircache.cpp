@@ -0,0 +1,403 @@
+#include "ircache.h"
+#include "driver.h"
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <algorithm>
+#include <cstring>
+#include <thread>
+#include <functional>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+namespace fs = std::filesystem;
+
+namespace {
+
+const char MAGIC[4] = {'P', 'T', 'I', 'R'};
+const uint32_t FORMAT_VERSION = 3;
+const char* const EXTENSION = ".ptir";
+
+enum MetadataType : uint8_t { META_INT = 0, META_DOUBLE = 1, META_STRING = 2 };
+
+struct Header {
+    char magic[4];
+    uint32_t format;
+    uint64_t hash;
+    uint64_t check;
+    uint64_t payloadSize;
+    uint64_t payloadChecksum;
+    uint32_t stringCount;
+    uint32_t instructionCount;
+};
+
+uint64_t fnv1a(const char* data, size_t size, uint64_t hash) {
+    for (size_t i = 0; i < size; i++) {
+        hash ^= static_cast<unsigned char>(data[i]);
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+template <typename T>
+void put(std::string& out, T value) {
+    out.append(reinterpret_cast<const char*>(&value), sizeof(T));
+}
+
+// Bounds-checked cursor over a mapped entry
+struct Reader {
+    const char* data;
+    size_t size;
+    size_t pos = 0;
+
+    template <typename T>
+    bool get(T& value) {
+        if (size - pos < sizeof(T)) return false;
+        std::memcpy(&value, data + pos, sizeof(T));
+        pos += sizeof(T);
+        return true;
+    }
+};
+
+}
+
+IRCache::IRCache(const std::string& dir, uint64_t limit)
+    : directory(dir), maxBytes(limit) {
+    fs::create_directories(directory);
+
+    // Seed the LRU order from modification times; hits refresh them
+    std::vector<std::pair<fs::file_time_type, std::pair<std::string, uint64_t>>> found;
+    for (const auto& entry : fs::directory_iterator(directory)) {
+        if (!entry.is_regular_file() || entry.path().extension() != EXTENSION) continue;
+        found.push_back({entry.last_write_time(), {entry.path().filename().string(), entry.file_size()}});
+    }
+    std::sort(found.begin(), found.end());
+    for (const auto& f : found) touch(f.second.first, f.second.second);
+}
+
+IRCache::Key IRCache::keyFor(const std::string& source, const CompileOptions& options) {
+    std::string prefix = std::string(MAGIC, 4) + std::to_string(FORMAT_VERSION) + "|" +
+                         PARSETOWER_VERSION + "|" + (options.optimize ? "O" : "-") + "|" +
+                         std::to_string(options.smoothTicks) + "|";
+    Key key;
+    key.hash = fnv1a(prefix.data(), prefix.size(), 14695981039346656037ULL);
+    key.hash = fnv1a(source.data(), source.size(), key.hash);
+    key.check = fnv1a(prefix.data(), prefix.size(), 0x9e3779b97f4a7c15ULL);
+    key.check = fnv1a(source.data(), source.size(), key.check) ^ source.size();
+    return key;
+}
+
+std::string IRCache::pathFor(const Key& key) const {
+    char name[32];
+    snprintf(name, sizeof(name), "%016llx", static_cast<unsigned long long>(key.hash));
+    return (fs::path(directory) / (std::string(name) + EXTENSION)).string();
+}
+
+std::string IRCache::encode(const Key& key, const std::vector<IRInstruction>& instructions) {
+    // Operands, metadata keys and string values share one table
+    std::map<std::string, uint32_t> index;
+    std::vector<const std::string*> strings;
+    auto intern = [&](const std::string& s) {
+        auto it = index.find(s);
+        if (it != index.end()) return it->second;
+        uint32_t id = static_cast<uint32_t>(strings.size());
+        strings.push_back(&index.emplace(s, id).first->first);
+        return id;
+    };
+
+    std::string body;
+    for (const auto& instr : instructions) {
+        put<uint8_t>(body, static_cast<uint8_t>(instr.opcode));
+        put<uint8_t>(body, static_cast<uint8_t>(instr.operands.size()));
+        put<uint16_t>(body, static_cast<uint16_t>(instr.metadata.size()));
+        for (const auto& op : instr.operands) put<uint32_t>(body, intern(op));
+        for (const auto& meta : instr.metadata) {
+            put<uint32_t>(body, intern(meta.first));
+            if (std::holds_alternative<int>(meta.second)) {
+                put<uint8_t>(body, META_INT);
+                put<int32_t>(body, std::get<int>(meta.second));
+            } else if (std::holds_alternative<double>(meta.second)) {
+                put<uint8_t>(body, META_DOUBLE);
+                put<double>(body, std::get<double>(meta.second));
+            } else {
+                put<uint8_t>(body, META_STRING);
+                put<uint32_t>(body, intern(std::get<std::string>(meta.second)));
+            }
+        }
+    }
+
+    std::string payload;
+    for (const std::string* s : strings) {
+        put<uint32_t>(payload, static_cast<uint32_t>(s->size()));
+        payload += *s;
+    }
+    payload += body;
+
+    Header header;
+    std::memcpy(header.magic, MAGIC, 4);
+    header.format = FORMAT_VERSION;
+    header.hash = key.hash;
+    header.check = key.check;
+    header.payloadSize = payload.size();
+    header.payloadChecksum = fnv1a(payload.data(), payload.size(), 14695981039346656037ULL);
+    header.stringCount = static_cast<uint32_t>(strings.size());
+    header.instructionCount = static_cast<uint32_t>(instructions.size());
+
+    std::string out(reinterpret_cast<const char*>(&header), sizeof(header));
+    return out + payload;
+}
+
+bool IRCache::decode(const char* data, size_t size, const Key& key, std::vector<IRInstruction>& instructions) {
+    Header header;
+    if (size < sizeof(header)) return false;
+    std::memcpy(&header, data, sizeof(header));
+    if (std::memcmp(header.magic, MAGIC, 4) != 0 || header.format != FORMAT_VERSION) return false;
+    if (header.hash != key.hash || header.check != key.check) return false;
+    if (header.payloadSize != size - sizeof(header)) return false;
+
+    const char* payload = data + sizeof(header);
+    if (fnv1a(payload, header.payloadSize, 14695981039346656037ULL) != header.payloadChecksum) return false;
+
+    // Every string and instruction takes at least four bytes; larger
+    // counts are damage and must not reach reserve()
+    if (header.stringCount > header.payloadSize / 4 || header.instructionCount > header.payloadSize / 4) return false;
+
+    Reader in{payload, static_cast<size_t>(header.payloadSize)};
+    std::vector<std::string> strings;
+    strings.reserve(header.stringCount);
+    for (uint32_t i = 0; i < header.stringCount; i++) {
+        uint32_t length;
+        if (!in.get(length) || in.size - in.pos < length) return false;
+        strings.emplace_back(in.data + in.pos, length);
+        in.pos += length;
+    }
+
+    auto string = [&](std::string& out) {
+        uint32_t id;
+        if (!in.get(id) || id >= strings.size()) return false;
+        out = strings[id];
+        return true;
+    };
+
+    std::vector<IRInstruction> decoded;
+    decoded.reserve(header.instructionCount);
+    for (uint32_t i = 0; i < header.instructionCount; i++) {
+        uint8_t opcode, operandCount;
+        uint16_t metaCount;
+        if (!in.get(opcode) || !in.get(operandCount) || !in.get(metaCount)) return false;
+        if (opcode > static_cast<uint8_t>(IROpcode::NOP)) return false;
+
+        IRInstruction instr(static_cast<IROpcode>(opcode));
+        instr.operands.resize(operandCount);
+        for (auto& op : instr.operands) {
+            if (!string(op)) return false;
+        }
+        for (uint16_t m = 0; m < metaCount; m++) {
+            std::string name;
+            uint8_t type;
+            if (!string(name) || !in.get(type)) return false;
+            if (type == META_INT) {
+                int32_t v;
+                if (!in.get(v)) return false;
+                instr.metadata[name] = static_cast<int>(v);
+            } else if (type == META_DOUBLE) {
+                double v;
+                if (!in.get(v)) return false;
+                instr.metadata[name] = v;
+            } else if (type == META_STRING) {
+                std::string v;
+                if (!string(v)) return false;
+                instr.metadata[name] = v;
+            } else {
+                return false;
+            }
+        }
+        decoded.push_back(std::move(instr));
+    }
+    if (in.pos != in.size) return false;
+
+    instructions = std::move(decoded);
+    return true;
+}
+
+bool IRCache::load(const Key& key, std::vector<IRInstruction>& instructions) {
+    std::string path = pathFor(key);
+    std::string name = fs::path(path).filename().string();
+
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        std::lock_guard<std::mutex> lock(mutex);
+        counters.misses++;
+        return false;
+    }
+
+    struct stat st;
+    bool ok = false;
+    size_t size = 0;
+    if (fstat(fd, &st) == 0 && st.st_size > 0) {
+        size = static_cast<size_t>(st.st_size);
+        void* mapped = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (mapped != MAP_FAILED) {
+            ok = decode(static_cast<const char*>(mapped), size, key, instructions);
+            munmap(mapped, size);
+        }
+    }
+    if (ok) futimens(fd, nullptr);   // Keeps LRU order across runs
+    close(fd);
+
+    std::lock_guard<std::mutex> lock(mutex);
+    if (!ok) {
+        counters.misses++;
+        counters.corrupt++;
+        unlink(path.c_str());
+        forget(name);
+        return false;
+    }
+    counters.hits++;
+    counters.bytesRead += size;
+    touch(name, size);
+    return true;
+}
+
+void IRCache::store(const Key& key, const std::vector<IRInstruction>& instructions) {
+    std::string data = encode(key, instructions);
+    std::string path = pathFor(key);
+
+    // Readers only ever see a complete entry or none
+    std::ostringstream tmp;
+    tmp << path << ".tmp." << getpid() << "." << std::hash<std::thread::id>()(std::this_thread::get_id());
+    {
+        std::ofstream out(tmp.str(), std::ios::binary);
+        if (!out.is_open()) return;   // Caching is best effort
+        out.write(data.data(), static_cast<std::streamsize>(data.size()));
+        if (!out) {
+            out.close();
+            unlink(tmp.str().c_str());
+            return;
+        }
+    }
+    if (rename(tmp.str().c_str(), path.c_str()) != 0) {
+        unlink(tmp.str().c_str());
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex);
+    counters.stores++;
+    counters.bytesWritten += data.size();
+    touch(fs::path(path).filename().string(), data.size());
+    evict();
+}
+
+void IRCache::touch(const std::string& name, uint64_t size) {
+    Entry& entry = entries[name];
+    totalBytes = totalBytes - entry.size + size;
+    entry.size = size;
+    entry.lastUse = ++clock;
+}
+
+void IRCache::forget(const std::string& name) {
+    auto it = entries.find(name);
+    if (it == entries.end()) return;
+    totalBytes -= it->second.size;
+    entries.erase(it);
+}
+
+void IRCache::evict() {
+    while (totalBytes > maxBytes && !entries.empty()) {
+        auto oldest = entries.begin();
+        for (auto it = entries.begin(); it != entries.end(); ++it) {
+            if (it->second.lastUse < oldest->second.lastUse) oldest = it;
+        }
+        unlink((fs::path(directory) / oldest->first).c_str());
+        totalBytes -= oldest->second.size;
+        entries.erase(oldest);
+        counters.evictions++;
+    }
+}
+
+IRCacheStats IRCache::stats() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return counters;
+}
+
+std::string IRCache::report() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    std::ostringstream out;
+    out << "IR cache: " << counters.hits << " hit(s), " << counters.misses << " miss(es), "
+        << counters.corrupt << " corrupt, " << counters.stores << " stored, "
+        << counters.evictions << " evicted; " << entries.size() << " entries, "
+        << totalBytes / 1024 << "/" << maxBytes / 1024 << " KB in " << directory << "\n";
+    return out.str();
+}
+
+bool IRCache::verify(const std::string& source, const CompileOptions& options, std::ostream& log) {
+    CompileOptions uncached = options;
+    uncached.cache = nullptr;
+    Compiler reference(uncached);
+    std::string expected = reference.compile(source);
+
+    fs::path dir = fs::temp_directory_path() / ("parsetower-verify-cache-" + std::to_string(getpid()));
+    struct Cleanup {
+        fs::path dir;
+        ~Cleanup() {
+            std::error_code ec;
+            fs::remove_all(dir, ec);
+        }
+    } cleanup{dir};
+    std::error_code ec;
+    fs::remove_all(dir, ec);
+
+    auto compileWith = [&](IRCache& cache, const std::string& text) {
+        CompileOptions cached = options;
+        cached.cache = &cache;
+        Compiler compiler(cached);
+        return compiler.compile(text);
+    };
+    auto check = [&](bool ok, const char* what) {
+        if (!ok) log << "  MISMATCH after " << what << "\n";
+        return ok;
+    };
+
+    const uint64_t limit = 64u * 1024 * 1024;
+    IRCache cache(dir.string(), limit);
+    if (!check(compileWith(cache, source) == expected, "the first compile")) return false;
+    if (!check(compileWith(cache, source) == expected && cache.stats().hits == 1, "a cache hit")) return false;
+
+    // A flipped payload byte, then a truncated file: both recompile
+    std::string entry = cache.pathFor(keyFor(source, options));
+    uint64_t entrySize = fs::file_size(entry);
+    {
+        std::fstream file(entry, std::ios::in | std::ios::out | std::ios::binary);
+        file.seekg(static_cast<std::streamoff>(entrySize - 1));
+        char last = static_cast<char>(file.get());
+        file.seekp(static_cast<std::streamoff>(entrySize - 1));
+        file.put(static_cast<char>(last ^ 0x5a));
+    }
+    if (!check(compileWith(cache, source) == expected && cache.stats().corrupt == 1, "a corrupted entry")) {
+        return false;
+    }
+    fs::resize_file(entry, entrySize / 2);
+    if (!check(compileWith(cache, source) == expected && cache.stats().corrupt == 2, "a truncated entry")) {
+        return false;
+    }
+
+    // A later process finds what this one stored
+    IRCache reopened(dir.string(), limit);
+    if (!check(compileWith(reopened, source) == expected && reopened.stats().hits == 1, "reopening")) {
+        return false;
+    }
+
+    // Room for two entries; a comment changes the key but not the IR
+    IRCache small((dir / "small").string(), 2 * entrySize + entrySize / 2);
+    for (int i = 0; i < 4; i++) {
+        if (!check(compileWith(small, source + "\n// " + std::to_string(i)) == expected, "eviction")) return false;
+    }
+    IRCacheStats evicted = small.stats();
+    if (!check(evicted.evictions == 2 && small.totalBytes <= small.maxBytes, "eviction")) return false;
+
+    log << "  IR cache matched uncached output (hit, corrupted and truncated entries recompiled, reopened, "
+        << evicted.evictions << " of " << evicted.stores << " entries evicted; " << entrySize << " bytes per entry).\n";
+    return true;
+}
@@ -0,0 +1,80 @@
+#ifndef IRCACHE_H
+#define IRCACHE_H
+
+#include "ir.h"
+#include <string>
+#include <vector>
+#include <ostream>
+#include <map>
+#include <mutex>
+#include <cstdint>
+
+struct CompileOptions;
+
+struct IRCacheStats {
+    size_t hits = 0;
+    size_t misses = 0;
+    size_t corrupt = 0;      // Entries that failed validation and were dropped
+    size_t stores = 0;
+    size_t evictions = 0;
+    uint64_t bytesRead = 0;
+    uint64_t bytesWritten = 0;
+};
+
+// On-disk cache of optimized IR, one file per (source, compiler version,
+// options) key. Entries are mapped read-only and decoded in place; a bad
+// magic, version, key, length or checksum counts as a miss and the file is
+// removed, so a damaged cache only costs a full compile. Entries are
+// written to a temporary file and renamed, and the directory is kept under
+// its byte limit by evicting the least recently used entries. Safe to share
+// between the threads of one process.
+class IRCache {
+public:
+    IRCache(const std::string& directory, uint64_t maxBytes);
+
+    struct Key {
+        uint64_t hash = 0;     // Names the entry file
+        uint64_t check = 0;    // Second hash stored in the header
+    };
+
+    // Only options that change the IR take part; output format and
+    // starting gold are applied later by the code generator.
+    static Key keyFor(const std::string& source, const CompileOptions& options);
+
+    bool load(const Key& key, std::vector<IRInstruction>& instructions);
+    void store(const Key& key, const std::vector<IRInstruction>& instructions);
+
+    IRCacheStats stats() const;
+    std::string report() const;
+
+    // Compile `source` through a scratch cache and check hits, corrupted
+    // and truncated entries, a reopened directory and eviction all give
+    // the uncached output
+    static bool verify(const std::string& source, const CompileOptions& options, std::ostream& log);
+
+    // Binary form of an instruction list (exposed for the cache tooling)
+    static std::string encode(const Key& key, const std::vector<IRInstruction>& instructions);
+    static bool decode(const char* data, size_t size, const Key& key, std::vector<IRInstruction>& instructions);
+
+private:
+    struct Entry {
+        uint64_t size = 0;
+        uint64_t lastUse = 0;
+    };
+
+    std::string directory;
+    uint64_t maxBytes;
+
+    mutable std::mutex mutex;
+    std::map<std::string, Entry> entries;   // By file name
+    uint64_t totalBytes = 0;
+    uint64_t clock = 0;
+    IRCacheStats counters;
+
+    std::string pathFor(const Key& key) const;
+    void touch(const std::string& name, uint64_t size);
+    void forget(const std::string& name);
+    void evict();
+};
+
+#endif // IRCACHE_H
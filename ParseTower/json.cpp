@@ -0,0 +1,277 @@
+#include "json.h"
+#include <stdexcept>
+#include <sstream>
+#include <cmath>
+#include <cstdlib>
+#include <cstdio>
+
+namespace {
+
+class JsonReader {
+public:
+    explicit JsonReader(const std::string& s) : src(s) {}
+
+    JsonValue document() {
+        JsonValue v = value();
+        skipSpace();
+        if (pos != src.size()) fail("trailing characters");
+        return v;
+    }
+
+private:
+    const std::string& src;
+    size_t pos = 0;
+
+    [[noreturn]] void fail(const std::string& what) {
+        throw std::runtime_error("JSON " + what + " at offset " + std::to_string(pos));
+    }
+
+    void skipSpace() {
+        while (pos < src.size() && (src[pos] == ' ' || src[pos] == '\t' || src[pos] == '\n' || src[pos] == '\r')) pos++;
+    }
+
+    bool literal(const char* word) {
+        size_t n = std::char_traits<char>::length(word);
+        if (src.compare(pos, n, word) != 0) return false;
+        pos += n;
+        return true;
+    }
+
+    JsonValue value() {
+        skipSpace();
+        if (pos >= src.size()) fail("unexpected end");
+        char c = src[pos];
+        if (c == '{') return objectValue();
+        if (c == '[') return arrayValue();
+        if (c == '"') return JsonValue(stringValue());
+        if (literal("true")) return JsonValue(true);
+        if (literal("false")) return JsonValue(false);
+        if (literal("null")) return JsonValue();
+        if (c == '-' || (c >= '0' && c <= '9')) return numberValue();
+        fail("unexpected character");
+    }
+
+    JsonValue objectValue() {
+        JsonValue obj = JsonValue::object();
+        pos++;
+        skipSpace();
+        if (pos < src.size() && src[pos] == '}') {
+            pos++;
+            return obj;
+        }
+        while (true) {
+            skipSpace();
+            if (pos >= src.size() || src[pos] != '"') fail("expected key");
+            std::string key = stringValue();
+            skipSpace();
+            if (pos >= src.size() || src[pos] != ':') fail("expected ':'");
+            pos++;
+            obj.set(key, value());
+            skipSpace();
+            if (pos < src.size() && src[pos] == ',') { pos++; continue; }
+            if (pos < src.size() && src[pos] == '}') { pos++; return obj; }
+            fail("expected ',' or '}'");
+        }
+    }
+
+    JsonValue arrayValue() {
+        JsonValue arr = JsonValue::array();
+        pos++;
+        skipSpace();
+        if (pos < src.size() && src[pos] == ']') {
+            pos++;
+            return arr;
+        }
+        while (true) {
+            arr.push(value());
+            skipSpace();
+            if (pos < src.size() && src[pos] == ',') { pos++; continue; }
+            if (pos < src.size() && src[pos] == ']') { pos++; return arr; }
+            fail("expected ',' or ']'");
+        }
+    }
+
+    JsonValue numberValue() {
+        const char* begin = src.c_str() + pos;
+        char* end = nullptr;
+        double n = std::strtod(begin, &end);
+        if (end == begin) fail("bad number");
+        pos += static_cast<size_t>(end - begin);
+        return JsonValue(n);
+    }
+
+    void appendUtf8(std::string& out, unsigned cp) {
+        if (cp < 0x80) {
+            out += static_cast<char>(cp);
+        } else if (cp < 0x800) {
+            out += static_cast<char>(0xC0 | (cp >> 6));
+            out += static_cast<char>(0x80 | (cp & 0x3F));
+        } else if (cp < 0x10000) {
+            out += static_cast<char>(0xE0 | (cp >> 12));
+            out += static_cast<char>(0x80 | ((cp >> 6) & 0x3F));
+            out += static_cast<char>(0x80 | (cp & 0x3F));
+        } else {
+            out += static_cast<char>(0xF0 | (cp >> 18));
+            out += static_cast<char>(0x80 | ((cp >> 12) & 0x3F));
+            out += static_cast<char>(0x80 | ((cp >> 6) & 0x3F));
+            out += static_cast<char>(0x80 | (cp & 0x3F));
+        }
+    }
+
+    unsigned hex4() {
+        if (src.size() - pos < 4) fail("bad escape");
+        unsigned v = 0;
+        for (int i = 0; i < 4; i++) {
+            char h = src[pos++];
+            v <<= 4;
+            if (h >= '0' && h <= '9') v |= h - '0';
+            else if (h >= 'a' && h <= 'f') v |= h - 'a' + 10;
+            else if (h >= 'A' && h <= 'F') v |= h - 'A' + 10;
+            else fail("bad escape");
+        }
+        return v;
+    }
+
+    std::string stringValue() {
+        std::string out;
+        pos++;
+        while (true) {
+            // Copy the unescaped run in one go
+            size_t run = src.find_first_of("\"\\", pos);
+            if (run == std::string::npos) fail("unterminated string");
+            out.append(src, pos, run - pos);
+            pos = run;
+            if (src[pos] == '"') {
+                pos++;
+                return out;
+            }
+
+            pos++;
+            if (pos >= src.size()) fail("bad escape");
+            char e = src[pos++];
+            switch (e) {
+                case '"': out += '"'; break;
+                case '\\': out += '\\'; break;
+                case '/': out += '/'; break;
+                case 'b': out += '\b'; break;
+                case 'f': out += '\f'; break;
+                case 'n': out += '\n'; break;
+                case 'r': out += '\r'; break;
+                case 't': out += '\t'; break;
+                case 'u': {
+                    unsigned cp = hex4();
+                    if (cp >= 0xD800 && cp <= 0xDBFF && src.compare(pos, 2, "\\u") == 0) {
+                        pos += 2;
+                        unsigned low = hex4();
+                        cp = 0x10000 + ((cp - 0xD800) << 10) + (low - 0xDC00);
+                    }
+                    appendUtf8(out, cp);
+                    break;
+                }
+                default: fail("bad escape");
+            }
+        }
+    }
+};
+
+const JsonValue& nullValue() {
+    static const JsonValue null;
+    return null;
+}
+
+}
+
+JsonValue JsonValue::parse(const std::string& text) {
+    JsonReader reader(text);
+    return reader.document();
+}
+
+const JsonValue& JsonValue::operator[](const std::string& key) const {
+    auto it = members.find(key);
+    return it == members.end() ? nullValue() : it->second;
+}
+
+const JsonValue& JsonValue::operator[](size_t index) const {
+    return index < items.size() ? items[index] : nullValue();
+}
+
+JsonValue& JsonValue::set(const std::string& key, const JsonValue& value) {
+    kind = Type::OBJECT;
+    members[key] = value;
+    return *this;
+}
+
+JsonValue& JsonValue::push(const JsonValue& value) {
+    kind = Type::ARRAY;
+    items.push_back(value);
+    return *this;
+}
+
+std::string JsonValue::quote(const std::string& s) {
+    std::string out = "\"";
+    for (char c : s) {
+        switch (c) {
+            case '"': out += "\\\""; break;
+            case '\\': out += "\\\\"; break;
+            case '\n': out += "\\n"; break;
+            case '\r': out += "\\r"; break;
+            case '\t': out += "\\t"; break;
+            default:
+                if (static_cast<unsigned char>(c) < 0x20) {
+                    char buf[8];
+                    std::snprintf(buf, sizeof(buf), "\\u%04x", c);
+                    out += buf;
+                } else {
+                    out += c;
+                }
+        }
+    }
+    return out + "\"";
+}
+
+std::string JsonValue::dump() const {
+    std::string out;
+    dumpTo(out);
+    return out;
+}
+
+void JsonValue::dumpTo(std::string& out) const {
+    switch (kind) {
+        case Type::NUL: out += "null"; break;
+        case Type::BOOL: out += boolean ? "true" : "false"; break;
+        case Type::NUMBER: {
+            if (std::floor(num) == num && std::fabs(num) < 1e15) {
+                out += std::to_string(static_cast<long long>(num));
+            } else {
+                std::ostringstream ss;
+                ss.precision(17);
+                ss << num;
+                out += ss.str();
+            }
+            break;
+        }
+        case Type::STRING: out += quote(text); break;
+        case Type::ARRAY: {
+            out += '[';
+            for (size_t i = 0; i < items.size(); i++) {
+                if (i) out += ',';
+                items[i].dumpTo(out);
+            }
+            out += ']';
+            break;
+        }
+        case Type::OBJECT: {
+            out += '{';
+            bool first = true;
+            for (const auto& m : members) {
+                if (!first) out += ',';
+                first = false;
+                out += quote(m.first);
+                out += ':';
+                m.second.dumpTo(out);
+            }
+            out += '}';
+            break;
+        }
+    }
+}
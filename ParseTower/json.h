@@ -0,0 +1,67 @@
+#ifndef JSON_H
+#define JSON_H
+
+#include <string>
+#include <vector>
+#include <map>
+#include <memory>
+
+// Small JSON document model for protocol messages. Objects keep their keys
+// sorted; numbers are doubles. parse() throws std::runtime_error.
+class JsonValue {
+public:
+    enum class Type { NUL, BOOL, NUMBER, STRING, ARRAY, OBJECT };
+
+    JsonValue() : kind(Type::NUL) {}
+    JsonValue(bool b) : kind(Type::BOOL), boolean(b) {}
+    JsonValue(int n) : kind(Type::NUMBER), num(n) {}
+    JsonValue(size_t n) : kind(Type::NUMBER), num(static_cast<double>(n)) {}
+    JsonValue(double n) : kind(Type::NUMBER), num(n) {}
+    JsonValue(const char* s) : kind(Type::STRING), text(s) {}
+    JsonValue(const std::string& s) : kind(Type::STRING), text(s) {}
+
+    static JsonValue array() { JsonValue v; v.kind = Type::ARRAY; return v; }
+    static JsonValue object() { JsonValue v; v.kind = Type::OBJECT; return v; }
+
+    static JsonValue parse(const std::string& text);
+    std::string dump() const;
+
+    Type type() const { return kind; }
+    bool isNull() const { return kind == Type::NUL; }
+    bool isObject() const { return kind == Type::OBJECT; }
+    bool isArray() const { return kind == Type::ARRAY; }
+    bool isString() const { return kind == Type::STRING; }
+    bool isNumber() const { return kind == Type::NUMBER; }
+
+    bool asBool() const { return boolean; }
+    double asNumber() const { return num; }
+    int asInt() const { return static_cast<int>(num); }
+    const std::string& asString() const { return text; }
+
+    // Missing keys and out-of-range indices read as null
+    const JsonValue& operator[](const std::string& key) const;
+    const JsonValue& operator[](size_t index) const;
+    bool has(const std::string& key) const { return members.count(key) > 0; }
+
+    JsonValue& set(const std::string& key, const JsonValue& value);
+    JsonValue& push(const JsonValue& value);
+
+    size_t size() const { return kind == Type::ARRAY ? items.size() : members.size(); }
+    const std::vector<JsonValue>& elements() const { return items; }
+    const std::map<std::string, JsonValue>& fields() const { return members; }
+
+    // Quote and escape a string as a JSON string literal
+    static std::string quote(const std::string& s);
+
+private:
+    Type kind;
+    bool boolean = false;
+    double num = 0.0;
+    std::string text;
+    std::vector<JsonValue> items;
+    std::map<std::string, JsonValue> members;
+
+    void dumpTo(std::string& out) const;
+};
+
+#endif // JSON_H
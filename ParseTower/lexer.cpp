@@ -3,7 +3,7 @@
 #include <cctype> 
 
 Lexer::Lexer(const std::string& src)
-    : source(src), pos(0), line(1)
+    : source(src), pos(0), tokenStart(0), line(1)
 {
     keywords = {
         {"map", TokenType::MAP},
@@ -13,6 +13,8 @@ Lexer::Lexer(const std::string& src)
         {"spawn", TokenType::SPAWN},
         {"place", TokenType::PLACE},
         {"at", TokenType::AT},
+        {"repeat", TokenType::REPEAT},
+        {"const", TokenType::CONST},
         {"size", TokenType::SIZE},
         {"path", TokenType::PATH},
         {"count", TokenType::COUNT},
@@ -22,6 +24,12 @@ Lexer::Lexer(const std::string& src)
 
 }
 
+void Lexer::reset(const std::string& src, int firstLine) {
+    source.assign(src);
+    pos = 0;
+    line = firstLine;
+}
+
 char Lexer::peek() {
     return isAtEnd() ? '\0' : source[pos];
 }
@@ -48,10 +56,12 @@ void Lexer::skipWhitespace() {
     }
 }
 
+// Skips a run of comment lines, so consecutive // lines are all dropped
 void Lexer::skipComment() {
-    if (peek() == '/' && pos + 1 < source.size() && source[pos + 1] == '/') {
+    while (peek() == '/' && pos + 1 < source.size() && source[pos + 1] == '/') {
         while (!isAtEnd() && peek() != '\n')
             advance();
+        skipWhitespace();
     }
 }
 
@@ -83,11 +93,18 @@ Token Lexer::number() {
 }
 
 Token Lexer::getNextToken() {
+    Token t = scanToken();
+    t.offset = tokenStart;
+    return t;
+}
+
+Token Lexer::scanToken() {
     while (true) {
         skipWhitespace();
         skipComment();
         skipWhitespace();
 
+        tokenStart = pos;
         if (isAtEnd()) return Token(TokenType::END_OF_FILE, "", line);
 
         char c = advance();
@@ -107,6 +124,10 @@ Token Lexer::getNextToken() {
             case ',': return Token(TokenType::COMMA, ",", line);
             case ';': return Token(TokenType::SEMICOLON, ";", line);
             case '=': return Token(TokenType::EQUAL, "=", line);
+            case '+': return Token(TokenType::PLUS, "+", line);
+            case '-': return Token(TokenType::MINUS, "-", line);
+            case '*': return Token(TokenType::MUL, "*", line);
+            case '/': return Token(TokenType::DIV, "/", line);
         }
 
         return Token(TokenType::UNKNOWN, std::string(1, c), line);
@@ -115,9 +136,11 @@ Token Lexer::getNextToken() {
 
 Token Lexer::peekToken() {
     size_t oldPos = pos;
+    size_t oldStart = tokenStart;
     int oldLine = line;
     Token t = getNextToken();
     pos = oldPos;
+    tokenStart = oldStart;
     line = oldLine;
     return t;
 }
@@ -7,16 +7,29 @@
 #include <unordered_map>
 #include "token.h"
 
-class Lexer {
+// Where the parser pulls its tokens from; the last token of a source is
+// END_OF_FILE
+class TokenSource {
+    public:
+        virtual ~TokenSource() {}
+        virtual Token getNextToken() = 0;
+};
+
+class Lexer : public TokenSource {
     public:
         Lexer(const std::string& src);
 
-        Token getNextToken();
+        // Start over on new source, keeping the keyword table and buffer.
+        // firstLine numbers a fragment cut from a larger file.
+        void reset(const std::string& src, int firstLine = 1);
+
+        Token getNextToken() override;
         Token peekToken();
 
     private:
         std::string source;
         size_t pos;
+        size_t tokenStart;
         int line;
         std::unordered_map<std::string, TokenType> keywords;
 
@@ -24,6 +37,7 @@ class Lexer {
         char advance();
         bool isAtEnd();
 
+        Token scanToken();
         Token identifier();
         Token number();
         void skipWhitespace();
@@ -0,0 +1,710 @@
+#include "lsp.h"
+#include "semantic.h"
+#include "driver.h"
+#include <sstream>
+#include <iomanip>
+#include <algorithm>
+#include <cctype>
+#include <stdexcept>
+#include <random>
+#include <chrono>
+#include <charconv>
+
+LanguageServer::LanguageServer(std::istream& input, std::ostream& output)
+    : in(input), out(output), lexer(""), parser(lexer) {
+    optimizer.setVerbose(false);
+}
+
+namespace {
+
+// Bodies announced larger than this are skipped rather than buffered
+const size_t MAX_MESSAGE = 64u * 1024 * 1024;
+
+}
+
+// False only at end of input. A header block without a well-formed
+// Content-Length, or announcing more than MAX_MESSAGE, is dropped and the
+// next one read.
+bool LanguageServer::readMessage(std::string& body) {
+    const std::string header = "Content-Length:";
+    while (true) {
+        size_t length = 0;
+        bool sawHeader = false;
+        bool valid = false;
+        bool ended = false;
+        std::string line;
+        while (true) {
+            if (!std::getline(in, line)) {
+                ended = true;
+                break;
+            }
+            if (!line.empty() && line.back() == '\r') line.pop_back();
+            if (line.empty()) {
+                if (sawHeader) break;
+                continue;
+            }
+            sawHeader = true;
+            // The unread body of a dropped message runs into the next header
+            size_t at = line.find(header);
+            if (at == std::string::npos) continue;
+            const char* first = line.data() + at + header.size();
+            const char* last = line.data() + line.size();
+            while (first < last && *first == ' ') first++;
+            while (last > first && last[-1] == ' ') last--;
+            auto parsed = std::from_chars(first, last, length);
+            valid = parsed.ec == std::errc() && parsed.ptr == last && first != last;
+        }
+        if (ended) return false;
+        if (!valid) continue;
+
+        if (length > MAX_MESSAGE) {
+            in.ignore(static_cast<std::streamsize>(length));
+            if (static_cast<size_t>(in.gcount()) != length) return false;
+            continue;
+        }
+        body.assign(length, '\0');
+        in.read(&body[0], static_cast<std::streamsize>(length));
+        return static_cast<size_t>(in.gcount()) == length;
+    }
+}
+
+void LanguageServer::send(const JsonValue& message) {
+    std::string body = message.dump();
+    out << "Content-Length: " << body.size() << "\r\n\r\n" << body << std::flush;
+}
+
+void LanguageServer::reply(const JsonValue& id, const JsonValue& result) {
+    JsonValue message = JsonValue::object();
+    message.set("jsonrpc", "2.0");
+    message.set("id", id);
+    message.set("result", result);
+    send(message);
+}
+
+int LanguageServer::run() {
+    std::string body;
+    while (readMessage(body)) {
+        JsonValue message;
+        try {
+            message = JsonValue::parse(body);
+        } catch (const std::exception&) {
+            continue;   // Nothing to answer without an id
+        }
+        if (message["method"].asString() == "exit") {
+            return shutdownRequested ? 0 : 1;
+        }
+        try {
+            handle(message);
+        } catch (const std::exception&) {
+            continue;   // Malformed params; keep the session alive
+        }
+    }
+    return shutdownRequested ? 0 : 1;
+}
+
+void LanguageServer::handle(const JsonValue& message) {
+    const std::string& method = message["method"].asString();
+    const JsonValue& params = message["params"];
+    const JsonValue& id = message["id"];
+
+    if (method == "initialize") {
+        JsonValue sync = JsonValue::object();
+        sync.set("openClose", true);
+        sync.set("change", 2);   // Incremental
+
+        JsonValue capabilities = JsonValue::object();
+        capabilities.set("textDocumentSync", sync);
+        capabilities.set("definitionProvider", true);
+        capabilities.set("hoverProvider", true);
+
+        JsonValue info = JsonValue::object();
+        info.set("name", "parsetower");
+        info.set("version", PARSETOWER_VERSION);
+
+        JsonValue result = JsonValue::object();
+        result.set("capabilities", capabilities);
+        result.set("serverInfo", info);
+        reply(id, result);
+    } else if (method == "shutdown") {
+        shutdownRequested = true;
+        reply(id, JsonValue());
+    } else if (method == "textDocument/didOpen") {
+        const JsonValue& doc = params["textDocument"];
+        open(doc["uri"].asString(), doc["text"].asString());
+    } else if (method == "textDocument/didChange") {
+        const std::string& uri = params["textDocument"]["uri"].asString();
+        auto it = documents.find(uri);
+        if (it == documents.end()) return;
+        for (const auto& change : params["contentChanges"].elements()) {
+            applyChange(it->second, change);
+        }
+        publishDiagnostics(uri, it->second);
+    } else if (method == "textDocument/didClose") {
+        documents.erase(params["textDocument"]["uri"].asString());
+    } else if (method == "textDocument/definition" || method == "textDocument/hover") {
+        const std::string& uri = params["textDocument"]["uri"].asString();
+        auto it = documents.find(uri);
+        if (it == documents.end()) {
+            reply(id, JsonValue());
+        } else if (method == "textDocument/definition") {
+            reply(id, definition(it->second, uri, params["position"]));
+        } else {
+            reply(id, hover(it->second, params["position"]));
+        }
+    } else if (!id.isNull()) {
+        JsonValue error = JsonValue::object();
+        error.set("code", -32601);
+        error.set("message", "method not supported: " + method);
+        JsonValue response = JsonValue::object();
+        response.set("jsonrpc", "2.0");
+        response.set("id", id);
+        response.set("error", error);
+        send(response);
+    }
+}
+
+void LanguageServer::open(const std::string& uri, const std::string& text) {
+    Document& doc = documents[uri];
+    doc = Document();
+    doc.text = text;
+    rebuildLines(doc);
+    reparse(doc, 0, 0, static_cast<long>(text.size()));
+    publishDiagnostics(uri, doc);
+}
+
+void LanguageServer::applyChange(Document& doc, const JsonValue& change) {
+    const std::string& replacement = change["text"].asString();
+    if (!change.has("range")) {
+        size_t oldSize = doc.text.size();
+        doc.text = replacement;
+        rebuildLines(doc);
+        reparse(doc, 0, oldSize, static_cast<long>(replacement.size()) - static_cast<long>(oldSize));
+        return;
+    }
+
+    size_t begin = offsetOf(doc, change["range"]["start"]);
+    size_t end = std::max(begin, offsetOf(doc, change["range"]["end"]));
+    doc.text.replace(begin, end - begin, replacement);
+    updateLines(doc, begin, end, replacement);
+    reparse(doc, begin, end, static_cast<long>(replacement.size()) - static_cast<long>(end - begin));
+}
+
+// [editBegin, editEnd) is in pre-edit offsets and now holds editEnd -
+// editBegin + delta bytes. Every entry touching it is reparsed together
+// with the whitespace and comments up to its neighbours, so a region always
+// starts and ends on a declaration boundary.
+void LanguageServer::reparse(Document& doc, size_t editBegin, size_t editEnd, long delta) {
+    auto& entries = doc.entries;
+
+    size_t lo = std::lower_bound(entries.begin(), entries.end(), editBegin,
+                                 [](const Entry& e, size_t offset) { return e.end < offset; }) - entries.begin();
+    size_t hi = std::upper_bound(entries.begin(), entries.end(), editEnd,
+                                 [](size_t offset, const Entry& e) { return offset < e.begin; }) - entries.begin();
+    // A failed declaration's recovery runs up to the next keyword, so it may
+    // absorb text typed after it, or a run of neighbouring failures that do
+    // not start with one
+    while (lo > 0 && !entries[lo - 1].node) lo--;
+    while (hi < entries.size() && !entries[hi].node) hi++;
+
+    size_t regionBegin = lo > 0 ? entries[lo - 1].end : 0;
+    size_t oldRegionEnd = hi < entries.size() ? entries[hi].begin
+                                               : static_cast<size_t>(static_cast<long>(doc.text.size()) - delta);
+    size_t regionEnd = static_cast<size_t>(static_cast<long>(oldRegionEnd) + delta);
+
+    int firstLine = static_cast<int>(std::upper_bound(doc.lineStarts.begin(), doc.lineStarts.end(), regionBegin) -
+                                     doc.lineStarts.begin());
+    lexer.reset(doc.text.substr(regionBegin, regionEnd - regionBegin), firstLine);
+    parser.reset();
+    for (ASTNode* c : doc.constants) {
+        if (c->sourceBegin < regionBegin) parser.defineConstant(*static_cast<ConstDecl*>(c));
+    }
+    std::vector<ParseError> errors;
+    std::shared_ptr<Program> fragment = parser.parseProgram(errors);
+
+    std::vector<Entry> fresh;
+    for (const auto& decl : fragment->declarations) {
+        decl->sourceBegin += regionBegin;
+        decl->sourceEnd += regionBegin;
+        Entry e;
+        e.node = decl;
+        e.begin = decl->sourceBegin;
+        e.end = decl->sourceEnd;
+        fresh.push_back(e);
+    }
+    for (const auto& err : errors) {
+        Entry e;
+        e.begin = err.begin + regionBegin;
+        e.end = std::max(err.end, err.begin) + regionBegin;
+        // The line is re-rendered from errorOffset, which moves with edits
+        e.error = err.message.substr(0, err.message.rfind(" at line "));
+        e.errorOffset = err.offset + regionBegin;
+        fresh.push_back(e);
+    }
+    std::sort(fresh.begin(), fresh.end(), [](const Entry& a, const Entry& b) { return a.begin < b.begin; });
+
+    std::vector<ASTNode*> removed;
+    std::vector<ASTNode*> added;
+    indexEntries(doc, lo, hi, false, removed);
+
+    // The replaced nodes stay alive until their names have been looked at
+    std::vector<Entry> replaced(entries.begin() + lo, entries.begin() + hi);
+    entries.erase(entries.begin() + lo, entries.begin() + hi);
+    entries.insert(entries.begin() + lo, fresh.begin(), fresh.end());
+    size_t shiftedFrom = lo + fresh.size();
+    indexEntries(doc, lo, shiftedFrom, true, added);
+
+    for (size_t i = shiftedFrom; i < entries.size(); i++) {
+        Entry& e = entries[i];
+        e.begin += delta;
+        e.end += delta;
+        e.errorOffset += delta;
+        if (e.node) {
+            e.node->sourceBegin += delta;
+            e.node->sourceEnd += delta;
+        }
+    }
+
+    // New declarations, everything sharing a name with a declaration that
+    // came or went, and the placements a changed map governs
+    std::vector<ASTNode*> dirty = added;
+    bool mapChanged = false;
+    for (ASTNode* node : removed) doc.semanticErrors.erase(node);
+    for (const auto* list : {&removed, &added}) {
+        for (ASTNode* node : *list) {
+            if (dynamic_cast<MapDecl*>(node)) mapChanged = true;
+            std::string name = nameOf(node);
+            if (name.empty()) continue;
+            for (const char* index : {"definitions", "references"}) {
+                auto& table = index[0] == 'd' ? doc.definitions : doc.references;
+                auto it = table.find(name);
+                if (it != table.end()) dirty.insert(dirty.end(), it->second.begin(), it->second.end());
+            }
+        }
+    }
+    if (mapChanged) {
+        for (size_t i = shiftedFrom; i < entries.size(); i++) {
+            ASTNode* node = entries[i].node.get();
+            if (dynamic_cast<MapDecl*>(node)) break;
+            if (dynamic_cast<PlaceStmt*>(node)) dirty.push_back(node);
+        }
+    }
+
+    std::sort(dirty.begin(), dirty.end());
+    dirty.erase(std::unique(dirty.begin(), dirty.end()), dirty.end());
+    for (ASTNode* node : dirty) {
+        std::string error = checkDeclaration(doc, node);
+        if (error.empty()) doc.semanticErrors.erase(node);
+        else doc.semanticErrors[node] = error;
+    }
+
+    // Later declarations were folded with the old constants; reparse them
+    bool constantChanged = false;
+    for (const auto* list : {&removed, &added}) {
+        for (ASTNode* node : *list) constantChanged = constantChanged || dynamic_cast<ConstDecl*>(node);
+    }
+    if (constantChanged && shiftedFrom < entries.size()) {
+        reparse(doc, entries[shiftedFrom].begin, doc.text.size(), 0);
+    }
+}
+
+template <typename T>
+ASTNode* LanguageServer::firstBefore(const Document& doc, const std::string& name, size_t offset) {
+    auto it = doc.definitions.find(name);
+    if (it == doc.definitions.end()) return nullptr;
+    ASTNode* best = nullptr;
+    for (ASTNode* node : it->second) {
+        if (node->sourceBegin < offset && dynamic_cast<T*>(node) &&
+            (!best || node->sourceBegin < best->sourceBegin)) {
+            best = node;
+        }
+    }
+    return best;
+}
+
+// Run the analyzer on `node` preceded by the definitions its checks read:
+// an earlier namesake (duplicates), the enemies a wave spawns, a placed
+// tower and the map in force.
+std::string LanguageServer::checkDeclaration(const Document& doc, ASTNode* node) {
+    size_t at = node->sourceBegin;
+    std::vector<ASTNode*> context;
+
+    if (auto m = dynamic_cast<MapDecl*>(node)) context.push_back(firstBefore<MapDecl>(doc, m->name, at));
+    if (auto e = dynamic_cast<EnemyDecl*>(node)) context.push_back(firstBefore<EnemyDecl>(doc, e->name, at));
+    if (auto t = dynamic_cast<TowerDecl*>(node)) context.push_back(firstBefore<TowerDecl>(doc, t->name, at));
+    if (auto w = dynamic_cast<WaveDecl*>(node)) {
+        context.push_back(firstBefore<WaveDecl>(doc, w->name, at));
+        for (const auto& spawn : w->spawns) context.push_back(firstBefore<EnemyDecl>(doc, spawn.enemyType, at));
+    }
+    if (auto p = dynamic_cast<PlaceStmt*>(node)) {
+        context.push_back(firstBefore<TowerDecl>(doc, p->towerType, at));
+        ASTNode* map = nullptr;
+        for (ASTNode* m : doc.maps) {
+            if (m->sourceBegin < at && (!map || m->sourceBegin > map->sourceBegin)) map = m;
+        }
+        context.push_back(map);
+    }
+
+    context.erase(std::remove(context.begin(), context.end(), nullptr), context.end());
+    std::sort(context.begin(), context.end(),
+              [](const ASTNode* a, const ASTNode* b) { return a->sourceBegin < b->sourceBegin; });
+    context.erase(std::unique(context.begin(), context.end()), context.end());
+    context.push_back(node);
+
+    // Non-owning handles; the entries own the nodes
+    auto program = std::make_shared<Program>();
+    for (ASTNode* n : context) program->declarations.push_back(std::shared_ptr<ASTNode>(std::shared_ptr<ASTNode>(), n));
+    std::vector<bool> validate(context.size(), false);
+    validate.back() = true;
+
+    SemanticAnalyzer analyzer;
+    try {
+        analyzer.analyze(program, validate);
+    } catch (const std::exception& e) {
+        if (analyzer.lastDeclaration() == context.size() - 1) return e.what();
+    }
+    return "";
+}
+
+void LanguageServer::indexEntries(Document& doc, size_t first, size_t last, bool add,
+                                  std::vector<ASTNode*>& touched) {
+    auto update = [add, &doc](std::unordered_map<std::string, std::vector<ASTNode*>>& table,
+                              const std::string& name, ASTNode* node) {
+        auto& nodes = table[name];
+        if (add) {
+            if (std::find(nodes.begin(), nodes.end(), node) == nodes.end()) nodes.push_back(node);
+        } else {
+            nodes.erase(std::remove(nodes.begin(), nodes.end(), node), nodes.end());
+            if (nodes.empty()) table.erase(name);
+        }
+    };
+
+    for (size_t i = first; i < last; i++) {
+        ASTNode* node = doc.entries[i].node.get();
+        if (!node) continue;
+        touched.push_back(node);
+
+        std::string name = nameOf(node);
+        if (!name.empty()) update(doc.definitions, name, node);
+        if (auto w = dynamic_cast<WaveDecl*>(node)) {
+            for (const auto& spawn : w->spawns) update(doc.references, spawn.enemyType, node);
+        }
+        if (auto p = dynamic_cast<PlaceStmt*>(node)) update(doc.references, p->towerType, node);
+        if (dynamic_cast<MapDecl*>(node)) {
+            if (add) doc.maps.push_back(node);
+            else doc.maps.erase(std::remove(doc.maps.begin(), doc.maps.end(), node), doc.maps.end());
+        }
+        if (dynamic_cast<ConstDecl*>(node)) {
+            if (add) doc.constants.push_back(node);
+            else doc.constants.erase(std::remove(doc.constants.begin(), doc.constants.end(), node), doc.constants.end());
+        }
+    }
+}
+
+void LanguageServer::publishDiagnostics(const std::string& uri, Document& doc) {
+    JsonValue diagnostics = JsonValue::array();
+    auto add = [&](size_t begin, size_t end, const std::string& message) {
+        JsonValue d = JsonValue::object();
+        d.set("range", rangeOf(doc, begin, end));
+        d.set("severity", 1);
+        d.set("source", "parsetower");
+        d.set("message", message);
+        diagnostics.push(d);
+    };
+
+    for (const auto& e : doc.entries) {
+        if (!e.node) {
+            size_t lineEnd = doc.text.find('\n', e.errorOffset);
+            size_t line = positionOf(doc, e.errorOffset)["line"].asInt() + 1;
+            add(e.errorOffset, lineEnd == std::string::npos ? doc.text.size() : lineEnd,
+                e.error + " at line " + std::to_string(line));
+        }
+    }
+
+    // The compiler stops at the first semantic problem; report that one
+    const ASTNode* culprit = nullptr;
+    for (const auto& failure : doc.semanticErrors) {
+        if (!culprit || failure.first->sourceBegin < culprit->sourceBegin) culprit = failure.first;
+    }
+    if (culprit) add(culprit->sourceBegin, culprit->sourceEnd, doc.semanticErrors[culprit]);
+
+    JsonValue params = JsonValue::object();
+    params.set("uri", uri);
+    params.set("diagnostics", diagnostics);
+    JsonValue message = JsonValue::object();
+    message.set("jsonrpc", "2.0");
+    message.set("method", "textDocument/publishDiagnostics");
+    message.set("params", params);
+    send(message);
+}
+
+std::string LanguageServer::nameOf(const ASTNode* node) {
+    if (auto m = dynamic_cast<const MapDecl*>(node)) return m->name;
+    if (auto e = dynamic_cast<const EnemyDecl*>(node)) return e->name;
+    if (auto t = dynamic_cast<const TowerDecl*>(node)) return t->name;
+    if (auto w = dynamic_cast<const WaveDecl*>(node)) return w->name;
+    if (auto c = dynamic_cast<const ConstDecl*>(node)) return c->name;
+    return "";
+}
+
+const ASTNode* LanguageServer::lookup(const Document& doc, const std::string& name) const {
+    auto it = doc.definitions.find(name);
+    if (it == doc.definitions.end()) return nullptr;
+
+    // The first definition is the one the compiler keeps
+    const ASTNode* best = nullptr;
+    for (const ASTNode* node : it->second) {
+        if (!best || node->sourceBegin < best->sourceBegin) best = node;
+    }
+    return best;
+}
+
+std::string LanguageServer::wordAt(const Document& doc, size_t offset) {
+    auto isWord = [](char c) { return std::isalnum(static_cast<unsigned char>(c)) || c == '_'; };
+    size_t begin = std::min(offset, doc.text.size());
+    size_t end = begin;
+    while (begin > 0 && isWord(doc.text[begin - 1])) begin--;
+    while (end < doc.text.size() && isWord(doc.text[end])) end++;
+    return doc.text.substr(begin, end - begin);
+}
+
+JsonValue LanguageServer::definition(const Document& doc, const std::string& uri, const JsonValue& position) {
+    const ASTNode* node = lookup(doc, wordAt(doc, offsetOf(doc, position)));
+    if (!node) return JsonValue();
+
+    // Point at the name after the declaration keyword
+    std::string name = nameOf(node);
+    size_t at = doc.text.find(name, doc.text.find_first_of(" \t\r\n", node->sourceBegin));
+    if (at == std::string::npos || at >= node->sourceEnd) at = node->sourceBegin;
+
+    JsonValue location = JsonValue::object();
+    location.set("uri", uri);
+    location.set("range", rangeOf(doc, at, at + name.size()));
+    return location;
+}
+
+JsonValue LanguageServer::hover(const Document& doc, const JsonValue& position) {
+    const ASTNode* node = lookup(doc, wordAt(doc, offsetOf(doc, position)));
+    if (!node) return JsonValue();
+
+    // Same lowering and folding the compiler applies to this declaration
+    std::vector<IRInstruction> ir = optimizer.optimizeLocal(irGen.generateDeclaration(node));
+
+    std::ostringstream text;
+    text << std::fixed << std::setprecision(2);
+    const char* kind = dynamic_cast<const MapDecl*>(node) ? "map" :
+                       dynamic_cast<const EnemyDecl*>(node) ? "enemy" :
+                       dynamic_cast<const TowerDecl*>(node) ? "tower" :
+                       dynamic_cast<const WaveDecl*>(node) ? "wave" : "const";
+    text << "**" << kind << " " << nameOf(node) << "**\n";
+    if (auto c = dynamic_cast<const ConstDecl*>(node)) {
+        text << "\nvalue = ";
+        if (c->isFloat) text << c->floatValue;
+        else text << c->intValue;
+        text << "\n";
+    }
+    for (const auto& instr : ir) {
+        if (instr.opcode == IROpcode::REPEAT_END) continue;
+        text << "\n";
+        if (instr.opcode == IROpcode::SPAWN_ENEMY) text << "spawn " << instr.operands[1] << ": ";
+        if (instr.opcode == IROpcode::REPEAT_BEGIN) text << "repeat " << instr.operands[1] << ": ";
+        bool first = true;
+        for (const auto& meta : instr.metadata) {
+            if (meta.first == "path") continue;
+            text << (first ? "" : ", ") << meta.first << " = ";
+            first = false;
+            if (std::holds_alternative<int>(meta.second)) text << std::get<int>(meta.second);
+            else if (std::holds_alternative<double>(meta.second)) text << std::get<double>(meta.second);
+            else text << std::get<std::string>(meta.second);
+        }
+        text << "\n";
+    }
+
+    JsonValue contents = JsonValue::object();
+    contents.set("kind", "markdown");
+    contents.set("value", text.str());
+    JsonValue result = JsonValue::object();
+    result.set("contents", contents);
+    result.set("range", rangeOf(doc, node->sourceBegin, node->sourceEnd));
+    return result;
+}
+
+void LanguageServer::rebuildLines(Document& doc) {
+    doc.lineStarts.assign(1, 0);
+    for (size_t at = doc.text.find('\n'); at != std::string::npos; at = doc.text.find('\n', at + 1)) {
+        doc.lineStarts.push_back(at + 1);
+    }
+}
+
+// Drop line starts inside the replaced range, add the replacement's and
+// shift the rest
+void LanguageServer::updateLines(Document& doc, size_t editBegin, size_t editEnd, const std::string& replacement) {
+    auto& starts = doc.lineStarts;
+    auto first = std::upper_bound(starts.begin(), starts.end(), editBegin);
+    auto last = std::upper_bound(first, starts.end(), editEnd);
+    long delta = static_cast<long>(replacement.size()) - static_cast<long>(editEnd - editBegin);
+    for (auto it = last; it != starts.end(); ++it) *it += delta;
+
+    std::vector<size_t> inserted;
+    for (size_t at = replacement.find('\n'); at != std::string::npos; at = replacement.find('\n', at + 1)) {
+        inserted.push_back(editBegin + at + 1);
+    }
+    size_t index = first - starts.begin();
+    starts.erase(first, last);
+    starts.insert(starts.begin() + index, inserted.begin(), inserted.end());
+}
+
+size_t LanguageServer::offsetOf(const Document& doc, const JsonValue& position) {
+    size_t line = static_cast<size_t>(std::max(0, position["line"].asInt()));
+    if (line >= doc.lineStarts.size()) return doc.text.size();
+    size_t lineEnd = line + 1 < doc.lineStarts.size() ? doc.lineStarts[line + 1] - 1 : doc.text.size();
+    return std::min(doc.lineStarts[line] + static_cast<size_t>(std::max(0, position["character"].asInt())), lineEnd);
+}
+
+JsonValue LanguageServer::positionOf(const Document& doc, size_t offset) {
+    size_t line = std::upper_bound(doc.lineStarts.begin(), doc.lineStarts.end(), offset) - doc.lineStarts.begin() - 1;
+    JsonValue position = JsonValue::object();
+    position.set("line", line);
+    position.set("character", offset - doc.lineStarts[line]);
+    return position;
+}
+
+JsonValue LanguageServer::rangeOf(const Document& doc, size_t begin, size_t end) {
+    JsonValue range = JsonValue::object();
+    range.set("start", positionOf(doc, begin));
+    range.set("end", positionOf(doc, end));
+    return range;
+}
+
+bool LanguageServer::verify(const std::string& source, std::ostream& log) {
+    std::istringstream none;
+    std::ostringstream replies;
+    LanguageServer server(none, replies);
+
+    // Handle one message and return the body of the last reply it sent
+    auto call = [&](const std::string& method, const JsonValue& params, const JsonValue& id = JsonValue()) {
+        JsonValue message = JsonValue::object();
+        message.set("jsonrpc", "2.0");
+        message.set("method", method);
+        message.set("params", params);
+        if (!id.isNull()) message.set("id", id);
+        replies.str("");
+        server.handle(message);
+        std::string text = replies.str();
+        size_t body = text.rfind("\r\n\r\n");
+        return body == std::string::npos ? JsonValue() : JsonValue::parse(text.substr(body + 4));
+    };
+    // {"textDocument": {"uri", "text"}}, without text when `text` is null
+    auto document = [](const std::string& uri, const std::string* text) {
+        JsonValue doc = JsonValue::object();
+        doc.set("uri", uri);
+        if (text) doc.set("text", *text);
+        JsonValue params = JsonValue::object();
+        params.set("textDocument", doc);
+        return params;
+    };
+    auto position = [](const std::string& text, size_t offset) {
+        size_t lineStart = text.rfind('\n', offset == 0 ? 0 : offset - 1);
+        lineStart = lineStart == std::string::npos || offset == 0 ? 0 : lineStart + 1;
+        JsonValue at = JsonValue::object();
+        at.set("line", static_cast<size_t>(std::count(text.begin(), text.begin() + offset, '\n')));
+        at.set("character", offset - lineStart);
+        return at;
+    };
+
+    const std::string edited = "file:///verify/edited.td";
+    const std::string fresh = "file:///verify/fresh.td";
+    call("textDocument/didOpen", document(edited, &source));
+
+    // Small, typical edits: retyped digits, deletions, pasted fragments,
+    // duplicated lines and unbalanced punctuation
+    const char* snippets[] = {
+        "}", "{", ";", "\n", " ", "=", "(", ")", ",", "Goblin", "wave",
+        "enemy Imp { hp = 5; speed = 1.0; reward = 1; }\n",
+        "wave Extra { spawn(Imp, count=2, start=0, interval=1); }\n",
+        "place Arrow at (1, 1);\n",
+    };
+    std::mt19937 random(20240601);
+    std::string text = source;
+    const int rounds = 200;
+    double millis = 0.0;
+    size_t failing = 0, hovers = 0;
+    size_t undoBegin = 0, undoEnd = 0;
+    std::string undoText;
+    for (int round = 0; round < rounds; round++) {
+        size_t begin = text.empty() ? 0 : random() % (text.size() + 1);
+        size_t end = begin;
+        std::string replacement;
+        // Every other round undoes the one before, so the document keeps
+        // coming back to a state that compiles
+        switch (round % 2 ? 4 : random() % 4) {
+            case 0:
+                replacement = std::string(1, static_cast<char>('0' + random() % 10));
+                end = std::min(text.size(), begin + 1);
+                break;
+            case 1:
+                end = std::min(text.size(), begin + random() % 24);
+                break;
+            case 2:
+                replacement = snippets[random() % (sizeof(snippets) / sizeof(snippets[0]))];
+                break;
+            default: {
+                size_t lineStart = text.rfind('\n', begin == 0 ? 0 : begin - 1);
+                begin = end = lineStart == std::string::npos || begin == 0 ? 0 : lineStart + 1;
+                size_t lineEnd = text.find('\n', begin);
+                replacement = text.substr(begin, lineEnd == std::string::npos ? std::string::npos : lineEnd + 1 - begin);
+                break;
+            }
+            case 4:
+                begin = undoBegin;
+                end = undoEnd;
+                replacement = undoText;
+                break;
+        }
+        undoBegin = begin;
+        undoEnd = begin + replacement.size();
+        undoText = text.substr(begin, end - begin);
+
+        JsonValue range = JsonValue::object();
+        range.set("start", position(text, begin));
+        range.set("end", position(text, end));
+        JsonValue change = JsonValue::object();
+        change.set("range", range);
+        change.set("text", replacement);
+        JsonValue changes = JsonValue::array();
+        changes.push(change);
+        JsonValue params = document(edited, nullptr);
+        params.set("contentChanges", changes);
+        text.replace(begin, end - begin, replacement);
+
+        auto start = std::chrono::steady_clock::now();
+        JsonValue incremental = call("textDocument/didChange", params);
+        millis += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+        JsonValue full = call("textDocument/didOpen", document(fresh, &text));
+
+        if (incremental["params"]["diagnostics"].dump() != full["params"]["diagnostics"].dump()) {
+            log << "  MISMATCH in diagnostics after edit " << round + 1 << "\n";
+            return false;
+        }
+        if (full["params"]["diagnostics"].size() > 0) failing++;
+
+        // Hover answers come from the name index
+        size_t probe = text.empty() ? 0 : random() % text.size();
+        while (probe > 0 && !std::isalpha(static_cast<unsigned char>(text[probe]))) probe--;
+        JsonValue hover = document(edited, nullptr);
+        hover.set("position", position(text, probe));
+        JsonValue a = call("textDocument/hover", hover, JsonValue(1));
+        hover.set("textDocument", document(fresh, nullptr)["textDocument"]);
+        JsonValue b = call("textDocument/hover", hover, JsonValue(1));
+        if (a["result"].dump() != b["result"].dump()) {
+            log << "  MISMATCH in hover after edit " << round + 1 << "\n";
+            return false;
+        }
+        if (!b["result"].isNull()) hovers++;
+        call("textDocument/didClose", document(fresh, nullptr));
+    }
+
+    log << "  Language server matched a fresh open after " << rounds << " random edits (" << failing
+        << " with errors, " << hovers << " hovers answered); " << std::fixed << std::setprecision(2) << millis / rounds << " ms per edit on average.\n";
+    return true;
+}
@@ -0,0 +1,99 @@
+#ifndef LSP_H
+#define LSP_H
+
+#include "lexer.h"
+#include "parser.h"
+#include "ir.h"
+#include "optimizer.h"
+#include "json.h"
+#include <string>
+#include <vector>
+#include <map>
+#include <unordered_map>
+#include <istream>
+#include <ostream>
+
+// Language server over stdio (JSON-RPC with Content-Length framing).
+//
+// Each open document is kept as a list of top-level entries: parsed
+// declarations and the spans of declarations that failed to parse. An
+// edit re-lexes and reparses only the entries it touches plus the gaps
+// around them; later entries are shifted in place. A name index of enemy,
+// tower and wave definitions is updated from the replaced entries and
+// answers go-to-definition and hover. Semantic checks are cached per
+// declaration: the analyzer runs on a declaration plus the earlier
+// definitions it depends on, and only declarations whose names or map
+// context changed are checked again. The first failing declaration in file
+// order is the one a full SemanticAnalyzer pass would report. Positions are
+// treated as byte columns, which matches UTF-16 columns for the ASCII .td
+// language.
+class LanguageServer {
+public:
+    LanguageServer(std::istream& in, std::ostream& out);
+
+    // Serve until `exit`; returns the process exit code
+    int run();
+
+    // Replay random edits of `source` through didChange and check that the
+    // diagnostics and hovers after each one match a fresh didOpen of the
+    // same text; also reports edit latency
+    static bool verify(const std::string& source, std::ostream& log);
+
+private:
+    struct Entry {
+        std::shared_ptr<ASTNode> node;  // Null when the text did not parse
+        size_t begin = 0;
+        size_t end = 0;
+        std::string error;
+        size_t errorOffset = 0;
+    };
+
+    struct Document {
+        std::string text;
+        std::vector<size_t> lineStarts;
+        std::vector<Entry> entries;
+        std::unordered_map<std::string, std::vector<ASTNode*>> definitions;
+        std::unordered_map<std::string, std::vector<ASTNode*>> references;  // Spawns and placements
+        std::vector<ASTNode*> maps;
+        std::vector<ASTNode*> constants;
+        std::unordered_map<const ASTNode*, std::string> semanticErrors;
+    };
+
+    std::istream& in;
+    std::ostream& out;
+    std::map<std::string, Document> documents;
+    bool shutdownRequested = false;
+
+    Lexer lexer;
+    Parser parser;
+    IRGenerator irGen;
+    Optimizer optimizer;
+
+    bool readMessage(std::string& body);
+    void send(const JsonValue& message);
+    void reply(const JsonValue& id, const JsonValue& result);
+    void handle(const JsonValue& message);
+
+    void open(const std::string& uri, const std::string& text);
+    void applyChange(Document& doc, const JsonValue& change);
+    void reparse(Document& doc, size_t editBegin, size_t editEnd, long delta);
+    void indexEntries(Document& doc, size_t first, size_t last, bool add, std::vector<ASTNode*>& touched);
+    std::string checkDeclaration(const Document& doc, ASTNode* node);
+    void publishDiagnostics(const std::string& uri, Document& doc);
+
+    JsonValue definition(const Document& doc, const std::string& uri, const JsonValue& position);
+    JsonValue hover(const Document& doc, const JsonValue& position);
+
+    static void rebuildLines(Document& doc);
+    static void updateLines(Document& doc, size_t editBegin, size_t editEnd, const std::string& replacement);
+    static size_t offsetOf(const Document& doc, const JsonValue& position);
+    static JsonValue positionOf(const Document& doc, size_t offset);
+    static JsonValue rangeOf(const Document& doc, size_t begin, size_t end);
+    static std::string nameOf(const ASTNode* node);
+    const ASTNode* lookup(const Document& doc, const std::string& name) const;
+    template <typename T>
+    static ASTNode* firstBefore(const Document& doc, const std::string& name, size_t offset);
+    static std::string wordAt(const Document& doc, size_t offset);
+};
+
+#endif // LSP_H
@@ -2,12 +2,38 @@
 #include <fstream>
 #include <sstream>
 #include <memory>
+#include <algorithm>
 #include "lexer.h"
 #include "parser.h"
 #include "semantic.h"
 #include "ir.h"
 #include "optimizer.h"
 #include "codegen.h"
+#include "simulator.h"
+#include "search.h"
+#include "tuner.h"
+#include "sourcewriter.h"
+#include "analysis.h"
+#include "batch.h"
+#include "watch.h"
+#include "incremental.h"
+#include "ircache.h"
+#include "server.h"
+#include "lsp.h"
+#include "importer.h"
+#include "bundle.h"
+#include "streaming.h"
+#include "pipeline.h"
+#include "delta.h"
+#include "publisher.h"
+#include <chrono>
+#include <charconv>
+#include <climits>
+#include <cerrno>
+#include <cstdio>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/uio.h>
 
 std::string readFile(const std::string& filename) {
     std::ifstream file(filename);
@@ -49,13 +75,104 @@ void writeFile(const std::string& filename, const std::string& content) {
     file.close();
 }
 
+// IR of a config to diff against or patch: a .json config is imported as
+// is, the way a server reads it; source is compiled with `options`
+std::vector<IRInstruction> loadConfigIR(const std::string& path, const CompileOptions& options) {
+    bool json = path.size() > 5 && path.compare(path.size() - 5, 5, ".json") == 0;
+    if (json) {
+        JSONImporter importer;
+        return importer.import(readFile(path));
+    }
+    Compiler compiler(options);
+    compiler.compile(readFile(path));
+    return compiler.lastIR();
+}
+
+// Gather-write buffers in order without joining them first
+void writeChunks(const std::string& filename, const std::vector<std::string>& chunks) {
+    int fd = ::open(filename.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        std::cerr << "Error: Could not write to file " << filename << std::endl;
+        exit(1);
+    }
+
+    std::vector<iovec> iov;
+    for (const auto& chunk : chunks) {
+        if (!chunk.empty()) iov.push_back({const_cast<char*>(chunk.data()), chunk.size()});
+    }
+
+    size_t next = 0;
+    while (next < iov.size()) {
+        int count = static_cast<int>(std::min<size_t>(iov.size() - next, IOV_MAX));
+        ssize_t written = ::writev(fd, &iov[next], count);
+        if (written < 0) {
+            if (errno == EINTR) continue;
+            std::cerr << "Error: Could not write to file " << filename << std::endl;
+            exit(1);
+        }
+        // Skip finished buffers and trim a partially written one
+        size_t left = static_cast<size_t>(written);
+        while (next < iov.size() && left >= iov[next].iov_len) left -= iov[next++].iov_len;
+        if (left > 0) {
+            iov[next].iov_base = static_cast<char*>(iov[next].iov_base) + left;
+            iov[next].iov_len -= left;
+        }
+    }
+    ::close(fd);
+}
+
+// Whole argument must be a number that fits T
+template <typename T>
+bool parseNumber(const char* text, T& value) {
+    const char* end = text + std::char_traits<char>::length(text);
+    auto result = std::from_chars(text, end, value);
+    return result.ec == std::errc() && result.ptr == end && result.ptr != text;
+}
+
 void printUsage(const char* programName) {
     std::cout << "Usage: " << programName << " <input_file> [options]\n";
+    std::cout << "       (a .json input in the gameConfig format is imported instead of parsed)\n";
+    std::cout << "       " << programName << " -batch <dir|glob|@manifest> [options]\n";
+    std::cout << "       " << programName << " -watch <dir|glob|@manifest> [options]\n";
+    std::cout << "       " << programName << " -serve <socket> [-threads <n>]\n";
+    std::cout << "       " << programName << " -lsp   (language server on stdin/stdout)\n";
     std::cout << "Options:\n";
     std::cout << "  -o <file>     Output file (default: output.json)\n";
     std::cout << "  -ir           Output IR to stdout\n";
     std::cout << "  -readable     Output readable format instead of JSON\n";
+    std::cout << "  -bundle       Output a sectioned, compressed bundle (default: output.ptb)\n";
+    std::cout << "  -bundle-raw   Like -bundle, with chunks stored uncompressed\n";
+    std::cout << "  -stream       Compile declaration by declaration in bounded memory (JSON only)\n";
+    std::cout << "  -pipeline     Run lexing, parsing, checking and lowering on their own threads\n";
+    std::cout << "  -delta-against <file>  Output a binary patch from a previous config (default: output.delta)\n";
+    std::cout << "  -apply-delta <patch>  Patch the input config and output the result\n";
+    std::cout << "  -publish-shm <name>  Publish the config to a shared memory segment instead of a file\n";
     std::cout << "  -no-opt       Disable optimization\n";
+    std::cout << "  -simulate     Simulate every wave against the placed towers\n";
+    std::cout << "  -place-search <gold>  Search the best placements under a gold budget\n";
+    std::cout << "  -tune <spec>  Solve enemy stats per wave, e.g. leaks=0 or Wave2:hp=10\n";
+    std::cout << "  -tune-speed   Tune enemy speed instead of hp\n";
+    std::cout << "  -tune-out <file>  Tuned source file (default: tuned.td)\n";
+    std::cout << "  -gold <n>     Starting gold for the economy section (default: 0)\n";
+    std::cout << "  -smooth <ticks>  Delay spawn groups by up to <ticks> to flatten per-tick peaks\n";
+    std::cout << "  -threads <n>  Worker threads for simulation and code generation (default: all cores)\n";
+    std::cout << "  -verify-incremental  Check incremental rebuilds against clean compiles\n";
+    std::cout << "  -verify-import  Check that imported JSON regenerates byte for byte\n";
+    std::cout << "  -verify-spawns  Check that spawn coalescing keeps every spawn time\n";
+    std::cout << "  -verify-codegen  Check that parallel code generation matches sequential\n";
+    std::cout << "  -verify-sim   Check that simulating on several threads matches one thread\n";
+    std::cout << "  -verify-lsp   Check language server diagnostics after random edits against a fresh open\n";
+    std::cout << "  -verify-bundle  Check that a bundle reads back to the JSON output\n";
+    std::cout << "  -verify-streaming  Check that a streaming build matches the normal compile\n";
+    std::cout << "  -verify-delta  Check that delta patches rebuild edited configs byte for byte\n";
+    std::cout << "  -verify-pipeline  Check a pipelined build against the normal compile and compare throughput\n";
+    std::cout << "  -verify-shm   Check shared memory snapshots while configs are republished\n";
+    std::cout << "  -verify-server  Check a loopback compile server and client against local compiles\n";
+    std::cout << "  -verify-cache  Check IR cache hits, damaged entries and eviction against uncached output\n";
+    std::cout << "  -cache <dir>  Reuse optimized IR of unchanged inputs from <dir>\n";
+    std::cout << "  -cache-limit <MB>  IR cache size before LRU eviction (default: 256)\n";
+    std::cout << "  -connect <socket>  Compile through a running -serve instance\n";
+    std::cout << "  -out-dir <dir>  Batch output directory (default: next to each input)\n";
     std::cout << "  -h, --help    Show this help message\n";
 }
 
@@ -66,13 +183,74 @@ int main(int argc, char* argv[]) {
     }
     
     // Parse command line arguments
-    std::string inputFile = argv[1];
+    std::string inputFile;
+    std::string batchSpec;
+    std::string watchSpec;
+    std::string serveSocket;
+    std::string outputDir;
+    int firstOption = 2;
+    
+    std::string mode = argv[1];
+    
+    // Language server: stdout carries the protocol, so nothing else may print
+    if (mode == "-lsp" || mode == "--lsp") {
+        std::ios::sync_with_stdio(false);
+        LanguageServer server(std::cin, std::cout);
+        return server.run();
+    }
+    
+    if (mode == "--serve") mode = "-serve";
+    if (mode == "-batch" || mode == "-watch" || mode == "-serve") {
+        if (argc < 3) {
+            printUsage(argv[0]);
+            return 1;
+        }
+        (mode == "-batch" ? batchSpec : mode == "-watch" ? watchSpec : serveSocket) = argv[2];
+        firstOption = 3;
+    } else {
+        inputFile = argv[1];
+    }
+    
     std::string outputFile = "output.json";
     bool showIR = false;
     bool readableFormat = false;
+    bool bundleOutput = false;
+    bool bundleCompress = true;
+    bool outputGiven = false;
     bool optimize = true;
+    bool simulate = false;
+    int searchBudget = -1;
+    std::string tuneSpec;
+    std::string tuneOutput = "tuned.td";
+    bool tuneSpeed = false;
+    int startingGold = 0;
+    int smoothTicks = 0;
+    bool verifyIncremental = false;
+    bool verifyImport = false;
+    bool verifySpawns = false;
+    bool verifyCodegen = false;
+    bool verifySim = false;
+    bool verifyLsp = false;
+    bool verifyBundle = false;
+    bool verifyStreaming = false;
+    bool streaming = false;
+    bool verifyPipeline = false;
+    bool verifyDelta = false;
+    std::string deltaAgainst;
+    std::string applyDelta;
+    bool verifyShm = false;
+    bool verifyServer = false;
+    bool verifyCache = false;
+    std::string publishShm;
+    bool pipelined = false;
+    bool goldGiven = false;
+    std::string cacheDir;
+    std::string connectSocket;
+    uint64_t cacheLimitMB = 256;
+    size_t threads = ThreadPool::defaultThreads();
+    std::string badValue;   // Option whose numeric argument did not parse
     
-    for (int i = 2; i < argc; i++) {
+    for (int i = firstOption; i < argc; i++) {
         std::string arg = argv[i];
         
         if (arg == "-h" || arg == "--help") {
@@ -80,110 +258,625 @@ int main(int argc, char* argv[]) {
             return 0;
         } else if (arg == "-o" && i + 1 < argc) {
             outputFile = argv[++i];
+            outputGiven = true;
         } else if (arg == "-ir") {
             showIR = true;
         } else if (arg == "-readable") {
             readableFormat = true;
         } else if (arg == "-no-opt") {
             optimize = false;
+        } else if (arg == "-simulate") {
+            simulate = true;
+        } else if (arg == "-place-search" && i + 1 < argc) {
+            if (!parseNumber(argv[++i], searchBudget)) badValue = arg;
+        } else if (arg == "-tune" && i + 1 < argc) {
+            tuneSpec = argv[++i];
+        } else if (arg == "-tune-speed") {
+            tuneSpeed = true;
+        } else if (arg == "-tune-out" && i + 1 < argc) {
+            tuneOutput = argv[++i];
+        } else if (arg == "-gold" && i + 1 < argc) {
+            if (!parseNumber(argv[++i], startingGold)) badValue = arg;
+            goldGiven = true;
+        } else if (arg == "-smooth" && i + 1 < argc) {
+            if (!parseNumber(argv[++i], smoothTicks)) badValue = arg;
+            smoothTicks = std::max(0, smoothTicks);
+        } else if (arg == "-verify-incremental") {
+            verifyIncremental = true;
+        } else if (arg == "-verify-import") {
+            verifyImport = true;
+        } else if (arg == "-verify-spawns") {
+            verifySpawns = true;
+        } else if (arg == "-verify-codegen") {
+            verifyCodegen = true;
+        } else if (arg == "-verify-sim") {
+            verifySim = true;
+        } else if (arg == "-verify-lsp") {
+            verifyLsp = true;
+        } else if (arg == "-verify-bundle") {
+            verifyBundle = true;
+        } else if (arg == "-verify-streaming") {
+            verifyStreaming = true;
+        } else if (arg == "-verify-delta") {
+            verifyDelta = true;
+        } else if (arg == "-delta-against" && i + 1 < argc) {
+            deltaAgainst = argv[++i];
+        } else if (arg == "-apply-delta" && i + 1 < argc) {
+            applyDelta = argv[++i];
+        } else if (arg == "-verify-shm") {
+            verifyShm = true;
+        } else if (arg == "-verify-server") {
+            verifyServer = true;
+        } else if (arg == "-verify-cache") {
+            verifyCache = true;
+        } else if (arg == "-publish-shm" && i + 1 < argc) {
+            publishShm = argv[++i];
+        } else if (arg == "-verify-pipeline") {
+            verifyPipeline = true;
+        } else if (arg == "-pipeline") {
+            pipelined = true;
+        } else if (arg == "-stream") {
+            streaming = true;
+        } else if (arg == "-bundle") {
+            bundleOutput = true;
+        } else if (arg == "-bundle-raw") {
+            bundleOutput = true;
+            bundleCompress = false;
+        } else if (arg == "-cache" && i + 1 < argc) {
+            cacheDir = argv[++i];
+        } else if (arg == "-cache-limit" && i + 1 < argc) {
+            if (!parseNumber(argv[++i], cacheLimitMB)) badValue = arg;
+        } else if (arg == "-connect" && i + 1 < argc) {
+            connectSocket = argv[++i];
+        } else if (arg == "-out-dir" && i + 1 < argc) {
+            outputDir = argv[++i];
+        } else if (arg == "-threads" && i + 1 < argc) {
+            if (!parseNumber(argv[++i], threads)) badValue = arg;
         } else {
             std::cerr << "Unknown option: " << arg << std::endl;
             printUsage(argv[0]);
             return 1;
         }
+        if (!badValue.empty()) {
+            std::cerr << "Invalid value for " << badValue << ": " << argv[i] << std::endl;
+            printUsage(argv[0]);
+            return 1;
+        }
+    }
+    
+    std::unique_ptr<IRCache> cache;
+    if (!cacheDir.empty()) {
+        try {
+            cache = std::make_unique<IRCache>(cacheDir, cacheLimitMB * 1024 * 1024);
+        } catch (const std::exception& e) {
+            std::cerr << "  Cache error: " << e.what() << std::endl;
+            return 1;
+        }
+    }
+    
+    // Every mode compiles with these; the ones needing a variation copy them
+    CompileOptions options;
+    options.optimize = optimize;
+    options.readable = readableFormat;
+    options.startingGold = startingGold;
+    options.smoothTicks = smoothTicks;
+    options.cache = cache.get();
+    
+    // Server mode: warm pipelines behind a Unix domain socket
+    if (!serveSocket.empty()) {
+        std::cout << "=== ParseTower Compiler (server) ===\n";
+        try {
+            CompileServer server(serveSocket, threads);
+            server.run();
+        } catch (const std::exception& e) {
+            std::cerr << "  Server error: " << e.what() << std::endl;
+            return 1;
+        }
+        return 0;
+    }
+    
+    // Watch mode: keep inputs compiled in memory, rebuild on save
+    if (!watchSpec.empty()) {
+        std::cout << "=== ParseTower Compiler (watch) ===\n";
+        try {
+            WatchCompiler watcher(options, outputDir);
+            watcher.run(watchSpec);
+        } catch (const std::exception& e) {
+            std::cerr << "  Watch error: " << e.what() << std::endl;
+            return 1;
+        }
+        return 0;
+    }
+    
+    // Batch mode: many inputs, one process, quiet per-file pipeline
+    if (!batchSpec.empty()) {
+        std::cout << "=== ParseTower Compiler (batch) ===\n";
+        try {
+            auto start = std::chrono::steady_clock::now();
+            std::vector<BatchItem> items = BatchCompiler::collectInputs(batchSpec);
+            BatchCompiler batch(options, threads);
+            batch.run(items, outputDir);
+            double millis = std::chrono::duration<double, std::milli>(
+                std::chrono::steady_clock::now() - start).count();
+            std::cout << batch.summary(items, millis);
+            if (cache) std::cout << cache->report();
+            
+            for (const auto& item : items) {
+                if (!item.ok) return 1;
+            }
+            return 0;
+        } catch (const std::exception& e) {
+            std::cerr << "  Batch error: " << e.what() << std::endl;
+            return 1;
+        }
     }
     
     std::cout << "=== ParseTower Compiler ===\n";
     std::cout << "Input: " << inputFile << "\n\n";
     
-    // Phase 1: Lexical Analysis
-    std::cout << "[Phase 1] Lexical Analysis...\n";
-    std::string source = readFile(inputFile);
-    Lexer lexer(source);
-    // while (true) {
-    //     Token t = lexer.getNextToken();
-    //     std::cout << "TOKEN " << (int)t.type << " '" << t.lexeme << "'\n";
-    //     if (t.type == TokenType::END_OF_FILE) break;
-    // }
-    
-    // Phase 2: Syntax Analysis (Parsing)
-    std::cout << "[Phase 2] Syntax Analysis (Parsing)...\n";
-    Parser parser(lexer);
-    std::shared_ptr<Program> ast;
+    if (verifyIncremental) {
+        std::cout << "[Verify] Incremental vs. clean compilation...\n";
+        return IncrementalCompiler::verify(readFile(inputFile), options, std::cout) ? 0 : 1;
+    }
     
-    try {
-        ast = parser.parseProgram();
-        std::cout << "  Parsing successful.\n";
-    } catch (const std::exception& e) {
-        std::cerr << "  Parse error: " << e.what() << std::endl;
-        return 1;
+    if (verifyImport) {
+        std::cout << "[Verify] JSON import round trip...\n";
+        try {
+            return JSONImporter::verify(readFile(inputFile), options, std::cout) ? 0 : 1;
+        } catch (const std::exception& e) {
+            std::cerr << "  Verify error: " << e.what() << std::endl;
+            return 1;
+        }
     }
     
-    // Phase 3: Semantic Analysis
-    std::cout << "[Phase 3] Semantic Analysis...\n";
-    SemanticAnalyzer analyzer;
+    if (verifySpawns) {
+        std::cout << "[Verify] Spawn coalescing...\n";
+        CompileOptions unoptimized = options;
+        unoptimized.optimize = false;
+        try {
+            Compiler compiler(unoptimized);
+            compiler.compile(readFile(inputFile));
+            Optimizer optimizer;
+            return optimizer.verifySpawnCoalescing(compiler.lastIR(), std::cout) ? 0 : 1;
+        } catch (const std::exception& e) {
+            std::cerr << "  Verify error: " << e.what() << std::endl;
+            return 1;
+        }
+    }
     
-    try {
-        analyzer.analyze(ast);
-        std::cout << "  Semantic analysis passed.\n";
-    } catch (const std::exception& e) {
-        std::cerr << "  Semantic error: " << e.what() << std::endl;
-        return 1;
+    if (verifyCodegen) {
+        std::cout << "[Verify] Parallel code generation...\n";
+        try {
+            Compiler compiler(options);
+            compiler.compile(readFile(inputFile));
+            CodeGenerator codeGen;
+            codeGen.setStartingGold(startingGold);
+            codeGen.setThreads(std::max<size_t>(threads, 2));
+            return codeGen.verifyParallel(compiler.lastIR(), std::cout) ? 0 : 1;
+        } catch (const std::exception& e) {
+            std::cerr << "  Verify error: " << e.what() << std::endl;
+            return 1;
+        }
     }
     
-    // Phase 4: Intermediate Code Generation
-    std::cout << "[Phase 4] Intermediate Code Generation...\n";
-    IRGenerator irGen;
-    std::vector<IRInstruction> ir = irGen.generate(ast);
-    std::cout << "  Generated " << ir.size() << " IR instructions.\n";
+    if (verifySim) {
+        std::cout << "[Verify] Simulation across thread counts...\n";
+        try {
+            Compiler compiler(options);
+            compiler.compile(readFile(inputFile));
+            return Simulator::verify(compiler.lastIR(), std::max<size_t>(threads, 4), std::cout) ? 0 : 1;
+        } catch (const std::exception& e) {
+            std::cerr << "  Verify error: " << e.what() << std::endl;
+            return 1;
+        }
+    }
     
-    if (showIR) {
-        std::cout << "\n--- Unoptimized IR ---\n";
-        auto irLines = irGen.toString(ir);
-        for (const auto& line : irLines) {
-            std::cout << line << "\n";
+    if (verifyLsp) {
+        std::cout << "[Verify] Language server edits...\n";
+        try {
+            return LanguageServer::verify(readFile(inputFile), std::cout) ? 0 : 1;
+        } catch (const std::exception& e) {
+            std::cerr << "  Verify error: " << e.what() << std::endl;
+            return 1;
         }
     }
     
-    // Phase 5: Optimization
-    std::vector<IRInstruction> optimizedIR = ir;
+    if (verifyBundle) {
+        std::cout << "[Verify] Config bundle round trip...\n";
+        try {
+            Compiler compiler(options);
+            compiler.compile(readFile(inputFile));
+            CodeGenerator codeGen;
+            codeGen.setStartingGold(startingGold);
+            return BundleReader::verify(compiler.lastIR(), codeGen, std::cout) ? 0 : 1;
+        } catch (const std::exception& e) {
+            std::cerr << "  Verify error: " << e.what() << std::endl;
+            return 1;
+        }
+    }
     
-    if (optimize) {
-        std::cout << "[Phase 5] Optimization...\n";
-        Optimizer optimizer;
-        optimizedIR = optimizer.optimize(ir);
-        std::cout << "  Optimized to " << optimizedIR.size() << " instructions.\n";
+    if (verifyStreaming) {
+        std::cout << "[Verify] Streaming vs. normal compilation...\n";
+        try {
+            return StreamingCompiler::verify(inputFile, options, std::cout) ? 0 : 1;
+        } catch (const std::exception& e) {
+            std::cerr << "  Verify error: " << e.what() << std::endl;
+            return 1;
+        }
+    }
+    
+    if (verifyDelta) {
+        std::cout << "[Verify] Delta patches...\n";
+        try {
+            Compiler compiler(options);
+            compiler.compile(readFile(inputFile));
+            CodeGenerator codeGen;
+            return DeltaWriter::verify(compiler.lastIR(), codeGen, std::cout) ? 0 : 1;
+        } catch (const std::exception& e) {
+            std::cerr << "  Verify error: " << e.what() << std::endl;
+            return 1;
+        }
+    }
+
+    if (verifyShm) {
+        std::cout << "[Verify] Shared memory publication...\n";
+        try {
+            Compiler compiler(options);
+            compiler.compile(readFile(inputFile));
+            CodeGenerator codeGen;
+            return ShmPublisher::verify(compiler.lastIR(), codeGen, std::cout) ? 0 : 1;
+        } catch (const std::exception& e) {
+            std::cerr << "  Verify error: " << e.what() << std::endl;
+            return 1;
+        }
+    }
+
+    if (verifyServer) {
+        std::cout << "[Verify] Compile server over loopback...\n";
+        try {
+            return CompileServer::verify(readFile(inputFile), options, std::cout) ? 0 : 1;
+        } catch (const std::exception& e) {
+            std::cerr << "  Verify error: " << e.what() << std::endl;
+            return 1;
+        }
+    }
+
+    if (verifyCache) {
+        std::cout << "[Verify] IR cache...\n";
+        try {
+            return IRCache::verify(readFile(inputFile), options, std::cout) ? 0 : 1;
+        } catch (const std::exception& e) {
+            std::cerr << "  Verify error: " << e.what() << std::endl;
+            return 1;
+        }
+    }
+    
+    // What a live server does with a patch: its current config in, the
+    // new config out
+    if (!applyDelta.empty()) {
+        try {
+            std::vector<IRInstruction> base = loadConfigIR(inputFile, options);
+            DeltaApplier applier;
+            std::vector<IRInstruction> patched = applier.apply(base, readFile(applyDelta));
+            CodeGenerator codeGen;
+            codeGen.setStartingGold(goldGiven ? startingGold : applier.startingGold());
+            writeFile(outputFile, readableFormat ? codeGen.generateReadable(patched) : codeGen.generateJSON(patched));
+        } catch (const std::exception& e) {
+            std::cerr << "  Delta error: " << e.what() << std::endl;
+            return 1;
+        }
+        std::cout << "[Delta] Applied " << applyDelta << "\n";
+        std::cout << "Output written to: " << outputFile << "\n";
+        return 0;
+    }
+    
+    if (verifyPipeline) {
+        std::cout << "[Verify] Pipelined vs. sequential compilation...\n";
+        try {
+            return PipelineCompiler::verify(readFile(inputFile), options, std::cout) ? 0 : 1;
+        } catch (const std::exception& e) {
+            std::cerr << "  Verify error: " << e.what() << std::endl;
+            return 1;
+        }
+    }
+    
+    if (pipelined) {
+        try {
+            auto start = std::chrono::steady_clock::now();
+            PipelineCompiler compiler(options);
+            std::string output = compiler.compile(readFile(inputFile));
+            double millis = std::chrono::duration<double, std::milli>(
+                std::chrono::steady_clock::now() - start).count();
+            writeFile(outputFile, output);
+            
+            const PipelineCompiler::Stats& stats = compiler.lastStats();
+            std::cout << "[Pipeline] " << stats.tokens << " tokens, " << stats.declarations
+                      << " declarations in " << millis << " ms\n";
+        } catch (const std::exception& e) {
+            std::cerr << "  Pipeline error: " << e.what() << std::endl;
+            return 1;
+        }
+        std::cout << "\n=== Compilation Successful ===\n";
+        std::cout << "Output written to: " << outputFile << "\n";
+        return 0;
+    }
+    
+    // The source is never held whole; each declaration is read, compiled
+    // and released in turn
+    if (streaming) {
+        try {
+            std::ifstream in(inputFile, std::ios::binary);
+            if (!in.is_open()) throw std::runtime_error("Could not open file: " + inputFile);
+            // Written beside the output and renamed, so a failed build
+            // leaves the previous output in place
+            std::string partial = outputFile + ".partial";
+            std::ofstream out(partial, std::ios::binary);
+            if (!out.is_open()) throw std::runtime_error("Could not create output file: " + partial);
+            
+            auto start = std::chrono::steady_clock::now();
+            StreamingCompiler compiler(options);
+            try {
+                compiler.compile(in, out);
+                out.close();
+                if (!out || std::rename(partial.c_str(), outputFile.c_str()) != 0) {
+                    throw std::runtime_error("Could not write output file: " + outputFile);
+                }
+            } catch (...) {
+                std::remove(partial.c_str());
+                throw;
+            }
+            double millis = std::chrono::duration<double, std::milli>(
+                std::chrono::steady_clock::now() - start).count();
+            
+            const StreamingCompiler::Stats& stats = compiler.lastStats();
+            std::cout << "[Stream] " << stats.declarations << " declarations in " << millis << " ms"
+                      << " (largest " << stats.largestDeclaration << " bytes, "
+                      << stats.spilledBytes << " bytes spilled)\n";
+        } catch (const std::exception& e) {
+            std::cerr << "  Stream error: " << e.what() << std::endl;
+            return 1;
+        }
+        std::cout << "\n=== Compilation Successful ===\n";
+        std::cout << "Output written to: " << outputFile << "\n";
+        return 0;
+    }
+    
+    // Client shim: same command line, the server does the compiling
+    if (!connectSocket.empty()) {
+        try {
+            auto start = std::chrono::steady_clock::now();
+            CompileClient client(connectSocket);
+            ServerResponse response = client.compile(readFile(inputFile), options);
+            double millis = std::chrono::duration<double, std::milli>(
+                std::chrono::steady_clock::now() - start).count();
+            
+            if (!response.ok) {
+                std::cerr << "  Compile error: " << response.diagnostics << std::endl;
+                return 1;
+            }
+            std::cout << response.diagnostics;
+            writeFile(outputFile, response.output);
+            std::cout << "[Server] Compiled in " << millis << " ms\n";
+            std::cout << "\n=== Compilation Successful ===\n";
+            std::cout << "Output written to: " << outputFile << "\n";
+            return 0;
+        } catch (const std::exception& e) {
+            std::cerr << "  Client error: " << e.what() << std::endl;
+            return 1;
+        }
+    }
+    
+    std::string source = readFile(inputFile);
+    std::shared_ptr<Program> ast;
+    std::vector<IRInstruction> optimizedIR;
+    bool jsonInput = inputFile.size() > 5 && inputFile.compare(inputFile.size() - 5, 5, ".json") == 0;
+    
+    // Generated JSON goes straight to IR, then through the optimizer
+    if (jsonInput) {
+        std::cout << "[Phase 1-4] JSON Import...\n";
+        try {
+            JSONImporter importer;
+            optimizedIR = importer.import(source);
+            if (!goldGiven) startingGold = importer.startingGold();
+            std::cout << "  Imported " << optimizedIR.size() << " IR instructions.\n";
+        } catch (const std::exception& e) {
+            std::cerr << "  Import error: " << e.what() << std::endl;
+            return 1;
+        }
+        
+        if (optimize) {
+            std::cout << "[Phase 5] Optimization...\n";
+            Optimizer optimizer;
+            optimizer.setSmoothing(smoothTicks);
+            optimizedIR = optimizer.optimize(optimizedIR);
+            std::cout << "  Optimized to " << optimizedIR.size() << " instructions.\n";
+        }
+    }
+    
+    // The AST and unoptimized IR are only needed for -ir and -tune
+    IRCache::Key cacheKey = IRCache::keyFor(source, options);
+    bool cacheHit = !jsonInput && cache && !showIR && tuneSpec.empty() && cache->load(cacheKey, optimizedIR);
+    if (cacheHit) {
+        std::cout << "[Cache] Hit: reusing " << optimizedIR.size() << " optimized IR instructions.\n";
+    }
+    
+    if (!cacheHit && !jsonInput) {
+        // Phase 1: Lexical Analysis
+        std::cout << "[Phase 1] Lexical Analysis...\n";
+        Lexer lexer(source);
+        // while (true) {
+        //     Token t = lexer.getNextToken();
+        //     std::cout << "TOKEN " << (int)t.type << " '" << t.lexeme << "'\n";
+        //     if (t.type == TokenType::END_OF_FILE) break;
+        // }
+        
+        // Phase 2: Syntax Analysis (Parsing)
+        std::cout << "[Phase 2] Syntax Analysis (Parsing)...\n";
+        Parser parser(lexer);
+        try {
+            ast = parser.parseProgram();
+            std::cout << "  Parsing successful.\n";
+        } catch (const std::exception& e) {
+            std::cerr << "  Parse error: " << e.what() << std::endl;
+            return 1;
+        }
+        
+        // Phase 3: Semantic Analysis
+        std::cout << "[Phase 3] Semantic Analysis...\n";
+        SemanticAnalyzer analyzer;
+        
+        try {
+            analyzer.analyze(ast);
+            std::cout << "  Semantic analysis passed.\n";
+        } catch (const std::exception& e) {
+            std::cerr << "  Semantic error: " << e.what() << std::endl;
+            return 1;
+        }
+        
+        // Phase 4: Intermediate Code Generation
+        std::cout << "[Phase 4] Intermediate Code Generation...\n";
+        IRGenerator irGen;
+        std::vector<IRInstruction> ir = irGen.generate(ast);
+        std::cout << "  Generated " << ir.size() << " IR instructions.\n";
         
         if (showIR) {
-            std::cout << "\n--- Optimized IR ---\n";
-            auto optLines = irGen.toString(optimizedIR);
-            for (const auto& line : optLines) {
+            std::cout << "\n--- Unoptimized IR ---\n";
+            auto irLines = irGen.toString(ir);
+            for (const auto& line : irLines) {
                 std::cout << line << "\n";
             }
         }
-    } else {
-        std::cout << "[Phase 5] Optimization (skipped)\n";
+        
+        // Phase 5: Optimization
+        optimizedIR = ir;
+        
+        if (optimize) {
+            std::cout << "[Phase 5] Optimization...\n";
+            Optimizer optimizer;
+            optimizer.setSmoothing(smoothTicks);
+            optimizedIR = optimizer.optimize(ir);
+            std::cout << "  Optimized to " << optimizedIR.size() << " instructions.\n";
+        
+            if (showIR) {
+                std::cout << "\n--- Optimized IR ---\n";
+                auto optLines = irGen.toString(optimizedIR);
+                for (const auto& line : optLines) {
+                    std::cout << line << "\n";
+                }
+            }
+        } else {
+            std::cout << "[Phase 5] Optimization (skipped)\n";
+        }
+        if (cache) cache->store(cacheKey, optimizedIR);
+    }
+    if (cache) std::cout << "  " << cache->report();
+    
+    // Closed-form balance check, cheap enough for every compile
+    BalanceAnalyzer balance;
+    std::cout << balance.format(balance.analyze(optimizedIR));
+    // Built once; the economy section renders from the same report
+    EconomyAnalyzer economy;
+    EconomyReport economyReport = economy.build(GameModel::fromIR(optimizedIR), startingGold);
+    std::cout << economy.validate(economyReport);
+    
+    // Optional: play the waves against the initial placements
+    if (simulate) {
+        std::cout << "[Simulation] Running with " << threads << " thread(s)...\n";
+        try {
+            Simulator simulator(threads);
+            simulator.load(optimizedIR);
+            SimResult result = simulator.run();
+            std::cout << simulator.report(result);
+        } catch (const std::exception& e) {
+            std::cerr << "  Simulation error: " << e.what() << std::endl;
+            return 1;
+        }
+    }
+    
+    // Optional: rank placement sets that fit the budget
+    if (searchBudget >= 0) {
+        std::cout << "[Placement Search] Budget " << searchBudget << " gold, "
+                  << threads << " thread(s)...\n";
+        try {
+            PlacementSearch search(threads);
+            auto plans = search.search(optimizedIR, searchBudget);
+            std::cout << "  Evaluated " << search.evaluations() << " placement sets.\n";
+            std::cout << search.format(plans, searchBudget);
+        } catch (const std::exception& e) {
+            std::cerr << "  Placement search error: " << e.what() << std::endl;
+            return 1;
+        }
+    }
+    
+    // Optional: solve enemy stats for the requested wave difficulty
+    if (!tuneSpec.empty()) {
+        std::cout << "[Tuning] Targets: " << tuneSpec << "\n";
+        try {
+            DifficultyTuner tuner(threads, tuneSpeed);
+            if (!ast) throw std::runtime_error("tuning rewrites .td source; imported JSON has none");
+            auto results = tuner.tune(optimizedIR, DifficultyTuner::parseTargets(tuneSpec));
+            std::cout << tuner.report(results);
+            tuner.apply(*ast);
+            SourceWriter writer;
+            writeFile(tuneOutput, writer.write(*ast));
+            std::cout << "  Tuned source written to: " << tuneOutput << "\n";
+        } catch (const std::exception& e) {
+            std::cerr << "  Tuning error: " << e.what() << std::endl;
+            return 1;
+        }
     }
     
     // Phase 6: Code Generation
     std::cout << "[Phase 6] Code Generation...\n";
     CodeGenerator codeGen;
+    codeGen.setStartingGold(startingGold);
+    codeGen.setEconomy(&economyReport);
+    codeGen.setThreads(threads);
 
     dumpIR(optimizedIR);
 
-    std::string output;
-    
-    if (readableFormat) {
-        output = codeGen.generateReadable(optimizedIR);
+    // Write output
+    if (!publishShm.empty()) {
+        try {
+            ShmPublisher publisher(publishShm);
+            std::string image = ShmPublisher::buildImage(optimizedIR, codeGen, startingGold);
+            uint64_t generation = publisher.publish(image);
+            outputFile = publisher.path();
+            std::cout << "  Published generation " << generation << " to " << outputFile
+                      << " (" << image.size() << " bytes).\n";
+        } catch (const std::exception& e) {
+            std::cerr << "  Publish error: " << e.what() << std::endl;
+            return 1;
+        }
+    } else if (!deltaAgainst.empty()) {
+        if (!outputGiven) outputFile = "output.delta";
+        try {
+            DeltaWriter writer;
+            bool jsonBase = deltaAgainst.size() > 5 && deltaAgainst.compare(deltaAgainst.size() - 5, 5, ".json") == 0;
+            std::string patch = writer.write(loadConfigIR(deltaAgainst, options),
+                                             jsonBase ? DeltaWriter::asJSON(optimizedIR, codeGen) : optimizedIR,
+                                             startingGold);
+            writeFile(outputFile, patch);
+            const DeltaWriter::Stats& stats = writer.lastStats();
+            std::cout << "  Delta against " << deltaAgainst << ": " << stats.changed << " changed, "
+                      << stats.added << " added, " << stats.removed << " removed, "
+                      << stats.unchanged << " unchanged (" << patch.size() << " bytes).\n";
+        } catch (const std::exception& e) {
+            std::cerr << "  Delta error: " << e.what() << std::endl;
+            return 1;
+        }
+    } else if (bundleOutput) {
+        if (!outputGiven) outputFile = "output.ptb";
+        BundleWriter writer(bundleCompress);
+        writeFile(outputFile, writer.write(optimizedIR, codeGen));
+    } else if (readableFormat) {
+        writeFile(outputFile, codeGen.generateReadable(optimizedIR));
     } else {
-        output = codeGen.generateJSON(optimizedIR);
+        writeChunks(outputFile, codeGen.generateJSONChunks(optimizedIR));
     }
-    
-    // Write output
-    writeFile(outputFile, output);
     std::cout << "  Code generation complete.\n";
     std::cout << "\n=== Compilation Successful ===\n";
-    std::cout << "Output written to: " << outputFile << "\n";
+    std::cout << (publishShm.empty() ? "Output written to: " : "Published to: ") << outputFile << "\n";
     
     return 0;
 }
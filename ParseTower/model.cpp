@@ -0,0 +1,102 @@
+#include "model.h"
+
+GameModel GameModel::fromIR(const std::vector<IRInstruction>& instructions) {
+    GameModel model;
+    model.add(instructions);
+    return model;
+}
+
+void GameModel::add(const std::vector<IRInstruction>& instructions) {
+    GameModel& model = *this;
+
+    auto addSpawn = [&](const IRInstruction& instr, int count, int start, int interval) {
+        auto e = model.enemyIndex.find(instr.operands[1]);
+        auto w = waveIndex.find(instr.operands[0]);
+        if (e == model.enemyIndex.end() || w == waveIndex.end()) return;
+        model.waves[w->second].spawns.push_back({e->second, count, start, interval});
+    };
+
+    for (size_t i = 0; i < instructions.size(); i++) {
+        const IRInstruction& instr = instructions[i];
+        switch (instr.opcode) {
+            case IROpcode::DEFINE_MAP:
+                if (!model.hasMap) {
+                    model.hasMap = true;
+                    model.mapName = instr.operands[0];
+                    model.width = std::get<int>(instr.metadata.at("width"));
+                    model.height = std::get<int>(instr.metadata.at("height"));
+                    model.path = PathGeometry(PathGeometry::parse(std::get<std::string>(instr.metadata.at("path"))));
+                }
+                break;
+
+            case IROpcode::DEFINE_ENEMY: {
+                Enemy e;
+                e.name = instr.operands[0];
+                e.hp = std::get<int>(instr.metadata.at("hp"));
+                e.speed = std::get<double>(instr.metadata.at("speed"));
+                e.reward = std::get<int>(instr.metadata.at("reward"));
+                model.enemyIndex[e.name] = static_cast<int>(model.enemies.size());
+                model.enemies.push_back(e);
+                break;
+            }
+
+            case IROpcode::DEFINE_TOWER: {
+                Tower t;
+                t.name = instr.operands[0];
+                t.range = std::get<int>(instr.metadata.at("range"));
+                t.damage = std::get<int>(instr.metadata.at("damage"));
+                t.cost = std::get<int>(instr.metadata.at("cost"));
+                t.fireRate = std::get<double>(instr.metadata.at("fire_rate"));
+                t.dps = t.damage * t.fireRate;
+                model.towerIndex[t.name] = static_cast<int>(model.towers.size());
+                model.towers.push_back(t);
+                break;
+            }
+
+            case IROpcode::DEFINE_WAVE: {
+                Wave w;
+                w.name = instr.operands[0];
+                // A folded wave replays its canonical wave's spawns
+                if (instr.metadata.count("alias")) {
+                    auto canonical = waveIndex.find(std::get<std::string>(instr.metadata.at("alias")));
+                    if (canonical != waveIndex.end()) w.spawns = model.waves[canonical->second].spawns;
+                }
+                waveIndex[w.name] = model.waves.size();
+                model.waves.push_back(w);
+                break;
+            }
+
+            case IROpcode::SPAWN_ENEMY:
+                addSpawn(instr, std::get<int>(instr.metadata.at("count")),
+                         std::get<int>(instr.metadata.at("start")),
+                         std::get<int>(instr.metadata.at("interval")));
+                break;
+
+            case IROpcode::REPEAT_BEGIN:
+                i = IRGenerator::expandRepeat(instructions, i, addSpawn);
+                break;
+
+            case IROpcode::DEFINE_ALIAS: {
+                auto& index = std::get<std::string>(instr.metadata.at("kind")) == "enemy" ? model.enemyIndex
+                                                                                          : model.towerIndex;
+                auto canonical = index.find(instr.operands[1]);
+                if (canonical != index.end()) index[instr.operands[0]] = canonical->second;
+                break;
+            }
+
+            case IROpcode::PLACE_TOWER: {
+                auto t = model.towerIndex.find(instr.operands[0]);
+                if (t == model.towerIndex.end()) break;
+                Placement p;
+                p.tower = t->second;
+                p.x = std::get<int>(instr.metadata.at("x"));
+                p.y = std::get<int>(instr.metadata.at("y"));
+                model.placements.push_back(p);
+                break;
+            }
+
+            default:
+                break;
+        }
+    }
+}
@@ -0,0 +1,42 @@
+#ifndef MODEL_H
+#define MODEL_H
+
+#include "ir.h"
+#include "geometry.h"
+#include <vector>
+#include <string>
+#include <unordered_map>
+
+// Typed, index-based view of an IR program for analysis passes. Names are
+// resolved once here so passes work on plain arrays.
+struct GameModel {
+    struct Enemy { std::string name; int hp; double speed; int reward; };
+    struct Tower { std::string name; int range; int damage; int cost; double fireRate; double dps; };
+    struct Spawn { int enemy; int count; int start; int interval; };
+    struct Wave { std::string name; std::vector<Spawn> spawns; };
+    struct Placement { int tower; int x; int y; };
+
+    bool hasMap = false;
+    std::string mapName;
+    int width = 0;
+    int height = 0;
+    PathGeometry path;
+
+    std::vector<Enemy> enemies;
+    std::vector<Tower> towers;
+    std::vector<Wave> waves;
+    std::vector<Placement> placements;
+
+    std::unordered_map<std::string, int> enemyIndex;
+    std::unordered_map<std::string, int> towerIndex;
+    std::unordered_map<std::string, size_t> waveIndex;
+
+    // References to undefined names are skipped; semantic analysis has
+    // already rejected them for source input.
+    static GameModel fromIR(const std::vector<IRInstruction>& instructions);
+
+    // Append more of a program; fromIR is add() on an empty model
+    void add(const std::vector<IRInstruction>& instructions);
+};
+
+#endif // MODEL_H
@@ -1,29 +1,258 @@
 #include "optimizer.h"
 #include <iostream>
 #include <algorithm>
+#include <charconv>
+#include <climits>
+#include <random>
+#include <tuple>
+#include <unordered_map>
+
+namespace {
+
+// True when the spawn field varies across the iterations of a repeat block
+bool isProgression(const IRInstruction& instr, const std::string& field) {
+    std::string prefix = field + "_step_";
+    auto it = instr.metadata.lower_bound(prefix);
+    return it != instr.metadata.end() && it->first.compare(0, prefix.size(), prefix) == 0;
+}
+
+// Append metadata in key order; doubles are written round-trip exact.
+// Keys naming a repeat counter (<field>_step_<var>) use its nesting depth
+// so that blocks differing only in counter names compare equal.
+void appendMetadata(std::string& out, const IRInstruction& instr,
+                    const std::map<std::string, std::string>& counters) {
+    for (const auto& [key, value] : instr.metadata) {
+        size_t step = key.find("_step_");
+        if (step == std::string::npos) out += key;
+        else out += key.substr(0, step + 6) + counters.at(key.substr(step + 6));
+        out += '=';
+        if (auto i = std::get_if<int>(&value)) {
+            out += std::to_string(*i);
+        } else if (auto d = std::get_if<double>(&value)) {
+            char buf[32];
+            out.append(buf, std::to_chars(buf, buf + sizeof(buf), *d).ptr);
+        } else {
+            const auto& str = std::get<std::string>(value);
+            out += std::to_string(str.size()) + ':' + str;
+        }
+        out += ';';
+    }
+}
+
+// One past the last instruction of the wave body starting after `index`
+size_t waveBodyEnd(const std::vector<IRInstruction>& instructions, size_t index) {
+    const std::string& wave = instructions[index].operands[0];
+    size_t end = index + 1;
+    while (end < instructions.size() && !instructions[end].operands.empty() &&
+           instructions[end].operands[0] == wave &&
+           (instructions[end].opcode == IROpcode::SPAWN_ENEMY ||
+            instructions[end].opcode == IROpcode::REPEAT_BEGIN ||
+            instructions[end].opcode == IROpcode::REPEAT_END)) {
+        end++;
+    }
+    return end;
+}
+
+// A top-level spawn record: count enemies at start, start + interval, ...
+struct Progression {
+    int start;
+    int interval;
+    int count;
+    size_t position;  // Instruction the record is written back at
+    bool alive;
+};
+
+// Fold b into a when a.start comes first and their spawn times together
+// are one progression with the given interval
+bool absorb(Progression& a, Progression& b, long long interval) {
+    long long count = static_cast<long long>(a.count) + b.count;
+    if (interval <= 0 || interval > INT_MAX || count > INT_MAX ||
+        a.start + (count - 1) * interval > INT_MAX) {
+        return false;
+    }
+    a.interval = static_cast<int>(interval);
+    a.count = static_cast<int>(count);
+    a.position = std::min(a.position, b.position);
+    b.alive = false;
+    return true;
+}
+
+// Greedily coalesce the spawns of one enemy in one wave, sorted by start.
+// A record merges with another that continues it, precedes it by one
+// step, or interleaves with it at half its interval; leftover single
+// spawns pair up in start order. Every merge keeps the multiset of spawn
+// times. Returns the number of records removed.
+size_t coalesce(std::vector<Progression>& records) {
+    std::unordered_map<int, std::vector<size_t>> byStart;
+    for (size_t k = 0; k < records.size(); k++) byStart[records[k].start].push_back(k);
+
+    auto find = [&](long long start, const auto& accept) -> Progression* {
+        if (start < INT_MIN || start > INT_MAX) return nullptr;
+        auto it = byStart.find(static_cast<int>(start));
+        if (it == byStart.end()) return nullptr;
+        for (size_t k : it->second) {
+            if (records[k].alive && accept(records[k])) return &records[k];
+        }
+        return nullptr;
+    };
+
+    size_t removed = 0;
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        for (auto& p : records) {
+            while (p.alive) {
+                // Continues p at the same interval (a single spawn adopts it)
+                Progression* q = find(p.start + static_cast<long long>(p.count) * p.interval,
+                                      [&](const Progression& c) { return c.count == 1 || c.interval == p.interval; });
+                if (q && absorb(p, *q, p.interval)) { removed++; changed = true; continue; }
+
+                // A single spawn one step before p
+                q = p.count > 1 ? find(static_cast<long long>(p.start) - p.interval,
+                                       [](const Progression& c) { return c.count == 1; }) : nullptr;
+                if (q && absorb(*q, p, p.interval)) { removed++; changed = true; break; }
+
+                // Interleaves p at half its interval
+                q = p.interval % 2 == 0 ? find(p.start + p.interval / 2, [&](const Progression& c) {
+                        return (c.count == 1 || c.interval == p.interval) &&
+                               (c.count == p.count || c.count + 1 == p.count);
+                    }) : nullptr;
+                if (q && absorb(p, *q, p.interval / 2)) { removed++; changed = true; continue; }
+                break;
+            }
+        }
+
+        if (changed) continue;
+        Progression* single = nullptr;
+        for (auto& p : records) {
+            if (!p.alive || p.count != 1) continue;
+            if (single && p.start > single->start && absorb(*single, p, p.start - single->start)) {
+                removed++;
+                changed = true;
+                single = nullptr;
+            } else {
+                single = &p;
+            }
+        }
+    }
+    return removed;
+}
+
+// Place the groups of a wave, sorted by start, so that no tick holds more
+// than `peak` spawns. A group is delayed by at most `tolerance` and never
+// starts before a group that started earlier. Of the delays that fit it
+// whole it takes the one over the least loaded ticks; when none does, the
+// longest fitting head is placed and the rest continues with a delay at
+// least as large. Returns false if some spawn cannot be placed.
+bool placeUnderPeak(const std::vector<Progression>& groups, int tolerance, int peak,
+                    std::unordered_map<long long, int> histogram, std::vector<Progression>& pieces) {
+    pieces.clear();
+    long long floor = 0;        // Latest delayed start among earlier-starting groups
+    long long tieLatest = 0;
+    long long tieStart = -1;
+    for (const auto& g : groups) {
+        if (g.start != tieStart) {
+            floor = std::max(floor, tieLatest);
+            tieStart = g.start;
+        }
+        long long first = g.start;
+        int remaining = g.count;
+        long long minDelay = std::max(0LL, floor - g.start);
+        bool head = true;
+        while (remaining > 0) {
+            int bestCount = 0;
+            long long bestDelay = 0;
+            long long bestLoad = 0;
+            for (long long delay = minDelay; delay <= tolerance; delay++) {
+                int fits = 0;
+                long long load = 0;
+                while (fits < remaining) {
+                    auto it = histogram.find(first + delay + static_cast<long long>(fits) * g.interval);
+                    int ticks = it == histogram.end() ? 0 : it->second;
+                    if (ticks >= peak) break;
+                    load += ticks;
+                    fits++;
+                }
+                if (fits > bestCount || (fits == remaining && load < bestLoad)) {
+                    bestCount = fits;
+                    bestDelay = delay;
+                    bestLoad = load;
+                }
+            }
+            if (bestCount == 0) return false;
+
+            for (int k = 0; k < bestCount; k++) histogram[first + bestDelay + static_cast<long long>(k) * g.interval]++;
+            pieces.push_back({static_cast<int>(first + bestDelay), g.interval, bestCount, g.position, true});
+            if (head) tieLatest = std::max(tieLatest, first + bestDelay);
+            head = false;
+            first += static_cast<long long>(bestCount) * g.interval;
+            remaining -= bestCount;
+            minDelay = bestDelay;
+        }
+    }
+    return true;
+}
+
+// Every concrete spawn as (wave, enemy, time), sorted
+std::vector<std::tuple<std::string, std::string, long long>> spawnTimes(const std::vector<IRInstruction>& instructions) {
+    std::vector<std::tuple<std::string, std::string, long long>> times;
+    auto add = [&](const IRInstruction& spawn, int count, int start, int interval) {
+        for (int k = 0; k < count; k++) {
+            times.emplace_back(spawn.operands[0], spawn.operands[1], start + static_cast<long long>(k) * interval);
+        }
+    };
+    for (size_t i = 0; i < instructions.size(); i++) {
+        const IRInstruction& instr = instructions[i];
+        if (instr.opcode == IROpcode::REPEAT_BEGIN) {
+            i = IRGenerator::expandRepeat(instructions, i, add);
+        } else if (instr.opcode == IROpcode::SPAWN_ENEMY) {
+            add(instr, std::get<int>(instr.metadata.at("count")), std::get<int>(instr.metadata.at("start")),
+                std::get<int>(instr.metadata.at("interval")));
+        }
+    }
+    std::sort(times.begin(), times.end());
+    return times;
+}
+
+}
 
 std::vector<IRInstruction> Optimizer::optimize(const std::vector<IRInstruction>& instructions) {
     auto result = instructions;
     
     // Apply optimization passes in sequence
-    std::cout << "Running optimization passes...\n";
+    if (verbose) std::cout << "Running optimization passes...\n";
     
     // Pass 1: Remove duplicate definitions (keep first occurrence)
     result = duplicateDefinitionRemoval(result);
     
-    // Pass 2: Merge redundant spawns in same wave
+    // Pass 2: Coalesce spawns of the same enemy that form progressions
     result = redundantSpawnMerging(result);
     
-    // Pass 3: Constant folding (for any computed values)
+    // Pass 3: Flatten per-tick spawn spikes (opt-in)
+    if (smoothTicks > 0) result = spawnLoadSmoothing(result);
+    
+    // Pass 4: Constant folding (for any computed values)
     result = constantFolding(result);
     
-    // Pass 4: Dead code elimination
+    // Pass 5: Dead code elimination
     result = deadCodeElimination(result);
     
-    std::cout << "Optimization complete.\n";
+    // Pass 6: Fold definitions that differ only in name
+    result = structuralDeduplication(result);
+    
+    if (verbose) std::cout << "Optimization complete.\n";
     return result;
 }
 
+std::vector<IRInstruction> Optimizer::optimizeLocal(const std::vector<IRInstruction>& declaration) {
+    std::vector<IRInstruction> merged = redundantSpawnMerging(declaration);
+    return constantFolding(smoothTicks > 0 ? spawnLoadSmoothing(merged) : merged);
+}
+
+std::vector<IRInstruction> Optimizer::optimizeGlobal(const std::vector<IRInstruction>& instructions) {
+    return structuralDeduplication(deadCodeElimination(duplicateDefinitionRemoval(instructions)));
+}
+
 std::vector<IRInstruction> Optimizer::constantFolding(const std::vector<IRInstruction>& instructions) {
     std::vector<IRInstruction> optimized;
     
@@ -43,8 +272,9 @@ std::vector<IRInstruction> Optimizer::constantFolding(const std::vector<IRInstru
         }
         
         if (instr.opcode == IROpcode::SPAWN_ENEMY) {
-            // Calculate total spawn duration
-            if (instr.metadata.count("count") && instr.metadata.count("interval")) {
+            // Calculate total spawn duration; progressions stay symbolic
+            if (instr.metadata.count("count") && instr.metadata.count("interval") &&
+                !isProgression(instr, "count") && !isProgression(instr, "interval")) {
                 int count = std::get<int>(instr.metadata.at("count"));
                 int interval = std::get<int>(instr.metadata.at("interval"));
                 int totalDuration = count * interval;
@@ -59,20 +289,11 @@ std::vector<IRInstruction> Optimizer::constantFolding(const std::vector<IRInstru
 }
 
 std::vector<IRInstruction> Optimizer::deadCodeElimination(const std::vector<IRInstruction>& instructions) {
-    std::vector<IRInstruction> optimized;
     std::set<std::string> referencedEnemies;
     std::set<std::string> referencedTowers;
-    std::set<std::string> definedEnemies;
-    std::set<std::string> definedTowers;
     
-    // First pass: collect all references and definitions
+    // First pass: collect all references
     for (const auto& instr : instructions) {
-        if (instr.opcode == IROpcode::DEFINE_ENEMY && !instr.operands.empty()) {
-            definedEnemies.insert(instr.operands[0]);
-        }
-        if (instr.opcode == IROpcode::DEFINE_TOWER && !instr.operands.empty()) {
-            definedTowers.insert(instr.operands[0]);
-        }
         if (instr.opcode == IROpcode::SPAWN_ENEMY && instr.operands.size() > 1) {
             referencedEnemies.insert(instr.operands[1]);
         }
@@ -82,13 +303,21 @@ std::vector<IRInstruction> Optimizer::deadCodeElimination(const std::vector<IRIn
     }
     
     // Second pass: keep only referenced definitions
+    return removeUnreferenced(instructions, referencedEnemies, referencedTowers);
+}
+
+std::vector<IRInstruction> Optimizer::removeUnreferenced(const std::vector<IRInstruction>& instructions,
+                                                         const std::set<std::string>& referencedEnemies,
+                                                         const std::set<std::string>& referencedTowers) {
+    std::vector<IRInstruction> optimized;
+    
     for (const auto& instr : instructions) {
         bool keep = true;
         
         // Remove unreferenced enemy definitions
         if (instr.opcode == IROpcode::DEFINE_ENEMY && !instr.operands.empty()) {
             if (referencedEnemies.find(instr.operands[0]) == referencedEnemies.end()) {
-                std::cout << "  DCE: Removing unreferenced enemy: " << instr.operands[0] << "\n";
+                if (verbose) std::cout << "  DCE: Removing unreferenced enemy: " << instr.operands[0] << "\n";
                 keep = false;
             }
         }
@@ -96,7 +325,7 @@ std::vector<IRInstruction> Optimizer::deadCodeElimination(const std::vector<IRIn
         // Remove unreferenced tower definitions
         if (instr.opcode == IROpcode::DEFINE_TOWER && !instr.operands.empty()) {
             if (referencedTowers.find(instr.operands[0]) == referencedTowers.end()) {
-                std::cout << "  DCE: Removing unreferenced tower: " << instr.operands[0] << "\n";
+                if (verbose) std::cout << "  DCE: Removing unreferenced tower: " << instr.operands[0] << "\n";
                 keep = false;
             }
         }
@@ -125,7 +354,7 @@ std::vector<IRInstruction> Optimizer::duplicateDefinitionRemoval(const std::vect
             std::string key = getDefinitionKey(instr);
             
             if (seenDefinitions.find(key) != seenDefinitions.end()) {
-                std::cout << "  Optimization: Removing duplicate definition: " << key << "\n";
+                if (verbose) std::cout << "  Optimization: Removing duplicate definition: " << key << "\n";
                 keep = false;
             } else {
                 seenDefinitions.insert(key);
@@ -142,36 +371,330 @@ std::vector<IRInstruction> Optimizer::duplicateDefinitionRemoval(const std::vect
 
 std::vector<IRInstruction> Optimizer::redundantSpawnMerging(const std::vector<IRInstruction>& instructions) {
     std::vector<IRInstruction> optimized;
-    std::map<std::string, size_t> spawnGroupIndex; // Key -> index in optimized
     
-    for (const auto& instr : instructions) {
-        if (instr.opcode == IROpcode::SPAWN_ENEMY && instr.operands.size() >= 2) {
-            std::string wave = instr.operands[0];
-            std::string enemy = instr.operands[1];
-            int start = std::get<int>(instr.metadata.at("start"));
-            int interval = std::get<int>(instr.metadata.at("interval"));
+    for (size_t i = 0; i < instructions.size(); i++) {
+        optimized.push_back(instructions[i]);
+        if (instructions[i].opcode != IROpcode::DEFINE_WAVE || instructions[i].operands.empty()) continue;
+        size_t end = waveBodyEnd(instructions, i);
+        
+        // Top-level spawns grouped by enemy; repeat blocks are per-iteration
+        // templates and are left be
+        std::unordered_map<std::string, int> enemyIds;
+        std::vector<std::vector<Progression>> byEnemy;
+        int repeatDepth = 0;
+        size_t records = 0;
+        for (size_t k = i + 1; k < end; k++) {
+            const IRInstruction& instr = instructions[k];
+            if (instr.opcode == IROpcode::REPEAT_BEGIN) repeatDepth++;
+            if (instr.opcode == IROpcode::REPEAT_END) repeatDepth--;
+            if (instr.opcode != IROpcode::SPAWN_ENEMY || repeatDepth > 0) continue;
             
-            std::string key = wave + "_" + enemy + "_" + std::to_string(start) + "_" + std::to_string(interval);
+            auto id = enemyIds.emplace(instr.operands[1], static_cast<int>(byEnemy.size()));
+            if (id.second) byEnemy.emplace_back();
+            byEnemy[id.first->second].push_back({std::get<int>(instr.metadata.at("start")),
+                                                 std::get<int>(instr.metadata.at("interval")),
+                                                 std::get<int>(instr.metadata.at("count")), k, true});
+            records++;
+        }
+        
+        // Written back at the first instruction of each coalesced group
+        size_t removed = 0;
+        std::unordered_map<size_t, const Progression*> written;
+        for (auto& group : byEnemy) {
+            std::sort(group.begin(), group.end(), [](const Progression& a, const Progression& b) {
+                return a.start != b.start ? a.start < b.start : a.position < b.position;
+            });
+            removed += coalesce(group);
+            for (const auto& p : group) {
+                if (p.alive) written[p.position] = &p;
+            }
+        }
+        
+        repeatDepth = 0;
+        for (size_t k = i + 1; k < end; k++) {
+            IRInstruction instr = instructions[k];
+            if (instr.opcode == IROpcode::REPEAT_BEGIN) repeatDepth++;
+            if (instr.opcode == IROpcode::REPEAT_END) repeatDepth--;
+            if (instr.opcode == IROpcode::SPAWN_ENEMY && repeatDepth == 0) {
+                auto it = written.find(k);
+                if (it == written.end()) continue;
+                instr.metadata["start"] = it->second->start;
+                instr.metadata["interval"] = it->second->interval;
+                instr.metadata["count"] = it->second->count;
+            }
+            optimized.push_back(instr);
+        }
+        
+        if (verbose && removed > 0) {
+            std::cout << "  Optimization: Coalesced " << records << " spawns into " << records - removed
+                      << " in wave " << instructions[i].operands[0] << "\n";
+        }
+        i = end - 1;
+    }
+    
+    return optimized;
+}
+
+bool Optimizer::verifySpawnCoalescing(const std::vector<IRInstruction>& instructions, std::ostream& log) {
+    bool wasVerbose = verbose;
+    verbose = false;
+    
+    // The program itself, then random waves built by splitting progressions
+    // into pieces, interleavings, single spawns and duplicates, shuffled
+    std::vector<std::vector<IRInstruction>> cases = {instructions};
+    std::mt19937 rng(42);
+    auto uniform = [&](int lo, int hi) { return std::uniform_int_distribution<int>(lo, hi)(rng); };
+    for (int w = 0; w < 2000; w++) {
+        std::vector<IRInstruction> wave(1, IRInstruction(IROpcode::DEFINE_WAVE));
+        wave[0].operands = {"R" + std::to_string(w)};
+        auto spawn = [&](const std::string& enemy, int count, int start, int interval) {
+            IRInstruction instr(IROpcode::SPAWN_ENEMY);
+            instr.operands = {wave[0].operands[0], enemy};
+            instr.metadata["count"] = count;
+            instr.metadata["start"] = start;
+            instr.metadata["interval"] = interval;
+            wave.push_back(instr);
+        };
+        for (int g = uniform(1, 4); g > 0; g--) {
+            std::string enemy = uniform(0, 1) ? "A" : "B";
+            int count = uniform(1, 12), start = uniform(0, 40), interval = uniform(1, 6);
+            switch (uniform(0, 4)) {
+                case 0:  // Contiguous pieces
+                    for (int done = 0; done < count;) {
+                        int piece = uniform(1, count - done);
+                        spawn(enemy, piece, start + done * interval, interval);
+                        done += piece;
+                    }
+                    break;
+                case 1:  // Two interleaved halves
+                    spawn(enemy, (count + 1) / 2, start, 2 * interval);
+                    if (count > 1) spawn(enemy, count / 2, start + interval, 2 * interval);
+                    break;
+                case 2:  // Single spawns with unrelated intervals
+                    for (int k = 0; k < count; k++) spawn(enemy, 1, start + k * interval, uniform(1, 9));
+                    break;
+                case 3:  // Duplicated
+                    spawn(enemy, count, start, interval);
+                    spawn(enemy, count, start, interval);
+                    break;
+                default:
+                    spawn(enemy, count, start, interval);
+                    break;
+            }
+        }
+        std::shuffle(wave.begin() + 1, wave.end(), rng);
+        cases.push_back(wave);
+    }
+    
+    size_t before = 0;
+    size_t after = 0;
+    bool ok = true;
+    for (size_t c = 0; c < cases.size() && ok; c++) {
+        std::vector<IRInstruction> coalesced = redundantSpawnMerging(cases[c]);
+        if (spawnTimes(coalesced) != spawnTimes(cases[c])) {
+            log << "  MISMATCH: coalescing changed the spawns of "
+                << (c == 0 ? std::string("the program") : cases[c][0].operands[0]) << "\n";
+            ok = false;
+        }
+        for (const auto& instr : cases[c]) before += instr.opcode == IROpcode::SPAWN_ENEMY;
+        for (const auto& instr : coalesced) after += instr.opcode == IROpcode::SPAWN_ENEMY;
+    }
+    
+    verbose = wasVerbose;
+    if (ok) {
+        log << "  Spawn times matched in " << cases.size() << " cases; " << before << " spawn records coalesced to "
+            << after << ".\n";
+    }
+    return ok;
+}
+
+std::vector<IRInstruction> Optimizer::spawnLoadSmoothing(const std::vector<IRInstruction>& instructions) {
+    std::vector<IRInstruction> optimized;
+    
+    for (size_t i = 0; i < instructions.size(); i++) {
+        optimized.push_back(instructions[i]);
+        if (instructions[i].opcode != IROpcode::DEFINE_WAVE || instructions[i].operands.empty()) continue;
+        size_t end = waveBodyEnd(instructions, i);
+        
+        // Spawns inside repeat blocks stay where they are and count as fixed load
+        std::unordered_map<long long, int> fixed;
+        std::vector<Progression> groups;
+        int fixedPeak = 0;
+        long long latest = 0;
+        for (size_t k = i + 1; k < end; k++) {
+            const IRInstruction& instr = instructions[k];
+            if (instr.opcode == IROpcode::REPEAT_BEGIN) {
+                k = IRGenerator::expandRepeat(instructions, k, [&](const IRInstruction&, int count, int start, int interval) {
+                    for (int c = 0; c < count; c++) {
+                        fixedPeak = std::max(fixedPeak, ++fixed[start + static_cast<long long>(c) * interval]);
+                    }
+                });
+            } else if (instr.opcode == IROpcode::SPAWN_ENEMY) {
+                groups.push_back({std::get<int>(instr.metadata.at("start")), std::get<int>(instr.metadata.at("interval")),
+                                  std::get<int>(instr.metadata.at("count")), k, true});
+                latest = std::max(latest, static_cast<long long>(groups.back().start));
+            }
+        }
+        
+        // Delayed starts must stay representable
+        std::vector<Progression> pieces;
+        int before = 0;
+        int after = 0;
+        if (!groups.empty() && latest + smoothTicks <= INT_MAX) {
+            std::stable_sort(groups.begin(), groups.end(), [](const Progression& a, const Progression& b) {
+                return a.start < b.start;
+            });
+            std::unordered_map<long long, int> load = fixed;
+            for (const auto& g : groups) {
+                for (int c = 0; c < g.count; c++) {
+                    before = std::max(before, ++load[g.start + static_cast<long long>(c) * g.interval]);
+                }
+            }
             
-            if (spawnGroupIndex.find(key) != spawnGroupIndex.end()) {
-                // Merge: update existing spawn in-place
-                size_t idx = spawnGroupIndex[key];
-                int existingCount = std::get<int>(optimized[idx].metadata.at("count"));
-                int newCount = std::get<int>(instr.metadata.at("count"));
-                optimized[idx].metadata["count"] = existingCount + newCount;
-                std::cout << "  Optimization: Merged redundant spawn in wave " << wave << "\n";
-            } else {
-                spawnGroupIndex[key] = optimized.size();
+            // The lowest peak the greedy placement reaches, trying upwards
+            for (int peak = std::max(fixedPeak, 1); peak < before; peak++) {
+                if (placeUnderPeak(groups, smoothTicks, peak, fixed, pieces)) {
+                    after = peak;
+                    break;
+                }
+            }
+        }
+        
+        if (after == 0) {
+            optimized.insert(optimized.end(), instructions.begin() + i + 1, instructions.begin() + end);
+            i = end - 1;
+            continue;
+        }
+        
+        // Pieces of a split group follow the group's instruction
+        std::stable_sort(pieces.begin(), pieces.end(), [](const Progression& a, const Progression& b) {
+            return a.position < b.position;
+        });
+        auto piece = pieces.begin();
+        for (size_t k = i + 1; k < end; k++) {
+            if (instructions[k].opcode == IROpcode::REPEAT_BEGIN) {
+                size_t close = IRGenerator::expandRepeat(instructions, k, [](const IRInstruction&, int, int, int) {});
+                optimized.insert(optimized.end(), instructions.begin() + k, instructions.begin() + close + 1);
+                k = close;
+                continue;
+            }
+            for (; piece != pieces.end() && piece->position == k; ++piece) {
+                IRInstruction instr = instructions[k];
+                instr.metadata["start"] = piece->start;
+                instr.metadata["count"] = piece->count;
                 optimized.push_back(instr);
             }
-        } else {
-            optimized.push_back(instr);
         }
+        
+        if (verbose) {
+            std::cout << "  Smoothing: wave " << instructions[i].operands[0] << " peak " << before << " -> " << after
+                      << " spawns per tick (" << pieces.size() - groups.size() << " groups split)\n";
+        }
+        i = end - 1;
     }
     
     return optimized;
 }
 
+bool Optimizer::foldDefinition(const IRInstruction& instr, AliasTable& canonical, AliasTable& enemyAliases,
+                               AliasTable& towerAliases, std::vector<IRInstruction>& optimized) {
+    bool enemy = instr.opcode == IROpcode::DEFINE_ENEMY;
+    std::string signature = enemy ? "E|" : "T|";
+    appendMetadata(signature, instr, {});
+
+    auto [it, inserted] = canonical.emplace(signature, instr.operands[0]);
+    if (inserted) return false;
+
+    if (verbose) std::cout << "  Optimization: Folded " << (enemy ? "enemy " : "tower ")
+                           << instr.operands[0] << " into " << it->second << "\n";
+    (enemy ? enemyAliases : towerAliases)[instr.operands[0]] = it->second;
+    IRInstruction alias(IROpcode::DEFINE_ALIAS);
+    alias.operands = {instr.operands[0], it->second};
+    alias.metadata["kind"] = std::string(enemy ? "enemy" : "tower");
+    optimized.push_back(alias);
+    return true;
+}
+
+std::string Optimizer::resolveWave(std::vector<IRInstruction>& body, const AliasTable& enemyAliases) {
+    std::string signature = "W|";
+    std::map<std::string, std::string> counters;
+    int depth = 0;
+    for (auto& b : body) {
+        if (b.opcode == IROpcode::SPAWN_ENEMY) {
+            auto alias = enemyAliases.find(b.operands[1]);
+            if (alias != enemyAliases.end()) b.operands[1] = alias->second;
+            signature += "S" + std::to_string(b.operands[1].size()) + ':' + b.operands[1];
+            appendMetadata(signature, b, counters);
+        } else if (b.opcode == IROpcode::REPEAT_BEGIN) {
+            counters[b.operands[1]] = std::to_string(depth++);
+            signature += "R";
+            appendMetadata(signature, b, counters);
+        } else {
+            depth--;
+            signature += "E";
+        }
+        signature += '|';
+    }
+    return signature;
+}
+
+std::vector<IRInstruction> Optimizer::structuralDeduplication(const std::vector<IRInstruction>& instructions) {
+    std::vector<IRInstruction> optimized;
+    AliasTable canonical;   // Normalized body -> first name
+    AliasTable enemyAlias;  // Folded name -> canonical name
+    AliasTable towerAlias;
+
+    for (size_t i = 0; i < instructions.size(); i++) {
+        IRInstruction instr = instructions[i];
+
+        if ((instr.opcode == IROpcode::DEFINE_ENEMY || instr.opcode == IROpcode::DEFINE_TOWER) &&
+            !instr.operands.empty()) {
+            if (foldDefinition(instr, canonical, enemyAlias, towerAlias, optimized)) continue;
+        } else if (instr.opcode == IROpcode::PLACE_TOWER && !instr.operands.empty()) {
+            auto alias = towerAlias.find(instr.operands[0]);
+            if (alias != towerAlias.end()) instr.operands[0] = alias->second;
+        } else if (instr.opcode == IROpcode::DEFINE_WAVE && !instr.operands.empty() &&
+                   !instr.metadata.count("alias")) {
+            size_t end = waveBodyEnd(instructions, i);
+            std::vector<IRInstruction> body(instructions.begin() + i + 1, instructions.begin() + end);
+            std::string signature = resolveWave(body, enemyAlias);
+
+            auto [it, inserted] = canonical.emplace(signature, instr.operands[0]);
+            if (!inserted) {
+                if (verbose) std::cout << "  Optimization: Folded wave " << instr.operands[0]
+                                       << " into " << it->second << "\n";
+                instr.metadata["alias"] = it->second;
+                optimized.push_back(instr);
+            } else {
+                optimized.push_back(instr);
+                optimized.insert(optimized.end(), body.begin(), body.end());
+            }
+            i = end - 1;
+            continue;
+        }
+
+        optimized.push_back(instr);
+    }
+
+    return optimized;
+}
+
+std::vector<IRInstruction> Optimizer::finishDefinitions(const std::vector<IRInstruction>& definitions,
+                                                        const std::set<std::string>& enemyRefs,
+                                                        const std::set<std::string>& towerRefs,
+                                                        AliasTable& enemyAliases, AliasTable& towerAliases) {
+    std::vector<IRInstruction> live = removeUnreferenced(duplicateDefinitionRemoval(definitions), enemyRefs, towerRefs);
+
+    std::vector<IRInstruction> optimized;
+    AliasTable canonical;
+    for (const auto& instr : live) {
+        bool definition = instr.opcode == IROpcode::DEFINE_ENEMY || instr.opcode == IROpcode::DEFINE_TOWER;
+        if (definition && foldDefinition(instr, canonical, enemyAliases, towerAliases, optimized)) continue;
+        optimized.push_back(instr);
+    }
+    return optimized;
+}
+
 bool Optimizer::isDefinitionInstruction(IROpcode opcode) {
     return opcode == IROpcode::DEFINE_MAP ||
            opcode == IROpcode::DEFINE_ENEMY ||
@@ -5,20 +5,64 @@
 #include <vector>
 #include <set>
 #include <map>
+#include <unordered_map>
+#include <ostream>
 
 class Optimizer {
 public:
     // Main optimization entry point
     std::vector<IRInstruction> optimize(const std::vector<IRInstruction>& instructions);
+    
+    // optimize() split by scope, for callers that cache per declaration.
+    // For semantically valid programs, optimizeGlobal over the concatenated
+    // optimizeLocal results equals optimize(): waves are unique, so spawn
+    // merging never crosses declarations and folding is per instruction.
+    // Structural deduplication compares whole definitions and is global.
+    std::vector<IRInstruction> optimizeLocal(const std::vector<IRInstruction>& declaration);
+    std::vector<IRInstruction> optimizeGlobal(const std::vector<IRInstruction>& instructions);
+    
+    // optimizeGlobal for streaming builds, which keep the definitions and
+    // see each wave once. finishDefinitions drops definitions outside the
+    // referenced names and folds identical survivors into DEFINE_ALIAS,
+    // filling the alias tables. resolveWave rewrites a wave body's spawns
+    // through the enemy aliases and returns the signature two waves share
+    // exactly when structural deduplication would fold one into the other.
+    using AliasTable = std::unordered_map<std::string, std::string>;
+    std::vector<IRInstruction> finishDefinitions(const std::vector<IRInstruction>& definitions,
+                                                 const std::set<std::string>& enemyRefs,
+                                                 const std::set<std::string>& towerRefs,
+                                                 AliasTable& enemyAliases, AliasTable& towerAliases);
+    static std::string resolveWave(std::vector<IRInstruction>& body, const AliasTable& enemyAliases);
+    
+    // Check that spawn coalescing keeps every wave's spawn times, on the
+    // given program and on generated waves
+    bool verifySpawnCoalescing(const std::vector<IRInstruction>& instructions, std::ostream& log);
+    
+    // Pass progress is logged to stdout unless disabled
+    void setVerbose(bool enabled) { verbose = enabled; }
+    
+    // Opt-in: delay spawn groups by up to `ticks` to lower each wave's
+    // peak spawns per tick (0 disables)
+    void setSmoothing(int ticks) { smoothTicks = ticks; }
 
 private:
+    bool verbose = true;
+    int smoothTicks = 0;
+    
     // Optimization passes
     std::vector<IRInstruction> constantFolding(const std::vector<IRInstruction>& instructions);
     std::vector<IRInstruction> deadCodeElimination(const std::vector<IRInstruction>& instructions);
     std::vector<IRInstruction> duplicateDefinitionRemoval(const std::vector<IRInstruction>& instructions);
     std::vector<IRInstruction> redundantSpawnMerging(const std::vector<IRInstruction>& instructions);
+    std::vector<IRInstruction> spawnLoadSmoothing(const std::vector<IRInstruction>& instructions);
+    std::vector<IRInstruction> structuralDeduplication(const std::vector<IRInstruction>& instructions);
     
     // Helper functions
+    std::vector<IRInstruction> removeUnreferenced(const std::vector<IRInstruction>& instructions,
+                                                  const std::set<std::string>& enemyRefs,
+                                                  const std::set<std::string>& towerRefs);
+    bool foldDefinition(const IRInstruction& instr, AliasTable& canonical, AliasTable& enemyAliases,
+                        AliasTable& towerAliases, std::vector<IRInstruction>& optimized);
     bool isDefinitionInstruction(IROpcode opcode);
     bool isRedundantInstruction(const IRInstruction& instr);
     std::string getDefinitionKey(const IRInstruction& instr);
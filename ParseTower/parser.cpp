@@ -1,11 +1,39 @@
 #include "parser.h"
-#include <iostream>
+#include <stdexcept>
+#include <algorithm>
+#include <charconv>
+#include <cmath>
+#include <climits>
 
-Parser::Parser(Lexer& lx) : lexer(lx) {
+Parser::Parser(TokenSource& lx) : lexer(lx) {
     current = lexer.getNextToken();
 }
 
+void Parser::reset() {
+    previousEnd = 0;
+    constants.clear();
+    current = lexer.getNextToken();
+}
+
+void Parser::resume() {
+    previousEnd = 0;
+    current = lexer.getNextToken();
+}
+
+void Parser::defineConstant(const ConstDecl& decl) {
+    LinearExpr value;
+    value.isFloat = decl.isFloat;
+    value.real = decl.floatValue;
+    value.base = decl.intValue;
+    constants[decl.name] = value;
+}
+
+void Parser::fail(const std::string& message, int line) {
+    throw std::runtime_error(message + " at line " + std::to_string(line));
+}
+
 void Parser::advance() {
+    previousEnd = current.offset + current.lexeme.size();
     current = lexer.getNextToken();
 }
 
@@ -21,9 +49,7 @@ bool Parser::match(TokenType type) {
 // Expects a token of a certain type, advances, and returns it
 Token Parser::expect(TokenType type, const std::string& msg) {
     if (current.type != type) {
-        std::cerr << "Parser Error: expected " << msg
-                  << " at line " << current.line << std::endl;
-        exit(1);
+        throw std::runtime_error("expected " + msg + " at line " + std::to_string(current.line));
     }
     Token t = current;
     advance(); // advance AFTER storing the token
@@ -31,22 +57,80 @@ Token Parser::expect(TokenType type, const std::string& msg) {
 }
 
 std::shared_ptr<Program> Parser::parseProgram() {
+    auto prog = std::make_shared<Program>();
+    while (auto decl = parseNext()) {
+        prog->declarations.push_back(decl);
+    }
+    return prog;
+}
+
+std::shared_ptr<ASTNode> Parser::parseNext() {
+    if (current.type == TokenType::END_OF_FILE) return nullptr;
+    size_t begin = current.offset;
+    auto decl = parseDeclaration();
+    decl->sourceBegin = begin;
+    decl->sourceEnd = previousEnd;
+    return decl;
+}
+
+std::shared_ptr<Program> Parser::parseProgram(std::vector<ParseError>& errors) {
     auto prog = std::make_shared<Program>();
     while (current.type != TokenType::END_OF_FILE) {
-        prog->declarations.push_back(parseDeclaration());
+        size_t begin = current.offset;
+        try {
+            auto decl = parseDeclaration();
+            decl->sourceBegin = begin;
+            decl->sourceEnd = previousEnd;
+            prog->declarations.push_back(decl);
+        } catch (const std::runtime_error& e) {
+            ParseError error{e.what(), current.offset, begin, 0};
+            if (current.offset == begin) advance();
+            while (current.type != TokenType::MAP && current.type != TokenType::ENEMY &&
+                   current.type != TokenType::TOWER && current.type != TokenType::WAVE &&
+                   current.type != TokenType::PLACE && current.type != TokenType::CONST &&
+                   current.type != TokenType::END_OF_FILE) {
+                advance();
+            }
+            error.end = std::max(previousEnd, error.offset);
+            errors.push_back(error);
+        }
     }
     return prog;
 }
 
 std::shared_ptr<ASTNode> Parser::parseDeclaration() {
-    if (match(TokenType::MAP)) return parseMapDecl();
-    if (match(TokenType::ENEMY)) return parseEnemyDecl();
-    if (match(TokenType::TOWER)) return parseTowerDecl();
-    if (match(TokenType::WAVE)) return parseWaveDecl();
-    if (match(TokenType::PLACE)) return parsePlaceStmt();
+    loopVariables.clear();
+    bindings.clear();
+
+    std::shared_ptr<ASTNode> decl;
+    if (match(TokenType::MAP)) decl = parseMapDecl();
+    else if (match(TokenType::ENEMY)) decl = parseEnemyDecl();
+    else if (match(TokenType::TOWER)) decl = parseTowerDecl();
+    else if (match(TokenType::WAVE)) decl = parseWaveDecl();
+    else if (match(TokenType::PLACE)) decl = parsePlaceStmt();
+    else if (match(TokenType::CONST)) decl = parseConstDecl();
+    else throw std::runtime_error("unexpected declaration at line " + std::to_string(current.line));
+
+    decl->constants = bindings;
+    return decl;
+}
 
-    std::cerr << "Unexpected declaration at line " << current.line << "\n";
-    exit(1);
+std::shared_ptr<ConstDecl> Parser::parseConstDecl() {
+    auto node = std::make_shared<ConstDecl>();
+    Token nameTok = expect(TokenType::IDENT, "constant name");
+    node->name = nameTok.lexeme;
+    if (constants.count(node->name)) fail("constant " + node->name + " already defined", nameTok.line);
+
+    expect(TokenType::EQUAL, "=");
+    valueName = "constant value";
+    LinearExpr value = parseExpression();
+    expect(TokenType::SEMICOLON, ";");
+
+    node->isFloat = value.isFloat;
+    node->intValue = value.base;
+    node->floatValue = value.real;
+    constants[node->name] = value;
+    return node;
 }
 
 std::shared_ptr<MapDecl> Parser::parseMapDecl() {
@@ -60,11 +144,9 @@ std::shared_ptr<MapDecl> Parser::parseMapDecl() {
     expect(TokenType::SIZE, "size");
     expect(TokenType::EQUAL, "=");
     expect(TokenType::LPAREN, "(");
-    Token wTok = expect(TokenType::INT, "map width");
-    node->width = std::stoi(wTok.lexeme);
+    node->width = intValue("map width");
     expect(TokenType::COMMA, ",");
-    Token hTok = expect(TokenType::INT, "map height");
-    node->height = std::stoi(hTok.lexeme);
+    node->height = intValue("map height");
     expect(TokenType::RPAREN, ")");
     expect(TokenType::SEMICOLON, ";");
 
@@ -74,11 +156,9 @@ std::shared_ptr<MapDecl> Parser::parseMapDecl() {
     expect(TokenType::LBRACKET, "[");
     while (!match(TokenType::RBRACKET)) {
         expect(TokenType::LPAREN, "(");
-        Token xTok = expect(TokenType::INT, "x coordinate");
-        int x = std::stoi(xTok.lexeme);
+        int x = intValue("x coordinate");
         expect(TokenType::COMMA, ",");
-        Token yTok = expect(TokenType::INT, "y coordinate");
-        int y = std::stoi(yTok.lexeme);
+        int y = intValue("y coordinate");
         expect(TokenType::RPAREN, ")");
         node->path.push_back({x, y});
         match(TokenType::COMMA);
@@ -98,22 +178,19 @@ std::shared_ptr<EnemyDecl> Parser::parseEnemyDecl() {
     // hp
     Token hpTok = expect(TokenType::IDENT, "hp");
     expect(TokenType::EQUAL, "=");
-    Token hpValTok = expect(TokenType::INT, "hp value");
-    node->hp = std::stoi(hpValTok.lexeme);
+    node->hp = intValue("hp value");
     expect(TokenType::SEMICOLON, ";");
 
     // speed
     Token speedTokName = expect(TokenType::IDENT, "speed");
     expect(TokenType::EQUAL, "=");
-    Token speedValTok = expect(TokenType::FLOAT, "speed value");
-    node->speed = std::stod(speedValTok.lexeme);
+    node->speed = floatValue("speed value");
     expect(TokenType::SEMICOLON, ";");
 
     // reward
     Token rewardTokName = expect(TokenType::IDENT, "reward");
     expect(TokenType::EQUAL, "=");
-    Token rewardValTok = expect(TokenType::INT, "reward value");
-    node->reward = std::stoi(rewardValTok.lexeme);
+    node->reward = intValue("reward value");
     expect(TokenType::SEMICOLON, ";");
 
     expect(TokenType::RBRACE, "}"); // Close brace for enemy
@@ -129,26 +206,22 @@ std::shared_ptr<TowerDecl> Parser::parseTowerDecl() {
 
     Token rangeTokName = expect(TokenType::IDENT, "range");  // Should get 'range'
     expect(TokenType::EQUAL, "=");
-    Token rangeTokVal = expect(TokenType::INT, "range value");
-    node->range = std::stoi(rangeTokVal.lexeme);
+    node->range = intValue("range value");
     expect(TokenType::SEMICOLON, ";");
 
     Token dmgTokName = expect(TokenType::IDENT, "damage");
     expect(TokenType::EQUAL, "=");
-    Token dmgTokVal = expect(TokenType::INT, "damage value");
-    node->damage = std::stoi(dmgTokVal.lexeme);
+    node->damage = intValue("damage value");
     expect(TokenType::SEMICOLON, ";");
 
     Token frTokName = expect(TokenType::IDENT, "fire_rate");
     expect(TokenType::EQUAL, "=");
-    Token frTokVal = expect(TokenType::FLOAT, "fire_rate value");
-    node->fire_rate = std::stod(frTokVal.lexeme);
+    node->fire_rate = floatValue("fire_rate value");
     expect(TokenType::SEMICOLON, ";");
 
     Token costTokName = expect(TokenType::IDENT, "cost");
     expect(TokenType::EQUAL, "=");
-    Token costTokVal = expect(TokenType::INT, "cost value");
-    node->cost = std::stoi(costTokVal.lexeme);
+    node->cost = intValue("cost value");
     expect(TokenType::SEMICOLON, ";");
 
     expect(TokenType::RBRACE, "}");
@@ -162,40 +235,244 @@ std::shared_ptr<WaveDecl> Parser::parseWaveDecl() {
     node->name = nameTok.lexeme;
 
     expect(TokenType::LBRACE, "{");
+    parseWaveBody(*node, -1);
+    expect(TokenType::RBRACE, "}");
+    return node;
+}
 
-    while (match(TokenType::SPAWN)) {
-        SpawnStmt s;
-        expect(TokenType::LPAREN, "(");
+void Parser::parseWaveBody(WaveDecl& wave, int block) {
+    while (true) {
+        if (match(TokenType::SPAWN)) parseSpawnStmt(wave, block);
+        else if (match(TokenType::REPEAT)) parseRepeatBlock(wave, block);
+        else break;
+    }
+}
 
-        Token eTok = expect(TokenType::IDENT, "enemy type");
-        s.enemyType = eTok.lexeme;
+void Parser::parseSpawnStmt(WaveDecl& wave, int block) {
+    SpawnStmt s;
+    s.block = block;
+    expect(TokenType::LPAREN, "(");
 
-        expect(TokenType::COMMA, ",");
-        expect(TokenType::COUNT, "count");
-        expect(TokenType::EQUAL, "=");
-        Token cTok = expect(TokenType::INT, "count");
-        s.count = std::stoi(cTok.lexeme);
+    Token eTok = expect(TokenType::IDENT, "enemy type");
+    s.enemyType = eTok.lexeme;
 
-        expect(TokenType::COMMA, ",");
-        expect(TokenType::START, "start");
-        expect(TokenType::EQUAL, "=");
-        Token startTok = expect(TokenType::INT, "start");
-        s.start = std::stoi(startTok.lexeme);
+    expect(TokenType::COMMA, ",");
+    expect(TokenType::COUNT, "count");
+    expect(TokenType::EQUAL, "=");
+    LinearExpr count = linearValue("count");
+    s.count = count.base;
+    s.countSteps = count.steps;
 
-        expect(TokenType::COMMA, ",");
-        expect(TokenType::INTERVAL, "interval");
-        expect(TokenType::EQUAL, "=");
-        Token intvTok = expect(TokenType::INT, "interval");
-        s.interval = std::stoi(intvTok.lexeme);
+    expect(TokenType::COMMA, ",");
+    expect(TokenType::START, "start");
+    expect(TokenType::EQUAL, "=");
+    LinearExpr start = linearValue("start");
+    s.start = start.base;
+    s.startSteps = start.steps;
 
-        expect(TokenType::RPAREN, ")");
-        expect(TokenType::SEMICOLON, ";");
+    expect(TokenType::COMMA, ",");
+    expect(TokenType::INTERVAL, "interval");
+    expect(TokenType::EQUAL, "=");
+    LinearExpr interval = linearValue("interval");
+    s.interval = interval.base;
+    s.intervalSteps = interval.steps;
 
-        node->spawns.push_back(s);
+    expect(TokenType::RPAREN, ")");
+    expect(TokenType::SEMICOLON, ";");
+
+    wave.spawns.push_back(s);
+}
+
+void Parser::parseRepeatBlock(WaveDecl& wave, int parent) {
+    expect(TokenType::LPAREN, "(");
+    Token varTok = expect(TokenType::IDENT, "loop variable");
+    if (std::find(loopVariables.begin(), loopVariables.end(), varTok.lexeme) != loopVariables.end()) {
+        throw std::runtime_error("loop variable " + varTok.lexeme + " already in use at line " +
+                                 std::to_string(varTok.line));
     }
+    expect(TokenType::COMMA, ",");
+    int times = intValue("repeat count");
+    expect(TokenType::RPAREN, ")");
+    expect(TokenType::LBRACE, "{");
+
+    int block = static_cast<int>(wave.repeats.size());
+    wave.repeats.push_back({varTok.lexeme, times, parent, wave.spawns.size(), 0});
+
+    loopVariables.push_back(varTok.lexeme);
+    parseWaveBody(wave, block);
+    loopVariables.pop_back();
 
     expect(TokenType::RBRACE, "}");
-    return node;
+    wave.repeats[block].endSpawn = wave.spawns.size();
+}
+
+namespace {
+
+bool isConstant(const LinearExpr& e) {
+    return std::all_of(e.steps.begin(), e.steps.end(), [](int step) { return step == 0; });
+}
+
+double realOf(const LinearExpr& e) {
+    return e.isFloat ? e.real : e.base;
+}
+
+}
+
+// A value the declaration needs as a plain integer
+int Parser::intValue(const std::string& what) {
+    int line = current.line;
+    valueName = what;
+    LinearExpr value = parseExpression();
+    if (value.isFloat) fail(what + " must be an integer", line);
+    if (!isConstant(value)) fail(what + " cannot depend on a loop variable", line);
+    return value.base;
+}
+
+// Integers are accepted where a float is expected
+double Parser::floatValue(const std::string& what) {
+    int line = current.line;
+    valueName = what;
+    LinearExpr value = parseExpression();
+    if (!isConstant(value)) fail(what + " cannot depend on a loop variable", line);
+    return realOf(value);
+}
+
+LinearExpr Parser::linearValue(const std::string& what) {
+    int line = current.line;
+    valueName = what;
+    LinearExpr value = parseExpression();
+    if (value.isFloat) fail(what + " must be an integer", line);
+    return value;
+}
+
+// expression := term (('+' | '-') term)*
+LinearExpr Parser::parseExpression() {
+    LinearExpr value = parseTerm();
+    while (current.type == TokenType::PLUS || current.type == TokenType::MINUS) {
+        bool plus = current.type == TokenType::PLUS;
+        int line = current.line;
+        advance();
+        LinearExpr rhs = parseTerm();
+
+        if (value.isFloat || rhs.isFloat) {
+            if (!isConstant(value) || !isConstant(rhs)) fail("loop variables need integer arithmetic", line);
+            double result = plus ? realOf(value) + realOf(rhs) : realOf(value) - realOf(rhs);
+            if (!std::isfinite(result)) fail("value out of range", line);
+            value.isFloat = true;
+            value.real = result;
+            continue;
+        }
+
+        bool overflow = plus ? __builtin_add_overflow(value.base, rhs.base, &value.base)
+                             : __builtin_sub_overflow(value.base, rhs.base, &value.base);
+        for (size_t k = 0; k < value.steps.size(); k++) {
+            overflow |= plus ? __builtin_add_overflow(value.steps[k], rhs.steps[k], &value.steps[k])
+                             : __builtin_sub_overflow(value.steps[k], rhs.steps[k], &value.steps[k]);
+        }
+        if (overflow) fail("integer overflow", line);
+    }
+    return value;
+}
+
+// term := factor (('*' | '/') factor)*. Products need a constant side and
+// quotients constant operands, so progressions stay linear.
+LinearExpr Parser::parseTerm() {
+    LinearExpr value = parseFactor();
+    while (current.type == TokenType::MUL || current.type == TokenType::DIV) {
+        bool multiply = current.type == TokenType::MUL;
+        int line = current.line;
+        advance();
+        LinearExpr rhs = parseFactor();
+
+        if (value.isFloat || rhs.isFloat) {
+            if (!isConstant(value) || !isConstant(rhs)) fail("loop variables need integer arithmetic", line);
+            if (!multiply && realOf(rhs) == 0.0) fail("division by zero", line);
+            double result = multiply ? realOf(value) * realOf(rhs) : realOf(value) / realOf(rhs);
+            if (!std::isfinite(result)) fail("value out of range", line);
+            value.isFloat = true;
+            value.real = result;
+            continue;
+        }
+
+        if (!multiply) {
+            if (!isConstant(value) || !isConstant(rhs)) fail("cannot divide a loop variable", line);
+            if (rhs.base == 0) fail("division by zero", line);
+            if (value.base == INT_MIN && rhs.base == -1) fail("integer overflow", line);
+            value.base /= rhs.base;
+            continue;
+        }
+
+        if (!isConstant(value) && !isConstant(rhs)) {
+            fail("product of loop variables is not a progression", line);
+        }
+        if (!isConstant(value)) std::swap(value, rhs);
+
+        // value is constant here
+        int factor = value.base;
+        value = rhs;
+        bool overflow = __builtin_mul_overflow(value.base, factor, &value.base);
+        for (auto& step : value.steps) overflow |= __builtin_mul_overflow(step, factor, &step);
+        if (overflow) fail("integer overflow", line);
+    }
+    return value;
+}
+
+// factor := INT | FLOAT | constant | loop variable | '-' factor | '(' expression ')'
+LinearExpr Parser::parseFactor() {
+    LinearExpr value;
+    value.steps.assign(loopVariables.size(), 0);
+    int line = current.line;
+    const char* first = current.lexeme.data();
+    const char* last = first + current.lexeme.size();
+
+    if (current.type == TokenType::INT) {
+        auto result = std::from_chars(first, last, value.base);
+        if (result.ec == std::errc::result_out_of_range) fail("integer overflow", line);
+        if (result.ec != std::errc() || result.ptr != last) fail("expected " + valueName, line);
+        advance();
+    } else if (current.type == TokenType::FLOAT) {
+        auto result = std::from_chars(first, last, value.real);
+        if (result.ec != std::errc() || result.ptr != last) fail("expected " + valueName, line);
+        value.isFloat = true;
+        advance();
+    } else if (current.type == TokenType::IDENT) {
+        auto loop = std::find(loopVariables.begin(), loopVariables.end(), current.lexeme);
+        if (loop != loopVariables.end()) {
+            value.steps[loop - loopVariables.begin()] = 1;
+        } else {
+            auto constant = constants.find(current.lexeme);
+            if (constant == constants.end()) fail("unknown name " + current.lexeme, line);
+            value.isFloat = constant->second.isFloat;
+            value.real = constant->second.real;
+            value.base = constant->second.base;
+
+            // Record the value read, so callers caching by source text can
+            // tell when a constant changed underneath the declaration
+            char buffer[32];
+            auto end = value.isFloat ? std::to_chars(buffer, buffer + sizeof(buffer), value.real).ptr
+                                     : std::to_chars(buffer, buffer + sizeof(buffer), value.base).ptr;
+            bindings += current.lexeme;
+            bindings += '=';
+            bindings.append(buffer, end);
+            bindings += ';';
+        }
+        advance();
+    } else if (match(TokenType::MINUS)) {
+        value = parseFactor();
+        if (value.isFloat) {
+            value.real = -value.real;
+        } else {
+            bool overflow = __builtin_sub_overflow(0, value.base, &value.base);
+            for (auto& step : value.steps) overflow |= __builtin_sub_overflow(0, step, &step);
+            if (overflow) fail("integer overflow", line);
+        }
+    } else if (match(TokenType::LPAREN)) {
+        value = parseExpression();
+        expect(TokenType::RPAREN, ")");
+    } else {
+        fail("expected " + valueName, line);
+    }
+    return value;
 }
 
 std::shared_ptr<PlaceStmt> Parser::parsePlaceStmt() {
@@ -206,13 +483,11 @@ std::shared_ptr<PlaceStmt> Parser::parsePlaceStmt() {
     expect(TokenType::AT, "at");
     expect(TokenType::LPAREN, "(");
 
-    Token xTok = expect(TokenType::INT, "x coordinate");
-    node->x = std::stoi(xTok.lexeme);
+    node->x = intValue("x coordinate");
 
     expect(TokenType::COMMA, ",");
 
-    Token yTok = expect(TokenType::INT, "y coordinate");
-    node->y = std::stoi(yTok.lexeme);
+    node->y = intValue("y coordinate");
 
     expect(TokenType::RPAREN, ")");
     expect(TokenType::SEMICOLON, ";");
@@ -3,26 +3,80 @@
 
 #include "lexer.h"
 #include "ast.h"
+#include <unordered_map>
+
+// A declaration that failed to parse, from its first token up to the next
+// declaration keyword
+struct ParseError {
+    std::string message;
+    size_t offset;      // Token the parser stopped at
+    size_t begin;
+    size_t end;
+};
+
+// A folded numeric expression. Integers may be linear in the enclosing
+// repeat counters: base + sum(steps[k] * counter k), outermost counter first.
+struct LinearExpr {
+    bool isFloat = false;
+    double real = 0.0; // Value when isFloat
+    int base = 0;
+    std::vector<int> steps;
+};
 
 class Parser {
     public:
-        Parser(Lexer& lx);
+        Parser(TokenSource& lx);
 
         std::shared_ptr<Program> parseProgram();
 
+        // The next top-level declaration with its source range set, or
+        // null once the tokens run out
+        std::shared_ptr<ASTNode> parseNext();
+
+        // Keep going after a bad declaration: report it, skip to the next
+        // map/enemy/tower/wave/place/const keyword and parse the rest
+        std::shared_ptr<Program> parseProgram(std::vector<ParseError>& errors);
+
+        // Re-prime after the lexer was reset to new source; forgets constants
+        void reset();
+
+        // Re-prime after the lexer moved on to the next piece of the same
+        // source; constants declared so far stay in scope
+        void resume();
+
+        // Bring a constant declared outside the source being parsed into scope
+        void defineConstant(const ConstDecl& decl);
+
     private:
-        Lexer& lexer;
+        TokenSource& lexer;
         Token current;
+        size_t previousEnd = 0; // End offset of the last consumed token
+        std::vector<std::string> loopVariables; // Enclosing repeat counters, outermost first
+        std::unordered_map<std::string, LinearExpr> constants;
+        std::string bindings;   // Constants read by the current declaration
+        std::string valueName;  // What the expression being parsed is, for messages
 
         void advance();
         bool match(TokenType type);
         Token expect(TokenType type, const std::string& msg);
 
         std::shared_ptr<ASTNode> parseDeclaration();
+        std::shared_ptr<ConstDecl> parseConstDecl();
         std::shared_ptr<MapDecl> parseMapDecl();
         std::shared_ptr<EnemyDecl> parseEnemyDecl();
         std::shared_ptr<TowerDecl> parseTowerDecl();
         std::shared_ptr<WaveDecl> parseWaveDecl();
+        void parseWaveBody(WaveDecl& wave, int block);
+        void parseSpawnStmt(WaveDecl& wave, int block);
+        void parseRepeatBlock(WaveDecl& wave, int parent);
+        int intValue(const std::string& what);
+        double floatValue(const std::string& what);
+        LinearExpr linearValue(const std::string& what);
+        [[noreturn]] void fail(const std::string& message, int line);
+
+        LinearExpr parseExpression();
+        LinearExpr parseTerm();
+        LinearExpr parseFactor();
         std::shared_ptr<PlaceStmt> parsePlaceStmt();
 };
 
@@ -0,0 +1,250 @@
+#include "pipeline.h"
+#include "semantic.h"
+#include "ircache.h"
+#include <chrono>
+#include <iomanip>
+#include <exception>
+#include <memory>
+#include <stdexcept>
+
+namespace {
+
+const size_t TOKEN_BATCH = 1024;
+const size_t DECLARATION_BATCH = 32;
+const size_t RING_BATCHES = 16;
+
+// What flows between stages. The last batch of a stream has `last` set
+// and carries the error that ended it, if any.
+template <typename T>
+struct Batch {
+    std::vector<T> items;
+    std::exception_ptr error;
+    bool last = false;
+};
+
+using TokenRing = SpscRing<Batch<Token>>;
+using DeclarationRing = SpscRing<Batch<std::shared_ptr<ASTNode>>>;
+using IRRing = SpscRing<Batch<IRInstruction>>;
+
+// Feeds the parser from the lexer's ring
+class RingTokens : public TokenSource {
+public:
+    explicit RingTokens(TokenRing& ring) : ring(ring) {}
+
+    Token getNextToken() override {
+        while (next == batch.items.size()) {
+            if (batch.last) return end;
+            batch = ring.pop();
+            next = 0;
+        }
+        Token token = std::move(batch.items[next++]);
+        if (token.type == TokenType::END_OF_FILE) end = token;
+        return token;
+    }
+
+    // Consume the rest of the stream so the lexer can finish
+    void drain() {
+        while (!batch.last) batch = ring.pop();
+    }
+
+private:
+    TokenRing& ring;
+    Batch<Token> batch;
+    size_t next = 0;
+    Token end{TokenType::END_OF_FILE, "", 0};
+};
+
+// Runs `work` on each batch from `in` and forwards what it produces to
+// `out`, in order. After `work` throws, the rest of the input is only
+// drained; an error from upstream takes precedence over the stage's own,
+// matching the sequential pipeline, which finishes each stage first.
+template <typename In, typename Out, typename Work>
+void relay(SpscRing<Batch<In>>& in, SpscRing<Batch<Out>>& out, Work work) {
+    std::exception_ptr failure;
+    while (true) {
+        Batch<In> batch = in.pop();
+        if (!failure) {
+            Batch<Out> produced;
+            try {
+                for (auto& item : batch.items) work(item, produced.items);
+            } catch (...) {
+                failure = std::current_exception();
+            }
+            if (!produced.items.empty()) out.push(std::move(produced));
+        }
+        if (batch.last) {
+            Batch<Out> end;
+            end.error = batch.error ? batch.error : failure;
+            end.last = true;
+            out.push(std::move(end));
+            return;
+        }
+    }
+}
+
+}
+
+PipelineCompiler::PipelineCompiler(const CompileOptions& opts) : options(opts) {
+    optimizer.setVerbose(false);
+    optimizer.setSmoothing(options.smoothTicks);
+    codeGen.setStartingGold(options.startingGold);
+}
+
+std::string PipelineCompiler::compile(const std::string& source) {
+    stats = Stats();
+
+    IRCache::Key key;
+    if (options.cache) {
+        key = IRCache::keyFor(source, options);
+        if (options.cache->load(key, optimizedIR)) {
+            return options.readable ? codeGen.generateReadable(optimizedIR) : codeGen.generateJSON(optimizedIR);
+        }
+    }
+
+    TokenRing tokens(RING_BATCHES);
+    DeclarationRing parsed(RING_BATCHES);
+    DeclarationRing checked(RING_BATCHES);
+    IRRing lowered(RING_BATCHES);
+
+    std::thread lex([&] {
+        Lexer lexer(source);
+        Batch<Token> batch;
+        while (true) {
+            batch.items.push_back(lexer.getNextToken());
+            stats.tokens++;
+            bool end = batch.items.back().type == TokenType::END_OF_FILE;
+            if (end || batch.items.size() == TOKEN_BATCH) {
+                batch.last = end;
+                tokens.push(std::move(batch));
+                batch = Batch<Token>();
+                if (end) return;
+            }
+        }
+    });
+
+    std::thread parse([&] {
+        RingTokens input(tokens);
+        Batch<std::shared_ptr<ASTNode>> batch;
+        try {
+            Parser parser(input);
+            while (auto decl = parser.parseNext()) {
+                batch.items.push_back(decl);
+                if (batch.items.size() == DECLARATION_BATCH) {
+                    parsed.push(std::move(batch));
+                    batch = Batch<std::shared_ptr<ASTNode>>();
+                }
+            }
+        } catch (...) {
+            // Declarations before the bad one still go down the line
+            batch.error = std::current_exception();
+            input.drain();
+        }
+        batch.last = true;
+        parsed.push(std::move(batch));
+    });
+
+    // The analyzer keeps pointers into every declaration it has seen
+    std::vector<std::shared_ptr<ASTNode>> declarations;
+    std::thread check([&] {
+        SemanticAnalyzer analyzer;
+        relay(parsed, checked, [&](std::shared_ptr<ASTNode>& decl, std::vector<std::shared_ptr<ASTNode>>& out) {
+            declarations.push_back(decl);
+            analyzer.analyzeDeclaration(decl.get());
+            out.push_back(decl);
+        });
+    });
+
+    std::thread lower([&] {
+        IRGenerator irGen;
+        Optimizer local;
+        local.setVerbose(false);
+        local.setSmoothing(options.smoothTicks);
+        relay(checked, lowered, [&](std::shared_ptr<ASTNode>& decl, std::vector<IRInstruction>& out) {
+            std::vector<IRInstruction> ir = irGen.generateDeclaration(decl.get());
+            if (options.optimize) ir = local.optimizeLocal(ir);
+            out.insert(out.end(), ir.begin(), ir.end());
+        });
+    });
+
+    // Every stage runs to its last batch even after an error, so the
+    // threads can always be joined once the last IR batch is in
+    std::vector<IRInstruction> ir;
+    std::exception_ptr error;
+    while (true) {
+        Batch<IRInstruction> batch = lowered.pop();
+        ir.insert(ir.end(), batch.items.begin(), batch.items.end());
+        if (batch.last) {
+            error = batch.error;
+            break;
+        }
+    }
+    lex.join();
+    parse.join();
+    check.join();
+    lower.join();
+
+    stats.declarations = declarations.size();
+    stats.instructions = ir.size();
+    stats.stalls[0] = tokens.producerStalls();
+    stats.stalls[1] = parsed.producerStalls();
+    stats.stalls[2] = checked.producerStalls();
+    stats.stalls[3] = lowered.producerStalls();
+    if (error) std::rethrow_exception(error);
+
+    optimizedIR = options.optimize ? optimizer.optimizeGlobal(ir) : ir;
+    if (options.cache) options.cache->store(key, optimizedIR);
+
+    return options.readable ? codeGen.generateReadable(optimizedIR) : codeGen.generateJSON(optimizedIR);
+}
+
+bool PipelineCompiler::verify(const std::string& source, const CompileOptions& options, std::ostream& log) {
+    CompileOptions uncached = options;
+    uncached.cache = nullptr;
+    Compiler sequential(uncached);
+    PipelineCompiler pipelined(uncached);
+
+    // Alternate the two builds for at least half a second. A failing input
+    // must fail the same way in both.
+    std::string expected, actual;
+    double sequentialSeconds = 0.0, pipelinedSeconds = 0.0;
+    size_t runs = 0;
+    do {
+        auto start = std::chrono::steady_clock::now();
+        try {
+            expected = sequential.compile(source);
+        } catch (const std::exception& e) {
+            expected = std::string("error: ") + e.what();
+        }
+        auto middle = std::chrono::steady_clock::now();
+        try {
+            actual = pipelined.compile(source);
+        } catch (const std::exception& e) {
+            actual = std::string("error: ") + e.what();
+        }
+        auto end = std::chrono::steady_clock::now();
+        sequentialSeconds += std::chrono::duration<double>(middle - start).count();
+        pipelinedSeconds += std::chrono::duration<double>(end - middle).count();
+        runs++;
+
+        if (actual != expected) {
+            log << "  MISMATCH after " << runs << " run(s)\n";
+            return false;
+        }
+    } while (sequentialSeconds + pipelinedSeconds < 0.5 && runs < 1000);
+
+    if (expected.compare(0, 7, "error: ") == 0) {
+        log << "  Both builds failed the same way (" << expected.substr(7) << ").\n";
+        return true;
+    }
+
+    const Stats& stats = pipelined.lastStats();
+    double megabytes = static_cast<double>(source.size()) * runs / (1024.0 * 1024.0);
+    log << "  Pipelined output matched (" << actual.size() << " bytes, " << stats.tokens << " tokens, "
+        << stats.declarations << " declarations, " << runs << " run(s)).\n";
+    log << std::fixed << std::setprecision(2);
+    log << "  Throughput: sequential " << megabytes / sequentialSeconds << " MB/s, pipelined "
+        << megabytes / pipelinedSeconds << " MB/s (" << std::thread::hardware_concurrency() << " core(s)).\n";
+    log << "  Back-pressure stalls: lex " << stats.stalls[0] << ", parse " << stats.stalls[1]
+        << ", check " << stats.stalls[2] << ", lower " << stats.stalls[3] << ".\n";
+    return true;
+}
@@ -0,0 +1,106 @@
+#ifndef PIPELINE_H
+#define PIPELINE_H
+
+#include "driver.h"
+#include <atomic>
+#include <vector>
+#include <string>
+#include <ostream>
+#include <thread>
+#include <cstddef>
+
+// Bounded single-producer/single-consumer ring. push blocks while the ring
+// is full and pop while it is empty, so a slow stage holds back the one
+// feeding it instead of letting batches pile up. Each index is written by
+// one side only and published with release/acquire, so no lock is taken.
+template <typename T>
+class SpscRing {
+public:
+    explicit SpscRing(size_t capacity) {
+        size_t size = 1;
+        while (size < capacity) size <<= 1;
+        slots.resize(size);
+        mask = size - 1;
+    }
+
+    SpscRing(const SpscRing&) = delete;
+    SpscRing& operator=(const SpscRing&) = delete;
+
+    void push(T&& item) {
+        size_t t = tail.load(std::memory_order_relaxed);
+        if (t - head.load(std::memory_order_acquire) > mask) {
+            fullWaits++;
+            for (unsigned spins = 0; t - head.load(std::memory_order_acquire) > mask; spins++) backoff(spins);
+        }
+        slots[t & mask] = std::move(item);
+        tail.store(t + 1, std::memory_order_release);
+    }
+
+    T pop() {
+        size_t h = head.load(std::memory_order_relaxed);
+        if (tail.load(std::memory_order_acquire) == h) {
+            emptyWaits++;
+            for (unsigned spins = 0; tail.load(std::memory_order_acquire) == h; spins++) backoff(spins);
+        }
+        T item = std::move(slots[h & mask]);
+        head.store(h + 1, std::memory_order_release);
+        return item;
+    }
+
+    // Pushes that found the ring full and pops that found it empty. Each
+    // counter belongs to one side; read them after both have finished.
+    size_t producerStalls() const { return fullWaits; }
+    size_t consumerStalls() const { return emptyWaits; }
+
+private:
+    std::vector<T> slots;
+    size_t mask = 0;
+    alignas(64) std::atomic<size_t> head{0};   // Next slot to pop; written by the consumer
+    alignas(64) std::atomic<size_t> tail{0};   // Next slot to push; written by the producer
+    alignas(64) size_t fullWaits = 0;
+    alignas(64) size_t emptyWaits = 0;
+
+    // Spin briefly for the other side, then give up the core to it
+    static void backoff(unsigned spins) {
+        if (spins >= 64) std::this_thread::yield();
+    }
+};
+
+// Compiler with each front-end stage on its own thread: lexing, parsing,
+// semantic checks and IR lowering (with per-declaration optimization) run
+// concurrently, linked by SpscRings that carry token and declaration
+// batches in source order. The caller's thread collects the IR, runs the
+// whole-program passes and generates output. Errors travel down the rings
+// in order, so a failing input reports what Compiler reports. Output is
+// byte-identical to Compiler::compile. Errors are thrown as
+// std::runtime_error.
+class PipelineCompiler {
+public:
+    explicit PipelineCompiler(const CompileOptions& options);
+
+    std::string compile(const std::string& source);
+
+    // Counters of the last compile. Stalls count the times a stage found
+    // its output ring full, i.e. back-pressure from the stage after it.
+    struct Stats {
+        size_t tokens = 0;
+        size_t declarations = 0;
+        size_t instructions = 0;
+        size_t stalls[4] = {0, 0, 0, 0};   // lex, parse, check, lower
+    };
+    const Stats& lastStats() const { return stats; }
+
+    const std::vector<IRInstruction>& lastIR() const { return optimizedIR; }
+
+    // Compare against Compiler on `source` and report the throughput of both
+    static bool verify(const std::string& source, const CompileOptions& options, std::ostream& log);
+
+private:
+    CompileOptions options;
+    Optimizer optimizer;
+    CodeGenerator codeGen;
+    std::vector<IRInstruction> optimizedIR;
+    Stats stats;
+};
+
+#endif // PIPELINE_H
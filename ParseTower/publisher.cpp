@@ -0,0 +1,332 @@
+#include "publisher.h"
+#include "model.h"
+#include <algorithm>
+#include <thread>
+#include <chrono>
+#include <stdexcept>
+#include <sys/file.h>
+
+namespace {
+
+const size_t SEGMENT_ALIGN = 4096;
+
+size_t roundUp(size_t value, size_t to) {
+    return (value + to - 1) / to * to;
+}
+
+// Appends strings and 8-byte aligned tables after a header placeholder
+class ImageBuilder {
+public:
+    ImageBuilder() : bytes(sizeof(ShmConfigImage), '\0') {}
+
+    ShmConfigImage::Range string(const std::string& text) {
+        ShmConfigImage::Range range{bytes.size(), text.size()};
+        bytes += text;
+        return range;
+    }
+
+    template <typename T>
+    ShmConfigImage::Range table(const std::vector<T>& rows) {
+        bytes.resize(roundUp(bytes.size(), 8), '\0');
+        ShmConfigImage::Range range{bytes.size(), rows.size()};
+        bytes.append(reinterpret_cast<const char*>(rows.data()), rows.size() * sizeof(T));
+        return range;
+    }
+
+    std::string finish(ShmConfigImage& header) {
+        header.magic = ShmConfigImage::MAGIC;
+        header.size = bytes.size();
+        std::memcpy(&bytes[0], &header, sizeof(header));
+        return std::move(bytes);
+    }
+
+private:
+    std::string bytes;
+};
+
+}
+
+ShmPublisher::ShmPublisher(const std::string& name)
+    : segmentPath(name.empty() || name[0] != '/' ? "/" + name : name) {
+    fd = shm_open(segmentPath.c_str(), O_RDWR | O_CREAT, 0644);
+    if (fd < 0) throw std::runtime_error("could not open shared memory " + segmentPath);
+
+    try {
+        if (flock(fd, LOCK_EX | LOCK_NB) != 0) {
+            throw std::runtime_error("another process is publishing to " + segmentPath);
+        }
+
+        struct stat info;
+        if (fstat(fd, &info) != 0) throw std::runtime_error("could not stat shared memory " + segmentPath);
+        size_t size = static_cast<size_t>(info.st_size);
+        if (size < sizeof(ShmConfigSegment)) {
+            // New segment: the zero-filled header is generation 0, no buffers
+            resize(roundUp(sizeof(ShmConfigSegment), SEGMENT_ALIGN));
+        } else {
+            void* address = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+            if (address == MAP_FAILED) throw std::runtime_error("could not map shared memory " + segmentPath);
+            base = static_cast<char*>(address);
+            mapped = size;
+        }
+
+        uint64_t magic = segment()->magic.load(std::memory_order_acquire);
+        if (magic == 0) {
+            segment()->version = ShmConfigSegment::VERSION;
+            segment()->magic.store(ShmConfigSegment::MAGIC, std::memory_order_release);
+        } else if (magic != ShmConfigSegment::MAGIC || segment()->version != ShmConfigSegment::VERSION) {
+            throw std::runtime_error(segmentPath + " is not a ParseTower config segment");
+        }
+    } catch (...) {
+        if (base) munmap(base, mapped);
+        ::close(fd);
+        throw;
+    }
+}
+
+ShmPublisher::~ShmPublisher() {
+    if (base) munmap(base, mapped);
+    ::close(fd);   // Releases the lock
+}
+
+void ShmPublisher::resize(size_t size) {
+    if (ftruncate(fd, static_cast<off_t>(size)) != 0) {
+        throw std::runtime_error("could not grow shared memory " + segmentPath);
+    }
+    if (base) munmap(base, mapped);
+    base = nullptr;
+    void* address = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (address == MAP_FAILED) throw std::runtime_error("could not map shared memory " + segmentPath);
+    base = static_cast<char*>(address);
+    mapped = size;
+}
+
+uint64_t ShmPublisher::publish(const std::string& image) {
+    uint64_t generation = segment()->generation.load(std::memory_order_relaxed) + 1;
+    size_t s = generation & 1;
+
+    // Readers still on this buffer see the odd sequence and retry. A
+    // publisher killed mid-write leaves the sequence odd, so force the
+    // parity rather than trusting it.
+    uint64_t sequence = segment()->slots[s].sequence.load(std::memory_order_relaxed) | 1;
+    segment()->slots[s].sequence.store(sequence, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    // Grow by appending a larger buffer; the segment never shrinks, so
+    // readers' mappings of the old buffers stay valid
+    if (image.size() > segment()->slots[s].capacity.load(std::memory_order_relaxed)) {
+        size_t offset = mapped;
+        size_t capacity = roundUp(image.size() + image.size() / 2, SEGMENT_ALIGN);
+        resize(offset + capacity);
+        segment()->slots[s].offset.store(offset, std::memory_order_relaxed);
+        segment()->slots[s].capacity.store(capacity, std::memory_order_relaxed);
+    }
+
+    ShmConfigSegment::Slot& slot = segment()->slots[s];
+    std::memcpy(base + slot.offset.load(std::memory_order_relaxed), image.data(), image.size());
+    slot.size.store(image.size(), std::memory_order_relaxed);
+    slot.sequence.store(sequence + 1, std::memory_order_release);
+    segment()->generation.store(generation, std::memory_order_release);
+    return generation;
+}
+
+std::string ShmPublisher::buildImage(const std::vector<IRInstruction>& instructions, CodeGenerator& codeGen,
+                                     int startingGold) {
+    GameModel model = GameModel::fromIR(instructions);
+    ImageBuilder builder;
+    ShmConfigImage header{};
+
+    header.hasMap = model.hasMap ? 1 : 0;
+    header.width = model.width;
+    header.height = model.height;
+    header.startingGold = startingGold;
+    header.mapName = builder.string(model.mapName);
+
+    std::vector<ShmConfigImage::Point> path;
+    for (const auto& p : model.path.waypoints()) path.push_back({p.first, p.second});
+
+    std::vector<ShmConfigImage::Enemy> enemies;
+    for (const auto& e : model.enemies) {
+        enemies.push_back({builder.string(e.name), e.hp, e.reward, e.speed});
+    }
+
+    std::vector<ShmConfigImage::Tower> towers;
+    for (const auto& t : model.towers) {
+        towers.push_back({builder.string(t.name), t.range, t.damage, t.cost, 0, t.fireRate, t.dps});
+    }
+
+    // Folded names point at their canonical entry
+    std::vector<ShmConfigImage::Alias> aliases;
+    for (const auto& instr : instructions) {
+        if (instr.opcode != IROpcode::DEFINE_ALIAS) continue;
+        bool enemy = std::get<std::string>(instr.metadata.at("kind")) == "enemy";
+        const auto& index = enemy ? model.enemyIndex : model.towerIndex;
+        auto canonical = index.find(instr.operands[0]);
+        if (canonical == index.end()) continue;
+        aliases.push_back({builder.string(instr.operands[0]), enemy ? 0u : 1u,
+                           static_cast<uint32_t>(canonical->second)});
+    }
+
+    // Wave names first; spawn ranges are filled in once the table's
+    // position is known
+    std::vector<ShmConfigImage::Wave> waves;
+    std::vector<ShmConfigImage::Spawn> spawns;
+    for (const auto& w : model.waves) {
+        waves.push_back({builder.string(w.name), {spawns.size(), w.spawns.size()}});
+        for (const auto& s : w.spawns) {
+            spawns.push_back({static_cast<uint32_t>(s.enemy), s.count, s.start, s.interval});
+        }
+    }
+
+    std::vector<ShmConfigImage::Placement> placements;
+    for (const auto& p : model.placements) {
+        placements.push_back({static_cast<uint32_t>(p.tower), p.x, p.y});
+    }
+
+    codeGen.setStartingGold(startingGold);
+    header.json = builder.string(codeGen.generateJSON(instructions));
+
+    header.path = builder.table(path);
+    header.enemies = builder.table(enemies);
+    header.towers = builder.table(towers);
+    ShmConfigImage::Range spawnTable = builder.table(spawns);
+    for (auto& w : waves) w.spawns.offset = spawnTable.offset + w.spawns.offset * sizeof(ShmConfigImage::Spawn);
+    header.waves = builder.table(waves);
+    header.placements = builder.table(placements);
+    header.aliases = builder.table(aliases);
+    return builder.finish(header);
+}
+
+bool ShmPublisher::verify(const std::vector<IRInstruction>& instructions, CodeGenerator& codeGen, std::ostream& log) {
+    const int gold = 100;
+    std::string first = buildImage(instructions, codeGen, gold);
+
+    // The second config repeats the waves under new names until it no
+    // longer fits the first buffer, so publishing it grows the segment
+    std::vector<IRInstruction> bigger = instructions;
+    for (int round = 0; round < 8; round++) {
+        std::vector<IRInstruction> copies;
+        bool inWave = false;
+        for (const auto& instr : bigger) {
+            if (instr.opcode == IROpcode::DEFINE_WAVE) inWave = true;
+            else if (instr.opcode != IROpcode::SPAWN_ENEMY && instr.opcode != IROpcode::REPEAT_BEGIN &&
+                     instr.opcode != IROpcode::REPEAT_END) inWave = false;
+            if (!inWave) continue;
+            copies.push_back(instr);
+            copies.back().operands[0] += "+";
+        }
+        bigger.insert(bigger.end(), copies.begin(), copies.end());
+        if (copies.empty() || buildImage(bigger, codeGen, gold).size() > 2 * first.size()) break;
+    }
+    std::string second = buildImage(bigger, codeGen, gold);
+    const std::string* images[2] = {&second, &first};   // By generation parity; generation 1 is `first`
+
+    std::string name = "/parsetower-verify-" + std::to_string(getpid());
+    shm_unlink(name.c_str());
+    bool ok = true;
+    try {
+        std::atomic<bool> stop{false};
+        std::atomic<size_t> snapshots{0}, retries{0}, failures{0};
+        uint64_t last = 0;
+        {
+            ShmPublisher publisher(name);
+            publisher.publish(first);
+
+            std::vector<std::thread> readers;
+            for (int r = 0; r < 2; r++) {
+                readers.emplace_back([&] {
+                    ShmConfigReader reader(name);
+                    uint64_t previous = 0;
+                    while (!stop.load(std::memory_order_relaxed)) {
+                        ShmConfigSnapshot snap = reader.snapshot();
+                        ShmConfigView view = snap.view();
+                        const std::string& expected = *images[snap.generation() & 1];
+                        if (snap.generation() < previous || view.image().size != expected.size() ||
+                            std::memcmp(&view.image(), expected.data(), expected.size()) != 0) {
+                            failures++;
+                        }
+                        previous = snap.generation();
+                        snapshots++;
+                    }
+                    retries += reader.retries();
+                });
+            }
+
+            // Publish in bursts so the readers get to run on small machines
+            auto until = std::chrono::steady_clock::now() + std::chrono::milliseconds(300);
+            for (size_t n = 1; std::chrono::steady_clock::now() < until || n < 64; n++) {
+                last = publisher.publish(n % 2 ? second : first);
+                if (n % 16 == 0) std::this_thread::yield();
+            }
+            stop = true;
+            for (auto& t : readers) t.join();
+        }
+
+        // A later publisher picks up where the last one left off
+        ShmPublisher again(name);
+        uint64_t next = again.publish(last % 2 ? second : first);
+        ShmConfigReader reader(name);
+        ShmConfigSnapshot snap = reader.snapshot();
+        ShmConfigView view = snap.view();
+        if (next != last + 1 || snap.generation() != next) {
+            log << "  MISMATCH in generation after reopening (" << snap.generation() << ", expected " << last + 1 << ")\n";
+            ok = false;
+        }
+
+        // A publisher killed between its two sequence stores leaves the
+        // idle slot odd; the next publisher must still finish on even
+        again.segment()->slots[(next + 1) & 1].sequence.fetch_add(1, std::memory_order_relaxed);
+        for (int n = 0; ok && n < 2; n++) again.publish(++next % 2 ? first : second);
+        for (const auto& slot : again.segment()->slots) {
+            if (slot.sequence.load(std::memory_order_relaxed) & 1) {
+                log << "  MISMATCH: a slot was left odd after an interrupted publish\n";
+                ok = false;
+            }
+        }
+        if (ok) {
+            snap = reader.snapshot();
+            view = snap.view();
+        }
+
+        // Tables of the first image against the model
+        if (ok && (next & 1) == 1) {
+            GameModel model = GameModel::fromIR(instructions);
+            bool same = view.json() == codeGen.generateJSON(instructions) &&
+                        view.enemies().size() == model.enemies.size() &&
+                        view.towers().size() == model.towers.size() &&
+                        view.waves().size() == model.waves.size() &&
+                        view.placements().size() == model.placements.size();
+            for (size_t i = 0; same && i < model.enemies.size(); i++) {
+                const auto& e = view.enemies()[i];
+                same = view.string(e.name) == model.enemies[i].name && e.hp == model.enemies[i].hp &&
+                       e.speed == model.enemies[i].speed && e.reward == model.enemies[i].reward;
+            }
+            for (size_t i = 0; same && i < model.waves.size(); i++) {
+                auto spawns = view.spawns(view.waves()[i]);
+                same = spawns.size() == model.waves[i].spawns.size();
+                for (size_t k = 0; same && k < spawns.size(); k++) {
+                    const auto& s = model.waves[i].spawns[k];
+                    same = spawns[k].enemy == static_cast<uint32_t>(s.enemy) && spawns[k].count == s.count &&
+                           spawns[k].start == s.start && spawns[k].interval == s.interval;
+                }
+            }
+            if (!same) {
+                log << "  MISMATCH between the image tables and the IR\n";
+                ok = false;
+            }
+        }
+
+        if (ok && failures > 0) {
+            log << "  MISMATCH: " << failures << " of " << snapshots << " snapshots were torn or out of order\n";
+            ok = false;
+        }
+        if (ok) {
+            log << "  Shared memory matched (" << first.size() << " and " << second.size() << " byte images, "
+                << next << " generations, " << snapshots << " snapshots, " << retries << " retries).\n";
+        }
+    } catch (...) {
+        shm_unlink(name.c_str());
+        throw;
+    }
+    shm_unlink(name.c_str());
+    return ok;
+}
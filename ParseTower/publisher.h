@@ -0,0 +1,49 @@
+#ifndef PUBLISHER_H
+#define PUBLISHER_H
+
+#include "ir.h"
+#include "codegen.h"
+#include "shmconfig.h"
+#include <string>
+#include <vector>
+#include <ostream>
+
+// Writes compiled configs into a POSIX shared memory segment for the
+// ShmConfigReader in shmconfig.h. The segment is created on first use and
+// kept between runs, so each publish bumps the generation the servers on
+// the host poll. An exclusive lock on the segment makes this the only
+// publisher. Errors are thrown as std::runtime_error.
+class ShmPublisher {
+public:
+    // `name` is a shm_open name; a leading '/' is added when missing
+    explicit ShmPublisher(const std::string& name);
+    ~ShmPublisher();
+
+    ShmPublisher(const ShmPublisher&) = delete;
+    ShmPublisher& operator=(const ShmPublisher&) = delete;
+
+    // Copy `image` into the buffer readers are not using, then flip the
+    // generation to it. Returns the new generation.
+    uint64_t publish(const std::string& image);
+
+    const std::string& path() const { return segmentPath; }
+
+    // Position-independent image of `instructions` (see ShmConfigImage)
+    static std::string buildImage(const std::vector<IRInstruction>& instructions, CodeGenerator& codeGen,
+                                  int startingGold);
+
+    // Publish alternating configs under concurrent readers and check each
+    // snapshot is a whole image, then compare the tables with the IR
+    static bool verify(const std::vector<IRInstruction>& instructions, CodeGenerator& codeGen, std::ostream& log);
+
+private:
+    std::string segmentPath;
+    int fd = -1;
+    char* base = nullptr;
+    size_t mapped = 0;
+
+    ShmConfigSegment* segment() const { return reinterpret_cast<ShmConfigSegment*>(base); }
+    void resize(size_t size);
+};
+
+#endif // PUBLISHER_H
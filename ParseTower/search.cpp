@@ -0,0 +1,208 @@
+#include "search.h"
+#include "model.h"
+#include "threadpool.h"
+#include <sstream>
+#include <algorithm>
+#include <stdexcept>
+#include <cmath>
+
+PlacementSearch::PlacementSearch(size_t threads, size_t beam, size_t perTower)
+    : threadCount(threads == 0 ? 1 : threads), beamWidth(beam), sitesPerTower(perTower) {}
+
+void PlacementSearch::collectSites(const std::vector<IRInstruction>& instructions) {
+    sites.clear();
+    towerNames.clear();
+
+    GameModel model = GameModel::fromIR(instructions);
+    if (!model.hasMap) {
+        throw std::runtime_error("placement search needs a map");
+    }
+    for (const auto& t : model.towers) towerNames.push_back(t.name);
+
+    const PathGeometry& path = model.path;
+    const int width = model.width;
+    const int height = model.height;
+    const auto& pts = path.waypoints();
+    std::vector<char> seen(static_cast<size_t>(width) * height);
+
+    for (size_t t = 0; t < model.towers.size(); t++) {
+        int r = model.towers[t].range;
+        std::fill(seen.begin(), seen.end(), 0);
+        std::vector<Site> candidates;
+
+        // Only tiles within range of some segment can ever fire
+        size_t segments = pts.size() > 1 ? pts.size() - 1 : pts.size();
+        for (size_t s = 0; s < segments; s++) {
+            const auto& a = pts[s];
+            const auto& b = pts[std::min(s + 1, pts.size() - 1)];
+            int x0 = std::max(0, std::min(a.first, b.first) - r);
+            int x1 = std::min(width - 1, std::max(a.first, b.first) + r);
+            int y0 = std::max(0, std::min(a.second, b.second) - r);
+            int y1 = std::min(height - 1, std::max(a.second, b.second) + r);
+
+            for (int y = y0; y <= y1; y++) {
+                for (int x = x0; x <= x1; x++) {
+                    char& mark = seen[static_cast<size_t>(y) * width + x];
+                    if (mark) continue;
+                    mark = 1;
+                    double covered = path.coveredLength(x, y, r);
+                    if (covered <= 0.0) continue;
+                    candidates.push_back({static_cast<int>(t), x, y, model.towers[t].cost, covered * model.towers[t].dps});
+                }
+            }
+        }
+
+        std::sort(candidates.begin(), candidates.end(), [](const Site& a, const Site& b) {
+            if (a.bound != b.bound) return a.bound > b.bound;
+            if (a.y != b.y) return a.y < b.y;
+            return a.x < b.x;
+        });
+        if (candidates.size() > sitesPerTower) candidates.resize(sitesPerTower);
+        sites.insert(sites.end(), candidates.begin(), candidates.end());
+    }
+}
+
+std::string PlacementSearch::keyOf(const std::vector<int>& siteIndices) {
+    std::string key;
+    for (int s : siteIndices) {
+        key += std::to_string(s);
+        key += ',';
+    }
+    return key;
+}
+
+bool PlacementSearch::better(const Node& a, const Node& b) {
+    if (a.hpLeaked != b.hpLeaked) return a.hpLeaked < b.hpLeaked;
+    if (a.leaked != b.leaked) return a.leaked < b.leaked;
+    if (a.cost != b.cost) return a.cost < b.cost;
+    return a.sites < b.sites;
+}
+
+std::vector<PlacementPlan> PlacementSearch::search(const std::vector<IRInstruction>& instructions,
+                                                   int budget, size_t resultCount) {
+    memo.clear();
+    evaluated = 0;
+    collectSites(instructions);
+
+    // One warm simulator per chunk; the pool hands each chunk its own
+    ThreadPool pool(threadCount);
+    std::vector<std::unique_ptr<Simulator>> sims;
+    for (size_t i = 0; i < pool.size(); i++) {
+        sims.push_back(std::make_unique<Simulator>(1));
+        sims.back()->load(instructions);
+    }
+
+    auto evaluate = [&](std::vector<Node>& nodes) {
+        pool.parallelFor(nodes.size(), [&](size_t begin, size_t end, size_t chunk) {
+            Simulator& sim = *sims[chunk];
+            for (size_t i = begin; i < end; i++) {
+                std::vector<SimPlacement> placed;
+                for (int s : nodes[i].sites) {
+                    placed.push_back({towerNames[sites[s].tower], sites[s].x, sites[s].y});
+                }
+                sim.setPlacements(placed);
+                SimResult result = sim.run();
+                nodes[i].hpLeaked = 0;
+                nodes[i].leaked = 0;
+                for (const auto& w : result.waves) {
+                    nodes[i].hpLeaked += w.hpLeaked;
+                    nodes[i].leaked += w.leaked;
+                }
+            }
+        });
+        evaluated += nodes.size();
+        for (const auto& n : nodes) memo[keyOf(n.sites)] = n;
+    };
+
+    std::vector<Node> beam(1);
+    evaluate(beam);
+
+    while (!beam.empty()) {
+        std::vector<Node> children;
+        std::unordered_map<std::string, bool> queued;
+
+        for (const auto& node : beam) {
+            // Nothing leaks: more towers can only cost more
+            if (node.hpLeaked == 0) continue;
+
+            for (size_t s = 0; s < sites.size(); s++) {
+                if (node.cost + sites[s].cost > budget) continue;
+
+                bool occupied = false;
+                for (int placed : node.sites) {
+                    if (sites[placed].x == sites[s].x && sites[placed].y == sites[s].y) {
+                        occupied = true;
+                        break;
+                    }
+                }
+                if (occupied) continue;
+
+                Node child;
+                child.sites = node.sites;
+                child.sites.insert(std::upper_bound(child.sites.begin(), child.sites.end(), static_cast<int>(s)),
+                                   static_cast<int>(s));
+                std::string key = keyOf(child.sites);
+                if (memo.count(key) || queued.count(key)) continue;
+                queued[key] = true;
+
+                child.cost = node.cost + sites[s].cost;
+                child.bound = node.bound + sites[s].bound;
+                children.push_back(child);
+            }
+        }
+
+        if (children.empty()) break;
+
+        // Prune by coverage bound before paying for simulations
+        std::sort(children.begin(), children.end(), [](const Node& a, const Node& b) {
+            if (a.bound != b.bound) return a.bound > b.bound;
+            return a.sites < b.sites;
+        });
+        if (children.size() > beamWidth * 4) children.resize(beamWidth * 4);
+
+        evaluate(children);
+
+        std::sort(children.begin(), children.end(), better);
+        if (children.size() > beamWidth) children.resize(beamWidth);
+        beam = children;
+    }
+
+    std::vector<Node> ranked;
+    for (const auto& entry : memo) {
+        if (!entry.second.sites.empty()) ranked.push_back(entry.second);
+    }
+    std::sort(ranked.begin(), ranked.end(), better);
+    if (ranked.size() > resultCount) ranked.resize(resultCount);
+
+    std::vector<PlacementPlan> plans;
+    for (const auto& node : ranked) {
+        PlacementPlan plan;
+        for (int s : node.sites) {
+            plan.placements.push_back({towerNames[sites[s].tower], sites[s].x, sites[s].y});
+        }
+        plan.cost = node.cost;
+        plan.hpLeaked = node.hpLeaked;
+        plan.leaked = node.leaked;
+        plans.push_back(plan);
+    }
+    return plans;
+}
+
+std::string PlacementSearch::format(const std::vector<PlacementPlan>& plans, int budget) const {
+    std::ostringstream out;
+    if (plans.empty()) {
+        out << "// No affordable placement covers the path with " << budget << " gold\n";
+        return out.str();
+    }
+
+    for (size_t i = 0; i < plans.size(); i++) {
+        const auto& plan = plans[i];
+        if (i > 0) out << "\n";
+        out << "// Rank " << (i + 1) << ": cost " << plan.cost << "/" << budget
+            << ", hp leaked " << plan.hpLeaked << " (" << plan.leaked << " enemies)\n";
+        for (const auto& p : plan.placements) {
+            out << "place " << p.towerType << " at (" << p.x << ", " << p.y << ");\n";
+        }
+    }
+    return out.str();
+}
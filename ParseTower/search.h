@@ -0,0 +1,70 @@
+#ifndef SEARCH_H
+#define SEARCH_H
+
+#include "ir.h"
+#include "simulator.h"
+#include <vector>
+#include <string>
+#include <unordered_map>
+#include <memory>
+
+// A scored set of placements
+struct PlacementPlan {
+    std::vector<SimPlacement> placements;
+    int cost = 0;
+    long long hpLeaked = 0;
+    int leaked = 0;
+};
+
+// Beam search over `place` statements under a gold budget.
+//
+// Candidate sites are tiles whose range disc covers part of the path; only
+// the best sites per tower type (by covered path length x DPS) survive.
+// Each beam step extends every plan by one affordable site, ranks the
+// children by that coverage bound, and simulates the most promising ones in
+// parallel. Simulated scores are memoized by the placement set, so a set
+// reached through different orders is only played once.
+class PlacementSearch {
+public:
+    PlacementSearch(size_t threads, size_t beamWidth = 8, size_t sitesPerTower = 24);
+
+    std::vector<PlacementPlan> search(const std::vector<IRInstruction>& instructions,
+                                      int budget, size_t resultCount = 5);
+
+    // Render plans as ranked `place ... at (x, y);` blocks
+    std::string format(const std::vector<PlacementPlan>& plans, int budget) const;
+
+    size_t evaluations() const { return evaluated; }
+
+private:
+    struct Site {
+        int tower;
+        int x;
+        int y;
+        int cost;
+        double bound; // Covered path length x DPS
+    };
+
+    struct Node {
+        std::vector<int> sites;   // Sorted indices into `sites`
+        int cost = 0;
+        double bound = 0.0;
+        long long hpLeaked = 0;
+        int leaked = 0;
+    };
+
+    size_t threadCount;
+    size_t beamWidth;
+    size_t sitesPerTower;
+    size_t evaluated = 0;
+
+    std::vector<Site> sites;
+    std::vector<std::string> towerNames;
+    std::unordered_map<std::string, Node> memo;
+
+    void collectSites(const std::vector<IRInstruction>& instructions);
+    static std::string keyOf(const std::vector<int>& siteIndices);
+    static bool better(const Node& a, const Node& b);
+};
+
+#endif // SEARCH_H
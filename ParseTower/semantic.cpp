@@ -1,121 +1,159 @@
 #include "semantic.h"
-#include <iostream>
+#include <stdexcept>
 #include <set>
+#include <algorithm>
+#include <climits>
 
 void SemanticAnalyzer::analyze(std::shared_ptr<Program> program) {
-    for (auto decl : program->declarations) {
-        if (auto m = dynamic_cast<MapDecl*>(decl.get())) {
-            checkMap(m);
-        }
-        else if (auto e = dynamic_cast<EnemyDecl*>(decl.get())) {
-            checkEnemy(e);
-        }
-        else if (auto t = dynamic_cast<TowerDecl*>(decl.get())) {
-            checkTower(t);
-        }
-        else if (auto w = dynamic_cast<WaveDecl*>(decl.get())) {
-            checkWave(w);
-        }
-        else if (auto p = dynamic_cast<PlaceStmt*>(decl.get())) {
-            checkPlace(p);
-        }
+    analyze(program, std::vector<bool>(program->declarations.size(), true));
+}
+
+void SemanticAnalyzer::analyze(std::shared_ptr<Program> program, const std::vector<bool>& validate) {
+    for (size_t i = 0; i < program->declarations.size(); i++) {
+        validating = validate[i];
+        current = i;
+        check(program->declarations[i].get());
+    }
+}
+
+void SemanticAnalyzer::analyzeDeclaration(ASTNode* decl) {
+    validating = true;
+    check(decl);
+    current++;
+}
+
+void SemanticAnalyzer::check(ASTNode* decl) {
+    if (auto m = dynamic_cast<MapDecl*>(decl)) {
+        checkMap(m);
+    }
+    else if (auto e = dynamic_cast<EnemyDecl*>(decl)) {
+        checkEnemy(e);
+    }
+    else if (auto t = dynamic_cast<TowerDecl*>(decl)) {
+        checkTower(t);
+    }
+    else if (auto w = dynamic_cast<WaveDecl*>(decl)) {
+        checkWave(w);
+    }
+    else if (auto p = dynamic_cast<PlaceStmt*>(decl)) {
+        checkPlace(p);
     }
 }
 
 void SemanticAnalyzer::checkMap(MapDecl* map) {
     if (maps.count(map->name)) {
-        std::cerr << "Semantic Error: Duplicate map name " << map->name << "\n";
-        exit(1);
+        throw std::runtime_error("Duplicate map name: " + map->name);
     }
     maps[map->name] = map;
     currentMap = map;
+    if (!validating) return;
 
     if (map->width <= 0 || map->height <= 0) {
-        std::cerr << "Invalid map size.\n";
-        exit(1);
+        throw std::runtime_error("Invalid map size.");
     }
 
     // Validate path coordinates
     for (auto& p : map->path) {
         if (p.first < 0 || p.first >= map->width ||
             p.second < 0 || p.second >= map->height) {
-            std::cerr << "Path coordinate out of map bounds.\n";
-            exit(1);
+            throw std::runtime_error("Path coordinate out of map bounds.");
         }
     }
 }
 
 void SemanticAnalyzer::checkEnemy(EnemyDecl* enemy) {
     if (enemies.count(enemy->name)) {
-        std::cerr << "Duplicate enemy: " << enemy->name << "\n";
-        exit(1);
+        throw std::runtime_error("Duplicate enemy: " + enemy->name);
     }
     enemies[enemy->name] = enemy;
+    if (!validating) return;
 
     if (enemy->hp <= 0) {
-        std::cerr << "Enemy HP invalid.\n";
-        exit(1);
+        throw std::runtime_error("Enemy HP invalid.");
     }
     if (enemy->speed <= 0) {
-        std::cerr << "Enemy speed invalid.\n";
-        exit(1);
+        throw std::runtime_error("Enemy speed invalid.");
     }
     if (enemy->reward < 0) {
-        std::cerr << "Enemy reward invalid.\n";
-        exit(1);
+        throw std::runtime_error("Enemy reward invalid.");
     }
 }
 
 void SemanticAnalyzer::checkTower(TowerDecl* tower) {
     if (towers.count(tower->name)) {
-        std::cerr << "Duplicate tower: " << tower->name << "\n";
-        exit(1);
+        throw std::runtime_error("Duplicate tower: " + tower->name);
     }
     towers[tower->name] = tower;
+    if (!validating) return;
 
     if (tower->range <= 0 || tower->damage <= 0 || tower->cost < 0) {
-        std::cerr << "Invalid tower stats.\n";
-        exit(1);
+        throw std::runtime_error("Invalid tower stats.");
     }
     if (tower->fire_rate <= 0) {
-        std::cerr << "Invalid fire rate.\n";
-        exit(1);
+        throw std::runtime_error("Invalid fire rate.");
     }
 }
 
 void SemanticAnalyzer::checkWave(WaveDecl* wave) {
     if (waves.count(wave->name)) {
-        std::cerr << "Duplicate wave: " << wave->name << "\n";
-        exit(1);
+        throw std::runtime_error("Duplicate wave: " + wave->name);
     }
     waves[wave->name] = wave;
+    if (!validating) return;
+
+    for (auto& r : wave->repeats) {
+        if (r.times <= 0) {
+            throw std::runtime_error("Invalid repeat count.");
+        }
+    }
 
     for (auto& s : wave->spawns) {
         if (!enemies.count(s.enemyType)) {
-            std::cerr << "Wave uses undefined enemy: " << s.enemyType << "\n";
-            exit(1);
+            throw std::runtime_error("Wave uses undefined enemy: " + s.enemyType);
         }
-        if (s.count <= 0 || s.start < 0 || s.interval <= 0) {
-            std::cerr << "Invalid spawn parameters.\n";
-            exit(1);
+
+        // Trip counts of the enclosing blocks, outermost first
+        std::vector<int> times;
+        for (int b = s.block; b >= 0; b = wave->repeats[b].parent) {
+            times.insert(times.begin(), wave->repeats[b].times);
+        }
+
+        // A progression is extreme at the first or last iteration of each
+        // counter, so checking its range covers every expanded spawn
+        int base[3] = {s.count, s.start, s.interval};
+        const std::vector<int>* steps[3] = {&s.countSteps, &s.startSteps, &s.intervalSteps};
+        long long low[3], high[3];
+        for (int f = 0; f < 3; f++) {
+            low[f] = high[f] = base[f];
+            for (size_t k = 0; k < steps[f]->size() && k < times.size(); k++) {
+                long long span = static_cast<long long>((*steps[f])[k]) * (times[k] - 1);
+                low[f] += std::min(0LL, span);
+                high[f] += std::max(0LL, span);
+            }
+            if (low[f] < INT_MIN || high[f] > INT_MAX) {
+                throw std::runtime_error("Spawn parameters out of range.");
+            }
+        }
+
+        if (low[0] <= 0 || low[1] < 0 || low[2] <= 0) {
+            throw std::runtime_error("Invalid spawn parameters.");
         }
     }
 }
 
 void SemanticAnalyzer::checkPlace(PlaceStmt* place) {
+    if (!validating) return;
+
     if (!towers.count(place->towerType)) {
-        std::cerr << "Placing undefined tower type: " << place->towerType << "\n";
-        exit(1);
+        throw std::runtime_error("Placing undefined tower type: " + place->towerType);
     }
 
     if (!currentMap) {
-        std::cerr << "Place statement appears before map definition.\n";
-        exit(1);
+        throw std::runtime_error("Place statement appears before map definition.");
     }
 
     if (place->x < 0 || place->x >= currentMap->width ||
         place->y < 0 || place->y >= currentMap->height) {
-        std::cerr << "Tower placement out of map bounds.\n";
-        exit(1);
+        throw std::runtime_error("Tower placement out of map bounds.");
     }
 }
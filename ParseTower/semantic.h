@@ -4,11 +4,25 @@
 #include "ast.h"
 #include <unordered_map>
 #include <string>
+#include <vector>
 
 class SemanticAnalyzer {
 public:
     void analyze(std::shared_ptr<Program> program);
 
+    // Register every declaration (names, duplicates, current map) but only
+    // run value and reference checks where validate[i] is set. Incremental
+    // builds pass false for declarations already checked in the same context.
+    void analyze(std::shared_ptr<Program> program, const std::vector<bool>& validate);
+
+    // Check one more declaration after those seen so far, for callers that
+    // release declarations once checked. Later checks only look up earlier
+    // names, except for the current map, which the caller keeps alive.
+    void analyzeDeclaration(ASTNode* decl);
+
+    // Index of the declaration being checked; after an error, the culprit
+    size_t lastDeclaration() const { return current; }
+
 private:
     std::unordered_map<std::string, MapDecl*> maps;
     std::unordered_map<std::string, EnemyDecl*> enemies;
@@ -16,7 +30,10 @@ private:
     std::unordered_map<std::string, WaveDecl*> waves;
 
     MapDecl* currentMap = nullptr;
+    bool validating = true;
+    size_t current = 0;
 
+    void check(ASTNode* decl);
     void checkMap(MapDecl* map);
     void checkEnemy(EnemyDecl* enemy);
     void checkTower(TowerDecl* tower);
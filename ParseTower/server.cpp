@@ -0,0 +1,611 @@
+#include "server.h"
+#include "analysis.h"
+#include "model.h"
+#include <iostream>
+#include <cstring>
+#include <csignal>
+#include <cerrno>
+#include <stdexcept>
+#include <filesystem>
+#include <chrono>
+#include <algorithm>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace fs = std::filesystem;
+
+namespace {
+
+const uint32_t MAX_FRAME = 64u * 1024 * 1024;
+// A client is not read while this much output waits for it, or while this
+// many of its requests are unanswered
+const size_t MAX_BACKLOG = 8u * 1024 * 1024;
+const uint64_t MAX_IN_FLIGHT = 64;
+const uint64_t LISTENER = 0;
+const uint64_t WAKE = 1;
+
+volatile std::sig_atomic_t stopRequested = 0;
+
+void onSignal(int) {
+    stopRequested = 1;
+}
+
+template <typename T>
+void put(std::string& out, T value) {
+    out.append(reinterpret_cast<const char*>(&value), sizeof(T));
+}
+
+std::string frame(const std::string& payload) {
+    std::string out;
+    put<uint32_t>(out, static_cast<uint32_t>(payload.size()));
+    return out + payload;
+}
+
+sockaddr_un addressOf(const std::string& path) {
+    sockaddr_un addr;
+    std::memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (path.size() >= sizeof(addr.sun_path)) {
+        throw std::runtime_error("socket path too long: " + path);
+    }
+    std::strcpy(addr.sun_path, path.c_str());
+    return addr;
+}
+
+}
+
+CompileServer::CompileServer(const std::string& path, size_t threads, size_t cacheSize)
+    : socketPath(path), threadCount(threads == 0 ? 1 : threads), cacheLimit(cacheSize) {
+    sockaddr_un addr = addressOf(socketPath);
+
+    // A socket file left by a crashed server would make bind fail
+    int probe = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (probe >= 0) {
+        bool live = connect(probe, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) == 0;
+        close(probe);
+        if (live) throw std::runtime_error("a server is already listening on " + socketPath);
+    }
+    unlink(socketPath.c_str());
+
+    listenFd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (listenFd < 0 || bind(listenFd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0 ||
+        listen(listenFd, 128) != 0) {
+        throw std::runtime_error("cannot listen on " + socketPath + ": " + std::strerror(errno));
+    }
+
+    epollFd = epoll_create1(EPOLL_CLOEXEC);
+    wakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (epollFd < 0 || wakeFd < 0) {
+        throw std::runtime_error("cannot create event loop");
+    }
+
+    epoll_event ev;
+    ev.events = EPOLLIN;
+    ev.data.u64 = LISTENER;
+    epoll_ctl(epollFd, EPOLL_CTL_ADD, listenFd, &ev);
+    ev.data.u64 = WAKE;
+    epoll_ctl(epollFd, EPOLL_CTL_ADD, wakeFd, &ev);
+}
+
+CompileServer::~CompileServer() {
+    {
+        std::lock_guard<std::mutex> lock(jobMutex);
+        stopping = true;
+    }
+    jobReady.notify_all();
+    for (auto& w : workers) w.join();
+
+    for (auto& entry : connections) close(entry.second.fd);
+    if (wakeFd >= 0) close(wakeFd);
+    if (epollFd >= 0) close(epollFd);
+    if (listenFd >= 0) {
+        close(listenFd);
+        unlink(socketPath.c_str());
+    }
+}
+
+void CompileServer::run() {
+    struct sigaction sa;
+    std::memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = onSignal;   // No SA_RESTART: epoll_wait must return
+    sigaction(SIGINT, &sa, nullptr);
+    sigaction(SIGTERM, &sa, nullptr);
+
+    std::cout << "Listening on " << socketPath << " with " << threadCount
+              << " worker(s). Press Ctrl+C to stop." << std::endl;
+    serve();
+
+    std::lock_guard<std::mutex> lock(cacheMutex);
+    std::cout << "Served " << requests << " request(s), " << hits << " from cache." << std::endl;
+}
+
+void CompileServer::serve() {
+    signal(SIGPIPE, SIG_IGN);
+    for (size_t i = 0; i < threadCount; i++) {
+        workers.emplace_back([this] { workerLoop(); });
+    }
+
+    epoll_event events[64];
+    while (!stopRequested && !stopCalled) {
+        int n = epoll_wait(epollFd, events, 64, -1);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            throw std::runtime_error(std::string("epoll_wait: ") + std::strerror(errno));
+        }
+
+        for (int i = 0; i < n; i++) {
+            uint64_t id = events[i].data.u64;
+            if (id == LISTENER) {
+                acceptClients();
+            } else if (id == WAKE) {
+                uint64_t count;
+                while (read(wakeFd, &count, sizeof(count)) > 0) {}
+                deliverDone();
+            } else if (connections.count(id)) {
+                if (events[i].events & (EPOLLHUP | EPOLLERR)) {
+                    closeClient(id);
+                    continue;
+                }
+                if (events[i].events & EPOLLIN) readClient(id);
+                if ((events[i].events & EPOLLOUT) && connections.count(id)) flushClient(id);
+            }
+        }
+    }
+}
+
+// Ends serve() from another thread
+void CompileServer::stop() {
+    stopCalled = true;
+    uint64_t one = 1;
+    ssize_t ignored = write(wakeFd, &one, sizeof(one));
+    (void)ignored;
+}
+
+void CompileServer::acceptClients() {
+    while (true) {
+        int fd = accept4(listenFd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0) return;
+
+        uint64_t id = nextConnection++;
+        connections[id].fd = fd;
+        connections[id].events = EPOLLIN;
+        epoll_event ev;
+        ev.events = EPOLLIN;
+        ev.data.u64 = id;
+        epoll_ctl(epollFd, EPOLL_CTL_ADD, fd, &ev);
+    }
+}
+
+void CompileServer::readClient(uint64_t id) {
+    Connection& conn = connections[id];
+    char buffer[65536];
+    while (true) {
+        ssize_t got = read(conn.fd, buffer, sizeof(buffer));
+        if (got > 0) {
+            conn.input.append(buffer, static_cast<size_t>(got));
+            continue;
+        }
+        if (got == 0 || (errno != EAGAIN && errno != EWOULDBLOCK)) {
+            closeClient(id);
+            return;
+        }
+        break;
+    }
+
+    frameRequests(id);
+    if (connections.count(id)) updateEvents(id);
+}
+
+bool CompileServer::Connection::keepingUp() const {
+    return output.size() < MAX_BACKLOG && nextRequest - nextResponse < MAX_IN_FLIGHT;
+}
+
+// Hand complete frames to the workers while the client keeps up; the rest
+// waits in `input` until its responses drain
+void CompileServer::frameRequests(uint64_t id) {
+    Connection& conn = connections[id];
+    size_t consumed = 0;
+    std::vector<Job> framed;
+    while (conn.input.size() - consumed >= sizeof(uint32_t) && conn.keepingUp()) {
+        uint32_t length;
+        std::memcpy(&length, conn.input.data() + consumed, sizeof(length));
+        if (length > MAX_FRAME) {
+            closeClient(id);
+            return;
+        }
+        if (conn.input.size() - consumed - sizeof(length) < length) break;
+        framed.push_back({id, conn.nextRequest++, conn.input.substr(consumed + sizeof(length), length)});
+        consumed += sizeof(length) + length;
+    }
+    conn.input.erase(0, consumed);
+
+    if (!framed.empty()) {
+        {
+            std::lock_guard<std::mutex> lock(jobMutex);
+            for (auto& job : framed) jobs.push_back(std::move(job));
+        }
+        jobReady.notify_all();
+    }
+}
+
+void CompileServer::flushClient(uint64_t id) {
+    Connection& conn = connections[id];
+    while (!conn.output.empty()) {
+        ssize_t sent = write(conn.fd, conn.output.data(), conn.output.size());
+        if (sent < 0) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK) break;
+            closeClient(id);
+            return;
+        }
+        conn.output.erase(0, static_cast<size_t>(sent));
+    }
+    frameRequests(id);
+    if (connections.count(id)) updateEvents(id);
+}
+
+// Requests are only read from a client that keeps up with its responses,
+// so one that never reads leaves its requests in the socket instead of
+// growing `output` without bound
+void CompileServer::updateEvents(uint64_t id) {
+    Connection& conn = connections[id];
+    uint32_t wanted = 0;
+    if (conn.keepingUp()) wanted |= EPOLLIN;
+    if (!conn.output.empty()) wanted |= EPOLLOUT;
+    if (wanted != conn.events) {
+        epoll_event ev;
+        ev.events = wanted;
+        ev.data.u64 = id;
+        epoll_ctl(epollFd, EPOLL_CTL_MOD, conn.fd, &ev);
+        conn.events = wanted;
+    }
+}
+
+void CompileServer::closeClient(uint64_t id) {
+    auto it = connections.find(id);
+    if (it == connections.end()) return;
+    epoll_ctl(epollFd, EPOLL_CTL_DEL, it->second.fd, nullptr);
+    close(it->second.fd);
+    connections.erase(it);
+}
+
+void CompileServer::deliverDone() {
+    std::vector<Done> finished;
+    {
+        std::lock_guard<std::mutex> lock(doneMutex);
+        finished.swap(done);
+    }
+
+    for (auto& d : finished) {
+        auto it = connections.find(d.connection);
+        if (it == connections.end()) continue;   // Client went away
+        Connection& conn = it->second;
+        conn.ready[d.sequence] = std::move(d.response);
+
+        // Keep per-connection request order
+        while (!conn.ready.empty() && conn.ready.begin()->first == conn.nextResponse) {
+            conn.output += frame(conn.ready.begin()->second);
+            conn.ready.erase(conn.ready.begin());
+            conn.nextResponse++;
+        }
+        flushClient(d.connection);
+    }
+}
+
+void CompileServer::workerLoop() {
+    // Warm pipelines, one per option set this worker has seen
+    std::map<std::string, std::unique_ptr<Compiler>> compilers;
+
+    while (true) {
+        Job job;
+        {
+            std::unique_lock<std::mutex> lock(jobMutex);
+            jobReady.wait(lock, [this] { return stopping || !jobs.empty(); });
+            if (stopping) return;
+            job = std::move(jobs.front());
+            jobs.pop_front();
+        }
+
+        std::string response = handle(job.request, compilers);
+
+        {
+            std::lock_guard<std::mutex> lock(doneMutex);
+            done.push_back({job.connection, job.sequence, std::move(response)});
+        }
+        uint64_t one = 1;
+        ssize_t ignored = write(wakeFd, &one, sizeof(one));
+        (void)ignored;
+    }
+}
+
+std::string CompileServer::handle(const std::string& request,
+                                  std::map<std::string, std::unique_ptr<Compiler>>& compilers) {
+    {
+        std::lock_guard<std::mutex> lock(cacheMutex);
+        requests++;
+        auto it = cache.find(request);
+        if (it != cache.end()) {
+            hits++;
+            lru.splice(lru.begin(), lru, it->second.lru);
+            return it->second.response;
+        }
+    }
+
+    ServerResponse result;
+    const size_t headerSize = sizeof(uint8_t) + 2 * sizeof(int32_t);
+    if (request.size() < headerSize) {
+        result.diagnostics = "malformed request";
+    } else {
+        uint8_t flags = static_cast<uint8_t>(request[0]);
+        int32_t gold;
+        int32_t smoothTicks;
+        std::memcpy(&gold, request.data() + 1, sizeof(gold));
+        std::memcpy(&smoothTicks, request.data() + 1 + sizeof(gold), sizeof(smoothTicks));
+
+        CompileOptions options;
+        options.optimize = (flags & 1) != 0;
+        options.readable = (flags & 2) != 0;
+        options.startingGold = gold;
+        options.smoothTicks = smoothTicks;
+
+        auto& compiler = compilers[request.substr(0, headerSize)];
+        if (!compiler) compiler = std::make_unique<Compiler>(options);
+
+        try {
+            result.output = compiler->compile(request.substr(headerSize));
+            result.ok = true;
+            EconomyAnalyzer economy;
+            result.diagnostics = economy.validate(economy.build(GameModel::fromIR(compiler->lastIR()), gold));
+        } catch (const std::exception& e) {
+            result.diagnostics = e.what();
+        }
+    }
+
+    std::string response;
+    put<uint8_t>(response, result.ok ? 0 : 1);
+    put<uint32_t>(response, static_cast<uint32_t>(result.diagnostics.size()));
+    response += result.diagnostics;
+    response += result.output;
+
+    // Errors are cached too: the same bytes fail the same way. A request is
+    // up to MAX_FRAME, so the table is bounded by bytes, not entries
+    size_t cost = request.size() + response.size();
+    std::lock_guard<std::mutex> lock(cacheMutex);
+    if (cost <= cacheLimit && !cache.count(request)) {
+        auto entry = cache.emplace(request, CachedResult{response, {}}).first;
+        lru.push_front(&entry->first);
+        entry->second.lru = lru.begin();
+        cacheBytes += cost;
+        while (cacheBytes > cacheLimit) {
+            auto oldest = cache.find(*lru.back());
+            cacheBytes -= oldest->first.size() + oldest->second.response.size();
+            lru.pop_back();
+            cache.erase(oldest);
+        }
+    }
+    return response;
+}
+
+bool CompileServer::verify(const std::string& source, const CompileOptions& options, std::ostream& log) {
+    CompileOptions local = options;
+    local.cache = nullptr;
+    Compiler reference(local);
+    std::string expected = reference.compile(source);
+    CompileOptions otherFormat = local;
+    otherFormat.readable = !local.readable;
+    std::string expectedOther = Compiler(otherFormat).compile(source);
+    std::string broken = source + "\nwave {";
+    std::string error;
+    try {
+        reference.compile(broken);
+    } catch (const std::exception& e) {
+        error = e.what();
+    }
+
+    std::string path = (fs::temp_directory_path() / ("parsetower-verify-" + std::to_string(getpid()) + ".sock")).string();
+    CompileServer server(path, 2);
+    std::thread loop([&server] { server.serve(); });
+    struct Stop {
+        CompileServer& server;
+        std::thread& loop;
+        ~Stop() {
+            if (!loop.joinable()) return;
+            server.stop();
+            loop.join();
+        }
+    } stopOnReturn{server, loop};
+
+    auto counters = [&server](size_t& hits, size_t& bytes, size_t& entries) {
+        std::lock_guard<std::mutex> lock(server.cacheMutex);
+        hits = server.hits;
+        bytes = server.cacheBytes;
+        entries = server.cache.size();
+    };
+    size_t hits = 0, bytes = 0, entries = 0;
+
+    CompileClient client(path);
+    ServerResponse first = client.compile(source, local);
+    ServerResponse again = client.compile(source, local);
+    counters(hits, bytes, entries);
+    if (!first.ok || first.output != expected || !again.ok || again.output != expected || hits != 1) {
+        log << "  MISMATCH in a repeated compile\n";
+        return false;
+    }
+    ServerResponse failed = client.compile(broken, local);
+    if (failed.ok || failed.diagnostics != error) {
+        log << "  MISMATCH in a failing compile\n";
+        return false;
+    }
+
+    // Three requests in flight come back in order
+    client.send(source, otherFormat);
+    client.send(broken, local);
+    client.send(source, local);
+    ServerResponse a = client.receive();
+    ServerResponse b = client.receive();
+    ServerResponse c = client.receive();
+    if (!a.ok || a.output != expectedOther || b.ok || !c.ok || c.output != expected) {
+        log << "  MISMATCH in pipelined responses\n";
+        return false;
+    }
+
+    // Shrink the response cache to about four entries; a comment changes
+    // the request but not the output
+    size_t responseSize = sizeof(uint8_t) + sizeof(uint32_t) + first.diagnostics.size() + expected.size();
+    size_t entryCost = sizeof(uint8_t) + 2 * sizeof(int32_t) + source.size() + 16 + responseSize;
+    {
+        std::lock_guard<std::mutex> lock(server.cacheMutex);
+        server.cacheLimit = 4 * entryCost;
+    }
+    const int distinct = 12;
+    for (int i = 0; i < distinct; i++) client.send(source + "\n// " + std::to_string(i), local);
+    for (int i = 0; i < distinct; i++) {
+        ServerResponse r = client.receive();
+        if (!r.ok || r.output != expected) {
+            log << "  MISMATCH in distinct request " << i << "\n";
+            return false;
+        }
+    }
+    size_t hitsBefore = 0;
+    counters(hitsBefore, bytes, entries);
+    client.compile(source + "\n// " + std::to_string(distinct - 1), local);
+    counters(hits, bytes, entries);
+    if (bytes > 4 * entryCost || entries > 4 || hits != hitsBefore + 1) {
+        log << "  Response cache holds " << bytes << " bytes in " << entries << " entries (limit "
+            << 4 * entryCost << ")\n";
+        return false;
+    }
+
+    // A client that pipelines but never reads: the server must stop taking
+    // its requests instead of queueing every response
+    sockaddr_un addr = addressOf(path);
+    int stalled = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (stalled < 0 || connect(stalled, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0) {
+        throw std::runtime_error("cannot connect to " + path);
+    }
+    std::string request;
+    put<uint8_t>(request, static_cast<uint8_t>((local.optimize ? 1 : 0) | (local.readable ? 2 : 0)));
+    put<int32_t>(request, local.startingGold);
+    put<int32_t>(request, local.smoothTicks);
+    request = frame(request + source);
+    // Twice what the server may queue before it stops reading, so the
+    // client must block before sending them all
+    size_t allowed = MAX_BACKLOG / responseSize + MAX_IN_FLIGHT + 1;
+    size_t total = 2 * allowed;
+    size_t sent = 0;
+    std::string pending;
+    for (int idle = 0; sent < total && idle < 50; ) {
+        if (pending.empty()) pending = request;
+        ssize_t n = write(stalled, pending.data(), pending.size());
+        if (n < 0) {
+            idle++;
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+            continue;
+        }
+        idle = 0;
+        pending.erase(0, static_cast<size_t>(n));
+        if (pending.empty()) sent++;
+    }
+
+    ServerResponse meanwhile = CompileClient(path).compile(source, local);
+
+    server.stop();
+    loop.join();
+    size_t backlog = 0;
+    uint64_t taken = 0;
+    for (const auto& entry : server.connections) {
+        backlog = std::max(backlog, entry.second.output.size());
+        taken = std::max(taken, entry.second.nextRequest);
+    }
+    close(stalled);
+
+    if (!meanwhile.ok || meanwhile.output != expected) {
+        log << "  MISMATCH for a client served beside a stalled one\n";
+        return false;
+    }
+    if (sent >= total || backlog > MAX_BACKLOG + MAX_IN_FLIGHT * (responseSize + sizeof(uint32_t))) {
+        log << "  Stalled client was still read: " << taken << " of " << sent << " requests taken, "
+            << backlog << " bytes queued\n";
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lock(server.cacheMutex);
+    log << "  Server matched local compiles (" << server.requests << " requests, " << server.hits
+        << " from cache; cache held " << bytes << " of " << 4 * entryCost << " bytes; a stalled client had "
+        << taken << " of " << sent << " requests taken with " << backlog / 1024 << " KB queued).\n";
+    return true;
+}
+
+CompileClient::CompileClient(const std::string& socketPath) {
+    sockaddr_un addr = addressOf(socketPath);
+    fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0 || connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0) {
+        throw std::runtime_error("cannot connect to " + socketPath + ": " + std::strerror(errno));
+    }
+}
+
+CompileClient::~CompileClient() {
+    if (fd >= 0) close(fd);
+}
+
+void CompileClient::writeAll(const std::string& data) {
+    size_t sent = 0;
+    while (sent < data.size()) {
+        ssize_t n = write(fd, data.data() + sent, data.size() - sent);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) throw std::runtime_error("server closed the connection");
+        sent += static_cast<size_t>(n);
+    }
+}
+
+std::string CompileClient::readFrame() {
+    auto readExactly = [this](char* out, size_t size) {
+        size_t got = 0;
+        while (got < size) {
+            ssize_t n = read(fd, out + got, size - got);
+            if (n < 0 && errno == EINTR) continue;
+            if (n <= 0) throw std::runtime_error("server closed the connection");
+            got += static_cast<size_t>(n);
+        }
+    };
+
+    uint32_t length;
+    readExactly(reinterpret_cast<char*>(&length), sizeof(length));
+    if (length > MAX_FRAME) throw std::runtime_error("oversized response");
+    std::string payload(length, '\0');
+    if (length > 0) readExactly(&payload[0], length);
+    return payload;
+}
+
+ServerResponse CompileClient::compile(const std::string& source, const CompileOptions& options) {
+    send(source, options);
+    return receive();
+}
+
+void CompileClient::send(const std::string& source, const CompileOptions& options) {
+    std::string request;
+    put<uint8_t>(request, static_cast<uint8_t>((options.optimize ? 1 : 0) | (options.readable ? 2 : 0)));
+    put<int32_t>(request, options.startingGold);
+    put<int32_t>(request, options.smoothTicks);
+    request += source;
+    writeAll(frame(request));
+}
+
+ServerResponse CompileClient::receive() {
+    std::string payload = readFrame();
+    const size_t headerSize = sizeof(uint8_t) + sizeof(uint32_t);
+    uint32_t diagnosticsLength = 0;
+    if (payload.size() >= headerSize) std::memcpy(&diagnosticsLength, payload.data() + 1, sizeof(diagnosticsLength));
+    if (payload.size() < headerSize || payload.size() - headerSize < diagnosticsLength) {
+        throw std::runtime_error("malformed response");
+    }
+
+    ServerResponse response;
+    response.ok = payload[0] == 0;
+    response.diagnostics = payload.substr(headerSize, diagnosticsLength);
+    response.output = payload.substr(headerSize + diagnosticsLength);
+    return response;
+}
@@ -0,0 +1,140 @@
+#ifndef SERVER_H
+#define SERVER_H
+
+#include "driver.h"
+#include <string>
+#include <vector>
+#include <map>
+#include <list>
+#include <deque>
+#include <unordered_map>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <atomic>
+#include <ostream>
+#include <cstdint>
+
+// Wire format (host byte order, same machine only). Every message is a
+// u32 length followed by that many bytes.
+//   request:  u8 flags (1 = optimize, 2 = readable), i32 starting gold,
+//             i32 smoothing ticks, source
+//   response: u8 status (0 = ok, 1 = error), u32 diagnostics length,
+//             diagnostics, output (empty on error)
+struct ServerResponse {
+    bool ok = false;
+    std::string diagnostics;   // Error message, or economy warnings on success
+    std::string output;
+};
+
+// Long-running compile service on a Unix domain socket. One epoll thread
+// accepts clients and frames their requests; a fixed set of workers, each
+// with its own warm Compiler per option set, does the compiling. Results
+// are memoized per (options, source) in an LRU table bounded by the bytes
+// of requests and responses it holds, so repeated requests for an unchanged
+// buffer skip the pipeline entirely. Responses go back in request order on
+// each connection, so clients may pipeline.
+class CompileServer {
+public:
+    CompileServer(const std::string& socketPath, size_t threads, size_t cacheSize = 256u * 1024 * 1024);
+    ~CompileServer();
+
+    // Serve until SIGINT/SIGTERM
+    void run();
+
+    // Serve on a scratch socket from this process and check output against
+    // local compiles: cache hits, errors, pipelined order, the response
+    // cache's byte bound and a client that stops reading
+    static bool verify(const std::string& source, const CompileOptions& options, std::ostream& log);
+
+private:
+    struct Connection {
+        int fd = -1;
+        std::string input;
+        std::string output;
+        uint64_t nextRequest = 0;      // Sequence number of the next frame read
+        uint64_t nextResponse = 0;     // Sequence number to send next
+        std::map<uint64_t, std::string> ready;
+        uint32_t events = 0;           // Armed epoll events
+
+        bool keepingUp() const;        // False pauses reading and framing
+    };
+
+    struct Job {
+        uint64_t connection;
+        uint64_t sequence;
+        std::string request;
+    };
+
+    struct Done {
+        uint64_t connection;
+        uint64_t sequence;
+        std::string response;
+    };
+
+    struct CachedResult {
+        std::string response;
+        std::list<const std::string*>::iterator lru;
+    };
+
+    std::string socketPath;
+    size_t threadCount;
+    size_t cacheLimit;                 // Bytes of cached requests and responses
+    int listenFd = -1;
+    int epollFd = -1;
+    int wakeFd = -1;
+
+    std::unordered_map<uint64_t, Connection> connections;
+    uint64_t nextConnection = 2;       // 0 and 1 tag the listener and wake fd
+
+    std::mutex jobMutex;
+    std::condition_variable jobReady;
+    std::deque<Job> jobs;
+    bool stopping = false;
+    std::atomic<bool> stopCalled{false};
+    std::vector<std::thread> workers;
+
+    std::mutex doneMutex;
+    std::vector<Done> done;
+
+    std::mutex cacheMutex;
+    std::unordered_map<std::string, CachedResult> cache;   // By request bytes
+    std::list<const std::string*> lru;                     // Keys of `cache`, most recent first
+    size_t cacheBytes = 0;
+    size_t hits = 0;
+    size_t requests = 0;
+
+    void serve();
+    void stop();
+    void workerLoop();
+    std::string handle(const std::string& request, std::map<std::string, std::unique_ptr<Compiler>>& compilers);
+    void acceptClients();
+    void readClient(uint64_t id);
+    void frameRequests(uint64_t id);
+    void flushClient(uint64_t id);
+    void updateEvents(uint64_t id);
+    void closeClient(uint64_t id);
+    void deliverDone();
+};
+
+// Blocking client for CompileServer; one connection, many requests
+class CompileClient {
+public:
+    explicit CompileClient(const std::string& socketPath);
+    ~CompileClient();
+
+    ServerResponse compile(const std::string& source, const CompileOptions& options);
+
+    // Pipelining: responses to sent requests arrive in order
+    void send(const std::string& source, const CompileOptions& options);
+    ServerResponse receive();
+
+private:
+    int fd = -1;
+
+    void writeAll(const std::string& data);
+    std::string readFrame();
+};
+
+#endif // SERVER_H
@@ -0,0 +1,286 @@
+#ifndef SHMCONFIG_H
+#define SHMCONFIG_H
+
+// Reader for configs published with -publish-shm. Header-only and free of
+// compiler dependencies, so a game server can include this file alone
+// (link with -lrt on glibc older than 2.34).
+//
+// The segment starts with a ShmConfigSegment header followed by buffers.
+// The header has two buffer slots; each slot points at one complete
+// config image. The publisher fills the slot the readers are not using.
+// It then flips `generation`, and (generation & 1) names the current
+// slot. Each slot also carries a seqlock sequence that is odd while the
+// slot is being rewritten. A reader copies the current image out and
+// retries only when the publisher reused that slot under it, so readers
+// never block the publisher or each other.
+//
+// An image is position independent: every reference is a byte offset from
+// the start of the image, so it is valid wherever it is copied or mapped.
+
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <stdexcept>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+struct ShmConfigSegment {
+    static constexpr uint64_t MAGIC = 0x314d485352575450ULL;   // "PTWRSHM1"
+    static constexpr uint32_t VERSION = 1;
+
+    struct Slot {
+        std::atomic<uint64_t> sequence;   // Odd while the publisher rewrites the slot
+        std::atomic<uint64_t> offset;     // Image position in the segment
+        std::atomic<uint64_t> size;
+        std::atomic<uint64_t> capacity;
+    };
+
+    std::atomic<uint64_t> magic;          // Stored last when the segment is created
+    uint32_t version;
+    uint32_t reserved;
+    std::atomic<uint64_t> generation;     // 0 until the first publish
+    Slot slots[2];
+};
+
+static_assert(std::atomic<uint64_t>::is_always_lock_free, "shared-memory atomics must be lock free");
+
+// Fixed-layout tables of one compiled config. Names are string Ranges into
+// the image; tables are Ranges of structs, 8-byte aligned. Enemy and tower
+// references are table indices, with folded names listed as aliases.
+struct ShmConfigImage {
+    static constexpr uint64_t MAGIC = 0x31474643574f5450ULL;   // "PTOWCFG1"
+
+    struct Range {
+        uint64_t offset;
+        uint64_t count;    // Bytes for strings, elements for tables
+    };
+
+    struct Point { int32_t x, y; };
+    struct Enemy { Range name; int32_t hp; int32_t reward; double speed; };
+    struct Tower { Range name; int32_t range; int32_t damage; int32_t cost; int32_t reserved; double fireRate; double dps; };
+    struct Spawn { uint32_t enemy; int32_t count; int32_t start; int32_t interval; };
+    struct Wave { Range name; Range spawns; };   // Repeat blocks already expanded
+    struct Placement { uint32_t tower; int32_t x; int32_t y; };
+    struct Alias { Range name; uint32_t kind; uint32_t index; };   // kind 0: enemy, 1: tower
+
+    uint64_t magic;
+    uint64_t size;
+    int32_t hasMap;
+    int32_t width;
+    int32_t height;
+    int32_t startingGold;
+    Range mapName;
+    Range path;          // Point
+    Range enemies;       // Enemy
+    Range towers;        // Tower
+    Range waves;         // Wave
+    Range placements;    // Placement
+    Range aliases;       // Alias
+    Range json;          // generateJSON output, for clients that want it
+};
+
+// Bounds-checked view of one image. The constructor checks every range, so
+// the accessors are plain pointer arithmetic.
+class ShmConfigView {
+public:
+    ShmConfigView(const char* data, size_t size) : data(data), size(size) {
+        if (size < sizeof(ShmConfigImage) || image().magic != ShmConfigImage::MAGIC || image().size != size) {
+            throw std::runtime_error("not a ParseTower config image");
+        }
+        const ShmConfigImage& config = image();
+        checkString(config.mapName);
+        checkString(config.json);
+        checkTable<ShmConfigImage::Point>(config.path);
+        for (const auto& e : table<ShmConfigImage::Enemy>(config.enemies)) checkString(e.name);
+        for (const auto& t : table<ShmConfigImage::Tower>(config.towers)) checkString(t.name);
+        for (const auto& w : table<ShmConfigImage::Wave>(config.waves)) {
+            checkString(w.name);
+            for (const auto& s : table<ShmConfigImage::Spawn>(w.spawns)) {
+                if (s.enemy >= config.enemies.count) fail();
+            }
+        }
+        for (const auto& p : table<ShmConfigImage::Placement>(config.placements)) {
+            if (p.tower >= config.towers.count) fail();
+        }
+        for (const auto& a : table<ShmConfigImage::Alias>(config.aliases)) {
+            checkString(a.name);
+            if (a.index >= (a.kind == 0 ? config.enemies.count : config.towers.count)) fail();
+        }
+    }
+
+    const ShmConfigImage& image() const { return *reinterpret_cast<const ShmConfigImage*>(data); }
+
+    std::string_view string(const ShmConfigImage::Range& range) const {
+        return std::string_view(data + range.offset, range.count);
+    }
+
+    template <typename T>
+    struct Table {
+        const T* first;
+        size_t count;
+        const T* begin() const { return first; }
+        const T* end() const { return first + count; }
+        size_t size() const { return count; }
+        const T& operator[](size_t i) const { return first[i]; }
+    };
+
+    template <typename T>
+    Table<T> table(const ShmConfigImage::Range& range) const {
+        checkTable<T>(range);
+        return Table<T>{reinterpret_cast<const T*>(data + range.offset), range.count};
+    }
+
+    Table<ShmConfigImage::Enemy> enemies() const { return table<ShmConfigImage::Enemy>(image().enemies); }
+    Table<ShmConfigImage::Tower> towers() const { return table<ShmConfigImage::Tower>(image().towers); }
+    Table<ShmConfigImage::Wave> waves() const { return table<ShmConfigImage::Wave>(image().waves); }
+    Table<ShmConfigImage::Spawn> spawns(const ShmConfigImage::Wave& wave) const {
+        return table<ShmConfigImage::Spawn>(wave.spawns);
+    }
+    Table<ShmConfigImage::Placement> placements() const { return table<ShmConfigImage::Placement>(image().placements); }
+    Table<ShmConfigImage::Point> path() const { return table<ShmConfigImage::Point>(image().path); }
+    Table<ShmConfigImage::Alias> aliases() const { return table<ShmConfigImage::Alias>(image().aliases); }
+    std::string_view json() const { return string(image().json); }
+
+private:
+    const char* data;
+    size_t size;
+
+    [[noreturn]] static void fail() { throw std::runtime_error("corrupt ParseTower config image"); }
+
+    void checkString(const ShmConfigImage::Range& range) const {
+        if (range.offset > size || range.count > size - range.offset) fail();
+    }
+
+    template <typename T>
+    void checkTable(const ShmConfigImage::Range& range) const {
+        if (range.offset % alignof(T) != 0 || range.offset > size ||
+            range.count > (size - range.offset) / sizeof(T)) {
+            fail();
+        }
+    }
+};
+
+// A consistent copy of the config current at `generation`
+class ShmConfigSnapshot {
+public:
+    uint64_t generation() const { return gen; }
+    ShmConfigView view() const { return ShmConfigView(reinterpret_cast<const char*>(words.data()), bytes); }
+
+private:
+    friend class ShmConfigReader;
+    uint64_t gen = 0;
+    std::vector<uint64_t> words;   // 8-byte aligned storage for the image
+    size_t bytes = 0;
+};
+
+// Opens a published segment read-only. snapshot() never takes a lock and
+// never waits for the publisher to finish. One reader per thread; the
+// mapping grows when the publisher grows the segment.
+class ShmConfigReader {
+public:
+    explicit ShmConfigReader(const std::string& name) {
+        std::string path = name.empty() || name[0] != '/' ? "/" + name : name;
+        fd = shm_open(path.c_str(), O_RDONLY, 0);
+        if (fd < 0) throw std::runtime_error("could not open shared memory " + path);
+        try {
+            map();
+            if (mapped < sizeof(ShmConfigSegment) ||
+                segment()->magic.load(std::memory_order_acquire) != ShmConfigSegment::MAGIC ||
+                segment()->version != ShmConfigSegment::VERSION) {
+                throw std::runtime_error(path + " is not a ParseTower config segment");
+            }
+        } catch (...) {
+            unmap();
+            ::close(fd);
+            throw;
+        }
+    }
+
+    ~ShmConfigReader() {
+        unmap();
+        ::close(fd);
+    }
+
+    ShmConfigReader(const ShmConfigReader&) = delete;
+    ShmConfigReader& operator=(const ShmConfigReader&) = delete;
+
+    // Cheap poll for hot reload; 0 until something is published
+    uint64_t generation() const { return segment()->generation.load(std::memory_order_acquire); }
+
+    // Copy out the current image. Throws when nothing is published yet.
+    ShmConfigSnapshot snapshot() {
+        ShmConfigSnapshot snap;
+        while (true) {
+            uint64_t gen = generation();
+            if (gen == 0) throw std::runtime_error("no config published yet");
+            const ShmConfigSegment::Slot& slot = segment()->slots[gen & 1];
+            uint64_t before = slot.sequence.load(std::memory_order_acquire);
+            uint64_t offset = slot.offset.load(std::memory_order_relaxed);
+            uint64_t size = slot.size.load(std::memory_order_relaxed);
+
+            if ((before & 1) || offset > UINT64_MAX - size) {
+                retried++;
+                continue;
+            }
+            if (offset + size > mapped) {
+                // `slot` lives in the old mapping, so start over either way
+                remap(offset + size);
+                continue;
+            }
+
+            snap.words.resize((size + 7) / 8);
+            std::memcpy(snap.words.data(), base + offset, size);
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (slot.sequence.load(std::memory_order_relaxed) == before && generation() == gen) {
+                snap.gen = gen;
+                snap.bytes = size;
+                return snap;
+            }
+            retried++;
+        }
+    }
+
+    // Snapshots that had to start over because the publisher moved on
+    size_t retries() const { return retried; }
+
+private:
+    int fd = -1;
+    char* base = nullptr;
+    size_t mapped = 0;
+    size_t retried = 0;
+
+    ShmConfigSegment* segment() const { return reinterpret_cast<ShmConfigSegment*>(base); }
+
+    void map() {
+        struct stat info;
+        if (fstat(fd, &info) != 0) throw std::runtime_error("could not stat shared memory");
+        size_t size = static_cast<size_t>(info.st_size);
+        if (size == 0) throw std::runtime_error("shared memory segment is empty");
+        void* address = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+        if (address == MAP_FAILED) throw std::runtime_error("could not map shared memory");
+        base = static_cast<char*>(address);
+        mapped = size;
+    }
+
+    void unmap() {
+        if (base) munmap(base, mapped);
+        base = nullptr;
+        mapped = 0;
+    }
+
+    // The segment only ever grows. A slot pointing past the end of the
+    // file is being rewritten, so the mapping stays as it is.
+    void remap(uint64_t needed) {
+        struct stat info;
+        if (fstat(fd, &info) != 0 || static_cast<uint64_t>(info.st_size) < needed) return;
+        unmap();
+        map();
+    }
+};
+
+#endif // SHMCONFIG_H
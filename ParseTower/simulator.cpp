@@ -0,0 +1,333 @@
+#include "simulator.h"
+#include <sstream>
+#include <iomanip>
+#include <algorithm>
+#include <stdexcept>
+#include <cmath>
+#include <chrono>
+
+Simulator::Simulator(size_t threads, double tickSeconds)
+    : pool(threads), dt(tickSeconds) {}
+
+void Simulator::load(const std::vector<IRInstruction>& instructions) {
+    model = GameModel::fromIR(instructions);
+    if (!model.hasMap) {
+        throw std::runtime_error("no map defined");
+    }
+
+    placements.clear();
+    for (const auto& mp : model.placements) {
+        placements.push_back({mp.tower, mp.x, mp.y, 0});
+    }
+
+    rebuildGrid();
+}
+
+void Simulator::setPlacements(const std::vector<SimPlacement>& newPlacements) {
+    placements.clear();
+    for (const auto& sp : newPlacements) {
+        auto it = model.towerIndex.find(sp.towerType);
+        if (it == model.towerIndex.end())
+            throw std::runtime_error("placement of undefined tower " + sp.towerType);
+        Placement p;
+        p.tower = it->second;
+        p.x = sp.x;
+        p.y = sp.y;
+        p.cell = 0;
+        placements.push_back(p);
+    }
+    rebuildGrid();
+}
+
+bool Simulator::setEnemyStats(const std::string& name, int hp, double speed) {
+    auto it = model.enemyIndex.find(name);
+    if (it == model.enemyIndex.end()) return false;
+    model.enemies[it->second].hp = hp;
+    model.enemies[it->second].speed = speed;
+    return true;
+}
+
+void Simulator::rebuildGrid() {
+    // Cells are at least one tower range wide so a tower scans a handful of
+    // cells, and the grid is capped at 64x64 to keep histograms cheap.
+    int maxRange = 1;
+    for (const auto& t : model.towers) maxRange = std::max(maxRange, t.range);
+    int longestSide = std::max(1, std::max(model.width, model.height));
+    cellSize = std::max<double>(maxRange, std::ceil(longestSide / 64.0));
+    gridW = std::max(1, static_cast<int>(std::ceil(std::max(1, model.width) / cellSize)));
+    gridH = std::max(1, static_cast<int>(std::ceil(std::max(1, model.height) / cellSize)));
+
+    for (auto& p : placements) p.cell = cellOf(p.x, p.y);
+
+    // Group towers by region so each worker scans a compact area of the grid
+    std::stable_sort(placements.begin(), placements.end(),
+                     [](const Placement& a, const Placement& b) { return a.cell < b.cell; });
+}
+
+int Simulator::cellOf(double x, double y) const {
+    int cx = std::min(gridW - 1, std::max(0, static_cast<int>(x / cellSize)));
+    int cy = std::min(gridH - 1, std::max(0, static_cast<int>(y / cellSize)));
+    return cy * gridW + cx;
+}
+
+SimResult Simulator::run() {
+    SimResult result;
+    result.digest = 1469598103934665603ULL;
+    for (size_t w = 0; w < model.waves.size(); w++) {
+        result.waves.push_back(runWave(w, result.digest));
+    }
+    return result;
+}
+
+// Counting sort of the active enemies by cell. Each chunk histograms its own
+// slice, the prefix sum walks (cell, chunk) in order and the scatter keeps
+// ascending ids inside every cell regardless of the chunk count.
+void Simulator::binActive() {
+    size_t cells = static_cast<size_t>(gridW) * gridH;
+    size_t chunks = pool.size();
+
+    chunkCounts.assign(cells * chunks, 0);
+    pool.parallelFor(active.size(), [this, cells](size_t begin, size_t end, size_t chunk) {
+        uint32_t* counts = &chunkCounts[chunk * cells];
+        for (size_t i = begin; i < end; i++) {
+            int cell = enemyCell[active[i]];
+            if (cell >= 0) counts[cell]++;
+        }
+    });
+
+    cellStart.assign(cells + 1, 0);
+    uint32_t running = 0;
+    for (size_t c = 0; c < cells; c++) {
+        cellStart[c] = running;
+        for (size_t k = 0; k < chunks; k++) {
+            uint32_t n = chunkCounts[k * cells + c];
+            chunkCounts[k * cells + c] = running;
+            running += n;
+        }
+    }
+    cellStart[cells] = running;
+
+    binned.resize(running);
+    pool.parallelFor(active.size(), [this, cells](size_t begin, size_t end, size_t chunk) {
+        uint32_t* offsets = &chunkCounts[chunk * cells];
+        for (size_t i = begin; i < end; i++) {
+            uint32_t id = active[i];
+            int cell = enemyCell[id];
+            if (cell >= 0) binned[offsets[cell]++] = id;
+        }
+    });
+}
+
+// Every placement only writes its own cooldown/target/shots slots, so the
+// split across workers cannot influence the result.
+void Simulator::acquireTargets() {
+    pool.parallelFor(placements.size(), [this](size_t begin, size_t end, size_t) {
+        for (size_t p = begin; p < end; p++) {
+            const Placement& pl = placements[p];
+            const GameModel::Tower& tt = model.towers[pl.tower];
+
+            target[p] = -1;
+            shots[p] = 0;
+            cooldown[p] = std::max(0.0, cooldown[p] - dt);
+            if (cooldown[p] > 0.0) continue;
+
+            double r2 = static_cast<double>(tt.range) * tt.range;
+            int x0 = std::max(0, static_cast<int>((pl.x - tt.range) / cellSize));
+            int x1 = std::min(gridW - 1, static_cast<int>((pl.x + tt.range) / cellSize));
+            int y0 = std::max(0, static_cast<int>((pl.y - tt.range) / cellSize));
+            int y1 = std::min(gridH - 1, static_cast<int>((pl.y + tt.range) / cellSize));
+
+            int best = -1;
+            for (int cy = y0; cy <= y1; cy++) {
+                for (int cx = x0; cx <= x1; cx++) {
+                    int cell = cy * gridW + cx;
+                    for (uint32_t k = cellStart[cell]; k < cellStart[cell + 1]; k++) {
+                        uint32_t id = binned[k];
+                        double dx = enemyX[id] - pl.x;
+                        double dy = enemyY[id] - pl.y;
+                        if (dx * dx + dy * dy > r2) continue;
+                        if (best < 0 || enemyProgress[id] > enemyProgress[best] ||
+                            (enemyProgress[id] == enemyProgress[best] && static_cast<int>(id) < best)) {
+                            best = static_cast<int>(id);
+                        }
+                    }
+                }
+            }
+
+            if (best >= 0) {
+                target[p] = best;
+                double period = 1.0 / tt.fireRate;
+                while (cooldown[p] <= 0.0) {
+                    shots[p]++;
+                    cooldown[p] += period;
+                }
+            }
+        }
+    });
+}
+
+SimWaveResult Simulator::runWave(size_t waveIdx, uint64_t& digest) {
+    const GameModel::Wave& wave = model.waves[waveIdx];
+    SimWaveResult result;
+    result.name = wave.name;
+
+    // Spawn order: time, then declaration order of the group, then index
+    events.clear();
+    for (const auto& g : wave.spawns) {
+        for (int k = 0; k < g.count; k++) {
+            events.push_back({static_cast<double>(g.start) + static_cast<double>(k) * g.interval, g.enemy});
+        }
+    }
+    std::stable_sort(events.begin(), events.end(),
+                     [](const SpawnEvent& a, const SpawnEvent& b) { return a.time < b.time; });
+
+    size_t n = events.size();
+    enemyKind.assign(n, 0);
+    enemyHp.assign(n, 0);
+    enemyProgress.assign(n, 0.0);
+    enemyX.assign(n, 0.0);
+    enemyY.assign(n, 0.0);
+    enemySegment.assign(n, 0);
+    enemyCell.assign(n, -1);
+    outcome.assign(n, 0);
+    outcomeTick.assign(n, 0);
+    active.clear();
+
+    cooldown.assign(placements.size(), 0.0);
+    target.assign(placements.size(), -1);
+    shots.assign(placements.size(), 0);
+
+    const double pathLength = model.path.length();
+    size_t cursor = 0;
+    uint32_t tick = 0;
+
+    while (cursor < n || !active.empty()) {
+        double now = tick * dt;
+
+        // Spawn everything due this tick
+        while (cursor < n && events[cursor].time <= now + 1e-9) {
+            uint32_t id = static_cast<uint32_t>(cursor);
+            enemyKind[id] = events[cursor].enemy;
+            enemyHp[id] = model.enemies[events[cursor].enemy].hp;
+            result.hpIncoming += enemyHp[id];
+            result.spawned++;
+            active.push_back(id);
+            cursor++;
+        }
+
+        // Movement, independent per enemy
+        pool.parallelFor(active.size(), [this, pathLength](size_t begin, size_t end, size_t) {
+            for (size_t i = begin; i < end; i++) {
+                uint32_t id = active[i];
+                enemyProgress[id] += model.enemies[enemyKind[id]].speed * dt;
+                if (enemyProgress[id] >= pathLength) {
+                    enemyCell[id] = -1;
+                    continue;
+                }
+                model.path.positionAt(enemyProgress[id], enemySegment[id], enemyX[id], enemyY[id]);
+                enemyCell[id] = cellOf(enemyX[id], enemyY[id]);
+            }
+        });
+
+        binActive();
+        acquireTargets();
+
+        // Deterministic reduction: apply shots in placement order
+        for (size_t p = 0; p < placements.size(); p++) {
+            if (target[p] >= 0) {
+                enemyHp[target[p]] -= shots[p] * model.towers[placements[p].tower].damage;
+            }
+        }
+
+        // Retire dead and leaked enemies, keeping ids ascending
+        size_t kept = 0;
+        for (size_t i = 0; i < active.size(); i++) {
+            uint32_t id = active[i];
+            if (enemyCell[id] < 0) {
+                outcome[id] = 2;
+                outcomeTick[id] = tick;
+                result.leaked++;
+                result.hpLeaked += std::max(0, enemyHp[id]);
+            } else if (enemyHp[id] <= 0) {
+                outcome[id] = 1;
+                outcomeTick[id] = tick;
+                result.killed++;
+                result.goldEarned += model.enemies[enemyKind[id]].reward;
+            } else {
+                active[kept++] = id;
+            }
+        }
+        active.resize(kept);
+
+        tick++;
+    }
+
+    result.duration = tick * dt;
+
+    // FNV-1a over every enemy's fate in spawn order
+    for (size_t id = 0; id < n; id++) {
+        uint64_t words[3] = { id, outcome[id], outcomeTick[id] };
+        for (uint64_t w : words) {
+            for (int b = 0; b < 8; b++) {
+                digest ^= (w >> (b * 8)) & 0xff;
+                digest *= 1099511628211ULL;
+            }
+        }
+    }
+
+    return result;
+}
+
+std::string Simulator::report(const SimResult& result) const {
+    std::ostringstream out;
+    out << "=== Simulation Report ===\n";
+    out << "Threads: " << pool.size() << ", tick: " << dt << "s, placements: " << placements.size() << "\n";
+
+    for (const auto& w : result.waves) {
+        double leakedPct = w.hpIncoming > 0 ? 100.0 * w.hpLeaked / w.hpIncoming : 0.0;
+        out << "  " << w.name
+            << ": spawned=" << w.spawned
+            << " killed=" << w.killed
+            << " leaked=" << w.leaked
+            << " hp_leaked=" << w.hpLeaked << "/" << w.hpIncoming
+            << " (" << std::fixed << std::setprecision(1) << leakedPct << "%)"
+            << " gold=" << w.goldEarned
+            << " duration=" << std::setprecision(1) << w.duration << "s\n";
+    }
+
+    out << "Digest: " << std::hex << std::setw(16) << std::setfill('0') << result.digest << std::dec << "\n";
+    return out.str();
+}
+
+bool Simulator::verify(const std::vector<IRInstruction>& instructions, size_t threads, std::ostream& log) {
+    Simulator sequential(1);
+    Simulator parallel(threads);
+    sequential.load(instructions);
+    parallel.load(instructions);
+
+    double millis[2] = {0.0, 0.0};
+    Simulator* runs[2] = {&sequential, &parallel};
+    for (size_t w = 0; w < sequential.waveCount(); w++) {
+        SimWaveResult results[2];
+        uint64_t digests[2];
+        for (int r = 0; r < 2; r++) {
+            digests[r] = 1469598103934665603ULL;
+            auto start = std::chrono::steady_clock::now();
+            results[r] = runs[r]->runWave(w, digests[r]);
+            millis[r] += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        }
+
+        const SimWaveResult& a = results[0];
+        const SimWaveResult& b = results[1];
+        if (digests[0] != digests[1] || a.spawned != b.spawned || a.killed != b.killed || a.leaked != b.leaked ||
+            a.hpLeaked != b.hpLeaked || a.goldEarned != b.goldEarned || a.duration != b.duration) {
+            log << "  MISMATCH in wave " << a.name << " between 1 and " << parallel.threadCount() << " thread(s)\n";
+            return false;
+        }
+    }
+
+    log << "  Simulation matched in " << sequential.waveCount() << " wave(s) on 1 and " << parallel.threadCount()
+        << " thread(s); " << std::fixed << std::setprecision(1) << millis[0] << " ms sequential, "
+        << millis[1] << " ms parallel.\n";
+    return true;
+}
@@ -0,0 +1,109 @@
+#ifndef SIMULATOR_H
+#define SIMULATOR_H
+
+#include "ir.h"
+#include "model.h"
+#include "threadpool.h"
+#include <vector>
+#include <string>
+#include <cstdint>
+#include <ostream>
+
+// Outcome of one wave played against the placed towers
+struct SimWaveResult {
+    std::string name;
+    int spawned = 0;
+    int killed = 0;
+    int leaked = 0;
+    long long hpIncoming = 0;   // Sum of spawn HP
+    long long hpLeaked = 0;     // HP still on enemies that reached the path end
+    long long goldEarned = 0;
+    double duration = 0.0;      // Seconds until the last enemy died or leaked
+};
+
+struct SimResult {
+    std::vector<SimWaveResult> waves;
+    uint64_t digest = 0;        // Hash of every enemy's fate; equal digests mean equal runs
+};
+
+struct SimPlacement {
+    std::string towerType;
+    int x;
+    int y;
+};
+
+// Fixed-timestep match simulator driven by (optimized) IR.
+//
+// Each tick enemies advance along the path, are binned into map regions,
+// every tower picks the in-range enemy furthest along the path (ties go to
+// the lower spawn id) and the shots are reduced in placement order. The
+// region and placement work is split across threads, but nothing a thread
+// computes depends on how the work was split, so the result is identical
+// for any thread count.
+class Simulator {
+public:
+    explicit Simulator(size_t threads = 1, double tickSeconds = 0.1);
+
+    // Build the compact model from IR. Can be called again to reload.
+    void load(const std::vector<IRInstruction>& instructions);
+
+    // Replace the PLACE_TOWER set from the IR
+    void setPlacements(const std::vector<SimPlacement>& placements);
+
+    // Override one enemy type's stats without reloading; false if unknown
+    bool setEnemyStats(const std::string& name, int hp, double speed);
+
+    SimResult run();
+    SimWaveResult runWave(size_t wave, uint64_t& digest);
+
+    size_t waveCount() const { return model.waves.size(); }
+    const std::string& waveName(size_t wave) const { return model.waves[wave].name; }
+    size_t threadCount() const { return pool.size(); }
+
+    std::string report(const SimResult& result) const;
+
+    // Play every wave on one thread and on `threads` and check each wave's
+    // result and digest match
+    static bool verify(const std::vector<IRInstruction>& instructions, size_t threads, std::ostream& log);
+
+private:
+    struct Placement { int tower; int x; int y; int cell; };
+    struct SpawnEvent { double time; int enemy; };
+
+    ThreadPool pool;
+    double dt;
+
+    GameModel model;
+    std::vector<Placement> placements;
+
+    // Region grid
+    double cellSize = 1.0;
+    int gridW = 1;
+    int gridH = 1;
+
+    // Per-run state, kept between runs to avoid reallocation
+    std::vector<SpawnEvent> events;
+    std::vector<int> enemyKind;
+    std::vector<int> enemyHp;
+    std::vector<double> enemyProgress;
+    std::vector<double> enemyX;
+    std::vector<double> enemyY;
+    std::vector<size_t> enemySegment;
+    std::vector<int> enemyCell;          // -1 once the enemy reached the path end
+    std::vector<uint32_t> active;        // Alive enemy ids, ascending
+    std::vector<uint32_t> binned;        // Active ids grouped by cell
+    std::vector<uint32_t> cellStart;     // gridW * gridH + 1 offsets into binned
+    std::vector<uint32_t> chunkCounts;   // Per-chunk cell histograms
+    std::vector<double> cooldown;        // Per placement
+    std::vector<int> target;             // Per placement, -1 when not firing
+    std::vector<int> shots;              // Per placement
+    std::vector<uint8_t> outcome;        // 0 alive, 1 killed, 2 leaked
+    std::vector<uint32_t> outcomeTick;
+
+    void rebuildGrid();
+    int cellOf(double x, double y) const;
+    void binActive();
+    void acquireTargets();
+};
+
+#endif // SIMULATOR_H
@@ -0,0 +1,157 @@
+#include "sourcewriter.h"
+#include <sstream>
+#include <iomanip>
+#include <algorithm>
+
+// The lexer only produces FLOAT for literals with a decimal point
+std::string SourceWriter::formatFloat(double value) {
+    std::ostringstream out;
+    out << std::setprecision(15) << value;
+    std::string text = out.str();
+    if (text.find('.') == std::string::npos) text += ".0";
+    return text;
+}
+
+std::string SourceWriter::writeMap(const MapDecl& map) {
+    std::ostringstream out;
+    out << "map " << map.name << " {\n";
+    out << "    size = (" << map.width << ", " << map.height << ");\n";
+    out << "    path = [";
+    for (size_t i = 0; i < map.path.size(); i++) {
+        if (i > 0) out << ", ";
+        out << "(" << map.path[i].first << "," << map.path[i].second << ")";
+    }
+    out << "];\n";
+    out << "}\n";
+    return out.str();
+}
+
+// Constants are written folded; declarations hold their folded values too
+std::string SourceWriter::writeConst(const ConstDecl& constant) {
+    std::ostringstream out;
+    out << "const " << constant.name << " = "
+        << (constant.isFloat ? formatFloat(constant.floatValue) : std::to_string(constant.intValue)) << ";\n";
+    return out.str();
+}
+
+std::string SourceWriter::writeEnemy(const EnemyDecl& enemy) {
+    std::ostringstream out;
+    out << "enemy " << enemy.name << " {\n";
+    out << "    hp = " << enemy.hp << ";\n";
+    out << "    speed = " << formatFloat(enemy.speed) << ";\n";
+    out << "    reward = " << enemy.reward << ";\n";
+    out << "}\n";
+    return out.str();
+}
+
+std::string SourceWriter::writeTower(const TowerDecl& tower) {
+    std::ostringstream out;
+    out << "tower " << tower.name << " {\n";
+    out << "    range = " << tower.range << ";\n";
+    out << "    damage = " << tower.damage << ";\n";
+    out << "    fire_rate = " << formatFloat(tower.fire_rate) << ";\n";
+    out << "    cost = " << tower.cost << ";\n";
+    out << "}\n";
+    return out.str();
+}
+
+// base + steps[k] * variables[k], written the way it would be typed: "5 + 2 * i"
+std::string SourceWriter::formatLinear(int base, const std::vector<int>& steps,
+                                       const std::vector<std::string>& variables) {
+    std::ostringstream out;
+    bool empty = true;
+    if (base != 0 || std::all_of(steps.begin(), steps.end(), [](int step) { return step == 0; })) {
+        out << base;
+        empty = false;
+    }
+    for (size_t k = 0; k < steps.size(); k++) {
+        int step = steps[k];
+        if (step == 0) continue;
+        if (empty) out << (step < 0 ? "-" : "");
+        else out << (step < 0 ? " - " : " + ");
+        empty = false;
+        int magnitude = step < 0 ? -step : step;
+        if (magnitude != 1) out << magnitude << " * ";
+        out << variables[k];
+    }
+    return out.str();
+}
+
+// Same walk as IRGenerator::emitSpawns; blocks are stored in opening order
+void SourceWriter::writeWaveBody(std::ostringstream& out, const WaveDecl& wave, int block, size_t& spawn,
+                                 size_t& repeat, std::vector<std::string>& variables) {
+    size_t end = block < 0 ? wave.spawns.size() : wave.repeats[block].endSpawn;
+    std::string indent(4 * (variables.size() + 1), ' ');
+
+    while (true) {
+        if (repeat < wave.repeats.size() && wave.repeats[repeat].parent == block &&
+            wave.repeats[repeat].firstSpawn == spawn) {
+            const RepeatBlock& r = wave.repeats[repeat];
+            int child = static_cast<int>(repeat++);
+            out << indent << "repeat(" << r.variable << ", " << r.times << ") {\n";
+            variables.push_back(r.variable);
+            writeWaveBody(out, wave, child, spawn, repeat, variables);
+            variables.pop_back();
+            out << indent << "}\n";
+        } else if (spawn < end) {
+            const SpawnStmt& s = wave.spawns[spawn++];
+            out << indent << "spawn(" << s.enemyType
+                << ", count=" << formatLinear(s.count, s.countSteps, variables)
+                << ", start=" << formatLinear(s.start, s.startSteps, variables)
+                << ", interval=" << formatLinear(s.interval, s.intervalSteps, variables) << ");\n";
+        } else {
+            break;
+        }
+    }
+}
+
+std::string SourceWriter::writeWave(const WaveDecl& wave) {
+    std::ostringstream out;
+    out << "wave " << wave.name << " {\n";
+    size_t spawn = 0;
+    size_t repeat = 0;
+    std::vector<std::string> variables;
+    writeWaveBody(out, wave, -1, spawn, repeat, variables);
+    out << "}\n";
+    return out.str();
+}
+
+std::string SourceWriter::writePlace(const PlaceStmt& place) {
+    std::ostringstream out;
+    out << "place " << place.towerType << " at (" << place.x << ", " << place.y << ");\n";
+    return out.str();
+}
+
+std::string SourceWriter::write(const Program& program) {
+    std::ostringstream out;
+    bool previousWasPlace = false;
+    bool previousWasConst = false;
+    bool first = true;
+
+    for (const auto& decl : program.declarations) {
+        auto p = dynamic_cast<PlaceStmt*>(decl.get());
+        auto c = dynamic_cast<ConstDecl*>(decl.get());
+
+        // Blank line between blocks; consecutive place or const statements stay together
+        if (!first && !(p && previousWasPlace) && !(c && previousWasConst)) out << "\n";
+        first = false;
+        previousWasPlace = p != nullptr;
+        previousWasConst = c != nullptr;
+
+        if (auto m = dynamic_cast<MapDecl*>(decl.get())) {
+            out << writeMap(*m);
+        } else if (auto e = dynamic_cast<EnemyDecl*>(decl.get())) {
+            out << writeEnemy(*e);
+        } else if (auto t = dynamic_cast<TowerDecl*>(decl.get())) {
+            out << writeTower(*t);
+        } else if (auto w = dynamic_cast<WaveDecl*>(decl.get())) {
+            out << writeWave(*w);
+        } else if (p) {
+            out << writePlace(*p);
+        } else if (c) {
+            out << writeConst(*c);
+        }
+    }
+
+    return out.str();
+}
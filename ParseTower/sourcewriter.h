@@ -0,0 +1,27 @@
+#ifndef SOURCEWRITER_H
+#define SOURCEWRITER_H
+
+#include "ast.h"
+#include <string>
+#include <sstream>
+#include <vector>
+
+// Pretty-prints an AST back to .td source that the Parser accepts
+class SourceWriter {
+public:
+    std::string write(const Program& program);
+
+private:
+    std::string formatFloat(double value);
+    std::string writeConst(const ConstDecl& constant);
+    std::string writeMap(const MapDecl& map);
+    std::string writeEnemy(const EnemyDecl& enemy);
+    std::string writeTower(const TowerDecl& tower);
+    std::string writeWave(const WaveDecl& wave);
+    void writeWaveBody(std::ostringstream& out, const WaveDecl& wave, int block, size_t& spawn,
+                       size_t& repeat, std::vector<std::string>& variables);
+    std::string formatLinear(int base, const std::vector<int>& steps, const std::vector<std::string>& variables);
+    std::string writePlace(const PlaceStmt& place);
+};
+
+#endif // SOURCEWRITER_H
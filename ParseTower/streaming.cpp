@@ -0,0 +1,620 @@
+#include "streaming.h"
+#include "semantic.h"
+#include "analysis.h"
+#include "ircache.h"
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <algorithm>
+#include <functional>
+#include <stdexcept>
+#include <cstdio>
+#include <cctype>
+#include <unistd.h>
+
+namespace {
+
+const size_t READ_BLOCK = 64 * 1024;
+const size_t PLACEMENT_BLOCK = 4096;   // Placements per spill record
+
+// Cuts a .td stream into top-level declarations: a declaration keyword at
+// brace depth 0 starts the next one, as in the parser's error recovery.
+// Only the declaration being cut and one read block are buffered.
+class DeclarationReader {
+public:
+    explicit DeclarationReader(std::istream& in) : in(in), block(READ_BLOCK) {}
+
+    // Next declaration with any blank lines and comments before it
+    bool next(std::string& text, int& firstLine) {
+        while (available(1)) {
+            char c = buffer[scanned];
+            if (c == '/' && available(2) && buffer[scanned + 1] == '/') {
+                while (available(1) && buffer[scanned] != '\n') scanned++;
+                continue;
+            }
+
+            if (std::isalpha(static_cast<unsigned char>(c)) || c == '_') {
+                size_t start = scanned;
+                while (available(1) && (std::isalnum(static_cast<unsigned char>(buffer[scanned])) ||
+                                        buffer[scanned] == '_')) {
+                    scanned++;
+                }
+                bool keyword = isDeclarationKeyword(buffer.substr(start, scanned - start));
+                if (depth == 0 && keyword && content) {
+                    cut(start, text, firstLine);
+                    return true;
+                }
+                content = true;
+                continue;
+            }
+
+            if (c == '{') depth++;
+            else if (c == '}') depth--;
+            if (!std::isspace(static_cast<unsigned char>(c))) content = true;
+            scanned++;
+        }
+
+        if (!content) return false;
+        cut(buffer.size(), text, firstLine);
+        content = false;
+        return true;
+    }
+
+private:
+    std::istream& in;
+    std::vector<char> block;
+    std::string buffer;
+    size_t scanned = 0;
+    int depth = 0;
+    bool content = false;   // The pending text holds a token, not just blanks
+    int line = 1;           // Line of buffer[0]
+
+    bool available(size_t n) {
+        while (buffer.size() < scanned + n) {
+            if (!in) return false;
+            in.read(block.data(), block.size());
+            if (in.gcount() <= 0) return false;
+            buffer.append(block.data(), static_cast<size_t>(in.gcount()));
+        }
+        return true;
+    }
+
+    void cut(size_t end, std::string& text, int& firstLine) {
+        text.assign(buffer, 0, end);
+        firstLine = line;
+        line += static_cast<int>(std::count(text.begin(), text.end(), '\n'));
+        buffer.erase(0, end);
+        scanned -= end;
+    }
+
+    static bool isDeclarationKeyword(const std::string& word) {
+        return word == "map" || word == "enemy" || word == "tower" || word == "wave" ||
+               word == "place" || word == "const";
+    }
+};
+
+// Anonymous temporary file, removed when closed. Records are written at
+// the end and read back by offset, so several readers can walk one spill.
+class SpillFile {
+public:
+    SpillFile() : file(std::tmpfile()) {
+        if (!file) throw std::runtime_error("could not create a spill file");
+    }
+    ~SpillFile() { std::fclose(file); }
+
+    SpillFile(const SpillFile&) = delete;
+    SpillFile& operator=(const SpillFile&) = delete;
+
+    uint64_t size() const { return end; }
+
+    void append(const std::string& bytes) {
+        const char* data = bytes.data();
+        size_t left = bytes.size();
+        while (left > 0) {
+            ssize_t written = pwrite(fileno(file), data, left, static_cast<off_t>(end));
+            if (written <= 0) throw std::runtime_error("could not write a spill file");
+            data += written;
+            left -= static_cast<size_t>(written);
+            end += static_cast<uint64_t>(written);
+        }
+    }
+
+    void read(uint64_t offset, size_t size, std::string& bytes) const {
+        bytes.resize(size);
+        size_t done = 0;
+        while (done < size) {
+            ssize_t got = pread(fileno(file), &bytes[done], size - done, static_cast<off_t>(offset + done));
+            if (got <= 0) throw std::runtime_error("could not read a spill file");
+            done += static_cast<size_t>(got);
+        }
+    }
+
+    // Length-prefixed records
+    void appendRecord(const std::string& record) {
+        uint64_t length = record.size();
+        append(std::string(reinterpret_cast<const char*>(&length), sizeof(length)));
+        append(record);
+    }
+
+    uint64_t readRecord(uint64_t offset, std::string& record) const {
+        std::string prefix;
+        read(offset, sizeof(uint64_t), prefix);
+        uint64_t length;
+        std::copy(prefix.begin(), prefix.end(), reinterpret_cast<char*>(&length));
+        read(offset + sizeof(length), static_cast<size_t>(length), record);
+        return offset + sizeof(length) + length;
+    }
+
+    // Raw contents, in order, without holding them all
+    void copyTo(std::ostream& out) const {
+        std::string piece;
+        for (uint64_t offset = 0; offset < end; offset += piece.size()) {
+            read(offset, static_cast<size_t>(std::min<uint64_t>(READ_BLOCK, end - offset)), piece);
+            out << piece;
+        }
+    }
+
+private:
+    std::FILE* file;
+    uint64_t end = 0;
+};
+
+void putBlock(SpillFile& spill, const std::vector<IRInstruction>& block) {
+    spill.appendRecord(IRCache::encode(IRCache::Key(), block));
+}
+
+uint64_t getBlock(const SpillFile& spill, uint64_t offset, std::vector<IRInstruction>& block) {
+    std::string record;
+    uint64_t next = spill.readRecord(offset, record);
+    if (!IRCache::decode(record.data(), record.size(), IRCache::Key(), block)) {
+        throw std::runtime_error("corrupt spill record");
+    }
+    return next;
+}
+
+// Row formatting shared with CodeGenerator's analysis sections: rows go one
+// per line, numbers joined by ", ", doubles with two decimals
+template <typename T>
+void appendRow(std::ostream& out, const std::vector<T>& row, bool first) {
+    out << (first ? "\n        [" : ",\n        [");
+    for (size_t c = 0; c < row.size(); c++) {
+        if (c > 0) out << ", ";
+        out << row[c];
+    }
+    out << "]";
+}
+
+template <typename T>
+void appendList(std::ostream& out, const std::vector<T>& list) {
+    out << "[";
+    for (size_t i = 0; i < list.size(); i++) {
+        if (i > 0) out << ", ";
+        out << list[i];
+    }
+    out << "]";
+}
+
+void appendNames(std::ostream& out, const std::vector<std::string>& names) {
+    out << "[";
+    for (size_t i = 0; i < names.size(); i++) {
+        if (i > 0) out << ", ";
+        out << "\"" << CodeGenerator::escapeJSON(names[i]) << "\"";
+    }
+    out << "]";
+}
+
+}
+
+StreamingCompiler::StreamingCompiler(const CompileOptions& opts) : options(opts) {}
+
+void StreamingCompiler::compile(std::istream& in, std::ostream& out) {
+    if (options.readable) throw std::runtime_error("streaming builds write JSON only");
+    stats = Stats();
+
+    Lexer lexer("");
+    Parser parser(lexer);
+    SemanticAnalyzer analyzer;
+    IRGenerator irGen;
+    Optimizer optimizer;
+    optimizer.setVerbose(false);
+    optimizer.setSmoothing(options.smoothTicks);
+
+    std::vector<std::shared_ptr<ASTNode>> maps;   // Placements are checked against the current map
+    std::vector<IRInstruction> definitions;       // Deferred until every reference is known
+    std::set<std::string> enemyRefs;
+    std::set<std::string> towerRefs;
+    SpillFile waves;
+    SpillFile placements;
+    std::vector<IRInstruction> placementBlock;
+    size_t waveCount = 0;
+    size_t placementCount = 0;
+
+    // Phase 1: one declaration at a time
+    DeclarationReader reader(in);
+    std::string text;
+    int firstLine = 1;
+    while (reader.next(text, firstLine)) {
+        stats.largestDeclaration = std::max(stats.largestDeclaration, text.size());
+        lexer.reset(text, firstLine);
+        parser.resume();
+        std::shared_ptr<Program> piece = parser.parseProgram();
+
+        for (const auto& decl : piece->declarations) {
+            stats.declarations++;
+            analyzer.analyzeDeclaration(decl.get());
+            if (dynamic_cast<MapDecl*>(decl.get())) maps.push_back(decl);
+
+            std::vector<IRInstruction> ir = irGen.generateDeclaration(decl.get());
+            if (options.optimize) ir = optimizer.optimizeLocal(ir);
+            if (ir.empty()) continue;
+
+            if (ir[0].opcode == IROpcode::DEFINE_WAVE) {
+                for (const auto& instr : ir) {
+                    if (instr.opcode == IROpcode::SPAWN_ENEMY) enemyRefs.insert(instr.operands[1]);
+                }
+                putBlock(waves, ir);
+                waveCount++;
+            } else if (ir[0].opcode == IROpcode::PLACE_TOWER) {
+                towerRefs.insert(ir[0].operands[0]);
+                placementBlock.insert(placementBlock.end(), ir.begin(), ir.end());
+                placementCount += ir.size();
+                if (placementBlock.size() >= PLACEMENT_BLOCK) {
+                    putBlock(placements, placementBlock);
+                    placementBlock.clear();
+                }
+            } else {
+                definitions.insert(definitions.end(), ir.begin(), ir.end());
+            }
+        }
+    }
+    if (!placementBlock.empty()) putBlock(placements, placementBlock);
+    placementBlock = std::vector<IRInstruction>();
+    stats.spilledBytes = waves.size() + placements.size();
+
+    // Phase 2: deferred whole-program passes over the definitions
+    Optimizer::AliasTable enemyAliases;
+    Optimizer::AliasTable towerAliases;
+    if (options.optimize) {
+        definitions = optimizer.finishDefinitions(definitions, enemyRefs, towerRefs, enemyAliases, towerAliases);
+    }
+    enemyRefs.clear();
+    towerRefs.clear();
+
+    bool hasEnemies = false, hasTowers = false;
+    for (const auto& instr : definitions) {
+        hasEnemies = hasEnemies || instr.opcode == IROpcode::DEFINE_ENEMY;
+        hasTowers = hasTowers || instr.opcode == IROpcode::DEFINE_TOWER;
+    }
+
+    CodeGenerator codeGen;
+    codeGen.setStartingGold(options.startingGold);
+    GameModel model = GameModel::fromIR(definitions);
+
+    // Phase 3: sections in generateJSON order, separated as assembleJSON does
+    bool first = true;
+    auto beginSection = [&] {
+        if (!first) out << ",\n";
+        first = false;
+    };
+    out << "{\n  \"gameConfig\": {\n";
+
+    for (JSONSection s : {SECTION_MAP, SECTION_ENEMIES, SECTION_TOWERS}) {
+        std::string section = codeGen.generateSection(definitions, s);
+        if (section.empty()) continue;
+        beginSection();
+        out << section;
+    }
+
+    // Waves: fold through the aliases, render, and keep per-wave economy
+    // rows and capacity lines for the later sections
+    SpillFile economyRows;
+    SpillFile capacityLines;
+    SpillFile waveAliases;
+    std::vector<long long> waveGold;
+    std::vector<int> pool(model.enemies.size(), 0);
+    int peak = 0;
+
+    if (waveCount > 0) {
+        beginSection();
+        out << "    \"waves\": [\n";
+
+        std::unordered_map<std::string, std::vector<uint64_t>> seen;   // Signature hash -> spill offsets
+        std::hash<std::string> hashSignature;
+        long long total = 0;
+        std::vector<IRInstruction> ir;
+        std::vector<IRInstruction> candidate;
+        uint64_t offset = 0;
+
+        for (size_t w = 0; w < waveCount; w++) {
+            uint64_t at = offset;
+            offset = getBlock(waves, offset, ir);
+            std::vector<IRInstruction> body(ir.begin() + 1, ir.end());
+            std::vector<IRInstruction> emitted;
+
+            if (options.optimize) {
+                std::string signature = Optimizer::resolveWave(body, enemyAliases);
+                auto& sameHash = seen[std::to_string(hashSignature(signature))];
+                const std::string* canonical = nullptr;
+                for (uint64_t earlier : sameHash) {
+                    getBlock(waves, earlier, candidate);
+                    std::vector<IRInstruction> other(candidate.begin() + 1, candidate.end());
+                    if (Optimizer::resolveWave(other, enemyAliases) == signature) {
+                        canonical = &candidate[0].operands[0];
+                        break;
+                    }
+                }
+
+                if (canonical) {
+                    IRInstruction alias = ir[0];
+                    alias.metadata["alias"] = *canonical;
+                    emitted.push_back(alias);
+                    waveAliases.append(std::string(waveAliases.size() > 0 ? ", " : "") + "\"" +
+                                       CodeGenerator::escapeJSON(ir[0].operands[0]) + "\": \"" +
+                                       CodeGenerator::escapeJSON(*canonical) + "\"");
+                } else {
+                    sameHash.push_back(at);
+                }
+            }
+            if (emitted.empty()) {
+                emitted.push_back(ir[0]);
+                emitted.insert(emitted.end(), body.begin(), body.end());
+            }
+
+            if (w > 0) out << ",\n";
+            out << codeGen.generateItems(emitted, SECTION_WAVES)[0];
+
+            // The wave's own spawns, resolved, stand in for an alias wave's
+            // replay of its canonical wave
+            std::vector<IRInstruction> resolved;
+            resolved.push_back(ir[0]);
+            resolved.insert(resolved.end(), body.begin(), body.end());
+            model.waves.clear();
+            model.waveIndex.clear();
+            model.add(resolved);
+
+            std::vector<EconomyReport::Point> points = EconomyAnalyzer::curve(model, model.waves[0], total);
+            if (!points.empty()) total = points.back().gold;
+            waveGold.push_back(total);
+            economyRows.appendRecord(std::string(reinterpret_cast<const char*>(points.data()),
+                                                 points.size() * sizeof(EconomyReport::Point)));
+
+            CapacityAnalyzer capacity;
+            CapacityHints hints = capacity.build(model);
+            const CapacityHints::Wave& wave = hints.waves[0];
+            std::ostringstream line;
+            line << std::fixed << std::setprecision(2);
+            line << (w > 0 ? ",\n        " : "\n        ");
+            line << "{\"name\": \"" << CodeGenerator::escapeJSON(wave.name) << "\", \"peakAlive\": " << wave.peak
+                 << ", \"peakTime\": " << wave.peakTime << ", \"perType\": ";
+            appendList(line, wave.perType);
+            line << "}";
+            capacityLines.append(line.str());
+            for (size_t t = 0; t < pool.size(); t++) pool[t] = std::max(pool[t], wave.perType[t]);
+            peak = std::max(peak, wave.peak);
+        }
+        out << "    ]";
+        model.waves.clear();
+        model.waveIndex.clear();
+    }
+
+    // Placements, with the combat matrix's dwell rows alongside
+    SpillFile dwellRows;
+    auto forEachPlacementBlock = [&](const std::function<void(std::vector<IRInstruction>&)>& visit) {
+        std::vector<IRInstruction> block;
+        for (uint64_t offset = 0; offset < placements.size(); ) {
+            offset = getBlock(placements, offset, block);
+            for (auto& instr : block) {
+                auto alias = towerAliases.find(instr.operands[0]);
+                if (alias != towerAliases.end()) instr.operands[0] = alias->second;
+            }
+            visit(block);
+        }
+    };
+
+    if (placementCount > 0) {
+        beginSection();
+        out << "    \"initialPlacements\": [\n";
+        size_t written = 0;
+        forEachPlacementBlock([&](std::vector<IRInstruction>& block) {
+            for (const auto& item : codeGen.generateItems(block, SECTION_PLACEMENTS)) {
+                out << item << (++written < placementCount ? ",\n" : "\n");
+            }
+
+            if (!hasEnemies || !hasTowers) return;
+            model.placements.clear();
+            model.add(block);
+            CombatAnalyzer combat;
+            std::ostringstream rows;
+            rows << std::fixed << std::setprecision(2);
+            size_t firstRow = written - block.size();
+            for (const auto& row : combat.build(model).dwellTime) {
+                appendRow(rows, row, firstRow++ == 0);
+            }
+            dwellRows.append(rows.str());
+        });
+        out << "    ]";
+        model.placements.clear();
+    }
+
+    if (hasEnemies && hasTowers) {
+        CombatAnalyzer combat;
+        CombatMatrix matrix = combat.build(model);
+
+        std::ostringstream json;
+        json << std::fixed << std::setprecision(2);
+        json << "    \"combatMatrix\": {\n";
+        json << "      \"towers\": ";
+        appendNames(json, matrix.towers);
+        json << ",\n      \"enemies\": ";
+        appendNames(json, matrix.enemies);
+        json << ",\n      \"shotsToKill\": [";
+        for (size_t r = 0; r < matrix.shotsToKill.size(); r++) appendRow(json, matrix.shotsToKill[r], r == 0);
+        json << (matrix.shotsToKill.empty() ? "]" : "\n      ]");
+        json << ",\n      \"timeToKill\": [";
+        for (size_t r = 0; r < matrix.timeToKill.size(); r++) appendRow(json, matrix.timeToKill[r], r == 0);
+        json << (matrix.timeToKill.empty() ? "]" : "\n      ]");
+        json << ",\n      \"dwellTime\": [";
+
+        beginSection();
+        out << json.str();
+        dwellRows.copyTo(out);
+        out << (placementCount == 0 ? "]" : "\n      ]") << "\n    }";
+    }
+
+    if (waveCount > 0 || placementCount > 0) {
+        beginSection();
+        out << "    \"economy\": {\n";
+        out << "      \"startingGold\": " << options.startingGold << ",\n";
+        out << "      \"waveGold\": ";
+        appendList(out, waveGold);
+        out << ",\n";
+
+        // Rows come back in wave order; placements advance a cursor over them
+        std::vector<EconomyReport::Point> row;
+        uint64_t rowOffset = 0;
+        auto readRow = [&] {
+            std::string record;
+            rowOffset = economyRows.readRecord(rowOffset, record);
+            row.resize(record.size() / sizeof(EconomyReport::Point));
+            std::copy(record.begin(), record.end(), reinterpret_cast<char*>(row.data()));
+        };
+
+        out << "      \"tickGold\": [";
+        for (size_t w = 0; w < waveCount; w++) {
+            readRow();
+            out << (w == 0 ? "\n        [" : ",\n        [");
+            for (size_t t = 0; t < row.size(); t++) {
+                out << (t > 0 ? ", [" : "[") << row[t].tick << ", " << row[t].gold << "]";
+            }
+            out << "]";
+        }
+        out << (waveCount == 0 ? "]" : "\n      ]") << ",\n";
+
+        out << "      \"placementAffordable\": [";
+        long long cost = 0;
+        size_t wave = 0;
+        size_t point = 0;
+        size_t index = 0;
+        rowOffset = 0;
+        if (waveCount > 0) readRow();
+        forEachPlacementBlock([&](std::vector<IRInstruction>& block) {
+            model.placements.clear();
+            model.add(block);
+            for (const auto& p : model.placements) {
+                const GameModel::Tower& tower = model.towers[p.tower];
+                cost += tower.cost;
+                bool affordable = cost <= options.startingGold;
+                int atWave = -1;
+                long long atTick = 0;
+                if (!affordable) {
+                    // Same cursor walk as EconomyAnalyzer::build
+                    while (wave < waveCount && !EconomyAnalyzer::affordAt(row, options.startingGold, cost, point)) {
+                        wave++;
+                        point = 0;
+                        if (wave < waveCount) readRow();
+                    }
+                    if (wave < waveCount) {
+                        affordable = true;
+                        atWave = static_cast<int>(wave);
+                        atTick = row[point].tick;
+                    }
+                }
+
+                out << (index++ > 0 ? ",\n        " : "\n        ");
+                out << "{\"towerType\": \"" << CodeGenerator::escapeJSON(tower.name) << "\", "
+                    << "\"cumulativeCost\": " << cost << ", ";
+                if (affordable) out << "\"wave\": " << atWave << ", \"tick\": " << atTick << "}";
+                else out << "\"wave\": null, \"tick\": null}";
+            }
+        });
+        out << (placementCount == 0 ? "]" : "\n      ]") << "\n";
+        out << "    }";
+    }
+
+    if (waveCount > 0 && hasEnemies) {
+        beginSection();
+        out << "    \"capacityHints\": {\n";
+        out << "      \"enemies\": ";
+        std::vector<std::string> names;
+        for (const auto& e : model.enemies) names.push_back(e.name);
+        appendNames(out, names);
+        out << ",\n";
+        out << "      \"peakAlive\": " << peak << ",\n";
+        out << "      \"pool\": ";
+        appendList(out, pool);
+        out << ",\n";
+        out << "      \"waves\": [";
+        capacityLines.copyTo(out);
+        out << "\n      ]\n";
+        out << "    }";
+    }
+
+    // Aliases: enemy and tower groups from the definitions, waves from the spill
+    std::string groups[2];
+    for (const auto& instr : definitions) {
+        if (instr.opcode != IROpcode::DEFINE_ALIAS) continue;
+        int group = std::get<std::string>(instr.metadata.at("kind")) == "enemy" ? 0 : 1;
+        if (!groups[group].empty()) groups[group] += ", ";
+        groups[group] += "\"" + CodeGenerator::escapeJSON(instr.operands[0]) + "\": \"" +
+                         CodeGenerator::escapeJSON(instr.operands[1]) + "\"";
+    }
+    static const char* const names[2] = {"enemies", "towers"};
+    bool aliasesOpen = false;
+    auto beginGroup = [&](const char* name) {
+        if (!aliasesOpen) {
+            beginSection();
+            out << "    \"aliases\": {\n";
+        } else {
+            out << ",\n";
+        }
+        aliasesOpen = true;
+        out << "      \"" << name << "\": {";
+    };
+    for (int g = 0; g < 2; g++) {
+        if (groups[g].empty()) continue;
+        beginGroup(names[g]);
+        out << groups[g] << "}";
+    }
+    if (waveAliases.size() > 0) {
+        beginGroup("waves");
+        waveAliases.copyTo(out);
+        out << "}";
+    }
+    if (aliasesOpen) out << "\n    }";
+
+    out << "\n  }\n}\n";
+    if (!out) throw std::runtime_error("could not write the output");
+
+    stats.spilledBytes += economyRows.size() + capacityLines.size() + waveAliases.size() + dwellRows.size();
+}
+
+bool StreamingCompiler::verify(const std::string& path, const CompileOptions& options, std::ostream& log) {
+    std::ifstream file(path, std::ios::binary);
+    if (!file.is_open()) throw std::runtime_error("could not open " + path);
+    std::ostringstream source;
+    source << file.rdbuf();
+
+    // Streaming builds write JSON only
+    CompileOptions jsonOptions = options;
+    jsonOptions.readable = false;
+    Compiler compiler(jsonOptions);
+    std::string expected = compiler.compile(source.str());
+
+    std::ifstream input(path, std::ios::binary);
+    std::ostringstream actual;
+    StreamingCompiler streaming(jsonOptions);
+    streaming.compile(input, actual);
+
+    if (actual.str() != expected) {
+        const std::string& got = actual.str();
+        size_t at = std::mismatch(expected.begin(), expected.end(), got.begin(), got.end()).first - expected.begin();
+        log << "  MISMATCH at byte " << at << " of " << expected.size() << "\n";
+        return false;
+    }
+
+    const Stats& stats = streaming.lastStats();
+    log << "  Streaming output matched (" << expected.size() << " bytes, " << stats.declarations
+        << " declarations, largest " << stats.largestDeclaration << " bytes, "
+        << stats.spilledBytes << " bytes spilled).\n";
+    return true;
+}
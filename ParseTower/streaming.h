@@ -0,0 +1,43 @@
+#ifndef STREAMING_H
+#define STREAMING_H
+
+#include "driver.h"
+#include <istream>
+#include <ostream>
+#include <string>
+#include <cstdint>
+
+// Bounded-memory compile for large inputs. Semantic analysis already
+// requires every reference to follow its definition, so the input can be
+// cut into top-level declarations as it is read; each one is parsed,
+// checked, lowered and locally optimized on its own and then released.
+// Waves and placements are encoded to temporary spill files as they come.
+// Map, enemy and tower definitions are held back for a deferred emission
+// step: DCE and structural folding run over them once the references are
+// known, then the spills are streamed back through the code generator,
+// section by section. The output is byte-identical to Compiler::compile,
+// and peak memory follows the largest declaration and the number of
+// definitions rather than the size of the file.
+class StreamingCompiler {
+public:
+    explicit StreamingCompiler(const CompileOptions& options);
+
+    // Errors are thrown as std::runtime_error; only JSON output is supported
+    void compile(std::istream& in, std::ostream& out);
+
+    struct Stats {
+        size_t declarations = 0;
+        size_t largestDeclaration = 0;  // Bytes of source text
+        uint64_t spilledBytes = 0;
+    };
+    const Stats& lastStats() const { return stats; }
+
+    // Compile the file at `path` both ways and compare the output
+    static bool verify(const std::string& path, const CompileOptions& options, std::ostream& log);
+
+private:
+    CompileOptions options;
+    Stats stats;
+};
+
+#endif // STREAMING_H
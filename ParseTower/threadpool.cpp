@@ -0,0 +1,81 @@
+#include "threadpool.h"
+
+ThreadPool::ThreadPool(size_t threads) : threadCount(threads == 0 ? 1 : threads) {
+    if (threadCount > 1) {
+        for (size_t i = 0; i < threadCount; i++) {
+            workers.emplace_back([this] { workerLoop(); });
+        }
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    taskReady.notify_all();
+    for (auto& w : workers) w.join();
+}
+
+size_t ThreadPool::defaultThreads() {
+    unsigned n = std::thread::hardware_concurrency();
+    return n == 0 ? 1 : n;
+}
+
+void ThreadPool::submit(std::function<void()> task) {
+    if (workers.empty()) {
+        task();
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        tasks.push(std::move(task));
+        pending++;
+    }
+    taskReady.notify_one();
+}
+
+void ThreadPool::wait() {
+    std::unique_lock<std::mutex> lock(mutex);
+    allDone.wait(lock, [this] { return pending == 0; });
+}
+
+void ThreadPool::parallelFor(size_t count, const std::function<void(size_t, size_t, size_t)>& fn) {
+    if (workers.empty() || count < 2) {
+        // Still report chunk boundaries so per-chunk buffers line up
+        for (size_t chunk = 0; chunk < threadCount; chunk++) {
+            size_t begin = count * chunk / threadCount;
+            size_t end = count * (chunk + 1) / threadCount;
+            fn(begin, end, chunk);
+        }
+        return;
+    }
+
+    for (size_t chunk = 0; chunk < threadCount; chunk++) {
+        size_t begin = count * chunk / threadCount;
+        size_t end = count * (chunk + 1) / threadCount;
+        submit([&fn, begin, end, chunk] { fn(begin, end, chunk); });
+    }
+    wait();
+}
+
+void ThreadPool::workerLoop() {
+    while (true) {
+        std::function<void()> task;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            taskReady.wait(lock, [this] { return stopping || !tasks.empty(); });
+            if (stopping && tasks.empty()) return;
+            task = std::move(tasks.front());
+            tasks.pop();
+        }
+
+        task();
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            pending--;
+            if (pending == 0) allDone.notify_all();
+        }
+    }
+}
@@ -0,0 +1,48 @@
+#ifndef THREADPOOL_H
+#define THREADPOOL_H
+
+#include <vector>
+#include <queue>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+
+// Fixed-size worker pool. A pool of size 1 runs everything on the caller's
+// thread, so single-threaded runs pay no synchronization cost.
+class ThreadPool {
+public:
+    explicit ThreadPool(size_t threads);
+    ~ThreadPool();
+
+    size_t size() const { return threadCount; }
+
+    // Queue a task for any worker
+    void submit(std::function<void()> task);
+
+    // Block until every submitted task has finished
+    void wait();
+
+    // Split [0, count) into size() contiguous chunks and run
+    // fn(begin, end, chunk) on each. Chunk boundaries depend only on count
+    // and size(), so callers can keep per-chunk buffers and merge them in
+    // chunk order for a deterministic result.
+    void parallelFor(size_t count, const std::function<void(size_t, size_t, size_t)>& fn);
+
+    // Default worker count for this machine
+    static size_t defaultThreads();
+
+private:
+    size_t threadCount;
+    std::vector<std::thread> workers;
+    std::queue<std::function<void()>> tasks;
+    std::mutex mutex;
+    std::condition_variable taskReady;
+    std::condition_variable allDone;
+    size_t pending = 0;
+    bool stopping = false;
+
+    void workerLoop();
+};
+
+#endif // THREADPOOL_H
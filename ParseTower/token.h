@@ -4,7 +4,7 @@
 #include <string>
 
 enum class TokenType {
-    MAP, ENEMY, TOWER, WAVE, SPAWN, PLACE, AT,
+    MAP, ENEMY, TOWER, WAVE, SPAWN, PLACE, AT, REPEAT, CONST,
     SIZE, PATH, COUNT, START, INTERVAL,
 
     IDENT, INT, FLOAT,
@@ -22,11 +22,12 @@ struct Token {
     TokenType type;
     std::string lexeme;
     int line;
+    size_t offset; // Byte offset of the lexeme in the source
 
-    Token() : type(TokenType::UNKNOWN), lexeme(""), line(0) {}
+    Token() : type(TokenType::UNKNOWN), lexeme(""), line(0), offset(0) {}
 
     Token(TokenType t, const std::string& lx, int ln)
-        : type(t), lexeme(lx), line(ln) {}
+        : type(t), lexeme(lx), line(ln), offset(0) {}
 };
 
 #endif
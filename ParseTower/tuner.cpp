@@ -0,0 +1,209 @@
+#include "tuner.h"
+#include <sstream>
+#include <iomanip>
+#include <stdexcept>
+#include <algorithm>
+#include <set>
+#include <cmath>
+#include <charconv>
+
+DifficultyTuner::DifficultyTuner(size_t threads, bool speed)
+    : simulator(threads), tuneSpeed(speed) {}
+
+std::vector<TuneTarget> DifficultyTuner::parseTargets(const std::string& spec) {
+    std::vector<TuneTarget> targets;
+    std::istringstream stream(spec);
+    std::string entry;
+
+    while (std::getline(stream, entry, ',')) {
+        if (entry.empty()) continue;
+        TuneTarget target;
+        const std::string original = entry;
+
+        size_t colon = entry.find(':');
+        if (colon != std::string::npos) {
+            target.wave = entry.substr(0, colon);
+            entry = entry.substr(colon + 1);
+        }
+
+        size_t eq = entry.find('=');
+        if (eq == std::string::npos) {
+            throw std::runtime_error("tune target '" + original + "' is not metric=value");
+        }
+        std::string metric = entry.substr(0, eq);
+        if (metric == "leaks") {
+            target.metric = TuneTarget::LEAKS;
+        } else if (metric == "hp") {
+            target.metric = TuneTarget::HP_PERCENT;
+        } else {
+            throw std::runtime_error("unknown tune metric '" + metric + "' (use leaks or hp)");
+        }
+        const char* first = entry.data() + eq + 1;
+        const char* last = entry.data() + entry.size();
+        auto parsed = std::from_chars(first, last, target.value);
+        if (parsed.ec != std::errc() || parsed.ptr != last || first == last) {
+            throw std::runtime_error("tune target '" + original + "' has a malformed value");
+        }
+        targets.push_back(target);
+    }
+
+    if (targets.empty()) {
+        throw std::runtime_error("no tune targets given");
+    }
+    return targets;
+}
+
+DifficultyTuner::BaseStats DifficultyTuner::scaled(const BaseStats& stats, double scale) const {
+    BaseStats result = stats;
+    if (tuneSpeed) {
+        // Speeds are emitted with two decimals; simulate what will be written
+        result.speed = std::max(0.01, std::round(stats.speed * scale * 100.0) / 100.0);
+    } else {
+        result.hp = std::max(1, static_cast<int>(std::lround(stats.hp * scale)));
+    }
+    return result;
+}
+
+double DifficultyTuner::measure(size_t wave, const std::vector<std::string>& enemies,
+                                double scale, const TuneTarget& target) {
+    for (const auto& name : enemies) {
+        BaseStats s = scaled(base.at(name), scale);
+        simulator.setEnemyStats(name, s.hp, s.speed);
+    }
+
+    uint64_t digest = 0;
+    SimWaveResult r = simulator.runWave(wave, digest);
+    if (target.metric == TuneTarget::LEAKS) return r.leaked;
+    return r.hpIncoming > 0 ? 100.0 * r.hpLeaked / r.hpIncoming : 0.0;
+}
+
+std::vector<TuneResult> DifficultyTuner::tune(const std::vector<IRInstruction>& instructions,
+                                              const std::vector<TuneTarget>& targets) {
+    base.clear();
+    tuned.clear();
+    aliases.clear();
+    simulator.load(instructions);
+
+    std::map<std::string, std::vector<std::string>> waveEnemies;
+    for (const auto& instr : instructions) {
+        if (instr.opcode == IROpcode::DEFINE_ENEMY) {
+            base[instr.operands[0]] = {std::get<int>(instr.metadata.at("hp")),
+                                       std::get<double>(instr.metadata.at("speed"))};
+        } else if (instr.opcode == IROpcode::DEFINE_ALIAS &&
+                   std::get<std::string>(instr.metadata.at("kind")) == "enemy") {
+            aliases[instr.operands[0]] = instr.operands[1];
+        } else if (instr.opcode == IROpcode::SPAWN_ENEMY) {
+            waveEnemies[instr.operands[0]].push_back(instr.operands[1]);
+        }
+    }
+
+    const TuneTarget* fallback = nullptr;
+    for (const auto& t : targets) {
+        if (t.wave.empty()) fallback = &t;
+    }
+
+    std::set<std::string> owned;
+    std::vector<TuneResult> results;
+
+    for (size_t w = 0; w < simulator.waveCount(); w++) {
+        TuneResult result;
+        result.wave = simulator.waveName(w);
+
+        const TuneTarget* target = fallback;
+        for (const auto& t : targets) {
+            if (t.wave == result.wave) target = &t;
+        }
+        if (!target) continue;
+
+        for (const auto& name : waveEnemies[result.wave]) {
+            if (owned.insert(name).second) result.enemies.push_back(name);
+        }
+
+        if (result.enemies.empty()) {
+            result.tunable = false;
+            result.achieved = measure(w, {}, 1.0, *target);
+            result.iterations = 1;
+            results.push_back(result);
+            continue;
+        }
+
+        // Bracket: grow the scale until the target breaks. The 1024x cap is
+        // probed too, and kept only if it still meets the target
+        double lo = 0.0;
+        double hi = 1.0;
+        bool capped = false;
+        while (true) {
+            result.iterations++;
+            if (measure(w, result.enemies, hi, *target) > target->value) break;
+            lo = hi;
+            if (hi >= 1024.0) {
+                capped = true;
+                break;
+            }
+            hi *= 2.0;
+        }
+
+        if (!capped) {
+            // Bisect on the boundary; stop once rounding makes probes identical
+            for (int i = 0; i < 30 && hi - lo > 1e-3 * hi; i++) {
+                double mid = 0.5 * (lo + hi);
+                result.iterations++;
+                if (measure(w, result.enemies, mid, *target) <= target->value) {
+                    lo = mid;
+                } else {
+                    hi = mid;
+                }
+            }
+        }
+
+        // Even the weakest enemies break the target; keep the minimum
+        if (lo <= 0.0) lo = 1.0 / 1024.0;
+
+        result.scale = lo;
+        result.iterations++;
+        result.achieved = measure(w, result.enemies, lo, *target);
+        for (const auto& name : result.enemies) {
+            tuned[name] = scaled(base.at(name), lo);
+        }
+        results.push_back(result);
+    }
+
+    return results;
+}
+
+void DifficultyTuner::apply(Program& program) const {
+    for (auto& decl : program.declarations) {
+        if (auto e = dynamic_cast<EnemyDecl*>(decl.get())) {
+            // Enemies folded into an identical one share its tuned stats
+            auto alias = aliases.find(e->name);
+            auto it = tuned.find(alias == aliases.end() ? e->name : alias->second);
+            if (it == tuned.end()) continue;
+            e->hp = it->second.hp;
+            e->speed = it->second.speed;
+        }
+    }
+}
+
+std::string DifficultyTuner::report(const std::vector<TuneResult>& results) const {
+    std::ostringstream out;
+    out << "=== Tuning Report (" << (tuneSpeed ? "speed" : "hp") << ") ===\n";
+
+    for (const auto& r : results) {
+        out << "  " << r.wave << ": ";
+        if (!r.tunable) {
+            out << "no untuned enemy types, metric=" << r.achieved << "\n";
+            continue;
+        }
+        out << "scale=" << std::fixed << std::setprecision(3) << r.scale
+            << " metric=" << std::setprecision(2) << r.achieved
+            << " runs=" << r.iterations << " [";
+        for (size_t i = 0; i < r.enemies.size(); i++) {
+            const auto& s = tuned.at(r.enemies[i]);
+            if (i > 0) out << ", ";
+            out << r.enemies[i] << " hp=" << s.hp << " speed=" << s.speed;
+        }
+        out << "]\n";
+        out.unsetf(std::ios::fixed);
+    }
+    return out.str();
+}
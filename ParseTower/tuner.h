@@ -0,0 +1,66 @@
+#ifndef TUNER_H
+#define TUNER_H
+
+#include "ir.h"
+#include "ast.h"
+#include "simulator.h"
+#include <vector>
+#include <string>
+#include <map>
+
+// What a wave should look like after tuning. An empty wave name applies
+// the target to every wave without its own entry.
+struct TuneTarget {
+    enum Metric { LEAKS, HP_PERCENT };
+
+    std::string wave;
+    Metric metric = LEAKS;
+    double value = 0.0;
+};
+
+struct TuneResult {
+    std::string wave;
+    std::vector<std::string> enemies; // Enemy types whose stats this wave decided
+    double scale = 1.0;
+    double achieved = 0.0;            // Metric at the chosen scale
+    int iterations = 0;               // Simulations spent on this wave
+    bool tunable = true;              // False if every enemy was tuned by an earlier wave
+};
+
+// Solves for the largest hp (or speed) scale at which each wave still meets
+// its target against the placements in the IR.
+//
+// Enemy types are shared between waves, so each type is owned by the first
+// wave that spawns it; waves are tuned in order with earlier scales fixed.
+// One warm Simulator is reused for every probe: only the enemy stats change
+// between runs, never the compiled IR.
+class DifficultyTuner {
+public:
+    DifficultyTuner(size_t threads, bool tuneSpeed);
+
+    // Parse "leaks=0", "hp=5" or "Wave2:hp=12.5" entries separated by commas
+    static std::vector<TuneTarget> parseTargets(const std::string& spec);
+
+    std::vector<TuneResult> tune(const std::vector<IRInstruction>& instructions,
+                                 const std::vector<TuneTarget>& targets);
+
+    // Write the solved stats into the AST so it can be saved as .td
+    void apply(Program& program) const;
+
+    std::string report(const std::vector<TuneResult>& results) const;
+
+private:
+    struct BaseStats { int hp; double speed; };
+
+    Simulator simulator;
+    bool tuneSpeed;
+    std::map<std::string, BaseStats> base;
+    std::map<std::string, BaseStats> tuned;
+    std::map<std::string, std::string> aliases;  // Folded enemy -> canonical enemy
+
+    BaseStats scaled(const BaseStats& stats, double scale) const;
+    double measure(size_t wave, const std::vector<std::string>& enemies,
+                   double scale, const TuneTarget& target);
+};
+
+#endif // TUNER_H
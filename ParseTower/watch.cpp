@@ -0,0 +1,138 @@
+#include "watch.h"
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <filesystem>
+#include <chrono>
+#include <stdexcept>
+#include <sys/inotify.h>
+#include <unistd.h>
+#include <limits.h>
+
+namespace fs = std::filesystem;
+
+WatchCompiler::WatchCompiler(const CompileOptions& opts, const std::string& outDir)
+    : options(opts), outputDir(outDir) {
+    inotifyFd = inotify_init1(IN_CLOEXEC);
+    if (inotifyFd < 0) {
+        throw std::runtime_error("inotify is not available");
+    }
+}
+
+WatchCompiler::~WatchCompiler() {
+    if (inotifyFd >= 0) close(inotifyFd);
+}
+
+void WatchCompiler::watchDirectory(const std::string& dir) {
+    for (const auto& entry : watchDirs) {
+        if (entry.second == dir) return;
+    }
+    // Only finished writes and renames; a created file is still empty
+    int wd = inotify_add_watch(inotifyFd, dir.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO);
+    if (wd < 0) {
+        throw std::runtime_error("cannot watch directory " + dir);
+    }
+    watchDirs[wd] = dir;
+}
+
+void WatchCompiler::addFile(const BatchItem& item) {
+    WatchedFile& file = files[fs::path(item.input).lexically_normal().string()];
+    file.item = item;
+    file.item.output = BatchCompiler::outputPathFor(item, outputDir, options.readable);
+    file.compiler = std::make_unique<IncrementalCompiler>(options);
+
+    fs::path parent = fs::path(item.input).parent_path();
+    watchDirectory(parent.empty() ? "." : parent.string());
+    recompile(file);
+}
+
+void WatchCompiler::recompile(WatchedFile& file) {
+    auto start = std::chrono::steady_clock::now();
+
+    std::ifstream in(file.item.input, std::ios::binary);
+    if (!in.is_open()) return; // Mid-rename; the MOVED_TO event follows
+    std::stringstream buffer;
+    buffer << in.rdbuf();
+    std::string source = buffer.str();
+
+    // Editors often rewrite identical bytes; nothing downstream can change
+    if (file.ok && source == file.source) return;
+    file.source = source;
+
+    try {
+        std::string output = file.compiler->compile(file.source);
+        const IncrementalCompiler::Stats& stats = file.compiler->lastStats();
+        file.ok = true;
+
+        bool changed = output != file.output;
+        if (changed) {
+            file.output = output;
+            fs::path parent = fs::path(file.item.output).parent_path();
+            if (!parent.empty()) fs::create_directories(parent);
+            std::ofstream out(file.item.output, std::ios::binary);
+            out << file.output;
+        }
+
+        double millis = std::chrono::duration<double, std::milli>(
+            std::chrono::steady_clock::now() - start).count();
+        std::cout << "  OK    " << file.item.input << " (" << std::fixed << std::setprecision(2)
+                  << millis << " ms, " << stats.regenerated << "/" << stats.declarations
+                  << " declarations rebuilt"
+                  << (changed ? "" : ", output unchanged") << ")" << std::endl;
+    } catch (const std::exception& e) {
+        // Leave the last good output file in place until the source is fixed
+        file.ok = false;
+        std::cout << "  FAIL  " << file.item.input << ": " << e.what() << std::endl;
+    }
+}
+
+void WatchCompiler::handleEvents() {
+    alignas(struct inotify_event) char buffer[64 * (sizeof(struct inotify_event) + NAME_MAX + 1)];
+    ssize_t len = read(inotifyFd, buffer, sizeof(buffer));
+    if (len <= 0) return;
+
+    // Coalesce one read's worth of events so a save touching a file
+    // several times compiles it once
+    std::map<std::string, bool> dirty;
+    for (char* p = buffer; p < buffer + len; ) {
+        auto* event = reinterpret_cast<struct inotify_event*>(p);
+        p += sizeof(struct inotify_event) + event->len;
+        if (event->len == 0) continue;
+
+        auto dir = watchDirs.find(event->wd);
+        if (dir == watchDirs.end()) continue;
+        // Keys are normalized, so ./a.td or sub/../sub/a.td still match
+        std::string path = (fs::path(dir->second) / event->name).lexically_normal().string();
+
+        if (files.count(path)) {
+            dirty[path] = true;
+        } else if (watchNewFiles && fs::path(path).extension() == ".td") {
+            BatchItem item;
+            item.input = path;
+            item.relative = fs::relative(path, rootDir).string();
+            addFile(item);
+        }
+    }
+
+    for (const auto& entry : dirty) {
+        recompile(files[entry.first]);
+    }
+}
+
+void WatchCompiler::run(const std::string& spec) {
+    std::vector<BatchItem> items = BatchCompiler::collectInputs(spec);
+    if (fs::is_directory(spec)) {
+        // New .td files appearing directly in the root are picked up too
+        watchNewFiles = true;
+        rootDir = spec;
+        watchDirectory(spec);
+    }
+
+    for (const auto& item : items) addFile(item);
+    std::cout << "Watching " << files.size() << " file(s). Press Ctrl+C to stop." << std::endl;
+
+    while (true) {
+        handleEvents();
+    }
+}
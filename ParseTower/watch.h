@@ -0,0 +1,47 @@
+#ifndef WATCH_H
+#define WATCH_H
+
+#include "driver.h"
+#include "batch.h"
+#include "incremental.h"
+#include <string>
+#include <vector>
+#include <map>
+#include <memory>
+
+// Keeps every watched file compiled in memory and recompiles only the file
+// an inotify event names. Parent directories are watched rather than the
+// files themselves, so editors that save by rename-over still trigger.
+class WatchCompiler {
+public:
+    WatchCompiler(const CompileOptions& options, const std::string& outputDir);
+    ~WatchCompiler();
+
+    // Compile everything once, then block processing change events
+    void run(const std::string& spec);
+
+private:
+    struct WatchedFile {
+        BatchItem item;
+        std::string source;
+        std::string output;
+        std::unique_ptr<IncrementalCompiler> compiler;  // Reuses unchanged declarations
+        bool ok = false;
+    };
+
+    CompileOptions options;
+    std::string outputDir;
+    int inotifyFd = -1;
+    bool watchNewFiles = false;
+
+    std::map<std::string, WatchedFile> files;      // By normalized input path
+    std::map<int, std::string> watchDirs;           // inotify wd -> directory
+    std::string rootDir;
+
+    void addFile(const BatchItem& item);
+    void watchDirectory(const std::string& dir);
+    void recompile(WatchedFile& file);
+    void handleEvents();
+};
+
+#endif // WATCH_H